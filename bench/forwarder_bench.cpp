@@ -0,0 +1,275 @@
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <filesystem>
+#include <sys/resource.h>
+#include <spdlog/spdlog.h>
+#include "../include/config.h"
+#include "../include/client_manager.h"
+#include "../include/media_handler.h"
+#include "../include/metrics.h"
+#include "../include/restricted_channel_forwarder.h"
+#include "mock_td_backend.h"
+
+using namespace tg_forwarder;
+
+namespace {
+// 基准测试选项
+struct BenchOptions {
+    std::string scenario;               // 回放的消息流文件，为空时按种子生成
+    std::string record;                 // 保存本次使用的消息流
+    std::size_t messages = 500;
+    double rate = 20.0;                 // 生成的消息速率（条/秒）
+    std::uint64_t seed = 1;
+    int targets = 1;
+    int timeout_seconds = 600;
+    std::string log_level = "warn";
+    NetworkProfile network;
+    ForwarderConfig forwarder;
+};
+
+void print_usage(const char* program) {
+    std::cout << "用法: " << program << " [选项]\n"
+        << "  --scenario FILE       回放录制的消息流（每行: 发布时间ms<TAB>类型<TAB>字节数<TAB>媒体组）\n"
+        << "  --record FILE         保存本次使用的消息流，供之后回放\n"
+        << "  --messages N          生成的消息数（默认 500）\n"
+        << "  --rate R              生成的消息速率，条/秒（默认 20）\n"
+        << "  --seed S              生成消息流的随机种子（默认 1）\n"
+        << "  --targets N           目标频道数（默认 1）\n"
+        << "  --rtt-ms N            请求往返延迟（默认 40）\n"
+        << "  --download-mbps N     下载带宽，MB/s（默认 40）\n"
+        << "  --upload-mbps N       上传带宽，MB/s（默认 20）\n"
+        << "  --flood-ratio X       发送请求被 FLOOD_WAIT 拒绝的比例（默认 0）\n"
+        << "  --flood-seconds N     FLOOD_WAIT 的等待秒数（默认 1）\n"
+        << "  --pipeline-depth N    转发流水线深度（默认 8）\n"
+        << "  --downloads N         最大并发下载数（默认 2）\n"
+        << "  --uploads N           最大并发上传数（默认 2）\n"
+        << "  --update-threads N    更新处理线程数（默认 2）\n"
+        << "  --album-quiet-ms N    媒体组静默期（默认 800）\n"
+        << "  --send-rate N         每个目标频道每分钟的发送上限，0 表示不限流（默认 0）\n"
+        << "  --timeout S           最长等待秒数（默认 600）\n"
+        << "  --log-level L         日志级别（默认 warn）\n";
+}
+
+// 解析命令行，出错时返回 false
+bool parse_options(int argc, char* argv[], BenchOptions& options) {
+    auto& forwarder = options.forwarder;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--help" || arg == "-h") {
+            return false;
+        }
+        if (i + 1 >= argc) {
+            std::cerr << "缺少参数值: " << arg << std::endl;
+            return false;
+        }
+        
+        std::string value = argv[++i];
+        if (arg == "--scenario") {
+            options.scenario = value;
+        } else if (arg == "--record") {
+            options.record = value;
+        } else if (arg == "--messages") {
+            options.messages = std::stoul(value);
+        } else if (arg == "--rate") {
+            options.rate = std::stod(value);
+        } else if (arg == "--seed") {
+            options.seed = std::stoull(value);
+        } else if (arg == "--targets") {
+            options.targets = std::max(std::stoi(value), 1);
+        } else if (arg == "--rtt-ms") {
+            options.network.rtt_ms = std::stoi(value);
+        } else if (arg == "--download-mbps") {
+            options.network.download_bytes_per_second = std::stod(value) * 1e6;
+        } else if (arg == "--upload-mbps") {
+            options.network.upload_bytes_per_second = std::stod(value) * 1e6;
+        } else if (arg == "--flood-ratio") {
+            options.network.flood_wait_ratio = std::clamp(std::stod(value), 0.0, 1.0);
+        } else if (arg == "--flood-seconds") {
+            options.network.flood_wait_seconds = std::max(std::stoi(value), 1);
+        } else if (arg == "--pipeline-depth") {
+            forwarder.pipeline_depth = std::stoi(value);
+        } else if (arg == "--downloads") {
+            forwarder.max_concurrent_downloads = std::stoi(value);
+        } else if (arg == "--uploads") {
+            forwarder.max_concurrent_uploads = std::stoi(value);
+        } else if (arg == "--update-threads") {
+            forwarder.update_handler_threads = std::stoi(value);
+        } else if (arg == "--album-quiet-ms") {
+            forwarder.album_quiet_period_ms = std::stoi(value);
+        } else if (arg == "--send-rate") {
+            forwarder.send_rate_per_minute = std::stoi(value);
+        } else if (arg == "--timeout") {
+            options.timeout_seconds = std::stoi(value);
+        } else if (arg == "--log-level") {
+            options.log_level = value;
+        } else {
+            std::cerr << "未知选项: " << arg << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// 读取 /proc/self/status 中的线程数
+int current_thread_count() {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.rfind("Threads:", 0) == 0) {
+            return std::atoi(line.c_str() + 8);
+        }
+    }
+    return 0;
+}
+
+double percentile(const std::vector<double>& sorted, double q) {
+    if (sorted.empty()) {
+        return 0.0;
+    }
+    auto rank = static_cast<std::size_t>(q * static_cast<double>(sorted.size() - 1) + 0.5);
+    return sorted[std::min(rank, sorted.size() - 1)];
+}
+}
+
+int main(int argc, char* argv[]) {
+    BenchOptions options;
+    
+    // 基准测试只关心转发流程本身：不落盘、不开端点、不走流式上传（模拟后端不支持）
+    auto& forwarder_config = options.forwarder;
+    forwarder_config.send_rate_per_minute = 0;
+    forwarder_config.checkpoint_file.clear();
+    forwarder_config.file_id_cache.clear();
+    forwarder_config.channel_cache.clear();
+    forwarder_config.metrics_port = 0;
+    
+    if (!parse_options(argc, argv, options)) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    forwarder_config.streaming_threshold_mb = 0;
+    
+    try {
+        spdlog::set_level(spdlog::level::from_str(options.log_level));
+        
+        auto messages = options.scenario.empty()
+            ? generate_scenario(options.messages, options.rate, options.seed)
+            : load_scenario(options.scenario);
+        if (!options.record.empty()) {
+            save_scenario(options.record, messages);
+        }
+        
+        // 源频道和目标频道（频道ID直接使用，不经过用户名解析）
+        const Int64 source_chat_id = -1001000000001LL;
+        std::vector<Int64> target_chat_ids;
+        ForwardRoute route;
+        route.source = std::to_string(source_chat_id);
+        for (int i = 0; i < options.targets; ++i) {
+            target_chat_ids.push_back(-1001000000002LL - i);
+            route.targets.push_back(std::to_string(target_chat_ids.back()));
+        }
+        
+        // ClientManager 从全局配置读取API参数和代理，写一份最小配置供其加载
+        auto config_path = std::filesystem::temp_directory_path() / "forwarder_bench_config.json";
+        {
+            std::ofstream config_file(config_path, std::ios::trunc);
+            config_file << R"({"api": {"id": 1, "hash": "bench", "phone": "+10000000000"},)"
+                        << R"( "channels": {"source": ")" << route.source << R"(", "target": ")"
+                        << route.targets.front() << R"("}})";
+        }
+        if (!Config::instance().load(config_path.string())) {
+            std::cerr << "无法加载基准测试配置: " << config_path << std::endl;
+            return 1;
+        }
+        
+        auto backend = std::make_unique<MockTdBackend>(source_chat_id, target_chat_ids, messages, options.network);
+        auto& mock = *backend;
+        
+        auto& client = ClientManager::instance();
+        client.set_backend(std::move(backend));
+        
+        AccountConfig account;
+        account.name = "bench";
+        account.phone_number = "+10000000000";
+        account.database_directory = "bench-db";
+        client.add_account(account);
+        client.init();
+        client.set_update_worker_count(static_cast<std::size_t>(std::max(forwarder_config.update_handler_threads, 1)));
+        if (!client.start()) {
+            std::cerr << "模拟客户端启动失败" << std::endl;
+            return 1;
+        }
+        
+        MediaHandler::instance().init();
+        auto& forwarder = RestrictedChannelForwarder::instance();
+        forwarder.init(forwarder_config);
+        if (!forwarder.start(std::vector<ForwardRoute>{route})) {
+            std::cerr << "转发器启动失败" << std::endl;
+            client.stop();
+            return 1;
+        }
+        
+        // 后台采样线程数峰值
+        std::atomic<bool> sampling{true};
+        std::atomic<int> peak_threads{current_thread_count()};
+        std::thread sampler([&] {
+            while (sampling) {
+                peak_threads = std::max(peak_threads.load(), current_thread_count());
+                std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            }
+        });
+        
+        // 等到每次投递都已送达或被转发器判定失败（失败的不会再送达）
+        mock.start_stream();
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(std::max(options.timeout_seconds, 1));
+        bool completed = false;
+        while (!completed && std::chrono::steady_clock::now() < deadline) {
+            completed = mock.wait_delivered(std::chrono::milliseconds(100))
+                || mock.delivered_count() + static_cast<std::size_t>(forwarder.get_failed_count()) >= mock.expected_deliveries();
+        }
+        
+        sampling = false;
+        sampler.join();
+        
+        forwarder.stop();
+        MediaHandler::instance().stop();
+        client.stop();
+        
+        // 汇总
+        auto latencies = mock.delivery_latencies_ms();
+        std::sort(latencies.begin(), latencies.end());
+        double elapsed = std::chrono::duration<double>(mock.stream_duration()).count();
+        
+        rusage usage{};
+        getrusage(RUSAGE_SELF, &usage);
+        
+        std::printf("消息流          %s\n", options.scenario.empty()
+            ? ("generated seed=" + std::to_string(options.seed)).c_str() : options.scenario.c_str());
+        std::printf("消息数          %zu，目标 %d 个\n", messages.size(), options.targets);
+        std::printf("投递            %zu / %zu%s\n", mock.delivered_count(), mock.expected_deliveries(),
+            completed ? "" : "（超时）");
+        std::printf("转发失败        %d\n", forwarder.get_failed_count());
+        std::printf("耗时            %.3f s\n", elapsed);
+        std::printf("吞吐            %.2f msg/s\n",
+            elapsed > 0 ? static_cast<double>(latencies.size()) / elapsed : 0.0);
+        std::printf("端到端延迟      p50 %.1f ms，p99 %.1f ms，最大 %.1f ms\n",
+            percentile(latencies, 0.50), percentile(latencies, 0.99), latencies.empty() ? 0.0 : latencies.back());
+        std::printf("FLOOD_WAIT      %llu\n", static_cast<unsigned long long>(mock.flood_wait_count()));
+        std::printf("请求数          %llu\n", static_cast<unsigned long long>(mock.request_count()));
+        std::printf("峰值RSS         %.1f MB\n", static_cast<double>(usage.ru_maxrss) / 1024.0);
+        std::printf("峰值线程数      %d\n", peak_threads.load());
+        
+        auto summary = Metrics::instance().summary();
+        if (!summary.empty()) {
+            std::printf("各阶段          %s\n", summary.c_str());
+        }
+        
+        return completed ? 0 : 2;
+    } catch (const std::exception& e) {
+        std::cerr << "错误: " << e.what() << std::endl;
+        return 1;
+    }
+}
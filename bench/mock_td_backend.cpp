@@ -0,0 +1,708 @@
+#include <cmath>
+#include <random>
+#include <cctype>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include "mock_td_backend.h"
+
+namespace tg_forwarder {
+
+namespace {
+// 种子消息的ID，源消息从 kFirstMessageId 开始连续编号
+constexpr Int64 kSeedMessageId = 1;
+constexpr Int64 kFirstMessageId = 2;
+
+// 本地请求（不访问服务器）的延迟
+constexpr auto kLocalDelay = std::chrono::milliseconds(1);
+
+// 确定性哈希，决定哪些发送请求被限流
+std::uint64_t mix(std::uint64_t x) {
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+// 取最后一个路径分隔符之后的第一段数字（"/mock/files/12.bin"、"media_12.jpg"、"bench #12" 都得到 12）
+Int64 parse_message_id(const std::string& text) {
+    auto start = text.find_last_of('/');
+    start = start == std::string::npos ? 0 : start + 1;
+    
+    auto digit = std::find_if(text.begin() + static_cast<std::ptrdiff_t>(start), text.end(),
+        [](char c) { return std::isdigit(static_cast<unsigned char>(c)); });
+    
+    Int64 id = 0;
+    for (; digit != text.end() && std::isdigit(static_cast<unsigned char>(*digit)); ++digit) {
+        id = id * 10 + (*digit - '0');
+    }
+    return id;
+}
+
+std::string local_path(Int64 message_id) {
+    return "/mock/files/" + std::to_string(message_id) + ".bin";
+}
+
+td_api::object_ptr<td_api::formattedText> empty_text() {
+    return td_api::make_object<td_api::formattedText>(
+        std::string(), std::vector<td_api::object_ptr<td_api::textEntity>>());
+}
+}
+
+std::vector<SourceMessage> load_scenario(const std::string& path) {
+    std::ifstream in(path);
+    if (!in.is_open()) {
+        throw Error("无法打开消息流文件: " + path);
+    }
+    
+    std::vector<SourceMessage> messages;
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        
+        std::istringstream fields(line);
+        SourceMessage message;
+        std::string at_ms;
+        std::string size;
+        if (!std::getline(fields, at_ms, '\t') || !std::getline(fields, message.type, '\t')) {
+            throw Error("消息流格式错误: " + line);
+        }
+        std::getline(fields, size, '\t');
+        std::getline(fields, message.album, '\t');
+        
+        message.at_ms = std::stoll(at_ms);
+        message.size = size.empty() ? 0 : std::stoll(size);
+        messages.push_back(std::move(message));
+    }
+    
+    // 按发布时间排序，同一时刻保持文件中的顺序
+    std::stable_sort(messages.begin(), messages.end(), [](const SourceMessage& a, const SourceMessage& b) {
+        return a.at_ms < b.at_ms;
+    });
+    return messages;
+}
+
+void save_scenario(const std::string& path, const std::vector<SourceMessage>& messages) {
+    std::ofstream out(path, std::ios::trunc);
+    if (!out.is_open()) {
+        throw Error("无法写入消息流文件: " + path);
+    }
+    
+    out << "# at_ms\ttype\tsize\talbum\n";
+    for (const auto& message : messages) {
+        out << message.at_ms << '\t' << message.type << '\t' << message.size << '\t' << message.album << '\n';
+    }
+}
+
+std::vector<SourceMessage> generate_scenario(std::size_t count, double messages_per_second, std::uint64_t seed) {
+    std::mt19937_64 rng(seed);
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    std::exponential_distribution<double> gap(std::max(messages_per_second, 0.001) / 1000.0);
+    
+    // 大小按对数均匀分布
+    auto log_uniform = [&](double low, double high) {
+        return static_cast<std::int64_t>(std::exp(std::log(low) + unit(rng) * (std::log(high) - std::log(low))));
+    };
+    
+    std::vector<SourceMessage> messages;
+    double at_ms = 0;
+    int album_count = 0;
+    
+    while (messages.size() < count) {
+        at_ms += gap(rng);
+        double kind = unit(rng);
+        
+        // 约10%为2~6条的媒体组，组内消息几乎同时到达
+        if (kind < 0.10) {
+            auto size = std::min<std::size_t>(2 + static_cast<std::size_t>(unit(rng) * 5), count - messages.size());
+            std::string album = "bench-album-" + std::to_string(++album_count);
+            for (std::size_t i = 0; i < size; ++i) {
+                SourceMessage message;
+                message.at_ms = static_cast<std::int64_t>(at_ms) + static_cast<std::int64_t>(i) * 5;
+                message.type = unit(rng) < 0.8 ? "photo" : "video";
+                message.size = message.type == "photo" ? log_uniform(50e3, 1e6) : log_uniform(1e6, 20e6);
+                message.album = album;
+                messages.push_back(std::move(message));
+            }
+            continue;
+        }
+        
+        SourceMessage message;
+        message.at_ms = static_cast<std::int64_t>(at_ms);
+        if (kind < 0.45) {
+            message.type = "text";
+        } else if (kind < 0.75) {
+            message.type = "photo";
+            message.size = log_uniform(50e3, 1e6);
+        } else if (kind < 0.85) {
+            message.type = "video";
+            message.size = log_uniform(1e6, 80e6);
+        } else if (kind < 0.95) {
+            message.type = "document";
+            message.size = log_uniform(10e3, 20e6);
+        } else {
+            message.type = "audio";
+            message.size = log_uniform(1e6, 10e6);
+        }
+        messages.push_back(std::move(message));
+    }
+    
+    return messages;
+}
+
+MockTdBackend::MockTdBackend(Int64 source_chat_id, std::vector<Int64> target_chat_ids,
+                             std::vector<SourceMessage> messages, NetworkProfile network)
+    : source_chat_id_(source_chat_id),
+      target_chat_ids_(std::move(target_chat_ids)),
+      messages_(std::move(messages)),
+      network_(network),
+      downloaded_(messages_.size(), false) {
+}
+
+std::int32_t MockTdBackend::create_client() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto client_id = next_client_id_++;
+    
+    auto update = td_api::make_object<td_api::updateAuthorizationState>();
+    update->authorization_state_ = td_api::make_object<td_api::authorizationStateWaitTdlibParameters>();
+    schedule(Clock::now(), TdResponse{client_id, 0, std::move(update)});
+    return client_id;
+}
+
+void MockTdBackend::destroy_client(std::int32_t client_id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    
+    // 丢弃该客户端尚未交付的事件
+    for (auto it = events_.begin(); it != events_.end();) {
+        if (it->second.response.client_id == client_id) {
+            it = events_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void MockTdBackend::send(std::int32_t client_id, std::uint64_t request_id, Function query) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++requests_;
+    
+    auto now = Clock::now();
+    auto due = now + rtt();
+    std::vector<std::pair<Int64, Int64>> deliveries;
+    auto response = handle(client_id, std::move(query), now, due, deliveries);
+    schedule(due, TdResponse{client_id, request_id, std::move(response)}, std::move(deliveries));
+}
+
+TdResponse MockTdBackend::receive(double timeout) {
+    auto deadline = Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(timeout));
+    
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        auto now = Clock::now();
+        if (!events_.empty() && events_.begin()->first.first <= now) {
+            auto node = events_.extract(events_.begin());
+            auto& event = node.mapped();
+            
+            if (!event.deliveries.empty()) {
+                for (const auto& delivery : event.deliveries) {
+                    delivered_.emplace(delivery, now);
+                }
+                last_delivery_ = now;
+                delivered_cv_.notify_all();
+            }
+            return std::move(event.response);
+        }
+        
+        if (now >= deadline) {
+            return TdResponse{};
+        }
+        
+        auto wake = events_.empty() ? deadline : std::min(deadline, events_.begin()->first.first);
+        events_cv_.wait_until(lock, wake);
+    }
+}
+
+Object MockTdBackend::execute(Function query) {
+    (void)query;
+    return td_api::make_object<td_api::ok>();
+}
+
+void MockTdBackend::start_stream() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (streaming_) {
+        return;
+    }
+    
+    streaming_ = true;
+    stream_start_ = Clock::now();
+    stream_start_date_ = static_cast<std::int32_t>(
+        std::chrono::system_clock::to_time_t(std::chrono::system_clock::now()));
+    
+    // 按发布时间推送给所有客户端（多账号时各自收到一份）
+    for (std::size_t i = 0; i < messages_.size(); ++i) {
+        auto due = stream_start_ + std::chrono::milliseconds(messages_[i].at_ms);
+        for (std::int32_t client_id = 1; client_id < next_client_id_; ++client_id) {
+            auto update = td_api::make_object<td_api::updateNewMessage>();
+            update->message_ = make_message(static_cast<int>(i), source_chat_id_,
+                                            kFirstMessageId + static_cast<Int64>(i));
+            schedule(due, TdResponse{client_id, 0, std::move(update)});
+        }
+    }
+}
+
+bool MockTdBackend::wait_delivered(std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return delivered_cv_.wait_for(lock, timeout, [this] {
+        return delivered_.size() >= messages_.size() * target_chat_ids_.size();
+    });
+}
+
+std::size_t MockTdBackend::expected_deliveries() const {
+    return messages_.size() * target_chat_ids_.size();
+}
+
+std::size_t MockTdBackend::delivered_count() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return delivered_.size();
+}
+
+std::vector<double> MockTdBackend::delivery_latencies_ms() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    
+    std::vector<double> latencies;
+    latencies.reserve(delivered_.size());
+    for (const auto& [key, delivered_at] : delivered_) {
+        auto index = index_of(key.first);
+        if (index < 0) {
+            continue;
+        }
+        auto published = stream_start_ + std::chrono::milliseconds(messages_[index].at_ms);
+        latencies.push_back(std::chrono::duration<double, std::milli>(delivered_at - published).count());
+    }
+    return latencies;
+}
+
+MockTdBackend::Clock::duration MockTdBackend::stream_duration() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!streaming_ || delivered_.empty() || messages_.empty()) {
+        return Clock::duration::zero();
+    }
+    
+    auto first = stream_start_ + std::chrono::milliseconds(messages_.front().at_ms);
+    return last_delivery_ - first;
+}
+
+std::uint64_t MockTdBackend::flood_wait_count() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return flood_waits_;
+}
+
+std::uint64_t MockTdBackend::request_count() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return requests_;
+}
+
+void MockTdBackend::schedule(Clock::time_point due, TdResponse response,
+                             std::vector<std::pair<Int64, Int64>> deliveries) {
+    events_.emplace(EventKey{due, next_seq_++}, Event{std::move(response), std::move(deliveries)});
+    events_cv_.notify_one();
+}
+
+Object MockTdBackend::handle(std::int32_t client_id, Function query, Clock::time_point now, Clock::time_point& due,
+                             std::vector<std::pair<Int64, Int64>>& deliveries) {
+    switch (query->get_id()) {
+        case td_api::setTdlibParameters::ID: {
+            // 参数设置后立即授权完成
+            auto update = td_api::make_object<td_api::updateAuthorizationState>();
+            update->authorization_state_ = td_api::make_object<td_api::authorizationStateReady>();
+            schedule(due, TdResponse{client_id, 0, std::move(update)});
+            return td_api::make_object<td_api::ok>();
+        }
+        case td_api::getMe::ID: {
+            auto user = td_api::make_object<td_api::user>();
+            user->id_ = 777000 + client_id;
+            return user;
+        }
+        case td_api::searchPublicChat::ID: {
+            // bench_source 为源频道，bench_target_<n> 为第 n 个目标频道（从1开始）
+            const auto& username = static_cast<const td_api::searchPublicChat&>(*query).username_;
+            if (username == "bench_source") {
+                return make_chat(source_chat_id_);
+            }
+            auto n = parse_message_id(username);
+            if (username.rfind("bench_target_", 0) == 0 && n >= 1 &&
+                n <= static_cast<Int64>(target_chat_ids_.size())) {
+                return make_chat(target_chat_ids_[n - 1]);
+            }
+            return td_api::make_object<td_api::error>(400, "USERNAME_NOT_OCCUPIED");
+        }
+        case td_api::getChat::ID:
+            due = now + kLocalDelay;
+            return make_chat(static_cast<const td_api::getChat&>(*query).chat_id_);
+        case td_api::getChatMember::ID: {
+            auto status = td_api::make_object<td_api::chatMemberStatusAdministrator>();
+            status->can_post_messages_ = true;
+            auto member = td_api::make_object<td_api::chatMember>();
+            member->status_ = std::move(status);
+            return member;
+        }
+        case td_api::getChatHistory::ID:
+            return handle_get_chat_history(static_cast<const td_api::getChatHistory&>(*query), now);
+        case td_api::getFile::ID: {
+            due = now + kLocalDelay;
+            auto index = index_of(static_cast<const td_api::getFile&>(*query).file_id_);
+            if (index < 0) {
+                return td_api::make_object<td_api::error>(400, "FILE_ID_INVALID");
+            }
+            return make_file(index);
+        }
+        case td_api::downloadFile::ID:
+            return handle_download_file(client_id, static_cast<const td_api::downloadFile&>(*query), now, due);
+        case td_api::sendMessage::ID: {
+            auto& send_message = static_cast<td_api::sendMessage&>(*query);
+            std::vector<td_api::object_ptr<td_api::InputMessageContent>> contents;
+            contents.push_back(std::move(send_message.input_message_content_));
+            return handle_send(client_id, send_message.chat_id_, std::move(contents), false, now, due, deliveries);
+        }
+        case td_api::sendMessageAlbum::ID: {
+            auto& send_album = static_cast<td_api::sendMessageAlbum&>(*query);
+            return handle_send(client_id, send_album.chat_id_, std::move(send_album.input_message_contents_),
+                               true, now, due, deliveries);
+        }
+        default:
+            // 代理、存储优化、打开聊天等对转发流程没有影响的请求
+            return td_api::make_object<td_api::ok>();
+    }
+}
+
+Object MockTdBackend::handle_get_chat_history(const td_api::getChatHistory& query, Clock::time_point now) {
+    if (query.chat_id_ != source_chat_id_) {
+        auto messages = td_api::make_object<td_api::messages>();
+        messages->total_count_ = 0;
+        return messages;
+    }
+    
+    // 已发布的消息ID依次为 1（种子）、2、3……，检索方式同TDLib：
+    // 从 from_message_id（0 为最新）开始向旧的方向取 limit 条，负的 offset 表示先向新的方向移动
+    auto newest = static_cast<Int64>(published_count(now)) + kSeedMessageId;
+    auto from = query.from_message_id_ == 0 ? newest : std::min(query.from_message_id_, newest);
+    auto start = std::clamp<Int64>(from - query.offset_, kSeedMessageId, newest);
+    
+    auto messages = td_api::make_object<td_api::messages>();
+    for (auto id = start; id >= kSeedMessageId && static_cast<int>(messages->messages_.size()) < query.limit_; --id) {
+        messages->messages_.push_back(make_message(index_of(id), source_chat_id_, id));
+    }
+    messages->total_count_ = static_cast<std::int32_t>(messages->messages_.size());
+    return messages;
+}
+
+Object MockTdBackend::handle_download_file(std::int32_t client_id, const td_api::downloadFile& query,
+                                           Clock::time_point now, Clock::time_point& due) {
+    auto index = index_of(query.file_id_);
+    if (index < 0) {
+        return td_api::make_object<td_api::error>(400, "FILE_ID_INVALID");
+    }
+    
+    if (downloaded_[index]) {
+        due = now + kLocalDelay;
+        return make_file(index);
+    }
+    
+    auto finished = transfer(download_link_free_, now, messages_[index].size, network_.download_bytes_per_second);
+    downloaded_[index] = true;
+    
+    if (query.synchronous_) {
+        due = finished;
+        return make_file(index);
+    }
+    
+    // 异步下载：先返回当前状态，完成后推送 updateFile
+    auto file = make_file(index);
+    auto pending = make_file(index);
+    pending->local_->is_downloading_active_ = true;
+    pending->local_->is_downloading_completed_ = false;
+    pending->local_->downloaded_prefix_size_ = 0;
+    pending->local_->downloaded_size_ = 0;
+    schedule(finished, TdResponse{client_id, 0, td_api::make_object<td_api::updateFile>(std::move(file))});
+    return pending;
+}
+
+Object MockTdBackend::handle_send(std::int32_t client_id, Int64 chat_id,
+                                  std::vector<td_api::object_ptr<td_api::InputMessageContent>> contents,
+                                  bool album, Clock::time_point now, Clock::time_point& due,
+                                  std::vector<std::pair<Int64, Int64>>& deliveries) {
+    if (contents.empty()) {
+        return td_api::make_object<td_api::error>(400, "MEDIA_EMPTY");
+    }
+    
+    std::vector<Int64> source_ids;
+    std::int64_t upload_bytes = 0;
+    for (const auto& content : contents) {
+        if (!content) {
+            return td_api::make_object<td_api::error>(400, "MESSAGE_EMPTY");
+        }
+        auto [source_id, bytes] = inspect_content(*content);
+        if (index_of(source_id) < 0) {
+            return td_api::make_object<td_api::error>(400, "mock: 无法识别发送内容对应的源消息");
+        }
+        source_ids.push_back(source_id);
+        upload_bytes += bytes;
+    }
+    
+    // 按（目标, 第一条源消息, 第几次尝试）决定是否限流，重发时换一个哈希
+    auto attempt = send_attempts_[{chat_id, source_ids.front()}]++;
+    auto hash = mix(static_cast<std::uint64_t>(chat_id) ^ mix(static_cast<std::uint64_t>(source_ids.front()) +
+                    (static_cast<std::uint64_t>(attempt) << 40)));
+    if (static_cast<double>(hash % 1000000) < network_.flood_wait_ratio * 1000000.0) {
+        ++flood_waits_;
+        return td_api::make_object<td_api::error>(429,
+            "Too Many Requests: retry after " + std::to_string(network_.flood_wait_seconds));
+    }
+    
+    // 上传占用账号的上传带宽，收到响应即视为投递完成；随后推送 updateMessageSendSucceeded
+    due = transfer(upload_link_free_, now, upload_bytes, network_.upload_bytes_per_second);
+    
+    std::vector<Message> sent;
+    for (auto source_id : source_ids) {
+        deliveries.emplace_back(source_id, chat_id);
+        
+        auto temporary_id = next_sent_message_id_++;
+        sent.push_back(make_message(index_of(source_id), chat_id, temporary_id));
+        
+        auto update = td_api::make_object<td_api::updateMessageSendSucceeded>();
+        update->message_ = make_message(index_of(source_id), chat_id, next_sent_message_id_++);
+        update->old_message_id_ = temporary_id;
+        schedule(due + kLocalDelay, TdResponse{client_id, 0, std::move(update)});
+    }
+    
+    if (album) {
+        auto messages = td_api::make_object<td_api::messages>();
+        messages->total_count_ = static_cast<std::int32_t>(sent.size());
+        messages->messages_ = std::move(sent);
+        return messages;
+    }
+    return std::move(sent.front());
+}
+
+Object MockTdBackend::make_chat(Int64 chat_id) const {
+    bool known = chat_id == source_chat_id_ ||
+        std::find(target_chat_ids_.begin(), target_chat_ids_.end(), chat_id) != target_chat_ids_.end();
+    if (!known) {
+        return td_api::make_object<td_api::error>(400, "Chat not found");
+    }
+    
+    auto type = td_api::make_object<td_api::chatTypeSupergroup>();
+    type->supergroup_id_ = -chat_id - 1000000000000LL;
+    type->is_channel_ = true;
+    
+    auto chat = td_api::make_object<td_api::chat>();
+    chat->id_ = chat_id;
+    chat->title_ = chat_id == source_chat_id_ ? "bench source" : "bench target";
+    chat->type_ = std::move(type);
+    return chat;
+}
+
+Message MockTdBackend::make_message(int index, Int64 chat_id, Int64 message_id) const {
+    auto message = td_api::make_object<td_api::message>();
+    message->id_ = message_id;
+    message->chat_id_ = chat_id;
+    message->media_album_id_ = 0;
+    
+    if (index < 0) {
+        auto content = td_api::make_object<td_api::messageText>();
+        content->text_ = td_api::make_object<td_api::formattedText>(
+            "bench seed", std::vector<td_api::object_ptr<td_api::textEntity>>());
+        message->date_ = stream_start_date_;
+        message->content_ = std::move(content);
+        return message;
+    }
+    
+    const auto& source = messages_[index];
+    auto source_id = kFirstMessageId + index;
+    message->date_ = stream_start_date_ + static_cast<std::int32_t>(source.at_ms / 1000);
+    
+    if (source.type == "photo") {
+        auto size = td_api::make_object<td_api::photoSize>();
+        size->type_ = "x";
+        size->photo_ = make_file(index);
+        size->width_ = 1280;
+        size->height_ = 960;
+        
+        auto photo = td_api::make_object<td_api::photo>();
+        photo->sizes_.push_back(std::move(size));
+        
+        auto content = td_api::make_object<td_api::messagePhoto>();
+        content->photo_ = std::move(photo);
+        content->caption_ = empty_text();
+        content->has_spoiler_ = false;
+        content->media_album_id_ = source.album;
+        message->content_ = std::move(content);
+    } else if (source.type == "video") {
+        auto video = td_api::make_object<td_api::video>();
+        video->duration_ = 30;
+        video->width_ = 1280;
+        video->height_ = 720;
+        video->file_name_ = "bench_" + std::to_string(source_id) + ".mp4";
+        video->mime_type_ = "video/mp4";
+        video->supports_streaming_ = true;
+        video->video_ = make_file(index);
+        
+        auto content = td_api::make_object<td_api::messageVideo>();
+        content->video_ = std::move(video);
+        content->caption_ = empty_text();
+        content->media_album_id_ = source.album;
+        message->content_ = std::move(content);
+    } else if (source.type == "document") {
+        auto document = td_api::make_object<td_api::document>();
+        document->file_name_ = "bench_" + std::to_string(source_id) + ".bin";
+        document->mime_type_ = "application/octet-stream";
+        document->document_ = make_file(index);
+        
+        auto content = td_api::make_object<td_api::messageDocument>();
+        content->document_ = std::move(document);
+        content->caption_ = empty_text();
+        content->media_album_id_ = source.album;
+        message->content_ = std::move(content);
+    } else if (source.type == "audio") {
+        auto audio = td_api::make_object<td_api::audio>();
+        audio->duration_ = 180;
+        audio->title_ = "bench";
+        audio->performer_ = "bench";
+        audio->file_name_ = "bench_" + std::to_string(source_id) + ".mp3";
+        audio->mime_type_ = "audio/mpeg";
+        audio->audio_ = make_file(index);
+        
+        auto content = td_api::make_object<td_api::messageAudio>();
+        content->audio_ = std::move(audio);
+        content->caption_ = empty_text();
+        content->media_album_id_ = source.album;
+        message->content_ = std::move(content);
+    } else {
+        auto content = td_api::make_object<td_api::messageText>();
+        content->text_ = td_api::make_object<td_api::formattedText>(
+            "bench #" + std::to_string(source_id), std::vector<td_api::object_ptr<td_api::textEntity>>());
+        message->content_ = std::move(content);
+    }
+    
+    return message;
+}
+
+td_api::object_ptr<td_api::file> MockTdBackend::make_file(int index) const {
+    auto source_id = kFirstMessageId + index;
+    auto size = messages_[index].size;
+    bool downloaded = downloaded_[index];
+    
+    auto local = td_api::make_object<td_api::localFile>();
+    local->path_ = downloaded ? local_path(source_id) : std::string();
+    local->can_be_downloaded_ = true;
+    local->is_downloading_active_ = false;
+    local->is_downloading_completed_ = downloaded;
+    local->download_offset_ = 0;
+    local->downloaded_prefix_size_ = downloaded ? size : 0;
+    local->downloaded_size_ = downloaded ? size : 0;
+    
+    auto remote = td_api::make_object<td_api::remoteFile>();
+    remote->id_ = "mock-remote-" + std::to_string(source_id);
+    remote->unique_id_ = "mock-unique-" + std::to_string(source_id);
+    remote->is_uploading_active_ = false;
+    remote->is_uploading_completed_ = true;
+    remote->uploaded_size_ = size;
+    
+    auto file = td_api::make_object<td_api::file>();
+    file->id_ = static_cast<std::int32_t>(source_id);
+    file->size_ = size;
+    file->expected_size_ = size;
+    file->local_ = std::move(local);
+    file->remote_ = std::move(remote);
+    return file;
+}
+
+int MockTdBackend::index_of(Int64 message_id) const {
+    auto index = message_id - kFirstMessageId;
+    if (index < 0 || index >= static_cast<Int64>(messages_.size())) {
+        return -1;
+    }
+    return static_cast<int>(index);
+}
+
+std::size_t MockTdBackend::published_count(Clock::time_point now) const {
+    if (!streaming_) {
+        return 0;
+    }
+    
+    auto elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(now - stream_start_).count();
+    auto it = std::upper_bound(messages_.begin(), messages_.end(), elapsed_ms,
+        [](std::int64_t value, const SourceMessage& message) { return value < message.at_ms; });
+    return static_cast<std::size_t>(it - messages_.begin());
+}
+
+std::pair<Int64, std::int64_t> MockTdBackend::inspect_content(const td_api::InputMessageContent& content) const {
+    const td_api::InputFile* input = nullptr;
+    switch (content.get_id()) {
+        case td_api::inputMessageText::ID: {
+            const auto& text = static_cast<const td_api::inputMessageText&>(content).text_;
+            return {text ? parse_message_id(text->text_) : 0, 0};
+        }
+        case td_api::inputMessagePhoto::ID:
+            input = static_cast<const td_api::inputMessagePhoto&>(content).photo_.get();
+            break;
+        case td_api::inputMessageVideo::ID:
+            input = static_cast<const td_api::inputMessageVideo&>(content).video_.get();
+            break;
+        case td_api::inputMessageDocument::ID:
+            input = static_cast<const td_api::inputMessageDocument&>(content).document_.get();
+            break;
+        case td_api::inputMessageAudio::ID:
+            input = static_cast<const td_api::inputMessageAudio&>(content).audio_.get();
+            break;
+        case td_api::inputMessageAnimation::ID:
+            input = static_cast<const td_api::inputMessageAnimation&>(content).animation_.get();
+            break;
+        default:
+            return {0, 0};
+    }
+    
+    if (!input) {
+        return {0, 0};
+    }
+    
+    // 复用远程文件时不需要上传
+    Int64 source_id = 0;
+    switch (input->get_id()) {
+        case td_api::inputFileLocal::ID:
+            source_id = parse_message_id(static_cast<const td_api::inputFileLocal*>(input)->path_);
+            break;
+        case td_api::inputFileMemory::ID:
+            source_id = parse_message_id(static_cast<const td_api::inputFileMemory*>(input)->name_);
+            break;
+        case td_api::inputFileGenerated::ID:
+            source_id = parse_message_id(static_cast<const td_api::inputFileGenerated*>(input)->original_path_);
+            break;
+        case td_api::inputFileRemote::ID:
+            return {parse_message_id(static_cast<const td_api::inputFileRemote*>(input)->id_), 0};
+        case td_api::inputFileId::ID:
+            source_id = static_cast<const td_api::inputFileId*>(input)->id_;
+            break;
+        default:
+            return {0, 0};
+    }
+    
+    auto index = index_of(source_id);
+    return {source_id, index < 0 ? 0 : messages_[index].size};
+}
+
+MockTdBackend::Clock::time_point MockTdBackend::transfer(Clock::time_point& link_free, Clock::time_point now,
+                                                         std::int64_t bytes, double bytes_per_second) const {
+    auto start = std::max(link_free, now);
+    auto seconds = bytes_per_second > 0 ? static_cast<double>(bytes) / bytes_per_second : 0.0;
+    link_free = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds));
+    return link_free + rtt();
+}
+
+MockTdBackend::Clock::duration MockTdBackend::rtt() const {
+    return std::chrono::milliseconds(std::max(network_.rtt_ms, 0));
+}
+
+} // namespace tg_forwarder
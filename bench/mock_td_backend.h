@@ -0,0 +1,156 @@
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <utility>
+#include <condition_variable>
+#include "../include/td_backend.h"
+
+namespace tg_forwarder {
+
+// 回放的一条源频道消息
+struct SourceMessage {
+    std::int64_t at_ms = 0;         // 相对回放开始的发布时间（毫秒）
+    std::string type = "text";      // text / photo / video / document / audio
+    std::int64_t size = 0;          // 媒体文件字节数
+    std::string album;              // 非空表示媒体组
+};
+
+// 模拟的网络条件
+struct NetworkProfile {
+    int rtt_ms = 40;                            // 每个请求的往返延迟
+    double download_bytes_per_second = 40e6;    // 账号的总下载带宽，同时进行的下载排队共享
+    double upload_bytes_per_second = 20e6;      // 账号的总上传带宽
+    double flood_wait_ratio = 0.0;              // 发送请求被 FLOOD_WAIT 拒绝的比例（0~1）
+    int flood_wait_seconds = 1;                 // FLOOD_WAIT 要求等待的秒数
+};
+
+// 读取录制的消息流：每行"发布时间ms<TAB>类型<TAB>字节数<TAB>媒体组"，# 开头为注释
+std::vector<SourceMessage> load_scenario(const std::string& path);
+
+// 保存消息流，格式同 load_scenario
+void save_scenario(const std::string& path, const std::vector<SourceMessage>& messages);
+
+// 按种子生成消息流：文本、图片和各种大小的媒体混合，部分图片和视频组成媒体组
+std::vector<SourceMessage> generate_scenario(std::size_t count, double messages_per_second, std::uint64_t seed);
+
+// 模拟的TDLib后端
+//
+// 在进程内应答转发流程用到的请求（授权、频道解析、历史消息、下载、发送），其余请求一律返回 ok。
+// 响应按往返延迟和带宽排进事件队列，由 receive 按到期时间交给 ClientManager；
+// 源频道的消息按录制的发布时间以 updateNewMessage 推送，发往目标频道的请求收到响应即视为投递完成。
+// 限流按（目标, 源消息, 第几次尝试）哈希决定，同一消息流的每次运行触发的位置相同。
+// 不模拟流式上传（inputFileGenerated），基准测试须关闭 streaming_threshold_mb。
+class MockTdBackend : public TdBackend {
+public:
+    using Clock = std::chrono::steady_clock;
+    
+    MockTdBackend(Int64 source_chat_id, std::vector<Int64> target_chat_ids,
+                  std::vector<SourceMessage> messages, NetworkProfile network);
+    
+    // TdBackend
+    std::int32_t create_client() override;
+    void destroy_client(std::int32_t client_id) override;
+    void send(std::int32_t client_id, std::uint64_t request_id, Function query) override;
+    TdResponse receive(double timeout) override;
+    Object execute(Function query) override;
+    
+    // 开始回放：之前的历史中只有一条种子消息，之后按发布时间推送新消息
+    void start_stream();
+    
+    // 等待所有消息投递到所有目标，超时返回 false
+    bool wait_delivered(std::chrono::milliseconds timeout);
+    
+    // 期望的投递次数（消息数 × 目标数）和已完成的投递次数
+    std::size_t expected_deliveries() const;
+    std::size_t delivered_count() const;
+    
+    // 各次投递从源消息发布到目标端收到发送响应的延迟（毫秒）
+    std::vector<double> delivery_latencies_ms() const;
+    
+    // 第一条消息发布到最后一次投递的时间
+    Clock::duration stream_duration() const;
+    
+    // 注入的 FLOOD_WAIT 次数和收到的请求总数
+    std::uint64_t flood_wait_count() const;
+    std::uint64_t request_count() const;
+    
+private:
+    // 到期后交给 receive 的响应或更新
+    struct Event {
+        TdResponse response;
+        std::vector<std::pair<Int64, Int64>> deliveries;   // 收到该响应即完成的（源消息ID, 目标）
+    };
+    
+    // 事件键：（到期时间, 序号），序号保证同一时刻的事件按产生顺序交付
+    using EventKey = std::pair<Clock::time_point, std::uint64_t>;
+    
+    // 把响应或更新排入事件队列（调用方持有锁）
+    void schedule(Clock::time_point due, TdResponse response,
+                  std::vector<std::pair<Int64, Int64>> deliveries = {});
+    
+    // 应答请求，返回响应对象；due 为响应的交付时间，deliveries 为随响应完成的投递（调用方持有锁）
+    Object handle(std::int32_t client_id, Function query, Clock::time_point now, Clock::time_point& due,
+                  std::vector<std::pair<Int64, Int64>>& deliveries);
+    
+    // 各类请求
+    Object handle_get_chat_history(const td_api::getChatHistory& query, Clock::time_point now);
+    Object handle_download_file(std::int32_t client_id, const td_api::downloadFile& query,
+                                Clock::time_point now, Clock::time_point& due);
+    Object handle_send(std::int32_t client_id, Int64 chat_id,
+                       std::vector<td_api::object_ptr<td_api::InputMessageContent>> contents,
+                       bool album, Clock::time_point now, Clock::time_point& due,
+                       std::vector<std::pair<Int64, Int64>>& deliveries);
+    Object make_chat(Int64 chat_id) const;
+    
+    // 构造源消息（index 为 messages_ 中的下标，-1 为种子消息）
+    Message make_message(int index, Int64 chat_id, Int64 message_id) const;
+    td_api::object_ptr<td_api::file> make_file(int index) const;
+    
+    // 消息ID对应的 messages_ 下标，不存在时返回 -1
+    int index_of(Int64 message_id) const;
+    
+    // 已发布的源消息数（调用方持有锁）
+    std::size_t published_count(Clock::time_point now) const;
+    
+    // 从发送内容中找出对应的源消息，以及需要上传的字节数
+    std::pair<Int64, std::int64_t> inspect_content(const td_api::InputMessageContent& content) const;
+    
+    // 传输占用带宽后的完成时间（共享链路，按到达顺序排队）
+    Clock::time_point transfer(Clock::time_point& link_free, Clock::time_point now,
+                               std::int64_t bytes, double bytes_per_second) const;
+    
+    Clock::duration rtt() const;
+    
+    const Int64 source_chat_id_;
+    const std::vector<Int64> target_chat_ids_;
+    const std::vector<SourceMessage> messages_;
+    const NetworkProfile network_;
+    
+    mutable std::mutex mutex_;
+    std::condition_variable events_cv_;
+    std::condition_variable delivered_cv_;
+    std::map<EventKey, Event> events_;
+    std::uint64_t next_seq_ = 0;
+    
+    std::int32_t next_client_id_ = 1;
+    Int64 next_sent_message_id_ = 1000000;
+    std::vector<bool> downloaded_;
+    Clock::time_point download_link_free_;
+    Clock::time_point upload_link_free_;
+    std::map<std::pair<Int64, Int64>, int> send_attempts_;
+    
+    // 回放进度与投递结果
+    bool streaming_ = false;
+    Clock::time_point stream_start_;
+    std::int32_t stream_start_date_ = 0;
+    std::map<std::pair<Int64, Int64>, Clock::time_point> delivered_;
+    Clock::time_point last_delivery_;
+    std::uint64_t flood_waits_ = 0;
+    std::uint64_t requests_ = 0;
+};
+
+} // namespace tg_forwarder
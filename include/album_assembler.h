@@ -0,0 +1,59 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <optional>
+#include <chrono>
+#include "utils.h"
+
+namespace tg_forwarder {
+
+// 相册（媒体组）组装缓冲
+// 从新消息流（推送和历史补漏）中按 media_album_id 收集消息，不再额外拉取历史。
+// 相册满 10 条，或最后一条到达后静默一段时间，即视为完整并交给调用方转发。
+// 非线程安全，仅在转发线程中使用。
+class AlbumAssembler {
+public:
+    using Clock = std::chrono::steady_clock;
+    
+    // Telegram 相册最多包含 10 条消息
+    static constexpr size_t kMaxAlbumSize = 10;
+    
+    explicit AlbumAssembler(std::chrono::milliseconds quiet_period = std::chrono::milliseconds(800));
+    
+    // 设置静默期
+    void set_quiet_period(std::chrono::milliseconds quiet_period);
+    
+    // 加入一条媒体组消息（不属于媒体组的消息返回 false 且不取走）
+    bool add(Message& message, Clock::time_point now = Clock::now());
+    
+    // 取出已完整的相册（满员或已超过静默期），按首条消息ID升序
+    std::vector<MessageVector> take_ready(Clock::time_point now = Clock::now());
+    
+    // 取出所有缓冲中的相册（一次性模式结束或停止时使用）
+    std::vector<MessageVector> take_all();
+    
+    // 最早一个相册到期的时间，没有缓冲时返回空
+    std::optional<Clock::time_point> next_deadline() const;
+    
+    // 缓冲中的相册数量
+    size_t pending_count() const;
+    
+    // 丢弃所有缓冲
+    void clear();
+
+private:
+    struct PendingAlbum {
+        MessageVector messages;
+        Clock::time_point last_update;
+    };
+    
+    // 把选中的相册按消息ID排序后移出
+    std::vector<MessageVector> extract(std::vector<std::string> group_ids);
+    
+    std::chrono::milliseconds quiet_period_;
+    std::unordered_map<std::string, PendingAlbum> albums_;
+};
+
+} // namespace tg_forwarder
@@ -0,0 +1,350 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace tg_forwarder {
+
+// 基于续延（continuation）的轻量 Future/Promise
+//
+// 与 std::future 不同，Future 支持 then() 链式回调：结果就绪时由设置结果的线程
+// （通常是 TDLib 接收线程）直接执行续延，调用方无需占用一个线程阻塞等待。
+// 仍然保留 get()/wait_for() 以便同步代码按原方式使用。
+
+template <typename T>
+class Future;
+
+template <typename T>
+class Promise;
+
+// Promise 未设置结果就被销毁时，关联的 Future 收到该异常
+class BrokenPromise : public std::logic_error {
+public:
+    BrokenPromise() : std::logic_error("Promise未设置结果即被销毁") {}
+};
+
+namespace detail {
+
+// void 结果的占位类型
+struct Unit {};
+
+template <typename T>
+using StorageOf = std::conditional_t<std::is_void_v<T>, Unit, T>;
+
+template <typename T>
+struct SharedState {
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::optional<StorageOf<T>> value;
+    std::exception_ptr error;
+    std::function<void()> continuation;
+    bool ready = false;
+    
+    // 标记就绪，并在锁外执行续延
+    void finish(std::unique_lock<std::mutex>& lock) {
+        ready = true;
+        auto callback = std::move(continuation);
+        continuation = nullptr;
+        lock.unlock();
+        cv.notify_all();
+        
+        if (callback) {
+            callback();
+        }
+    }
+};
+
+template <typename T>
+struct IsFuture : std::false_type {};
+
+template <typename T>
+struct IsFuture<Future<T>> : std::true_type {};
+
+// then() 回调返回 Future<U> 时展开为 U
+template <typename T>
+struct UnwrapFuture {
+    using type = T;
+};
+
+template <typename T>
+struct UnwrapFuture<Future<T>> {
+    using type = T;
+};
+
+} // namespace detail
+
+template <typename T>
+class Promise {
+public:
+    Promise() : state_(std::make_shared<detail::SharedState<T>>()) {}
+    
+    Promise(Promise&&) noexcept = default;
+    Promise(const Promise&) = delete;
+    Promise& operator=(const Promise&) = delete;
+    
+    Promise& operator=(Promise&& other) noexcept {
+        if (this != &other) {
+            abandon();
+            state_ = std::move(other.state_);
+        }
+        return *this;
+    }
+    
+    // 未设置结果就被销毁时以 BrokenPromise 完成 Future，等待者不会永远阻塞
+    ~Promise() {
+        abandon();
+    }
+    
+    // 获取关联的Future
+    Future<T> get_future() const {
+        return Future<T>(state_);
+    }
+    
+    // 设置结果
+    template <typename U = T, typename = std::enable_if_t<!std::is_void_v<U>>>
+    void set_value(U value) {
+        std::unique_lock<std::mutex> lock(state_->mutex);
+        if (state_->ready) {
+            throw std::logic_error("Promise已设置");
+        }
+        state_->value.emplace(std::move(value));
+        state_->finish(lock);
+    }
+    
+    template <typename U = T, typename = std::enable_if_t<std::is_void_v<U>>>
+    void set_value() {
+        std::unique_lock<std::mutex> lock(state_->mutex);
+        if (state_->ready) {
+            throw std::logic_error("Promise已设置");
+        }
+        state_->value.emplace();
+        state_->finish(lock);
+    }
+    
+    // 设置异常
+    void set_exception(std::exception_ptr error) {
+        std::unique_lock<std::mutex> lock(state_->mutex);
+        if (state_->ready) {
+            throw std::logic_error("Promise已设置");
+        }
+        state_->error = std::move(error);
+        state_->finish(lock);
+    }
+
+private:
+    // 放弃共享状态：尚未就绪时设置 BrokenPromise 并执行续延
+    void abandon() noexcept {
+        if (!state_) {
+            return;
+        }
+        
+        std::unique_lock<std::mutex> lock(state_->mutex);
+        if (!state_->ready) {
+            state_->error = std::make_exception_ptr(BrokenPromise());
+            state_->finish(lock);
+        }
+    }
+    
+    std::shared_ptr<detail::SharedState<T>> state_;
+};
+
+template <typename T>
+class Future {
+public:
+    using ValueType = T;
+    
+    Future() = default;
+    
+    // 是否关联了共享状态
+    bool valid() const {
+        return static_cast<bool>(state_);
+    }
+    
+    // 结果是否已就绪
+    bool is_ready() const {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        return state_->ready;
+    }
+    
+    // 阻塞等待结果
+    void wait() const {
+        std::unique_lock<std::mutex> lock(state_->mutex);
+        state_->cv.wait(lock, [this] { return state_->ready; });
+    }
+    
+    // 限时等待，返回结果是否就绪
+    template <typename Rep, typename Period>
+    bool wait_for(const std::chrono::duration<Rep, Period>& timeout) const {
+        std::unique_lock<std::mutex> lock(state_->mutex);
+        return state_->cv.wait_for(lock, timeout, [this] { return state_->ready; });
+    }
+    
+    // 阻塞获取结果（只能调用一次），异常会被重新抛出
+    T get() {
+        wait();
+        auto state = std::move(state_);
+        
+        if (state->error) {
+            std::rethrow_exception(state->error);
+        }
+        
+        if constexpr (!std::is_void_v<T>) {
+            return std::move(*state->value);
+        }
+    }
+    
+    // 结果就绪后调用 f(T)；f 返回 Future<U> 时自动展开为 Future<U>
+    // 前一步抛出的异常直接传递给后续 Future，不再调用 f
+    template <typename F>
+    auto then(F&& f) {
+        using Result = std::conditional_t<std::is_void_v<T>,
+            std::invoke_result<F>, std::invoke_result<F, T>>;
+        using R = typename Result::type;
+        using U = typename detail::UnwrapFuture<R>::type;
+        
+        auto promise = std::make_shared<Promise<U>>();
+        auto next = promise->get_future();
+        
+        on_ready([promise, f = std::forward<F>(f)](Future<T> self) mutable {
+            try {
+                if constexpr (detail::IsFuture<R>::value) {
+                    R inner = invoke_with(f, self);
+                    inner.on_ready([promise](Future<U> result) {
+                        forward_result(*promise, result);
+                    });
+                } else if constexpr (std::is_void_v<R>) {
+                    invoke_with(f, self);
+                    promise->set_value();
+                } else {
+                    promise->set_value(invoke_with(f, self));
+                }
+            } catch (...) {
+                promise->set_exception(std::current_exception());
+            }
+        });
+        
+        return next;
+    }
+    
+    // 结果就绪后以已就绪的Future调用回调（成功或失败都会调用）
+    void on_ready(std::function<void(Future<T>)> callback) {
+        auto state = std::move(state_);
+        
+        std::unique_lock<std::mutex> lock(state->mutex);
+        if (!state->ready) {
+            state->continuation = [state, callback = std::move(callback)]() mutable {
+                callback(Future<T>(state));
+            };
+            return;
+        }
+        lock.unlock();
+        
+        callback(Future<T>(state));
+    }
+
+private:
+    friend class Promise<T>;
+    
+    template <typename>
+    friend class Future;
+    
+    explicit Future(std::shared_ptr<detail::SharedState<T>> state)
+        : state_(std::move(state)) {}
+    
+    template <typename F>
+    static decltype(auto) invoke_with(F& f, Future<T>& ready) {
+        if constexpr (std::is_void_v<T>) {
+            ready.get();
+            return f();
+        } else {
+            return f(ready.get());
+        }
+    }
+    
+    template <typename U>
+    static void forward_result(Promise<U>& promise, Future<U>& ready) {
+        try {
+            if constexpr (std::is_void_v<U>) {
+                ready.get();
+                promise.set_value();
+            } else {
+                promise.set_value(ready.get());
+            }
+        } catch (...) {
+            promise.set_exception(std::current_exception());
+        }
+    }
+    
+    std::shared_ptr<detail::SharedState<T>> state_;
+};
+
+// 生成已就绪的Future
+template <typename T>
+Future<T> make_ready_future(T value) {
+    Promise<T> promise;
+    promise.set_value(std::move(value));
+    return promise.get_future();
+}
+
+inline Future<void> make_ready_future() {
+    Promise<void> promise;
+    promise.set_value();
+    return promise.get_future();
+}
+
+// 生成携带异常的Future
+template <typename T>
+Future<T> make_exceptional_future(std::exception_ptr error) {
+    Promise<T> promise;
+    promise.set_exception(std::move(error));
+    return promise.get_future();
+}
+
+// 等待一组Future全部就绪（不占用线程），按原顺序返回已就绪的Future
+template <typename T>
+Future<std::vector<Future<T>>> when_all(std::vector<Future<T>> futures) {
+    struct Context {
+        std::mutex mutex;
+        std::vector<Future<T>> results;
+        std::size_t remaining;
+        Promise<std::vector<Future<T>>> promise;
+    };
+    
+    auto context = std::make_shared<Context>();
+    context->results.resize(futures.size());
+    context->remaining = futures.size();
+    auto all = context->promise.get_future();
+    
+    if (futures.empty()) {
+        context->promise.set_value({});
+        return all;
+    }
+    
+    for (std::size_t i = 0; i < futures.size(); ++i) {
+        futures[i].on_ready([context, i](Future<T> ready) {
+            bool last = false;
+            {
+                std::lock_guard<std::mutex> lock(context->mutex);
+                context->results[i] = std::move(ready);
+                last = --context->remaining == 0;
+            }
+            
+            if (last) {
+                context->promise.set_value(std::move(context->results));
+            }
+        });
+    }
+    
+    return all;
+}
+
+} // namespace tg_forwarder
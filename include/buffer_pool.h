@@ -0,0 +1,71 @@
+#pragma once
+
+#include <array>
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+namespace tg_forwarder {
+
+// 按容量分级复用的大块缓冲区池
+//
+// 缓冲区按2的幂分级（64KB ~ 256MB），归还后留在对应级别的空闲列表中，下次申请同级别容量时直接复用，
+// 避免持续负载下反复分配、释放几十MB的内存块导致堆碎片。池中保留的总字节数有上限，超出时直接释放。
+// 缓冲区以 std::string 的形式借出，可以直接移交给只接受 std::string 的接口（如 inputFileMemory），
+// 移交后的内存由接收方释放，不再回到池中。
+class BufferPool {
+public:
+    // 获取单例实例
+    static BufferPool& instance();
+    
+    // 禁止复制和移动
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+    BufferPool(BufferPool&&) = delete;
+    BufferPool& operator=(BufferPool&&) = delete;
+    
+    // 借出容量不小于 capacity 的空缓冲区（超过最大级别时按实际大小分配，不入池）
+    std::string acquire(size_t capacity);
+    
+    // 归还缓冲区（内容作废）；容量不在分级范围或池已满时直接释放
+    void recycle(std::string&& buffer);
+    
+    // 设置/获取池中最多保留的字节数
+    void set_retained_limit(size_t bytes);
+    size_t retained_limit() const;
+    
+    // 池中当前保留的字节数
+    size_t retained_bytes() const;
+    
+    // 命中（复用）次数和未命中（新分配）次数
+    uint64_t hit_count() const;
+    uint64_t miss_count() const;
+    
+    // 释放池中所有缓冲区
+    void trim();
+
+private:
+    // 私有构造函数（单例模式）
+    BufferPool() = default;
+    
+    // 最小、最大级别（2的幂次）
+    static constexpr size_t kMinClassShift = 16;
+    static constexpr size_t kMaxClassShift = 28;
+    static constexpr size_t kClassCount = kMaxClassShift - kMinClassShift + 1;
+    
+    // 容量向上/向下取整到的级别，不在范围内时返回 kClassCount
+    static size_t class_for_request(size_t capacity);
+    static size_t class_for_block(size_t capacity);
+    
+    mutable std::mutex mutex_;
+    std::array<std::vector<std::string>, kClassCount> free_lists_;
+    size_t retained_bytes_ = 0;
+    size_t retained_limit_ = 128 * 1024 * 1024;
+    
+    std::atomic<uint64_t> hit_count_{0};
+    std::atomic<uint64_t> miss_count_{0};
+};
+
+} // namespace tg_forwarder
@@ -2,12 +2,25 @@
 
 #include <string>
 #include <map>
-#include <future>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <utility>
+#include <optional>
+#include <fstream>
 #include <mutex>
+#include <chrono>
 #include "utils.h"
+#include "async.h"
 
 namespace tg_forwarder {
 
+// 频道解析器
+//
+// 解析结果按（账号, 用户名）缓存，并以追加写日志的形式保存在磁盘上，重启后无需再次 searchPublicChat。
+// 成功结果和"用户名不存在"之类的永久性失败分别有各自的有效期；从磁盘加载的结果首次使用前
+// 先用本地的 getChat 确认该账号的TDLib仍认识该聊天，确认失败时重新查询。
+// 同一频道同时只发出一个查询，并发查询的数量有上限，避免配置了大量路由时集中触发限流。
 class ChannelResolver {
 public:
     // 获取单例实例
@@ -19,36 +32,97 @@ public:
     ChannelResolver(ChannelResolver&&) = delete;
     ChannelResolver& operator=(ChannelResolver&&) = delete;
     
+    // 打开（或创建）持久化缓存并加载未过期的记录（须在客户端添加账号之后调用）
+    bool open(const std::string& path);
+    
+    // 关闭持久化缓存（内存中的缓存仍然有效）
+    void close();
+    
+    // 设置成功结果和永久性失败结果的有效期
+    void set_ttl(std::chrono::seconds positive_ttl, std::chrono::seconds negative_ttl);
+    
     // 解析频道标识符，获取频道ID
     // 支持格式：
-    // - 频道链接：https://t.me/example_channel
+    // - 频道链接：https://t.me/example_channel、t.me/s/example_channel、tg://resolve?domain=example_channel
     // - 用户名：@example_channel
     // - 频道ID：-1001234567890
     // 返回标准化的频道ID（如 -1001234567890）
-    std::future<Int64> resolve_channel(const std::string& channel_identifier);
+    // 查询通过链式Future完成，不占用额外线程；通过当前线程所绑定的账号查询，各账号分别缓存
+    Future<Int64> resolve_channel(const std::string& channel_identifier);
     
     // 同步版本，会阻塞直到解析完成
     Int64 resolve_channel_sync(const std::string& channel_identifier);
     
-    // 清除缓存
+    // 批量解析：缓存中没有的频道并发查询，全部完成后按输入顺序返回各自的结果
+    Future<std::vector<Future<Int64>>> resolve_channels(const std::vector<std::string>& channel_identifiers);
+    
+    // 清除缓存（包括磁盘上的记录）
     void clear_cache();
     
+    // 从链接或用户名中提取用户名（统一为小写），无法识别时抛出 ChannelError
+    static std::string normalize_username(const std::string& channel_identifier);
+    
 private:
+    // 缓存键：（账号序号, 小写用户名）；账号须自己查询过频道，TDLib才认识该聊天
+    using CacheKey = std::pair<std::size_t, std::string>;
+    using Clock = std::chrono::system_clock;
+    
+    struct CacheEntry {
+        Int64 chat_id = 0;          // 0 表示永久性失败（如用户名不存在）
+        std::string error;          // 永久性失败的原因
+        Clock::time_point expires_at;
+        bool verified = false;      // 本次运行中已确认TDLib认识该聊天
+    };
+    
+    // 等待同一频道查询结果的调用方
+    using Waiters = std::vector<std::shared_ptr<Promise<Int64>>>;
+    
     // 私有构造函数（单例模式）
     ChannelResolver();
     
     // 处理t.me链接，提取用户名部分
-    std::string extract_username_from_link(const std::string& link);
+    static std::string extract_username_from_link(const std::string& link);
     
     // 检查是否是合法的频道ID格式
-    bool is_valid_channel_id(const std::string& id_str);
+    static bool is_valid_channel_id(const std::string& id_str);
+    
+    // 在查询名额内发起排队中的查询
+    void start_lookups();
+    
+    // 执行单个查询：unverified_chat_id 为从磁盘加载、尚待确认的结果，确认失败时通过 searchPublicChat 查询
+    void run_lookup(const CacheKey& key, std::optional<Int64> unverified_chat_id);
+    
+    // 查询完成：写入缓存并通知所有等待者
+    void finish_lookup(const CacheKey& key, Future<Int64> result);
     
     // 通过API查询频道信息
-    Int64 get_chat_id_by_username(const std::string& username);
+    Future<Int64> get_chat_id_by_username(const std::string& username);
+    
+    // 确认TDLib认识该聊天（本地查询，不访问服务器）
+    Future<Int64> verify_chat_id(Int64 chat_id);
+    
+    // 追加一条记录到日志（调用方持有锁）
+    void append_record(const CacheKey& key, const CacheEntry& entry);
+    
+    // 重写日志，只保留未过期的记录（调用方持有锁）
+    void compact();
+    
+    // 同时进行的查询上限
+    static constexpr std::size_t kMaxConcurrentLookups = 4;
     
-    // 缓存和锁
     std::mutex cache_mutex_;
-    std::map<std::string, Int64> channel_cache_;
+    std::map<CacheKey, CacheEntry> channel_cache_;
+    std::map<CacheKey, Waiters> lookups_;
+    std::deque<std::pair<CacheKey, std::optional<Int64>>> pending_lookups_;
+    std::size_t active_lookups_ = 0;
+    
+    // 持久化
+    std::string path_;
+    std::ofstream log_;
+    std::size_t log_records_ = 0;
+    
+    std::chrono::seconds positive_ttl_{std::chrono::hours(24 * 7)};
+    std::chrono::seconds negative_ttl_{std::chrono::minutes(10)};
 };
 
-} // namespace tg_forwarder 
\ No newline at end of file
+} // namespace tg_forwarder
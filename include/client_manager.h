@@ -4,12 +4,21 @@
 #include <functional>
 #include <memory>
 #include <map>
+#include <unordered_map>
+#include <vector>
+#include <deque>
 #include <queue>
+#include <optional>
 #include <mutex>
 #include <condition_variable>
 #include <thread>
 #include <atomic>
+#include <chrono>
 #include "utils.h"
+#include "async.h"
+#include "rate_limiter.h"
+#include "update_dispatcher.h"
+#include "td_backend.h"
 
 namespace tg_forwarder {
 
@@ -25,8 +34,88 @@ enum class ClientState {
     Error              // 发生错误
 };
 
-// 更新处理器类型
-using UpdateHandler = std::function<void(Object)>;
+// 账号配置（多个账号共用一个进程和同一个TDLib接收循环）
+struct AccountConfig {
+    std::string name;                   // 账号名称，转发路由通过名称指定账号
+    std::string phone_number;
+    std::string database_directory;     // TDLib数据库目录，各账号必须不同
+    int max_pending_queries = 64;       // 同时等待响应的请求上限，超出的请求在本账号队列中排队，0 表示不限
+};
+
+// TDLib数据库和文件缓存设置（所有账号共用）
+// 默认与原来一致；relay 配置面向只转发不回看的场景：不写消息数据库，定期按大小和时间清理文件缓存
+struct TdlibProfile {
+    bool use_message_database = true;       // 把收到的消息写入TDLib的消息数据库
+    bool use_chat_info_database = true;     // 缓存用户、群组和频道信息，重启后无需重新获取
+    bool use_file_database = true;          // 持久化文件信息
+    bool enable_storage_optimizer = true;   // TDLib自动清理长期未使用的文件
+    std::string files_directory;            // 文件缓存目录（可放在 tmpfs 上），为空时使用数据库目录；各账号使用以账号名命名的子目录
+    bool delete_uploaded_files = false;     // 全部目标发送完成后 deleteFile 删除下载的源文件
+    int storage_max_size_mb = 0;            // optimizeStorage：清理后文件缓存的总大小上限（MB），0 表示使用TDLib默认值
+    int storage_max_files = 0;              // optimizeStorage：清理后保留的文件数上限，0 表示使用TDLib默认值
+    int storage_ttl_minutes = 0;            // optimizeStorage：清理超过该时长未访问的文件，0 表示使用TDLib默认值
+    int storage_immunity_minutes = 0;       // optimizeStorage：创建后该时长内的文件不清理，0 表示使用TDLib默认值（1天）
+    int storage_optimize_interval_minutes = 0; // 每隔多久调用一次 optimizeStorage，0 表示不调用
+    
+    // 转发中继配置：关闭消息数据库，文件转发后即删除，每10分钟把缓存清理到1GB、1小时以内
+    static TdlibProfile relay();
+};
+
+// 在作用域内把当前线程发出的请求绑定到指定账号（未绑定时使用主账号 0）
+// 接收线程分发响应、更新处理线程执行处理器时会自动绑定对应账号，因此续延和处理器中发出的后续请求仍走同一账号
+class AccountScope {
+public:
+    explicit AccountScope(std::size_t account);
+    ~AccountScope();
+    
+    // 禁止复制和移动
+    AccountScope(const AccountScope&) = delete;
+    AccountScope& operator=(const AccountScope&) = delete;
+    
+private:
+    std::size_t previous_;
+};
+
+// 响应处理器类型
+using ResponseHandler = std::function<void(Object)>;
+
+// 请求响应分发表
+// 以 request_id 低位作为槽位下标，O(1) 找到等待中的调用方；
+// 槽位被仍未返回的旧请求占用时退回到溢出表
+class ResponseDispatchTable {
+public:
+    explicit ResponseDispatchTable(std::size_t capacity = 4096);
+    
+    // 登记等待响应的处理器
+    void insert(std::uint64_t request_id, ResponseHandler handler);
+    
+    // 取出并移除处理器，不存在时返回空处理器
+    ResponseHandler take(std::uint64_t request_id);
+    
+    // 移除处理器（如请求超时），返回是否存在
+    bool erase(std::uint64_t request_id);
+    
+    // 清空所有处理器
+    void clear();
+    
+    // 取出所有等待中的处理器
+    std::vector<ResponseHandler> take_all();
+    
+    // 当前等待中的请求数量
+    std::size_t size() const;
+    
+private:
+    struct Slot {
+        std::uint64_t request_id = 0;
+        ResponseHandler handler;
+    };
+    
+    mutable std::mutex mutex_;
+    std::vector<Slot> slots_;
+    std::size_t mask_;
+    std::unordered_map<std::uint64_t, ResponseHandler> overflow_;
+    std::size_t size_ = 0;
+};
 
 class ClientManager {
 public:
@@ -39,18 +128,45 @@ public:
     ClientManager(ClientManager&&) = delete;
     ClientManager& operator=(ClientManager&&) = delete;
     
-    // 初始化客户端
+    // 替换TDLib后端（须在 init 之前调用，基准测试用模拟后端驱动转发流程）
+    void set_backend(std::unique_ptr<TdBackend> backend);
+    
+    // 添加账号（须在 init 之前调用；未添加任何账号时使用配置文件中的手机号作为唯一账号）
+    void add_account(const AccountConfig& account);
+    
+    // 初始化客户端（为每个账号创建一个TDLib客户端实例）
     void init();
     
-    // 启动客户端
+    // 启动客户端，等待所有账号授权完成
     bool start();
     
+    // 启动接收线程开始连接和授权，不等待完成；调用方可在等待期间做其他初始化，再调用 wait_ready
+    bool start_connecting();
+    
+    // 等待所有账号授权完成，失败或超时时停止客户端
+    bool wait_ready();
+    
     // 停止客户端
     void stop();
     
-    // 获取当前状态
+    // 获取当前线程所绑定账号的状态
     ClientState state() const;
     
+    // 获取指定账号的状态
+    ClientState state(std::size_t account) const;
+    
+    // 账号数量
+    std::size_t account_count() const;
+    
+    // 按名称查找账号
+    std::optional<std::size_t> find_account(const std::string& name) const;
+    
+    // 获取账号名称
+    std::string account_name(std::size_t account) const;
+    
+    // 当前线程所绑定的账号
+    static std::size_t current_account();
+    
     // 设置验证码（用于双重认证）
     void send_code(const std::string& code);
     
@@ -61,18 +177,80 @@ public:
     Object send_query(Function&& query, double timeout = 10.0);
     
     // 异步发送请求
-    std::uint64_t send_query_async(Function&& query, std::function<void(Object)> handler = nullptr);
+    std::uint64_t send_query_async(Function&& query, ResponseHandler handler = nullptr);
+    
+    // 异步发送可重建的请求：发送类请求被 FLOOD_WAIT 拒绝时自动重新生成并在限流结束后重发
+    std::uint64_t send_query_async(QueryFactory factory, ResponseHandler handler);
+    
+    // 发送请求，返回可链式组合的Future，不占用调用线程等待
+    // 注意：续延在TDLib接收线程上执行，不能在其中调用阻塞的 send_query
+    Future<Object> send_query_future(Function&& query);
+    Future<Object> send_query_future(QueryFactory factory);
+    
+    // 设置发送类请求的限流（每个目标聊天每秒请求数和突发容量），速率为0表示不限流
+    void set_send_rate_limit(double rate_per_second, double burst);
+    
+    // 获取限流队列中的请求数量
+    std::size_t rate_limited_query_count() const;
+    
+    // 是否启用了发送限流（启用时被限流拒绝的请求会由工厂重新构造）
+    bool send_rate_limited() const;
+    
+    // 设置重建被限流请求（可能读取文件）所用的后台执行器，为空时在接收线程上重建
+    void set_background_executor(BackgroundExecutor executor);
+    
+    // 发送请求并转换为指定结果类型，TDLib错误以异常形式传递
+    template <typename T>
+    Future<td_api::object_ptr<T>> request(Function&& query);
     
-    // 注册更新处理器
-    void register_update_handler(const std::string& type, UpdateHandler handler);
+    // 获取等待响应的请求数量
+    std::size_t pending_query_count() const;
     
-    // 取消注册更新处理器
-    void unregister_update_handler(const std::string& type);
+    // 获取指定账号已发出和排队中的请求数量
+    std::size_t in_flight_query_count(std::size_t account) const;
+    std::size_t queued_query_count(std::size_t account) const;
+    
+    // 获取当前账号的登录用户ID
+    Int64 get_my_id();
+    Future<Int64> get_my_id_async();
+    
+    // 设置更新处理线程数（须在 start 之前调用）
+    void set_update_worker_count(std::size_t count);
+    
+    // 设置TDLib数据库和文件缓存配置（须在 start 之前调用）
+    void set_tdlib_profile(const TdlibProfile& profile);
+    
+    // 排队等待处理的更新数量
+    std::size_t queued_update_count() const;
+    
+    // 注册更新处理器（type 为 td_api 更新的构造函数ID，如 td_api::updateNewMessage::ID）
+    // 处理器在更新处理线程上执行，同一聊天的更新按接收顺序处理
+    void register_update_handler(std::int32_t type, UpdateHandler handler);
+    
+    // 取消注册更新处理器，返回时该处理器不会再被调用
+    void unregister_update_handler(std::int32_t type);
     
     // 清除所有更新处理器
     void clear_update_handlers();
     
 private:
+    // 单个账号的客户端和请求预算
+    struct Account {
+        std::size_t index = 0;
+        AccountConfig config;
+        std::int32_t client_id = 0;
+        std::atomic<ClientState> state{ClientState::Idle};
+        std::atomic<Int64> my_id{0};
+        
+        // 请求预算：已发出未返回的请求数和超出预算后排队的请求
+        mutable std::mutex budget_mutex;
+        std::size_t in_flight = 0;
+        std::deque<std::pair<std::uint64_t, Function>> queued;
+        
+        // 下一次 optimizeStorage 的时间（仅接收线程访问）
+        std::chrono::steady_clock::time_point next_storage_optimization{};
+    };
+    
     // 私有构造函数（单例模式）
     ClientManager();
     
@@ -82,17 +260,46 @@ private:
     // 处理TDLib更新
     void process_updates();
     
+    // 处理单个TDLib响应或更新（request_id 为0表示更新）
+    void process_response(Account& account, std::uint64_t request_id, Object object);
+    
+    // 获取当前线程所绑定的账号，未初始化时抛出异常
+    Account& current();
+    
+    // 登记处理器，经过限流器后在账号预算内发送
+    std::uint64_t dispatch_query(Function query, QueryFactory factory, ResponseHandler handler);
+    
+    // 发出限流队列中已到期的请求
+    void send_due_queries();
+    
+    // 按间隔为已就绪的账号清理TDLib文件缓存（在接收线程上调用）
+    void optimize_storage_if_due();
+    
+    // 发送失败更新中的限流错误：暂停该聊天的令牌桶，限流结束后重发该消息
+    void handle_send_failed(Account& account, const td_api::updateMessageSendFailed& update);
+    
+    // 在账号预算内发送请求，预算用尽时排队
+    void send_with_budget(Account& account, std::uint64_t query_id, Function query);
+    
+    // 请求返回后释放预算，并发出排队中的下一个请求
+    void release_budget(Account& account);
+    
     // 设置状态
-    void set_state(ClientState state);
+    void set_state(Account& account, ClientState state);
     
     // 认证处理
-    void handle_authorization_state(Object object);
+    void handle_authorization_state(Account& account, Object object);
+    
+    // 授权完成后预加载主聊天列表，转发器打开频道和检查权限时不必再等待网络（在接收线程上调用）
+    void preload_chats(Account& account);
     
-    // 客户端标识符
-    std::unique_ptr<std::int32_t> client_id_;
+    // TDLib后端：创建客户端、收发请求
+    std::unique_ptr<TdBackend> backend_;
     
-    // 状态
-    std::atomic<ClientState> state_;
+    // 账号列表：init 之后只读，接收线程按TDLib客户端ID查找
+    std::vector<std::unique_ptr<Account>> accounts_;
+    std::unordered_map<std::int32_t, Account*> accounts_by_client_;
+    std::atomic<bool> initialized_{false};
     
     // 更新处理线程
     std::unique_ptr<std::thread> update_thread_;
@@ -103,17 +310,56 @@ private:
     // 认证状态同步
     std::mutex auth_mutex_;
     std::condition_variable auth_cond_;
+    std::chrono::steady_clock::time_point connect_start_;
     
     // 响应处理
-    std::mutex response_mutex_;
-    std::map<std::uint64_t, std::function<void(Object)>> response_handlers_;
+    ResponseDispatchTable response_handlers_;
     
-    // 更新处理器
-    std::mutex handlers_mutex_;
-    std::map<std::string, UpdateHandler> update_handlers_;
+    // 发送类请求的令牌桶限流
+    RateLimiter rate_limiter_;
     
-    // 请求计数器
-    std::atomic<std::uint64_t> query_id_{0};
+    // 更新处理：接收线程只负责分发，处理器在分发器的处理线程上执行
+    UpdateDispatcher update_dispatcher_;
+    std::size_t update_worker_count_ = 2;
+    
+    // TDLib数据库和文件缓存配置
+    TdlibProfile tdlib_profile_;
+    
+    // 请求计数器（1~kReservedQueryIds 留给认证流程中的固定请求）
+    static constexpr std::uint64_t kReservedQueryIds = 16;
+    std::atomic<std::uint64_t> query_id_{kReservedQueryIds};
 };
 
+// 将TDLib响应转换为指定类型，error 对象转换为异常（临时性错误为 NetworkError）
+template <typename T>
+td_api::object_ptr<T> expect_object(Object object) {
+    if (!object) {
+        throw Error("TDLib返回空响应");
+    }
+    
+    if (object->get_id() == td_api::error::ID) {
+        auto error = td::move_object_as<td_api::error>(object);
+        auto what = "TDLib错误 " + std::to_string(error->code_) + ": " + error->message_;
+        
+        // 临时性错误以 NetworkError 抛出，调用方可据此重试
+        if (is_retryable_error(error->code_, error->message_)) {
+            throw NetworkError(what, parse_retry_after(error->code_, error->message_));
+        }
+        throw Error(what);
+    }
+    
+    if (object->get_id() != T::ID) {
+        throw Error("TDLib返回了意外的响应类型: " + std::to_string(object->get_id()));
+    }
+    
+    return td::move_object_as<T>(object);
+}
+
+template <typename T>
+Future<td_api::object_ptr<T>> ClientManager::request(Function&& query) {
+    return send_query_future(std::move(query)).then([](Object object) {
+        return expect_object<T>(std::move(object));
+    });
+}
+
 } // namespace tg_forwarder 
\ No newline at end of file
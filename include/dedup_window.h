@@ -0,0 +1,66 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace tg_forwarder {
+
+// 固定容量的去重窗口
+// 环形缓冲记录插入顺序，开放寻址（线性探测）哈希表负责 O(1) 查询；两者都是连续数组，
+// 没有逐节点分配。满员后插入新键会淘汰最旧的键。字符串ID先哈希为 64 位再存入。
+class DedupWindow {
+public:
+    explicit DedupWindow(std::size_t capacity = 1024);
+    
+    // 清空并重新设置容量
+    void reset(std::size_t capacity);
+    
+    // 是否包含该键
+    bool contains(std::uint64_t key) const;
+    
+    // 插入键，已存在时返回 false
+    bool insert(std::uint64_t key);
+    
+    // 当前键数量和容量
+    std::size_t size() const;
+    std::size_t capacity() const;
+    
+    // 清空
+    void clear();
+    
+    // 按插入顺序（从旧到新）遍历
+    template <typename F>
+    void for_each(F&& f) const {
+        for (std::size_t i = 0; i < size_; ++i) {
+            f(ring_[(head_ + i) % ring_.size()]);
+        }
+    }
+    
+    // 字符串ID的 64 位哈希（FNV-1a）
+    static std::uint64_t hash(const std::string& value);
+
+private:
+    // 键在哈希表中的起始槽位
+    std::size_t home_slot(std::uint64_t key) const;
+    
+    // 查找键所在槽位，不存在时返回表大小
+    std::size_t find_slot(std::uint64_t key) const;
+    
+    // 从哈希表删除（向后移位，不留墓碑）
+    void erase(std::uint64_t key);
+    
+    // 0 作为空槽标记，键 0 单独记录
+    static constexpr std::uint64_t kEmpty = 0;
+    
+    std::vector<std::uint64_t> ring_;
+    std::size_t head_ = 0;
+    std::size_t size_ = 0;
+    
+    std::vector<std::uint64_t> table_;
+    std::size_t mask_ = 0;
+    bool has_zero_ = false;
+};
+
+} // namespace tg_forwarder
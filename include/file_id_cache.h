@@ -0,0 +1,75 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <optional>
+#include <fstream>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+
+namespace tg_forwarder {
+
+// 远程文件ID复用缓存
+// 以（账号，源文件的 remote_->unique_id_）为键，记录该文件由该账号上传到目标端后得到的 remote_->id_。
+// 远程文件ID只对取得它的账号有效，因此不同账号的记录互不复用。
+// 命中时可直接以 inputFileRemote 发送，跳过下载和上传。
+// 索引以追加写日志的形式保存在磁盘上，重启后重新加载。
+class FileIdCache {
+public:
+    // 获取单例实例
+    static FileIdCache& instance();
+    
+    // 禁止复制和移动
+    FileIdCache(const FileIdCache&) = delete;
+    FileIdCache& operator=(const FileIdCache&) = delete;
+    FileIdCache(FileIdCache&&) = delete;
+    FileIdCache& operator=(FileIdCache&&) = delete;
+    
+    // 打开（或创建）索引文件并加载已有记录
+    bool open(const std::string& path);
+    
+    // 关闭索引文件
+    void close();
+    
+    // 是否已打开
+    bool is_open() const;
+    
+    // 查询已上传的远程文件ID（计入命中/未命中统计）
+    std::optional<std::string> lookup(const std::string& account, const std::string& unique_id);
+    
+    // 记录上传结果
+    void store(const std::string& account, const std::string& unique_id, const std::string& remote_id);
+    
+    // 使记录失效（如远程文件ID已不可用）
+    void invalidate(const std::string& account, const std::string& unique_id);
+    
+    // 统计信息
+    std::uint64_t hit_count() const;
+    std::uint64_t miss_count() const;
+    std::size_t size() const;
+
+private:
+    // 私有构造函数（单例模式）
+    FileIdCache() = default;
+    
+    // 由账号和源文件ID组成记录键
+    static std::string make_key(const std::string& account, const std::string& unique_id);
+    
+    // 追加一条记录到日志（调用方持有锁）
+    void append_record(const std::string& key, const std::string& remote_id);
+    
+    // 重写日志，去掉被覆盖和失效的记录（调用方持有锁）
+    void compact();
+    
+    mutable std::mutex mutex_;
+    std::string path_;
+    std::ofstream log_;
+    std::unordered_map<std::string, std::string> entries_;
+    std::size_t log_records_ = 0;
+    
+    std::atomic<std::uint64_t> hits_{0};
+    std::atomic<std::uint64_t> misses_{0};
+};
+
+} // namespace tg_forwarder
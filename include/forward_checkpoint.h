@@ -0,0 +1,77 @@
+#pragma once
+
+#include <string>
+#include <chrono>
+#include <cstdint>
+#include "dedup_window.h"
+
+namespace tg_forwarder {
+
+// 转发进度检查点
+// 记录最后一条连续提交的源消息ID，以及最近转发过的消息ID和媒体组ID（有界去重窗口），
+// 重启后从检查点继续，不漏转也不重复转发。
+// 以追加写日志保存，按批次 fsync；记录过多时压缩重写。路径为空时只在内存中维护去重窗口。
+// 非线程安全，仅在转发线程中使用。
+class ForwardCheckpoint {
+public:
+    ForwardCheckpoint() = default;
+    ~ForwardCheckpoint();
+    
+    // 禁止复制和移动
+    ForwardCheckpoint(const ForwardCheckpoint&) = delete;
+    ForwardCheckpoint& operator=(const ForwardCheckpoint&) = delete;
+    ForwardCheckpoint(ForwardCheckpoint&&) = delete;
+    ForwardCheckpoint& operator=(ForwardCheckpoint&&) = delete;
+    
+    // 打开（或创建）检查点并加载记录；源/目标频道与记录不符时丢弃旧记录
+    bool open(const std::string& path, std::int64_t source_chat_id, std::int64_t target_chat_id,
+              std::size_t window_size);
+    
+    // 落盘并关闭
+    void close();
+    
+    // 是否关联了磁盘文件
+    bool is_persistent() const;
+    
+    // 最后一条连续提交的消息ID，没有记录时为 0
+    std::int64_t last_message_id() const;
+    
+    // 去重查询
+    bool contains_message(std::int64_t message_id) const;
+    bool contains_media_group(const std::string& media_group_id) const;
+    
+    // 记录已转发的消息/媒体组
+    void record_message(std::int64_t message_id);
+    void record_media_group(const std::string& media_group_id);
+    
+    // 推进最后提交的消息ID（满一批或超过间隔时 fsync）
+    void commit(std::int64_t last_message_id);
+    
+    // 立即 fsync
+    void sync();
+
+private:
+    // 追加一行记录
+    void append_line(const std::string& line);
+    
+    // 把当前状态重写为新日志
+    void compact();
+    
+    std::string path_;
+    int fd_ = -1;
+    std::int64_t source_chat_id_ = 0;
+    std::int64_t target_chat_id_ = 0;
+    std::int64_t last_message_id_ = 0;
+    std::size_t window_size_ = 1024;
+    
+    // 去重窗口（媒体组ID以哈希值保存）
+    DedupWindow messages_;
+    DedupWindow media_groups_;
+    
+    // 日志统计与批量落盘
+    std::size_t log_records_ = 0;
+    std::size_t unsynced_records_ = 0;
+    std::chrono::steady_clock::time_point last_sync_;
+};
+
+} // namespace tg_forwarder
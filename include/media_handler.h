@@ -11,6 +11,12 @@
 #include <thread>
 #include <functional>
 #include "utils.h"
+#include "async.h"
+#include "streaming_transfer.h"
+#include "task_executor.h"
+#include "media_scheduler.h"
+#include "retry_policy.h"
+#include "memory_budget.h"
 
 namespace tg_forwarder {
 
@@ -29,10 +35,17 @@ enum class MediaTaskType {
     Upload      // 上传任务
 };
 
+// 媒体上传输入方式
+enum class MediaInputMode {
+    LocalFile,  // 直接把TDLib缓存中的本地文件路径交给上传（inputFileLocal），不读入内存
+    Memory      // 读入内存后以 inputFileMemory 上传
+};
+
 // 媒体任务基类
 class MediaTask {
 public:
-    MediaTask(MediaTaskType type, const Message& message);
+    // 消息由转发流水线和所有任务共用，不复制
+    MediaTask(MediaTaskType type, SharedMessage message);
     virtual ~MediaTask() = default;
     
     // 获取任务ID
@@ -44,9 +57,12 @@ public:
     // 获取任务状态
     MediaTaskState state() const;
     
-    // 设置任务状态
+    // 设置任务状态（进入完成/失败/取消状态时触发完成回调）
     void set_state(MediaTaskState state);
     
+    // 注册完成回调，任务首次进入终止状态时调用一次；若已终止则立即调用
+    void on_finished(std::function<void(MediaTaskState)> callback);
+    
     // 获取关联的消息
     const Message& message() const;
     
@@ -54,6 +70,51 @@ public:
     MemoryBuffer& buffer();
     const MemoryBuffer& buffer() const;
     
+    // 获取/设置TDLib本地文件路径（下载完成后由TDLib提供）
+    const std::string& local_path() const;
+    void set_local_path(const std::string& path);
+    
+    // 获取/设置源文件在TDLib中的文件ID（已下载到本地时非0，转发完成后可据此删除本地副本）
+    Int32 local_file_id() const;
+    void set_local_file_id(Int32 file_id);
+    
+    // 获取/设置下载该文件的账号（文件ID按账号各自编号，删除本地副本须通过同一账号）
+    std::size_t account() const;
+    void set_account(std::size_t account);
+    
+    // 登记一条已发出、尚未收到发送结果（updateMessageSendSucceeded/Failed）的消息
+    void add_unconfirmed_send();
+    
+    // 一条消息已有发送结果；返回 true 表示这是最后一条，且之前已请求释放本地文件
+    bool confirm_send();
+    
+    // 请求释放本地文件；返回 true 表示所有消息都已有发送结果，调用方可立即释放，
+    // 否则在最后一条消息有结果时由 confirm_send 返回 true
+    bool request_release();
+    
+    // 获取/设置源文件的唯一ID（remote_->unique_id_）
+    const std::string& source_unique_id() const;
+    void set_source_unique_id(const std::string& unique_id);
+    
+    // 获取/设置可复用的远程文件ID（命中文件ID缓存时无需下载）
+    const std::string& remote_file_id() const;
+    void set_remote_file_id(const std::string& remote_id);
+    
+    // 获取/设置流式传输的 conversion（非空表示以 inputFileGenerated 边下边传）
+    const std::string& stream_conversion() const;
+    void set_stream_conversion(const std::string& conversion);
+    
+    // 获取/设置文件大小（字节）
+    int64_t file_size() const;
+    void set_file_size(int64_t size);
+    
+    // 获取/设置是否留在磁盘上（内存模式下超过溢出阈值的文件不读入内存，直接引用TDLib缓存中的文件）
+    bool spilled() const;
+    void set_spilled(bool spilled);
+    
+    // 设置占用的内存预算额度，任务销毁时归还（同一媒体组的任务共用一份）
+    void set_memory_reservation(std::shared_ptr<MemoryBudget::Reservation> reservation);
+    
     // 获取/设置错误信息
     std::string error() const;
     void set_error(const std::string& error);
@@ -74,24 +135,42 @@ public:
 private:
     std::string id_;
     MediaTaskType type_;
-    MediaTaskState state_;
-    Message message_;
+    std::atomic<MediaTaskState> state_;
+    SharedMessage message_;
     MemoryBuffer buffer_;
+    std::string local_path_;
+    Int32 local_file_id_ = 0;
+    std::size_t account_ = 0;
+    std::string source_unique_id_;
+    std::string remote_file_id_;
+    std::string stream_conversion_;
+    int64_t file_size_;
+    bool spilled_ = false;
+    std::shared_ptr<MemoryBudget::Reservation> memory_reservation_;
+    std::atomic<int> progress_;
+    
+    // 保护跨线程读写的错误信息、时间、完成回调和发送确认计数
+    mutable std::mutex mutex_;
     std::string error_;
-    int progress_;
     std::chrono::system_clock::time_point start_time_;
     std::chrono::system_clock::time_point end_time_;
+    std::function<void(MediaTaskState)> finished_callback_;
+    bool finished_ = false;
+    int unconfirmed_sends_ = 0;
+    bool release_requested_ = false;
 };
 
 // 媒体组任务，包含多个相关的媒体任务
-class MediaGroupTask {
+// 各任务终止时通过回调更新原子计数，最后一个任务结束时唤醒等待者并执行完成回调
+class MediaGroupTask : public std::enable_shared_from_this<MediaGroupTask> {
 public:
-    MediaGroupTask(const std::string& group_id);
+    // expected_count 为组内任务总数，全部终止后视为完成
+    MediaGroupTask(const std::string& group_id, size_t expected_count);
     
     // 获取组ID
     std::string id() const;
     
-    // 添加任务
+    // 添加任务（须在任务开始处理前添加全部任务）
     void add_task(std::shared_ptr<MediaTask> task);
     
     // 获取所有任务
@@ -106,15 +185,36 @@ public:
     // 检查所有任务是否已完成（成功或失败）
     bool is_completed() const;
     
+    // 阻塞等待所有任务完成
+    void wait() const;
+    
+    // 注册完成回调，所有任务结束时在最后完成的线程上调用；若已完成则立即调用
+    void on_completed(std::function<void()> callback);
+    
     // 获取整体进度（0-100）
     int overall_progress() const;
     
-    // 获取说明文字（从第一个消息中提取）
-    std::string caption() const;
+    // 获取说明文字（第一个有说明文字的消息，含实体），都没有时返回 nullptr；指向任务持有的消息
+    const td_api::formattedText* caption() const;
     
 private:
+    // 单个任务终止时调用
+    void on_task_finished(MediaTaskState state);
+    
     std::string id_;
+    size_t expected_count_;
     std::vector<std::shared_ptr<MediaTask>> tasks_;
+    
+    // 终止计数
+    std::atomic<size_t> completed_count_{0};
+    std::atomic<size_t> failed_count_{0};
+    std::atomic<size_t> finished_count_{0};
+    
+    // 完成通知
+    mutable std::mutex mutex_;
+    mutable std::condition_variable cv_;
+    std::vector<std::function<void()>> completion_callbacks_;
+    bool completed_ = false;
 };
 
 // 媒体处理器类
@@ -138,22 +238,61 @@ public:
     // 停止处理器
     void stop();
     
-    // 下载单个媒体消息
-    std::future<std::shared_ptr<MediaTask>> download_media(const Message& message);
+    // 下载单个媒体消息（任务共用调用方的消息）
+    Future<std::shared_ptr<MediaTask>> download_media(SharedMessage message);
     
-    // 下载媒体组
-    std::future<std::shared_ptr<MediaGroupTask>> download_media_group(const MessageVector& messages);
+    // 下载媒体组（各条目完成后以续延汇总，不占用额外线程；各任务共用同一份消息列表）
+    Future<std::shared_ptr<MediaGroupTask>> download_media_group(SharedMessageVector messages);
     
     // 上传媒体任务到目标频道
-    std::future<Message> upload_media(Int64 chat_id, const std::shared_ptr<MediaTask>& task);
+    Future<Message> upload_media(Int64 chat_id, const std::shared_ptr<MediaTask>& task);
     
     // 上传媒体组到目标频道
-    std::future<MessageVector> upload_media_group(Int64 chat_id, const std::shared_ptr<MediaGroupTask>& group_task);
+    Future<MessageVector> upload_media_group(Int64 chat_id, const std::shared_ptr<MediaGroupTask>& group_task);
     
-    // 设置并发下载/上传限制
+    // 设置并发下载/上传限制（运行中调整会立即改变线程池大小）
     void set_max_concurrent_downloads(int max);
     void set_max_concurrent_uploads(int max);
     
+    // 设置排队任务上限，超过时 download_media/upload_media 阻塞调用方
+    void set_queue_capacity(size_t capacity);
+    
+    // 获取排队中的任务数量
+    size_t queued_task_count() const;
+    
+    // 设置大文件阈值（字节），不小于该大小的任务走大文件通道，最多占用一半工作线程
+    void set_large_file_threshold(int64_t bytes);
+    
+    // 设置内存模式下读入内存的媒体数据总量上限（字节，0 表示不限制），超过时下载任务排队等待
+    void set_memory_budget(int64_t bytes);
+    
+    // 设置溢出阈值（字节），内存模式下不小于该大小的文件不读入内存，0 表示全部读入
+    void set_memory_spill_threshold(int64_t bytes);
+    
+    // 获取读入内存的媒体数据占用的字节数，以及等待内存预算的下载请求数量
+    int64_t memory_in_flight_bytes() const;
+    size_t memory_waiting_count() const;
+    
+    // 设置下载、上传失败后的重试次数和初始间隔（秒），间隔按指数退避增长
+    void set_retry_policy(int retry_count, int retry_delay_seconds);
+    
+    // 获取等待重试的任务数量
+    size_t scheduled_retry_count() const;
+    
+    // 设置媒体上传输入方式
+    void set_media_input_mode(MediaInputMode mode);
+    
+    // 设置流式传输阈值（字节），不小于该大小的文件边下载边上传，0 表示禁用
+    void set_streaming_threshold(int64_t bytes);
+    
+    // 设置是否在转发完成后删除源文件的本地副本（deleteFile），让TDLib文件缓存不随转发量增长
+    void set_delete_uploaded_files(bool enabled);
+    
+    // 删除任务下载到本地的源文件（所有目标都已发出后调用，未启用或无本地文件时忽略）
+    // TDLib 在发送请求返回后仍从本地路径上传，因此等各条消息都收到发送结果后才真正删除
+    void release_local_files(const std::shared_ptr<MediaTask>& task);
+    void release_local_files(const std::shared_ptr<MediaGroupTask>& group_task);
+    
     // 获取当前活动任务数量
     int active_download_count() const;
     int active_upload_count() const;
@@ -165,41 +304,117 @@ private:
     // 析构函数
     ~MediaHandler();
     
-    // 下载线程函数
-    void download_worker();
-    
-    // 上传线程函数
-    void upload_worker();
+    // 按内存预算为一组下载任务申请额度（同一媒体组一次申请），额度不足时返回的 Future 稍后就绪
+    Future<void> reserve_memory(const std::vector<std::shared_ptr<MediaTask>>& tasks);
+    
+    // 把已创建的下载任务提交到线程池，在指定账号上执行
+    Future<std::shared_ptr<MediaTask>> submit_download(const std::shared_ptr<MediaTask>& task, std::size_t account);
+    
+    // 执行下载任务（在线程池中调用），失败时返回异常，由调用方决定重试或标记失败
+    std::exception_ptr process_download(const std::shared_ptr<MediaTask>& task);
+    
+    // 发起上传任务（在线程池中调用），不等待响应；无法发出请求时抛出异常，发送失败时返回的 Future 带异常
+    Future<Message> process_upload(Int64 chat_id, const std::shared_ptr<MediaTask>& task);
+    
+    // 按文件大小和消息时间把下载、上传和媒体组发送交给调度器
+    void schedule_download(const std::shared_ptr<MediaTask>& task,
+                           const std::shared_ptr<Promise<std::shared_ptr<MediaTask>>>& promise,
+                           std::size_t account, int attempt);
+    void schedule_upload(Int64 chat_id, const std::shared_ptr<MediaTask>& task,
+                         const std::shared_ptr<Promise<Message>>& promise,
+                         std::size_t account, int attempt);
+    void schedule_album_upload(Int64 chat_id, const std::shared_ptr<MediaGroupTask>& group_task,
+                               const std::shared_ptr<Promise<MessageVector>>& promise,
+                               std::size_t account, int attempt);
+    
+    // 执行第 attempt 次重试的下载、上传和媒体组发送（0 为首次），临时性错误按重试策略重新调度
+    void run_download(const std::shared_ptr<MediaTask>& task,
+                      const std::shared_ptr<Promise<std::shared_ptr<MediaTask>>>& promise,
+                      std::size_t account, int attempt);
+    void run_upload(Int64 chat_id, const std::shared_ptr<MediaTask>& task,
+                    const std::shared_ptr<Promise<Message>>& promise,
+                    std::size_t account, int attempt);
+    void run_album_upload(Int64 chat_id, const std::shared_ptr<MediaGroupTask>& group_task,
+                          const std::shared_ptr<Promise<MessageVector>>& promise,
+                          std::size_t account, int attempt);
+    
+    // 可重试的错误在退避时间后把 retry 放回线程池，返回 false 表示应直接失败
+    bool schedule_retry(const std::string& what, const std::exception_ptr& error, int attempt,
+                        TaskExecutor::Task retry);
     
     // 下载文件的具体实现
     void download_file(std::shared_ptr<MediaTask> task);
     
     // 上传文件的具体实现
-    Message upload_file(Int64 chat_id, const std::shared_ptr<MediaTask>& task);
+    Future<Message> upload_file(Int64 chat_id, const std::shared_ptr<MediaTask>& task);
+    
+    // 根据媒体类型发送不同类型的媒体，响应在接收线程上处理，不占用工作线程
+    Future<Message> send_media_by_type(Int64 chat_id, const std::shared_ptr<MediaTask>& task);
+    
+    // 构造发送媒体组的请求（限流重发时会再次调用）
+    Function make_album_request(Int64 chat_id, const std::shared_ptr<MediaGroupTask>& group_task);
+    
+    // 根据媒体类型构造消息内容（限流重发时会再次调用）
+    td_api::object_ptr<td_api::InputMessageContent> make_media_content(const std::shared_ptr<MediaTask>& task);
     
-    // 根据媒体类型发送不同类型的媒体
-    Message send_media_by_type(Int64 chat_id, const std::shared_ptr<MediaTask>& task);
+    // 为任务构造上传用的输入文件
+    td_api::object_ptr<td_api::InputFile> make_input_file(const std::shared_ptr<MediaTask>& task);
     
-    // 线程和同步
+    // 记录已发出的消息，等待其发送结果：成功后把远程文件ID写入缓存，
+    // 全部有结果后再删除本地文件（在TDLib接收线程上调用）
+    void track_sent_message(Int64 message_id, const std::shared_ptr<MediaTask>& task,
+                            std::chrono::steady_clock::time_point started);
+    
+    // 一条已发出的消息有了发送结果
+    void confirm_sent_message(const std::shared_ptr<MediaTask>& task);
+    
+    // 通过下载该文件的账号删除本地副本
+    void delete_local_file(const std::shared_ptr<MediaTask>& task);
+    
+    // 消息发送结果更新处理
+    void on_message_send_succeeded(Object update);
+    void on_message_send_failed(Object update);
+    
+    // 运行状态
     std::atomic<bool> running_{false};
-    std::vector<std::thread> download_threads_;
-    std::vector<std::thread> upload_threads_;
     
-    // 下载队列
-    std::mutex download_mutex_;
-    std::condition_variable download_cv_;
-    std::queue<std::pair<std::shared_ptr<MediaTask>, std::promise<std::shared_ptr<MediaTask>>>> download_queue_;
+    // 下载和上传共用的线程池，以及按大小分通道的调度器
+    TaskExecutor executor_;
+    MediaScheduler scheduler_;
     std::atomic<int> active_downloads_{0};
-    
-    // 上传队列
-    std::mutex upload_mutex_;
-    std::condition_variable upload_cv_;
-    std::queue<std::tuple<Int64, std::shared_ptr<MediaTask>, std::promise<Message>>> upload_queue_;
     std::atomic<int> active_uploads_{0};
     
     // 并发限制
-    int max_concurrent_downloads_;
-    int max_concurrent_uploads_;
+    std::atomic<int> max_concurrent_downloads_;
+    std::atomic<int> max_concurrent_uploads_;
+    
+    // 上传输入方式
+    std::atomic<MediaInputMode> media_input_mode_{MediaInputMode::LocalFile};
+    
+    // 失败重试策略
+    mutable std::mutex retry_mutex_;
+    RetryPolicy retry_policy_;
+    
+    // 读入内存的媒体数据预算
+    MemoryBudget memory_budget_;
+    std::atomic<int64_t> memory_spill_threshold_{0};
+    
+    // 流式传输
+    StreamingTransfer streaming_;
+    std::atomic<int64_t> streaming_threshold_{0};
+    
+    // 转发完成后删除本地源文件
+    std::atomic<bool> delete_uploaded_files_{false};
+    
+    // 已发出、等待发送结果的消息：对应的媒体任务和发出请求的时间（上传耗时算到服务器确认为止）
+    struct SentMessage {
+        std::shared_ptr<MediaTask> task;
+        std::chrono::steady_clock::time_point started;
+    };
+    
+    // 等待发送结果的（账号序号, 临时消息ID）-> 已发出的消息
+    std::mutex sent_messages_mutex_;
+    std::map<std::pair<std::size_t, Int64>, SentMessage> sent_messages_;
     
     // 媒体组任务管理
     std::mutex group_mutex_;
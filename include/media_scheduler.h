@@ -0,0 +1,96 @@
+#pragma once
+
+#include <queue>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <condition_variable>
+#include "task_executor.h"
+
+namespace tg_forwarder {
+
+// 媒体任务调度器
+//
+// 任务按预计文件大小分为小文件和大文件两个通道，各自按"消息时间 + 预计传输时间"排序，
+// 相当于短任务优先、等待越久越靠前，大文件不会被无限推迟。
+// 调度器只在通道有空闲名额时把任务交给线程池：大文件最多占用一半线程，
+// 其余线程始终留给小文件，因此正在传输的大文件不会拖慢照片和短视频。
+class MediaScheduler {
+public:
+    using Task = std::function<void()>;
+    
+    // 任务通道
+    enum class Lane {
+        Small,
+        Large
+    };
+    
+    explicit MediaScheduler(TaskExecutor& executor);
+    
+    // 禁止复制和移动
+    MediaScheduler(const MediaScheduler&) = delete;
+    MediaScheduler& operator=(const MediaScheduler&) = delete;
+    
+    // 启动/停止调度；停止时尚未执行的任务立即交给线程池，由任务自己发现处理器已停止
+    void start(size_t thread_count);
+    void stop();
+    
+    // 设置线程数（决定各通道的并发名额）
+    void set_thread_count(size_t thread_count);
+    
+    // 设置大文件阈值（字节），不小于该大小的任务进入大文件通道
+    void set_large_threshold(int64_t bytes);
+    
+    // 提交任务；expected_size 为预计传输字节数，message_date 为消息时间（Unix秒）。
+    // 排队数达到线程池容量时阻塞外部提交方；调度器未运行时在当前线程直接执行
+    void submit(int64_t expected_size, int32_t message_date, Task task);
+    
+    // 各通道排队中和执行中的任务数量
+    size_t queued_count(Lane lane) const;
+    size_t running_count(Lane lane) const;
+    
+    // 按文件大小换算的TDLib下载优先级（1~32，越小的文件越高）
+    static int32_t download_priority(int64_t expected_size);
+
+private:
+    struct Job {
+        double key = 0;         // 排序键：消息时间 + 预计传输秒数
+        uint64_t sequence = 0;  // 相同排序键时按提交顺序
+        Task task;
+    };
+    
+    struct JobOrder {
+        bool operator()(const Job& a, const Job& b) const;
+    };
+    
+    using JobQueue = std::priority_queue<Job, std::vector<Job>, JobOrder>;
+    
+    // 把有名额的任务交给线程池（调用方持有锁，返回需要提交的任务）
+    std::vector<std::pair<Lane, Task>> take_runnable();
+    
+    // 任务执行完毕，归还名额并继续调度
+    void finish(Lane lane);
+    
+    // 提交到线程池
+    void dispatch(std::vector<std::pair<Lane, Task>> runnable);
+    
+    // 大文件通道的并发名额（调用方持有锁）
+    size_t large_slots() const;
+    
+    TaskExecutor& executor_;
+    
+    mutable std::mutex mutex_;
+    std::condition_variable space_cv_;
+    JobQueue small_queue_;
+    JobQueue large_queue_;
+    size_t small_running_ = 0;
+    size_t large_running_ = 0;
+    size_t thread_count_ = 1;
+    uint64_t next_sequence_ = 0;
+    std::atomic<int64_t> large_threshold_{16 * 1024 * 1024};
+    bool running_ = false;
+};
+
+} // namespace tg_forwarder
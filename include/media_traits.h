@@ -0,0 +1,70 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include "utils.h"
+
+namespace tg_forwarder {
+
+// 消息类型过滤掩码：每种内容类型占一位，可用 | 组合
+using ContentFilterMask = std::uint32_t;
+
+// 表中没有的内容类型（投票、位置等）共用的过滤位，只有"all"包含它
+constexpr ContentFilterMask kOtherContentFilter = 1u << 31;
+
+// 所有类型，包括表中没有的
+constexpr ContentFilterMask kAllContentFilters = ~ContentFilterMask{0};
+
+// 一种消息内容类型的特性和处理函数
+//
+// 表在编译期按 td_api::messageXxx 逐个生成，按TDLib构造器ID查找。分类、取文件、
+// 取说明文字和构造发送内容都经过这张表，新增类型只需在表中加一项。
+struct ContentTraits {
+    using InputContent = td_api::object_ptr<td_api::InputMessageContent>;
+    using InputFile = td_api::object_ptr<td_api::InputFile>;
+    using Caption = td_api::object_ptr<td_api::formattedText>;
+    
+    Int32 constructor_id;               // TDLib 内容构造器ID（messageXxx::ID）
+    const char* name;                   // 过滤器和日志中使用的名称
+    MediaType media_type;               // 文本为 MediaType::Unknown
+    ContentFilterMask filter_bit;       // 该类型的过滤位
+    bool album_capable;                 // 可以放进 sendMessageAlbum 的媒体组
+    const char* default_extension;      // 无法从文件名或MIME类型判断时使用的扩展名
+    
+    // 主媒体文件（照片取最大尺寸），不含文件时返回 nullptr
+    const td_api::file* (*main_file)(const td_api::MessageContent& content);
+    
+    // 追加消息引用的所有文件ID（含缩略图）
+    void (*file_ids)(const td_api::MessageContent& content, std::vector<Int32>& ids);
+    
+    // 说明文字（文本消息为正文），没有时返回 nullptr
+    const td_api::formattedText* (*caption)(const td_api::MessageContent& content);
+    
+    // 媒体组ID，不支持媒体组的类型返回 nullptr
+    const std::string* (*media_album_id)(const td_api::MessageContent& content);
+    
+    // 文件扩展名（含点号）
+    std::string (*extension)(const td_api::MessageContent& content);
+    
+    // 用上传的文件和说明文字构造发送内容，保留源消息的时长、尺寸等属性；文本消息抛出 MediaError
+    InputContent (*make_input)(const td_api::MessageContent& content, InputFile file, Caption caption);
+};
+
+// 按构造器ID查找内容类型，表中没有时返回 nullptr
+const ContentTraits* find_content_traits(Int32 constructor_id);
+
+// 查找消息内容的类型
+const ContentTraits* find_content_traits(const Message& message);
+
+// 按媒体类型查找
+const ContentTraits* find_content_traits(MediaType type);
+
+// 按过滤器名称查找（text / photo / video / document / audio / animation / sticker / voice_note / video_note）
+const ContentTraits* find_content_traits(std::string_view name);
+
+// 消息内容对应的过滤位，表中没有的类型返回 kOtherContentFilter
+ContentFilterMask content_filter_bit(const Message& message);
+
+} // namespace tg_forwarder
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <memory>
+#include <atomic>
+#include <cstdint>
+#include "async.h"
+
+namespace tg_forwarder {
+
+// 进程内媒体数据的字节预算
+//
+// 下载前按文件大小申请额度，额度不足时申请在队列中按先后顺序等待，已占用的额度释放后依次放行。
+// 单个申请超过整个预算时，只在没有其他占用时放行，保证大文件最终能被处理而不会超出太多。
+// 等待通过 Future 完成，不占用线程。
+class MemoryBudget {
+public:
+    // 已获得的额度，析构时自动归还
+    class Reservation {
+    public:
+        Reservation() = default;
+        ~Reservation();
+        
+        Reservation(Reservation&& other) noexcept;
+        Reservation& operator=(Reservation&& other) noexcept;
+        Reservation(const Reservation&) = delete;
+        Reservation& operator=(const Reservation&) = delete;
+        
+        // 占用的字节数
+        std::int64_t bytes() const;
+        
+        // 提前归还额度
+        void release();
+    
+    private:
+        friend class MemoryBudget;
+        
+        Reservation(MemoryBudget* budget, std::int64_t bytes);
+        
+        MemoryBudget* budget_ = nullptr;
+        std::int64_t bytes_ = 0;
+    };
+    
+    // limit 为预算字节数，0 表示不限制（仍然统计占用量）
+    explicit MemoryBudget(std::int64_t limit = 0);
+    
+    // 禁止复制和移动
+    MemoryBudget(const MemoryBudget&) = delete;
+    MemoryBudget& operator=(const MemoryBudget&) = delete;
+    
+    // 设置/获取预算（放宽预算会立即放行等待中的申请）
+    void set_limit(std::int64_t limit);
+    std::int64_t limit() const;
+    
+    // 申请 bytes 字节的额度，额度足够时返回已就绪的 Future
+    Future<Reservation> acquire(std::int64_t bytes);
+    
+    // 当前占用的字节数
+    std::int64_t in_use() const;
+    
+    // 等待中的申请数量和字节数
+    std::size_t waiting_count() const;
+    std::int64_t waiting_bytes() const;
+    
+    // 以异常结束所有等待中的申请（停止时调用）
+    void cancel_all();
+
+private:
+    struct Waiter {
+        std::int64_t bytes = 0;
+        std::shared_ptr<Promise<Reservation>> promise;
+    };
+    
+    // 归还额度并放行队首能满足的申请
+    void release(std::int64_t bytes);
+    
+    // 队首申请是否可以放行（调用方持有锁）
+    bool fits(std::int64_t bytes) const;
+    
+    // 取出可以放行的申请并记入占用（调用方持有锁）
+    std::deque<Waiter> take_admitted();
+    
+    mutable std::mutex mutex_;
+    std::int64_t limit_;
+    std::atomic<std::int64_t> in_use_{0};
+    std::int64_t waiting_bytes_ = 0;
+    std::deque<Waiter> waiters_;
+};
+
+} // namespace tg_forwarder
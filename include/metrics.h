@@ -0,0 +1,142 @@
+#pragma once
+
+#include <array>
+#include <map>
+#include <mutex>
+#include <memory>
+#include <atomic>
+#include <string>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+
+namespace tg_forwarder {
+
+// 单调递增计数器
+class Counter {
+public:
+    void add(std::uint64_t n = 1);
+    std::uint64_t value() const;
+    
+private:
+    std::atomic<std::uint64_t> value_{0};
+};
+
+// 延迟直方图
+//
+// HDR 风格的对数线性分桶：以微秒记录，每个2的幂区间再均分为8个子桶，相对误差不超过12.5%，
+// 覆盖 1 微秒 ~ 12 天。记录时只对当前线程所属分片做无锁的原子加法，读取时合并所有分片。
+class Histogram {
+public:
+    // 2的幂区间内的子桶数（2^kSubBucketBits）
+    static constexpr int kSubBucketBits = 3;
+    static constexpr int kSubBuckets = 1 << kSubBucketBits;
+    
+    // 最大记录值为 2^kMaxExponent 微秒，超出的记入最后一个桶
+    static constexpr int kMaxExponent = 40;
+    static constexpr int kBucketCount = (kMaxExponent - kSubBucketBits + 1) * kSubBuckets;
+    
+    // 合并后的快照
+    struct Snapshot {
+        std::array<std::uint64_t, kBucketCount> buckets{};
+        std::uint64_t count = 0;
+        std::uint64_t sum_us = 0;
+        
+        // 估算分位数（0~1），返回微秒
+        std::uint64_t quantile(double q) const;
+        
+        // 小于 2^exponent 微秒的记录数
+        std::uint64_t count_below_power(int exponent) const;
+    };
+    
+    Histogram();
+    
+    // 禁止复制和移动
+    Histogram(const Histogram&) = delete;
+    Histogram& operator=(const Histogram&) = delete;
+    
+    // 记录一个值
+    void record_us(std::int64_t microseconds);
+    
+    template <typename Rep, typename Period>
+    void record(std::chrono::duration<Rep, Period> duration) {
+        record_us(std::chrono::duration_cast<std::chrono::microseconds>(duration).count());
+    }
+    
+    // 合并所有分片
+    Snapshot snapshot() const;
+    
+    // 值所在的桶，以及桶的上界（不含）
+    static int bucket_index(std::uint64_t value);
+    static std::uint64_t bucket_upper_bound(int index);
+    
+private:
+    // 分片数：线程按首次记录的顺序轮流分到各分片，避免多个线程争用同一缓存行
+    static constexpr std::size_t kShardCount = 8;
+    
+    struct alignas(64) Shard {
+        std::array<std::atomic<std::uint64_t>, kBucketCount> buckets;
+        std::atomic<std::uint64_t> sum_us{0};
+    };
+    
+    std::unique_ptr<Shard[]> shards_;
+};
+
+// 指标注册表
+//
+// 计数器和直方图在首次获取时创建，之后地址不变，调用方可以保存引用；
+// 瞬时值（队列深度、进行中的请求数等）通过回调在导出时读取。
+// render_prometheus() 生成 Prometheus 文本格式，供 MetricsServer 的 /metrics 使用。
+class Metrics {
+public:
+    // 获取单例实例
+    static Metrics& instance();
+    
+    // 禁止复制和移动
+    Metrics(const Metrics&) = delete;
+    Metrics& operator=(const Metrics&) = delete;
+    Metrics(Metrics&&) = delete;
+    Metrics& operator=(Metrics&&) = delete;
+    
+    // 获取（或创建）计数器和直方图，name 为完整的指标名
+    Counter& counter(const std::string& name, const std::string& help);
+    Histogram& histogram(const std::string& name, const std::string& help);
+    
+    // 注册导出时读取的瞬时值，同名注册会替换之前的回调
+    void gauge(const std::string& name, const std::string& help, std::function<double()> read);
+    
+    // 注册由其他模块自行计数的累计值（导出为 counter 类型）
+    void counter_callback(const std::string& name, const std::string& help, std::function<double()> read);
+    
+    // 移除所有回调（回调引用的对象停止前调用）
+    void clear_callbacks();
+    
+    // 生成 Prometheus 文本格式
+    std::string render_prometheus() const;
+    
+    // 各直方图的分位数摘要，用于停止时写日志
+    std::string summary() const;
+    
+private:
+    // 私有构造函数（单例模式）
+    Metrics() = default;
+    
+    template <typename T>
+    struct Entry {
+        std::string help;
+        std::unique_ptr<T> metric;
+    };
+    
+    struct Callback {
+        std::string help;
+        std::string type;
+        std::function<double()> read;
+    };
+    
+    mutable std::mutex mutex_;
+    std::map<std::string, Entry<Counter>> counters_;
+    std::map<std::string, Entry<Histogram>> histograms_;
+    std::map<std::string, Callback> callbacks_;
+};
+
+} // namespace tg_forwarder
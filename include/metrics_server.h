@@ -0,0 +1,50 @@
+#pragma once
+
+#include <string>
+#include <thread>
+#include <atomic>
+#include <cstdint>
+
+namespace tg_forwarder {
+
+// Prometheus 指标的HTTP端点
+//
+// 单独的线程监听指定地址和端口，GET /metrics 返回 Metrics::render_prometheus() 的内容。
+// 抓取频率很低，连接逐个处理，每个连接只应答一个请求后关闭。
+class MetricsServer {
+public:
+    // 获取单例实例
+    static MetricsServer& instance();
+    
+    // 禁止复制和移动
+    MetricsServer(const MetricsServer&) = delete;
+    MetricsServer& operator=(const MetricsServer&) = delete;
+    MetricsServer(MetricsServer&&) = delete;
+    MetricsServer& operator=(MetricsServer&&) = delete;
+    
+    // 开始监听，端口被占用等失败时返回 false
+    bool start(const std::string& bind_address, std::uint16_t port);
+    
+    // 停止监听
+    void stop();
+    
+    // 是否正在监听
+    bool is_running() const;
+    
+private:
+    // 私有构造函数（单例模式）
+    MetricsServer() = default;
+    ~MetricsServer();
+    
+    // 监听线程
+    void serve();
+    
+    // 处理单个连接
+    void handle_connection(int fd);
+    
+    int listen_fd_ = -1;
+    std::thread thread_;
+    std::atomic<bool> running_{false};
+};
+
+} // namespace tg_forwarder
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <map>
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <string>
+#include <optional>
+#include <functional>
+#include <unordered_map>
+#include "utils.h"
+
+namespace tg_forwarder {
+
+// 可重建的请求：被限流拒绝后由限流器重新生成并排队重发
+using QueryFactory = std::function<Function()>;
+
+// 在后台线程上以指定账号执行任务，无法接收任务时返回 false
+using BackgroundExecutor = std::function<bool(std::size_t account, std::function<void()> task)>;
+
+// 发送请求的令牌桶限流器
+//
+// 每个（账号, 目标聊天）一个令牌桶，发往同一聊天的各种发送请求（文本、媒体、媒体组、重发）共用一个桶，
+// 桶内按提交顺序发出，后提交的相册不会越过仍在排队的文本。令牌不足时请求在桶内排队，由接收循环在令牌恢复后发出。
+// 每个桶同一时间只有一个请求在途，收到响应后才发出下一个，因此被限流退回重发的请求不会被后面的请求越过。
+// 收到 FLOOD_WAIT / 429 时只暂停对应的桶并把速率减半，之后每次成功再逐步恢复到配置的速率
+//（加性增、乘性减），使持续吞吐停在服务器限制之下，而不是在突发和封禁之间来回。
+class RateLimiter {
+public:
+    using Clock = std::chrono::steady_clock;
+    
+    // 令牌桶标识
+    struct Key {
+        std::size_t account = 0;
+        Int64 chat_id = 0;
+        
+        bool operator<(const Key& other) const;
+    };
+    
+    // 到期可以发出的请求
+    struct Ready {
+        std::size_t account = 0;
+        std::uint64_t query_id = 0;
+        Function query;
+    };
+    
+    // 重建失败、需要把限流错误交还调用方的请求
+    struct Failed {
+        std::size_t account = 0;
+        std::uint64_t query_id = 0;
+        std::int32_t code = 0;
+        std::string message;
+    };
+    
+    RateLimiter() = default;
+    
+    // 禁止复制和移动
+    RateLimiter(const RateLimiter&) = delete;
+    RateLimiter& operator=(const RateLimiter&) = delete;
+    
+    // 设置每个桶的速率（每秒请求数）和突发容量，速率为0表示不限流
+    void configure(double rate_per_second, double burst);
+    
+    // 是否启用
+    bool enabled() const;
+    
+    // 设置重建被限流请求所用的后台执行器，为空时在调用 on_response 的线程上重建
+    void set_executor(BackgroundExecutor executor);
+    
+    // 需要限流的发送类请求返回其令牌桶标识，其余请求返回空
+    static std::optional<Key> classify(std::size_t account, const Function& query);
+    
+    // 提交请求：令牌足够且桶内无排队时返回 true，由调用方立即发送；
+    // 否则请求被移入桶内排队（query 置空），返回 false
+    bool admit(const Key& key, std::uint64_t query_id, Function& query, QueryFactory factory, Clock::time_point now);
+    
+    // 直接把请求放入桶内排队（如限流后的重发）
+    void enqueue(const Key& key, std::uint64_t query_id, Function query, Clock::time_point now);
+    
+    // 请求返回：遇到限流且已重新排队时返回 true，调用方不再分发该响应
+    // 重建在后台执行器上进行，完成前该请求在桶的队首占位，桶内后续请求不会越过它
+    bool on_response(std::uint64_t query_id, const Object& response, Clock::time_point now);
+    
+    // 暂停某个聊天的桶（如 updateMessageSendFailed 中的限流错误）
+    void pause_chat(std::size_t account, Int64 chat_id, int retry_after, Clock::time_point now);
+    
+    // 取出所有已到期的排队请求，并定期回收长时间空闲的桶
+    std::vector<Ready> take_due(Clock::time_point now);
+    
+    // 取出重建失败的请求
+    std::vector<Failed> take_failed();
+    
+    // 最早的排队请求可以发出的时间，没有排队请求时返回空
+    std::optional<Clock::time_point> next_deadline(Clock::time_point now) const;
+    
+    // 排队中的请求数量和处于暂停状态的桶数量
+    std::size_t queued_count() const;
+    std::size_t paused_count(Clock::time_point now) const;
+    
+    // 清空所有桶和记录
+    void clear();
+
+private:
+    // 排队中的请求
+    struct Pending {
+        std::uint64_t query_id = 0;
+        Function query;
+        QueryFactory factory;
+        int attempts = 0;
+        bool rebuilding = false;            // 正在后台重建，完成前不能发出
+    };
+    
+    // 已发出、等待响应的请求
+    struct InFlight {
+        Key key;
+        QueryFactory factory;
+        int attempts = 0;
+    };
+    
+    struct Bucket {
+        double tokens = 0;
+        double rate = 0;                    // 当前速率，限流后降低
+        Clock::time_point updated;
+        Clock::time_point paused_until;
+        std::deque<Pending> queue;
+        bool in_flight = false;             // 已发出一个请求，尚未收到响应
+    };
+    
+    // 获取或创建令牌桶
+    Bucket& bucket(const Key& key, Clock::time_point now);
+    
+    // 按经过的时间补充令牌（暂停期间不补充）
+    void refill(Bucket& bucket, Clock::time_point now) const;
+    
+    // 暂停令牌桶并降低速率
+    void pause(Bucket& bucket, int retry_after, Clock::time_point now);
+    
+    // 重建被限流的请求并填入桶内的占位，失败时记录到 failed_
+    void rebuild(const Key& key, std::uint64_t query_id, QueryFactory factory, std::int32_t code,
+                 const std::string& message);
+    
+    // 回收没有排队请求、暂停已结束且长时间未使用的桶（调用方持有锁）
+    void prune(Clock::time_point now);
+    
+    // 同一请求因限流最多重发的次数
+    static constexpr int kMaxFloodRetries = 5;
+    
+    // 每次成功后速率恢复的步长，以及限流后速率的下限（均为配置速率的比例）
+    static constexpr double kRecoveryStep = 0.05;
+    static constexpr double kMinRateFactor = 1.0 / 16;
+    
+    // 空闲桶的回收间隔和空闲时长
+    static constexpr std::chrono::seconds kPruneInterval{60};
+    static constexpr std::chrono::seconds kIdleTimeout{300};
+    
+    mutable std::mutex mutex_;
+    double rate_ = 0;
+    double burst_ = 1;
+    std::map<Key, Bucket> buckets_;
+    std::unordered_map<std::uint64_t, InFlight> in_flight_;
+    std::vector<Failed> failed_;
+    BackgroundExecutor executor_;
+    Clock::time_point last_prune_{};
+};
+
+} // namespace tg_forwarder
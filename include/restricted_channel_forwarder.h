@@ -3,16 +3,72 @@
 #include <string>
 #include <vector>
 #include <map>
-#include <set>
+#include <unordered_map>
+#include <memory>
+#include <deque>
 #include <mutex>
 #include <atomic>
+#include <thread>
 #include <condition_variable>
-#include <future>
 #include "utils.h"
+#include "async.h"
 #include "media_handler.h"
+#include "album_assembler.h"
+#include "forward_checkpoint.h"
+#include "media_traits.h"
 
 namespace tg_forwarder {
 
+// 转发器工作模式
+enum class ForwarderMode {
+    Continuous, // 连续模式：持续监听新消息
+    OneTime     // 一次性模式：转发完当前新消息后退出
+};
+
+// 转发路由：一个源频道转发到一个或多个目标频道
+struct ForwardRoute {
+    std::string source;
+    std::vector<std::string> targets;
+    std::string account;                // 负责该路由的账号名称，留空则自动分配
+};
+
+// 转发器配置
+struct ForwarderConfig {
+    ForwarderMode mode = ForwarderMode::Continuous;
+    std::string source_channel;
+    std::string target_channel;
+    std::vector<ForwardRoute> routes;   // 多源多目标路由表，为空时使用 source_channel → target_channel
+    int wait_time_ms = 1000;
+    int album_quiet_period_ms = 800;    // 媒体组最后一条消息到达后等待多久视为完整
+    int max_history_messages = 100;
+    int max_concurrent_downloads = 2;
+    int max_concurrent_uploads = 2;
+    int pipeline_depth = 8;             // 同时处于下载阶段的消息（或媒体组）数量上限
+    int media_queue_capacity = 256;     // 媒体任务排队上限，超过时阻塞提交方
+    int large_file_threshold_mb = 16;   // 不小于该大小（MB）的文件走大文件通道，最多占用一半媒体线程，0 表示不分通道
+    int retry_count = 3;                // 下载、上传失败（网络错误、限流）后的最多重试次数
+    int retry_delay = 5;                // 首次重试前的等待秒数，之后按指数退避增长
+    bool push_updates = true;   // 通过 updateNewMessage 推送获取新消息，轮询仅用于重连后补漏
+    int update_handler_threads = 2;     // 更新处理线程数，接收线程只分发更新，处理器在这些线程上按聊天分片执行
+    std::string media_input_mode = "local"; // 上传输入方式："local" 引用TDLib本地文件，"memory" 读入内存
+    int memory_budget_mb = 512;         // 内存模式下同时读入内存的媒体数据上限（MB），超过时下载排队，0 表示不限制
+    int memory_spill_threshold_mb = 64; // 内存模式下不小于该大小（MB）的文件留在磁盘上不读入内存，0 表示全部读入
+    int buffer_pool_mb = 128;           // 缓冲区池最多保留的空闲内存（MB），0 表示不保留
+    std::string file_id_cache = "tdlib-db/file_id_cache.tsv"; // 远程文件ID复用缓存，留空则禁用
+    std::string channel_cache = "tdlib-db/channel_cache.tsv"; // 频道解析结果缓存，留空则只在内存中缓存
+    int channel_cache_ttl_hours = 168;      // 频道解析结果的有效期（小时）
+    int channel_negative_ttl_minutes = 10;  // 用户名不存在等解析失败结果的有效期（分钟），0 表示不缓存失败
+    int streaming_threshold_mb = 20; // 不小于该大小（MB）的文件边下载边上传，0 表示禁用
+    std::string checkpoint_file = "tdlib-db/forward_checkpoint.log"; // 转发进度检查点（每个源频道追加 .<频道ID>），留空则每次从最新消息开始
+    int dedup_window = 1024;            // 检查点中保留的已转发消息/媒体组ID数量
+    int send_rate_per_minute = 20;      // 每个目标频道每种发送请求每分钟的数量上限，0 表示不限流
+    int send_burst = 5;                 // 发送限流的突发容量
+    int metrics_port = 9464;            // Prometheus 指标端点端口（GET /metrics），0 表示禁用
+    std::string metrics_bind = "127.0.0.1"; // 指标端点监听地址
+    bool watch_config = false;          // 配置文件修改后自动重新加载（也可发送 SIGHUP）
+    std::vector<std::string> message_filters;   // 转发的消息类型：text / photo / video / document / audio / animation / sticker / voice_note / video_note / all
+};
+
 class RestrictedChannelForwarder {
 public:
     // 获取单例实例
@@ -25,99 +81,279 @@ public:
     RestrictedChannelForwarder& operator=(RestrictedChannelForwarder&&) = delete;
     
     // 初始化转发器
-    std::future<void> initialize();
+    void init(const ForwarderConfig& config);
     
-    // 启动监听
-    std::future<void> start();
+    // 按路由表启动转发（同一源频道的多条路由会合并）
+    bool start(const std::vector<ForwardRoute>& routes);
     
-    // 停止监听
+    // 启动单一源频道到单一目标频道的转发
+    bool start(const std::string& source_channel, const std::string& target_channel);
+    
+    // 停止转发
     void stop();
     
+    // 运行中重新加载配置：并发、限流等参数立即生效，过滤器和路由表由转发线程在两轮处理之间整体替换。
+    // 已在转发的源频道保留流水线和检查点，新增的源频道完成权限检查后加入，移除的源频道转发完已在流水线中的项后停止。
+    // 新路由无法解析或没有权限时返回 false 并保留当前配置
+    bool reload(const ForwarderConfig& config, const std::vector<ForwardRoute>& routes);
+    
     // 是否正在运行
     bool is_running() const;
     
-    // 获取源频道ID
-    Int64 source_channel_id() const;
+    // 获取已转发的消息数量
+    int get_forwarded_count() const;
     
-    // 获取目标频道ID
-    Int64 target_channel_id() const;
+    // 获取转发失败的消息数量
+    int get_failed_count() const;
+
+private:
+    // 下载阶段的结果，由下载完成回调写入（受 incoming_mutex_ 保护）
+    struct DownloadResult {
+        bool done = false;
+        std::shared_ptr<MediaTask> task;
+        std::shared_ptr<MediaGroupTask> group_task;
+    };
     
-    // 获取已处理的消息数量
-    int processed_message_count() const;
+    // 发往一个目标的发送阶段（started 和 text 仅转发线程访问，done 和 success 由发送完成回调写入，受 incoming_mutex_ 保护）
+    struct SendResult {
+        Int64 target_chat_id = 0;
+        bool started = false;
+        bool text = false;                      // 文本请求发出后即排在同一聊天的后续请求之前，不必等响应
+        bool done = false;
+        bool success = false;
+    };
     
-    // 获取已处理的媒体组数量
-    int processed_media_group_count() const;
+    // 转发流水线中的一项：单条消息或一个媒体组，按源消息ID顺序提交
+    struct PipelineSlot {
+        Int64 first_message_id = 0;
+        Int64 last_message_id = 0;
+        SharedMessage message;                  // 单条消息，与下载任务和发送请求共用
+        std::string media_group_id;             // 非空表示媒体组
+        SharedMessageVector album;              // 媒体组消息，凑齐后填入
+        bool album_ready = false;
+        bool skip = false;                      // 被过滤或已处理，提交时只推进 last_message_id
+        bool started = false;                   // 已开始下载（或无需下载）
+        std::shared_ptr<DownloadResult> download; // 为空表示无需下载
+        bool sending = false;                   // 已进入发送阶段
+        bool take_text = false;                 // 文本请求不会被重建，最后发出的目标直接取走正文
+        std::vector<std::shared_ptr<SendResult>> sends; // 发往各目标的结果，进入发送阶段时按当时的目标创建
+    };
+    
+    // 一个源频道的转发状态：各目标共用同一次下载，按源消息顺序依次发往每个目标
+    struct SourceRoute {
+        std::string source_channel;
+        Int64 source_chat_id = 0;
+        std::vector<std::string> target_channels;
+        std::vector<Int64> target_chat_ids;
+        
+        // 负责该源频道的账号：拉取、下载和上传都通过它进行
+        std::size_t account = 0;
+        
+        // 最新已处理的消息ID（只越过连续提交完成的消息）
+        Int64 last_message_id = 0;
+        
+        // 已进入流水线的最大消息ID
+        Int64 last_enqueued_id = 0;
+        
+        // 补漏翻页位置：历史记录返回过的最大消息ID，推送的消息不推进它
+        Int64 catch_up_cursor = 0;
+        
+        // 推送的新消息和补漏标记（受 incoming_mutex_ 保护）；补漏翻页期间推送的消息留在 incoming 中，
+        // 取空积压后再放入流水线，否则它们会越过尚未取到的历史消息
+        MessageVector incoming;
+        bool catch_up_pending = false;
+        
+        // 以下仅转发线程访问
+        MessageVector batch;                    // 本轮收集到的新消息
+        std::deque<PipelineSlot> pipeline;      // 转发流水线
+        AlbumAssembler album_assembler;         // 媒体组收集缓冲
+        ForwardCheckpoint checkpoint;           // 转发进度检查点和去重窗口
+        std::chrono::steady_clock::time_point next_poll_time;
+        
+        // 已从路由表移除，流水线排空后关闭（受 incoming_mutex_ 保护）
+        bool retiring = false;
+    };
+    
+    // 源频道列表，以及接收线程按源频道ID查找用的路由表快照
+    using RouteList = std::vector<std::shared_ptr<SourceRoute>>;
+    using RouteTable = std::unordered_map<Int64, std::shared_ptr<SourceRoute>>;
+    
+    // 重新加载后某个源频道的目标
+    struct RouteUpdate {
+        std::shared_ptr<SourceRoute> route;     // 已在转发的源频道为运行中的对象，新增的为已打开的新对象
+        std::vector<std::string> target_channels;
+        std::vector<Int64> target_chat_ids;
+    };
+    
+    // 等待转发线程生效的重新加载内容（受 incoming_mutex_ 保护）
+    struct PendingReload {
+        int wait_time_ms = 1000;
+        int pipeline_depth = 8;
+        int max_history_messages = 100;
+        int album_quiet_period_ms = 800;
+        ContentFilterMask filter_mask = kAllContentFilters;
+        std::vector<RouteUpdate> routes;        // 新路由表的顺序
+    };
     
-private:
     // 私有构造函数（单例模式）
     RestrictedChannelForwarder();
     
     // 析构函数
     ~RestrictedChannelForwarder();
     
-    // 处理新消息
-    void process_message(const Message& message);
+    // 转发线程函数
+    void forward_worker();
+    
+    // 应用可在运行中调整的媒体处理器和限流参数
+    void apply_settings(const ForwarderConfig& config);
+    
+    // 在转发线程上应用等待中的重新加载（设置、过滤器和路由表一次性替换）
+    void apply_pending_reload();
     
-    // 处理单条消息
-    void handle_single_message(const Message& message);
+    // 关闭已移除且流水线已排空的源频道
+    void remove_retired_routes();
     
-    // 处理媒体组消息
-    void handle_media_group_message(const Message& message);
+    // 按当前源频道列表发布新的路由表快照（调用方持有 incoming_mutex_，或转发线程尚未启动）
+    void publish_route_table();
     
-    // 处理普通文本消息
-    void handle_text_message(const Message& message);
+    // 当前路由表快照
+    std::shared_ptr<const RouteTable> route_table() const;
+    
+    // 源频道的检查点文件路径，未配置检查点时为空
+    std::string checkpoint_path(Int64 source_chat_id) const;
+    
+    // 关闭启动或重新加载时打开的源频道
+    void close_source_chat(const SourceRoute& route);
+    
+    // 收集各源频道待处理的新消息（推送队列 + 必要时的历史补漏），返回消息总数
+    size_t collect_new_messages();
+    
+    // 新消息推送处理（在TDLib接收线程上调用）
+    void on_update_new_message(Object update);
     
-    // 处理媒体消息
-    void handle_media_message(const Message& message);
+    // 连接状态变化处理，重连后触发补漏
+    void on_update_connection_state(Object update);
     
-    // 转发媒体组
-    void forward_media_group(const MessageVector& media_group);
+    // 获取比 last_message_id 更新的消息
+    MessageVector get_new_messages(Int64 chat_id, Int64 last_message_id, int limit);
     
-    // 判断是否为媒体消息
-    bool is_media_message(const Message& message) const;
+    // 获取频道最新消息ID
+    Future<Int64> get_latest_message_id(Int64 chat_id);
     
-    // 获取媒体组中的所有消息
-    std::future<MessageVector> get_media_group(const Message& message);
+    // 过滤新消息并放入流水线
+    void enqueue_messages(SourceRoute& route, MessageVector messages);
     
-    // 检查消息是否已处理
-    bool is_message_processed(Int64 message_id) const;
+    // 把已凑齐的媒体组交给对应的流水线槽位（flush_all 为 true 时不再等待）
+    void assign_ready_albums(SourceRoute& route, bool flush_all);
+    
+    // 在 pipeline_depth 限制内（所有源频道共享）为尚未开始的槽位启动下载
+    void start_downloads();
+    
+    // 下载完成回调：记录结果并唤醒转发线程
+    void finish_download(const std::shared_ptr<DownloadResult>& result,
+                         std::shared_ptr<MediaTask> task,
+                         std::shared_ptr<MediaGroupTask> group_task);
+    
+    // 为已下载完成的槽位异步发往各目标：同一目标前面的媒体尚未发完时等待，保证目标频道中的顺序
+    void start_sends(SourceRoute& route);
+    
+    // 把槽位异步发往一个目标，完成时写入 send 并唤醒转发线程
+    void start_send(const PipelineSlot& slot, const std::shared_ptr<SendResult>& send);
+    
+    // 发送完成回调：记录结果并唤醒转发线程
+    void finish_send(const std::shared_ptr<SendResult>& send, bool success);
+    
+    // 按顺序提交队首所有目标都已发送完成的槽位（只负责顺序，不等待网络）
+    void commit_ready_slots(SourceRoute& route);
+    
+    // 统计单个槽位在各目标的发送结果并记入检查点
+    void commit_slot(SourceRoute& route, PipelineSlot& slot);
+    
+    // 记录一次成功投递的端到端延迟（源消息发布到目标频道发送成功）
+    void record_delivery(const Message& message);
+    
+    // 注册队列深度、进行中请求数和各模块累计值的指标回调
+    void register_metrics();
+    
+    // 查找媒体组对应的槽位
+    PipelineSlot* find_album_slot(SourceRoute& route, const std::string& media_group_id);
+    
+    // 所有源频道的流水线是否都已排空
+    bool pipelines_empty() const;
+    
+    // 检查消息类型是否符合过滤条件
+    bool should_forward_message(const Message& message);
     
     // 检查媒体组是否已处理
-    bool is_media_group_processed(const std::string& media_group_id) const;
+    bool media_group_processed(const SourceRoute& route, const std::string& media_group_id);
     
-    // 标记消息为已处理
-    void mark_message_processed(Int64 message_id);
+    // 为各源频道分配账号（指定了账号的按配置，其余分给负责源频道最少的账号，assigned 为已分配好的源频道）
+    bool assign_accounts(const RouteList& routes, const std::map<Int64, std::string>& requested_accounts,
+                         const RouteList& assigned);
     
-    // 标记媒体组为已处理
-    void mark_media_group_processed(const std::string& media_group_id);
+    // 非主账号以自己的身份解析一次所负责的频道，并确认与主账号解析的结果一致
+    bool resolve_on_accounts(const RouteList& routes);
     
-    // 限制处理过的消息和媒体组集合大小
-    void limit_processed_collections();
+    // 启动检查：解析频道、构建路由表、分配账号，再并行检查权限、确定起始位置并打开源频道
+    bool prepare_routes(const std::vector<ForwardRoute>& routes);
     
-    // 更新处理函数（注册给ClientManager）
-    void on_update_new_message(Object update);
+    // 解析路由表中的频道并按源频道合并，返回各源频道指定的账号
+    bool build_routes(const std::vector<ForwardRoute>& routes, RouteList& built,
+                      std::map<Int64, std::string>& requested_accounts);
+    
+    // 并行检查 routes 中所有目标的发消息权限，并为 opening 中的源频道打开检查点、确定起始位置和打开频道
+    bool open_routes(const RouteList& routes, const RouteList& opening);
+    
+    // 检查当前账号在目标频道中是否有发消息权限
+    Future<bool> check_send_message_permission(Int64 chat_id);
+    
+    // 发出文本消息请求，不等待响应：take 为 true 时取走源消息的正文和格式实体，否则复制一份；
+    // rebuildable 为 true 时被限流拒绝后由限流器重新复制正文构造请求
+    Future<Object> send_text_message(Int64 target_chat_id, const SharedMessage& message, bool rebuildable, bool take);
     
-    // 处理异常（如限流等）
-    void handle_exception(const std::exception& e, const std::string& context);
+    // 检查文本消息请求的响应，失败时记录日志并返回 false
+    bool text_message_sent(Object response);
     
-    // 成员变量
-    std::atomic<bool> running_{false};
-    std::atomic<bool> initialized_{false};
+    // 运行状态
+    std::atomic<bool> running_;
+    std::atomic<bool> stopping_;
     
-    Int64 source_channel_id_{0};
-    Int64 target_channel_id_{0};
+    // 配置
+    ForwarderConfig config_;
+    ContentFilterMask message_filter_mask_ = kAllContentFilters;   // 允许转发的内容类型
+    int wait_time_ms_;
     
-    // 已处理的消息ID集合
-    mutable std::mutex processed_messages_mutex_;
-    std::set<Int64> processed_messages_;
+    // 源频道列表：只在转发线程上（持有 incoming_mutex_ 时）修改
+    RouteList routes_;
     
-    // 已处理的媒体组ID集合
-    mutable std::mutex processed_media_groups_mutex_;
-    std::set<std::string> processed_media_groups_;
+    // 接收线程按源频道ID查找的路由表快照，重新加载时整体替换（RCU），读取方不加锁
+    std::shared_ptr<const RouteTable> route_table_ = std::make_shared<const RouteTable>();
+    
+    // 等待生效的重新加载，以及正在排空的已移除源频道数（受 incoming_mutex_ 保护）
+    std::unique_ptr<PendingReload> pending_reload_;
+    size_t retiring_route_count_ = 0;
+    
+    // 转发线程
+    std::thread forward_thread_;
+    
+    // 新消息、补漏和下载完成的通知
+    std::mutex incoming_mutex_;
+    std::condition_variable incoming_cv_;
+    bool incoming_pending_ = false;
+    bool pipeline_progress_ = false;
+    std::vector<bool> connection_ready_;    // 各账号的连接状态
+    
+    // 一次性模式下已取到消息，停止拉取并排空流水线（仅转发线程访问）
+    bool draining_ = false;
     
     // 统计信息
-    std::atomic<int> processed_message_count_{0};
-    std::atomic<int> processed_media_group_count_{0};
+    std::atomic<int> forwarded_count_;
+    std::atomic<int> failed_count_;
+    
+    // 启动耗时和首条消息转发距启动的时间（毫秒，0 表示尚未转发）
+    std::chrono::steady_clock::time_point started_at_;
+    std::atomic<std::int64_t> startup_ms_{0};
+    std::atomic<std::int64_t> first_forward_ms_{0};
 };
 
-} // namespace tg_forwarder 
\ No newline at end of file
+} // namespace tg_forwarder
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <exception>
+
+namespace tg_forwarder {
+
+// 失败重试策略：指数退避加随机抖动
+//
+// 第 n 次重试等待 base_delay * 2^(n-1)（不超过 max_delay），实际等待在其一半到全部之间随机取值，
+// 避免同时失败的任务在同一时刻一起重试；服务器要求等待更久（FLOOD_WAIT）时以服务器为准。
+// 只有网络错误（NetworkError：连接、超时、限流、服务器内部错误）才会重试，其余错误视为永久失败。
+class RetryPolicy {
+public:
+    explicit RetryPolicy(int max_retries = 3,
+                         std::chrono::milliseconds base_delay = std::chrono::seconds(5),
+                         std::chrono::milliseconds max_delay = std::chrono::minutes(5));
+    
+    // 最多重试次数（不含首次执行）
+    int max_retries() const;
+    
+    // 第 attempt 次重试（从1开始）前的等待时间，retry_after 为服务器要求的最少等待秒数
+    std::chrono::milliseconds delay_for(int attempt, int retry_after = 0) const;
+    
+    // 判断错误是否可以重试，并取出服务器要求的等待秒数
+    static bool is_retryable(const std::exception_ptr& error, int& retry_after);
+    
+    // 取出异常的说明文字
+    static std::string describe(const std::exception_ptr& error);
+
+private:
+    int max_retries_;
+    std::chrono::milliseconds base_delay_;
+    std::chrono::milliseconds max_delay_;
+};
+
+} // namespace tg_forwarder
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <string>
+#include <map>
+#include <memory>
+#include <fstream>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include "utils.h"
+
+namespace tg_forwarder {
+
+// 边下载边上传的流式传输
+//
+// 源文件以异步方式下载（downloadFile synchronous_ = false），上传端使用 inputFileGenerated。
+// TDLib 发出 updateFileGenerationStart 后，把已下载的前缀不断追加到生成文件中，
+// 并通过 setFileGenerationProgress 告知上传端可用长度，下载完成后 finishFileGeneration。
+// 这样单个文件的耗时接近 max(下载, 上传)，而不是二者之和。
+class StreamingTransfer {
+public:
+    StreamingTransfer() = default;
+    ~StreamingTransfer();
+    
+    // 禁止复制和移动
+    StreamingTransfer(const StreamingTransfer&) = delete;
+    StreamingTransfer& operator=(const StreamingTransfer&) = delete;
+    
+    // 启动/停止搬运线程
+    void start();
+    void stop();
+    
+    // 开始流式传输：发起源文件下载，返回 inputFileGenerated 使用的 conversion 字符串
+    std::string begin(Int32 source_file_id, int64_t expected_size, int priority);
+    
+    // 是否为本模块生成的 conversion
+    static bool is_stream_conversion(const std::string& conversion);
+    
+    // TDLib更新处理（在接收线程上调用，只更新状态并唤醒搬运线程）
+    void on_update_file(const td_api::updateFile& update);
+    void on_generation_start(const td_api::updateFileGenerationStart& update);
+    void on_generation_stop(const td_api::updateFileGenerationStop& update);
+    
+    // 当前进行中的流式传输数量
+    size_t active_count() const;
+
+private:
+    struct Stream {
+        Int32 source_file_id = 0;
+        std::string source_path;
+        int64_t expected_size = 0;
+        int64_t downloaded_prefix = 0;
+        bool download_completed = false;
+        bool download_failed = false;
+        
+        int64_t generation_id = 0;
+        std::string destination_path;
+        int64_t written = 0;
+        
+        std::unique_ptr<std::ifstream> source;
+        std::unique_ptr<std::ofstream> destination;
+    };
+    
+    // 搬运线程函数
+    void pump_worker();
+    
+    // 把新下载的数据追加到生成文件，返回流是否已结束（调用方不持有锁）
+    bool pump(Stream& stream);
+    
+    // 结束文件生成
+    void finish(Stream& stream, const std::string& error);
+    
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    std::map<Int32, std::shared_ptr<Stream>> streams_;   // 源文件ID -> 流
+    std::map<Int32, bool> dirty_;                         // 有新进展待搬运的流
+    
+    std::atomic<bool> running_{false};
+    std::thread worker_;
+};
+
+} // namespace tg_forwarder
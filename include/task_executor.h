@@ -0,0 +1,122 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include "timer_wheel.h"
+
+namespace tg_forwarder {
+
+// 有界工作窃取线程池
+//
+// 每个工作线程有自己的任务队列，空闲时从其他线程的队列尾部窃取任务，
+// 因此下载和上传任务共用同一组线程，不会出现一边排队一边空闲的情况。
+// 排队任务总数受 capacity 限制：外部线程提交时若已满则阻塞等待（背压），
+// 工作线程内部提交的后续任务不受限制，避免线程池自锁。
+// 线程数可在运行时通过 resize() 调整。
+// submit_after() 把延迟任务放入时间轮，到期后再进入队列（如失败重试），等待期间不占用工作线程。
+class TaskExecutor {
+public:
+    using Task = std::function<void()>;
+    
+    explicit TaskExecutor(std::string name, size_t capacity = 256);
+    ~TaskExecutor();
+    
+    // 禁止复制和移动
+    TaskExecutor(const TaskExecutor&) = delete;
+    TaskExecutor& operator=(const TaskExecutor&) = delete;
+    
+    // 启动指定数量的工作线程
+    void start(size_t thread_count);
+    
+    // 停止：执行完已排队的任务后退出所有线程
+    void stop();
+    
+    // 调整工作线程数量（运行中生效）
+    void resize(size_t thread_count);
+    
+    // 提交任务，队列已满时阻塞；执行器已停止时返回 false
+    bool submit(Task task);
+    
+    // 尝试提交任务，队列已满或已停止时立即返回 false
+    bool try_submit(Task task);
+    
+    // 在 delay 之后提交任务（不受容量限制，提交时已经占用过一次容量）；执行器已停止时返回 false
+    bool submit_after(std::chrono::milliseconds delay, Task task);
+    
+    // 等待到期的延迟任务数
+    size_t scheduled_count() const;
+    
+    // 设置/获取排队任务上限
+    void set_capacity(size_t capacity);
+    size_t capacity() const;
+    
+    // 当前排队任务数
+    size_t queued_count() const;
+    
+    // 当前工作线程数
+    size_t thread_count() const;
+    
+    // 是否正在运行
+    bool is_running() const;
+    
+    // 当前线程是否为本执行器的工作线程
+    bool in_worker_thread() const;
+
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Task> queue;
+        std::thread thread;
+        std::atomic<bool> retiring{false};
+        std::atomic<bool> exited{false};
+    };
+    
+    // 工作线程函数
+    void worker_loop(Worker* self);
+    
+    // 把任务放入某个工作线程的队列
+    void enqueue(Task task);
+    
+    // 从自己的队列取任务，取不到则窃取
+    bool take_task(Worker* self, Task& task);
+    
+    // 运行中的工作线程队列里是否有任务（空闲线程据此等待）
+    bool has_reachable_task() const;
+    
+    // 回收已退出的线程
+    void join_retired();
+    
+    std::string name_;
+    
+    // 工作线程列表（resize 时独占，提交和窃取时共享）
+    mutable std::shared_mutex workers_mutex_;
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::vector<std::unique_ptr<Worker>> retired_;
+    std::atomic<size_t> next_worker_{0};
+    
+    // 空闲等待
+    std::mutex idle_mutex_;
+    std::condition_variable idle_cv_;
+    
+    // 背压
+    std::mutex space_mutex_;
+    std::condition_variable space_cv_;
+    std::atomic<size_t> capacity_;
+    std::atomic<size_t> queued_{0};
+    
+    // 延迟任务
+    TimerWheel timers_;
+    
+    std::atomic<bool> running_{false};
+};
+
+} // namespace tg_forwarder
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include "utils.h"
+
+namespace tg_forwarder {
+
+// 从TDLib收到的一个响应或更新
+struct TdResponse {
+    std::int32_t client_id = 0;
+    std::uint64_t request_id = 0;   // 0 表示更新
+    Object object;                  // 等待超时时为空
+};
+
+// TDLib 客户端后端
+//
+// ClientManager 只通过该接口创建客户端、收发请求。默认实现直接调用 td::ClientManager；
+// 基准测试（bench/）用模拟实现替换，无需真实账号即可驱动完整的转发流程。
+class TdBackend {
+public:
+    virtual ~TdBackend() = default;
+    
+    // 创建客户端实例，返回客户端ID
+    virtual std::int32_t create_client() = 0;
+    
+    // 销毁客户端实例
+    virtual void destroy_client(std::int32_t client_id) = 0;
+    
+    // 发送请求，响应以相同的 request_id 从 receive 返回
+    virtual void send(std::int32_t client_id, std::uint64_t request_id, Function query) = 0;
+    
+    // 等待下一个响应或更新，最多等待 timeout 秒（只在接收线程上调用）
+    virtual TdResponse receive(double timeout) = 0;
+    
+    // 同步执行不需要客户端的请求（如设置日志级别）
+    virtual Object execute(Function query) = 0;
+};
+
+// 基于 TDLib 的默认后端
+class TdlibBackend : public TdBackend {
+public:
+    std::int32_t create_client() override;
+    void destroy_client(std::int32_t client_id) override;
+    void send(std::int32_t client_id, std::uint64_t request_id, Function query) override;
+    TdResponse receive(double timeout) override;
+    Object execute(Function query) override;
+};
+
+} // namespace tg_forwarder
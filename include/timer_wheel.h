@@ -0,0 +1,72 @@
+#pragma once
+
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <condition_variable>
+
+namespace tg_forwarder {
+
+// 哈希时间轮
+//
+// 定时任务按到期的格数放入环形槽位，超过一圈的记录剩余圈数。
+// 后台线程每过一格只检查当前槽位，到期任务交给 dispatch 回调（通常是放入线程池），
+// 因此大量等待重试的任务不占用任何工作线程。没有定时任务时线程空闲等待，不按格唤醒。
+class TimerWheel {
+public:
+    using Task = std::function<void()>;
+    using Clock = std::chrono::steady_clock;
+    
+    // tick 为每格时长，slot_count 为槽位数量
+    explicit TimerWheel(std::chrono::milliseconds tick = std::chrono::milliseconds(100), size_t slot_count = 512);
+    ~TimerWheel();
+    
+    // 禁止复制和移动
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+    
+    // 启动时间轮，到期任务通过 dispatch 分发（在时间轮线程上调用）
+    void start(std::function<void(Task)> dispatch);
+    
+    // 停止时间轮，返回尚未到期的任务，由调用方决定如何处理
+    std::vector<Task> stop();
+    
+    // 在 delay 之后执行任务；时间轮未运行时返回 false
+    bool schedule(std::chrono::milliseconds delay, Task task);
+    
+    // 等待中的定时任务数量
+    size_t pending_count() const;
+    
+    // 是否正在运行
+    bool is_running() const;
+
+private:
+    struct Timer {
+        size_t rounds = 0;
+        Task task;
+    };
+    
+    // 时间轮线程函数
+    void run();
+    
+    // 前进一格，取出当前槽位中到期的任务（调用方持有锁）
+    void advance(std::vector<Task>& due);
+    
+    std::chrono::milliseconds tick_;
+    std::vector<std::vector<Timer>> slots_;
+    size_t cursor_ = 0;
+    size_t pending_ = 0;
+    Clock::time_point next_tick_;
+    
+    std::function<void(Task)> dispatch_;
+    
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    std::thread thread_;
+    std::atomic<bool> running_{false};
+};
+
+} // namespace tg_forwarder
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <mutex>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <condition_variable>
+#include "utils.h"
+
+namespace tg_forwarder {
+
+// 更新处理器类型
+using UpdateHandler = std::function<void(Object)>;
+
+// TDLib更新分发器
+//
+// 接收线程只负责把更新放入队列，处理器在独立的处理线程上执行，慢处理器不会拖住TDLib响应。
+// 更新按"账号 + 聊天"分片，每个分片一个无锁多生产者单消费者队列和一个处理线程，
+// 同一聊天的更新始终按接收顺序处理；文件和连接状态更新按账号归入固定分片。
+// 处理器按 td_api 构造函数ID登记，没有处理器的更新在接收线程上直接丢弃，不进入队列。
+// 处理器表按 RCU 方式整体替换，分发时只读取当前表的快照，不加锁。
+class UpdateDispatcher {
+public:
+    UpdateDispatcher() = default;
+    ~UpdateDispatcher();
+    
+    // 禁止复制和移动
+    UpdateDispatcher(const UpdateDispatcher&) = delete;
+    UpdateDispatcher& operator=(const UpdateDispatcher&) = delete;
+    
+    // 启动指定数量的处理线程（须在接收线程启动前调用）
+    void start(size_t worker_count);
+    
+    // 处理完已排队的更新后停止处理线程（须在接收线程退出后调用）
+    void stop();
+    
+    // 处理线程数量，未启动时为0
+    size_t worker_count() const;
+    
+    // 注册/取消注册处理器；取消注册返回后新分发的更新不再调用该处理器，
+    // 已经开始的调用会执行完（不等待，因此可以在处理器内调用）
+    void register_handler(std::int32_t type, UpdateHandler handler);
+    void unregister_handler(std::int32_t type);
+    
+    // 清除所有处理器
+    void clear_handlers();
+    
+    // 分发属于指定账号的更新；未启动时在当前线程直接处理
+    void post(std::size_t account, Object update);
+    
+    // 排队中的更新数量
+    size_t queued_count() const;
+
+private:
+    struct Node {
+        std::atomic<Node*> next{nullptr};
+        std::size_t account = 0;
+        Object update;
+    };
+    
+    // 单个分片：Vyukov 无锁MPSC队列和对应的处理线程
+    struct Shard {
+        Shard();
+        ~Shard();
+        
+        // 入队（任意线程）
+        void push(Node* node);
+        
+        // 出队（仅处理线程），队列为空或生产者尚未链接完成时返回 false
+        bool pop(std::size_t& account, Object& update);
+        
+        std::atomic<Node*> head;
+        Node* tail;
+        std::atomic<size_t> pending{0};
+        
+        // 处理线程空闲时在此等待
+        std::mutex wake_mutex;
+        std::condition_variable wake_cv;
+        std::atomic<bool> sleeping{false};
+        
+        std::thread thread;
+    };
+    
+    // 处理线程主循环
+    void worker_loop(Shard& shard);
+    
+    // 查找处理器并在对应账号下执行
+    void invoke(std::size_t account, Object update);
+    
+    // 查找处理器
+    std::shared_ptr<const UpdateHandler> find_handler(std::int32_t type) const;
+    
+    // 更新所属分片的键：同一聊天的更新落在同一分片
+    static std::uint64_t shard_key(std::size_t account, const td_api::Object& update);
+    
+    std::vector<std::unique_ptr<Shard>> shards_;
+    std::atomic<bool> stopping_{false};
+    
+    // 处理器表：注册和取消注册时复制出新表整体替换，读取方通过 atomic_load 取得快照
+    using HandlerTable = std::unordered_map<std::int32_t, std::shared_ptr<const UpdateHandler>>;
+    std::mutex handlers_write_mutex_;   // 只串行化修改处理器表的一方
+    std::shared_ptr<const HandlerTable> handlers_ = std::make_shared<const HandlerTable>();
+};
+
+} // namespace tg_forwarder
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <map>
 #include <memory>
@@ -26,6 +27,8 @@ using Object = td_api::object_ptr<td_api::Object>;
 using Function = td_api::object_ptr<td_api::Function>;
 using Message = td_api::object_ptr<td_api::message>;
 using MessageVector = std::vector<Message>;
+using SharedMessage = std::shared_ptr<const Message>;              // 多个任务和目标共用的只读消息
+using SharedMessageVector = std::shared_ptr<const MessageVector>;  // 共用的媒体组消息
 using Int32 = std::int32_t;
 using Int64 = std::int64_t;
 
@@ -60,15 +63,34 @@ public:
     explicit MediaError(const std::string& message) : Error(message) {}
 };
 
+// 从TDLib错误中解析需要等待的秒数（FLOOD_WAIT_X、SLOWMODE_WAIT_X 或 429 "retry after X"），
+// 不是限流错误时返回0
+int parse_retry_after(int code, const std::string& message);
+
+// 判断TDLib错误是否为临时性错误（限流、服务器内部错误、连接中断或超时），可以稍后重试
+bool is_retryable_error(int code, const std::string& message);
+
 // 判断消息是否为媒体消息
 bool is_media_message(const Message& message);
 
 // 从消息中获取文件ID
 std::vector<Int32> get_file_ids(const Message& message);
 
+// 获取消息的主媒体文件（照片取最大尺寸），不含媒体时返回 nullptr
+const td_api::file* get_main_file(const Message& message);
+
 // 从消息中获取媒体组ID
 std::optional<std::string> get_media_group_id(const Message& message);
 
+// 获取消息的格式化说明文字（文本消息为正文，含实体），没有时返回 nullptr
+const td_api::formattedText* get_formatted_text(const Message& message);
+
+// 复制格式化文本及其实体（粗体、链接、提及等），text 为空或没有文字时返回 nullptr
+td_api::object_ptr<td_api::formattedText> clone_formatted_text(const td_api::formattedText* text);
+
+// 取走文本消息的正文（含实体），之后消息中不再有正文；不是文本消息或没有文字时返回 nullptr
+td_api::object_ptr<td_api::formattedText> take_formatted_text(const Message& message);
+
 // 从消息中获取说明文字
 std::string get_caption(const Message& message);
 
@@ -82,17 +104,37 @@ void delay(int seconds);
 std::string generate_message_id(Int64 chat_id, Int64 message_id);
 
 // 内存缓冲区类，用于存储下载的媒体数据
+// 存储空间从 BufferPool 借出，清空或销毁时归还，供后续任务复用
 class MemoryBuffer {
 public:
     MemoryBuffer() = default;
+    ~MemoryBuffer();
     
-    // 添加数据到缓冲区
-    void append(const std::string& data);
+    // 可移动，不可复制
+    MemoryBuffer(MemoryBuffer&& other) noexcept;
+    MemoryBuffer& operator=(MemoryBuffer&& other) noexcept;
+    MemoryBuffer(const MemoryBuffer&) = delete;
+    MemoryBuffer& operator=(const MemoryBuffer&) = delete;
+    
+    // 添加数据到缓冲区（容量不足时换用池中更大的缓冲区）
+    void append(std::string_view data);
+    
+    // 添加数据到缓冲区；缓冲区为空时直接接管 data 的存储，不复制
+    void append(std::string&& data);
+    
+    // 预留容量
+    void reserve(size_t capacity);
+    
+    // 从文件直接读入缓冲区（按文件大小一次分配，不经过中间字符串）
+    void load_from_file(const std::string& path);
     
     // 获取缓冲区中的所有数据
     const std::string& data() const;
     
-    // 清空缓冲区
+    // 移出缓冲区数据（用于构造请求时避免再复制一份，移出的存储不再回到池中）
+    std::string release();
+    
+    // 清空缓冲区并把存储归还到池中
     void clear();
     
     // 获取缓冲区大小
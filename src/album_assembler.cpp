@@ -0,0 +1,101 @@
+#include <algorithm>
+#include "../include/album_assembler.h"
+
+namespace tg_forwarder {
+
+AlbumAssembler::AlbumAssembler(std::chrono::milliseconds quiet_period)
+    : quiet_period_(quiet_period) {
+}
+
+void AlbumAssembler::set_quiet_period(std::chrono::milliseconds quiet_period) {
+    quiet_period_ = quiet_period;
+}
+
+bool AlbumAssembler::add(Message& message, Clock::time_point now) {
+    auto media_group_id = get_media_group_id(message);
+    if (!media_group_id) {
+        return false;
+    }
+    
+    auto& album = albums_[*media_group_id];
+    
+    // 推送与补漏可能重复送达同一条消息
+    bool duplicate = std::any_of(album.messages.begin(), album.messages.end(), [&](const Message& existing) {
+        return existing->id_ == message->id_;
+    });
+    
+    if (!duplicate) {
+        album.messages.push_back(std::move(message));
+        album.last_update = now;
+    }
+    
+    return true;
+}
+
+std::vector<MessageVector> AlbumAssembler::take_ready(Clock::time_point now) {
+    std::vector<std::string> ready;
+    for (const auto& [group_id, album] : albums_) {
+        if (album.messages.size() >= kMaxAlbumSize || now - album.last_update >= quiet_period_) {
+            ready.push_back(group_id);
+        }
+    }
+    
+    return extract(std::move(ready));
+}
+
+std::vector<MessageVector> AlbumAssembler::take_all() {
+    std::vector<std::string> all;
+    all.reserve(albums_.size());
+    for (const auto& entry : albums_) {
+        all.push_back(entry.first);
+    }
+    
+    return extract(std::move(all));
+}
+
+std::optional<AlbumAssembler::Clock::time_point> AlbumAssembler::next_deadline() const {
+    std::optional<Clock::time_point> deadline;
+    for (const auto& entry : albums_) {
+        auto album_deadline = entry.second.messages.size() >= kMaxAlbumSize
+            ? entry.second.last_update
+            : entry.second.last_update + quiet_period_;
+        if (!deadline || album_deadline < *deadline) {
+            deadline = album_deadline;
+        }
+    }
+    
+    return deadline;
+}
+
+size_t AlbumAssembler::pending_count() const {
+    return albums_.size();
+}
+
+void AlbumAssembler::clear() {
+    albums_.clear();
+}
+
+std::vector<MessageVector> AlbumAssembler::extract(std::vector<std::string> group_ids) {
+    std::vector<MessageVector> result;
+    result.reserve(group_ids.size());
+    
+    for (const auto& group_id : group_ids) {
+        auto it = albums_.find(group_id);
+        auto messages = std::move(it->second.messages);
+        albums_.erase(it);
+        
+        std::sort(messages.begin(), messages.end(), [](const auto& a, const auto& b) {
+            return a->id_ < b->id_;
+        });
+        result.push_back(std::move(messages));
+    }
+    
+    // 按首条消息ID排序，保持相册之间的发布顺序
+    std::sort(result.begin(), result.end(), [](const auto& a, const auto& b) {
+        return a.front()->id_ < b.front()->id_;
+    });
+    
+    return result;
+}
+
+} // namespace tg_forwarder
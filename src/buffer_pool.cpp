@@ -0,0 +1,113 @@
+#include <utility>
+#include "../include/buffer_pool.h"
+
+namespace tg_forwarder {
+
+BufferPool& BufferPool::instance() {
+    static BufferPool instance;
+    return instance;
+}
+
+std::string BufferPool::acquire(size_t capacity) {
+    auto index = class_for_request(capacity);
+    
+    if (index < kClassCount) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto& list = free_lists_[index];
+        if (!list.empty()) {
+            std::string buffer = std::move(list.back());
+            list.pop_back();
+            retained_bytes_ -= buffer.capacity();
+            ++hit_count_;
+            return buffer;
+        }
+    }
+    
+    ++miss_count_;
+    
+    // 按级别大小分配，归还后能被同级别的申请复用
+    std::string buffer;
+    buffer.reserve(index < kClassCount ? size_t(1) << (index + kMinClassShift) : capacity);
+    return buffer;
+}
+
+void BufferPool::recycle(std::string&& buffer) {
+    auto index = class_for_block(buffer.capacity());
+    if (index >= kClassCount) {
+        return;
+    }
+    
+    buffer.clear();
+    
+    std::string block = std::move(buffer);
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (retained_bytes_ + block.capacity() > retained_limit_) {
+        return;
+    }
+    
+    retained_bytes_ += block.capacity();
+    free_lists_[index].push_back(std::move(block));
+}
+
+void BufferPool::set_retained_limit(size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    retained_limit_ = bytes;
+    
+    // 收紧上限时从最大的级别开始释放
+    for (size_t i = kClassCount; i-- > 0 && retained_bytes_ > retained_limit_;) {
+        auto& list = free_lists_[i];
+        while (!list.empty() && retained_bytes_ > retained_limit_) {
+            retained_bytes_ -= list.back().capacity();
+            list.pop_back();
+        }
+    }
+}
+
+size_t BufferPool::retained_limit() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return retained_limit_;
+}
+
+size_t BufferPool::retained_bytes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return retained_bytes_;
+}
+
+uint64_t BufferPool::hit_count() const {
+    return hit_count_;
+}
+
+uint64_t BufferPool::miss_count() const {
+    return miss_count_;
+}
+
+void BufferPool::trim() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& list : free_lists_) {
+        list.clear();
+    }
+    retained_bytes_ = 0;
+}
+
+size_t BufferPool::class_for_request(size_t capacity) {
+    size_t shift = kMinClassShift;
+    while (shift <= kMaxClassShift && (size_t(1) << shift) < capacity) {
+        ++shift;
+    }
+    return shift <= kMaxClassShift ? shift - kMinClassShift : kClassCount;
+}
+
+size_t BufferPool::class_for_block(size_t capacity) {
+    if (capacity < (size_t(1) << kMinClassShift) || capacity >= (size_t(1) << (kMaxClassShift + 1))) {
+        return kClassCount;
+    }
+    
+    // 向下取整，保证同级别的每个缓冲区都能满足该级别的申请
+    size_t shift = kMinClassShift;
+    while (shift < kMaxClassShift && (size_t(1) << (shift + 1)) <= capacity) {
+        ++shift;
+    }
+    return shift - kMinClassShift;
+}
+
+} // namespace tg_forwarder
@@ -1,11 +1,44 @@
-#include <regex>
-#include <future>
+#include <cctype>
+#include <algorithm>
+#include <cstdio>
+#include <sstream>
 #include <spdlog/spdlog.h>
 #include "../include/channel_resolver.h"
 #include "../include/client_manager.h"
 
 namespace tg_forwarder {
 
+// 日志中每行一条记录："<账号名称>\t<用户名>\t<频道ID>\t<过期时间(Unix秒)>\t<失败原因>"，频道ID为0表示永久性失败
+namespace {
+constexpr char kFieldSeparator = '\t';
+
+// 去掉失败原因中会破坏记录格式的字符
+std::string sanitize_field(std::string text) {
+    for (auto& c : text) {
+        if (c == kFieldSeparator || c == '\n' || c == '\r') {
+            c = ' ';
+        }
+    }
+    return text;
+}
+
+// 不区分大小写地比较前缀，匹配时返回前缀之后的位置
+size_t skip_prefix(const std::string& text, size_t pos, const char* prefix) {
+    size_t i = 0;
+    for (; prefix[i] != '\0'; ++i) {
+        if (pos + i >= text.size() ||
+            std::tolower(static_cast<unsigned char>(text[pos + i])) != prefix[i]) {
+            return std::string::npos;
+        }
+    }
+    return pos + i;
+}
+
+bool is_username_char(char c) {
+    return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+}
+}
+
 // 单例实现
 ChannelResolver& ChannelResolver::instance() {
     static ChannelResolver instance;
@@ -17,49 +50,185 @@ ChannelResolver::ChannelResolver() {
     spdlog::debug("频道解析器初始化");
 }
 
-std::future<Int64> ChannelResolver::resolve_channel(const std::string& channel_identifier) {
-    // 返回一个future，异步解析频道ID
-    return std::async(std::launch::async, [this, channel_identifier]() {
-        return resolve_channel_sync(channel_identifier);
-    });
+bool ChannelResolver::open(const std::string& path) {
+    std::lock_guard<std::mutex> lock(cache_mutex_);
+    
+    if (log_.is_open()) {
+        log_.close();
+    }
+    
+    path_ = path;
+    log_records_ = 0;
+    
+    // 加载未过期的记录，后出现的记录覆盖先出现的；账号已不存在的记录丢弃
+    auto now = Clock::now();
+    std::size_t loaded = 0;
+    std::ifstream input(path_);
+    std::string line;
+    while (std::getline(input, line)) {
+        std::istringstream fields(line);
+        std::string account_name, username, chat_id, expires_at, error;
+        if (!std::getline(fields, account_name, kFieldSeparator) ||
+            !std::getline(fields, username, kFieldSeparator) ||
+            !std::getline(fields, chat_id, kFieldSeparator) ||
+            !std::getline(fields, expires_at, kFieldSeparator)) {
+            continue;
+        }
+        std::getline(fields, error);
+        ++log_records_;
+        
+        auto account = ClientManager::instance().find_account(account_name);
+        if (!account || username.empty()) {
+            continue;
+        }
+        
+        CacheEntry entry;
+        try {
+            entry.chat_id = std::stoll(chat_id);
+            entry.expires_at = Clock::time_point(std::chrono::seconds(std::stoll(expires_at)));
+        } catch (const std::exception&) {
+            continue;
+        }
+        entry.error = std::move(error);
+        
+        CacheKey key{*account, username};
+        if (entry.expires_at <= now) {
+            channel_cache_.erase(key);
+            continue;
+        }
+        
+        // 本次运行中已经确认过的结果不被旧记录覆盖
+        auto it = channel_cache_.find(key);
+        if (it != channel_cache_.end() && it->second.verified) {
+            continue;
+        }
+        channel_cache_[key] = std::move(entry);
+        ++loaded;
+    }
+    input.close();
+    
+    // 过期和被覆盖的记录过多时重写日志
+    if (log_records_ > channel_cache_.size() * 2 + 64) {
+        compact();
+    }
+    
+    log_.open(path_, std::ios::app);
+    if (!log_.is_open()) {
+        spdlog::error("无法打开频道解析缓存: {}", path_);
+        return false;
+    }
+    
+    spdlog::info("频道解析缓存已加载: {} ({} 条记录)", path_, loaded);
+    return true;
 }
 
-Int64 ChannelResolver::resolve_channel_sync(const std::string& channel_identifier) {
-    // 同步解析频道ID
+void ChannelResolver::close() {
+    std::lock_guard<std::mutex> lock(cache_mutex_);
+    
+    if (log_.is_open()) {
+        log_.flush();
+        log_.close();
+    }
+}
+
+void ChannelResolver::set_ttl(std::chrono::seconds positive_ttl, std::chrono::seconds negative_ttl) {
+    std::lock_guard<std::mutex> lock(cache_mutex_);
+    positive_ttl_ = positive_ttl;
+    negative_ttl_ = negative_ttl;
+}
+
+Future<Int64> ChannelResolver::resolve_channel(const std::string& channel_identifier) {
+    // 检查是否为整数ID，无需查询
+    if (is_valid_channel_id(channel_identifier)) {
+        return make_ready_future(static_cast<Int64>(std::stoll(channel_identifier)));
+    }
+    
+    // 处理链接或用户名
+    std::string username;
+    try {
+        username = normalize_username(channel_identifier);
+    } catch (...) {
+        return make_exceptional_future<Int64>(std::current_exception());
+    }
+    
+    CacheKey key{ClientManager::current_account(), username};
+    std::optional<Int64> unverified_chat_id;
+    auto promise = std::make_shared<Promise<Int64>>();
+    auto future = promise->get_future();
     
-    // 检查缓存
     {
         std::lock_guard<std::mutex> lock(cache_mutex_);
-        auto it = channel_cache_.find(channel_identifier);
+        
+        // 检查缓存
+        auto it = channel_cache_.find(key);
         if (it != channel_cache_.end()) {
-            spdlog::debug("频道 {} 已在缓存中，ID: {}", channel_identifier, it->second);
-            return it->second;
+            auto& entry = it->second;
+            if (entry.expires_at <= Clock::now()) {
+                channel_cache_.erase(it);
+            } else if (entry.chat_id == 0) {
+                spdlog::debug("频道 {} 在缓存中记录为不可解析", channel_identifier);
+                return make_exceptional_future<Int64>(std::make_exception_ptr(
+                    ChannelError(entry.error + "（缓存）")));
+            } else if (entry.verified) {
+                spdlog::debug("频道 {} 已在缓存中，ID: {}", channel_identifier, entry.chat_id);
+                return make_ready_future(entry.chat_id);
+            } else {
+                unverified_chat_id = entry.chat_id;
+            }
         }
-    }
-    
-    // 检查是否为整数ID
-    if (is_valid_channel_id(channel_identifier)) {
-        Int64 channel_id = std::stoll(channel_identifier);
         
-        // 缓存并返回结果
-        {
-            std::lock_guard<std::mutex> lock(cache_mutex_);
-            channel_cache_[channel_identifier] = channel_id;
-            spdlog::debug("频道ID {} 已加入缓存", channel_id);
+        // 同一频道已有查询进行中时等待该查询的结果
+        auto& waiters = lookups_[key];
+        waiters.push_back(promise);
+        if (waiters.size() > 1) {
+            return future;
         }
-        
-        return channel_id;
+        pending_lookups_.emplace_back(key, unverified_chat_id);
     }
     
-    // 处理链接或用户名
+    start_lookups();
+    return future;
+}
+
+Int64 ChannelResolver::resolve_channel_sync(const std::string& channel_identifier) {
+    // 同步版本，阻塞等待异步解析结果
+    return resolve_channel(channel_identifier).get();
+}
+
+Future<std::vector<Future<Int64>>> ChannelResolver::resolve_channels(
+    const std::vector<std::string>& channel_identifiers) {
+    // 各频道的查询同时排队，由查询名额控制并发；重复的标识符共用同一次查询
+    std::vector<Future<Int64>> futures;
+    futures.reserve(channel_identifiers.size());
+    for (const auto& identifier : channel_identifiers) {
+        futures.push_back(resolve_channel(identifier));
+    }
+    return when_all(std::move(futures));
+}
+
+void ChannelResolver::clear_cache() {
+    std::lock_guard<std::mutex> lock(cache_mutex_);
+    channel_cache_.clear();
+    
+    if (log_.is_open()) {
+        log_.close();
+        log_.open(path_, std::ios::trunc);
+        log_records_ = 0;
+    }
+    spdlog::debug("频道缓存已清空");
+}
+
+std::string ChannelResolver::normalize_username(const std::string& channel_identifier) {
     std::string username;
     
     // 处理t.me链接
-    if (channel_identifier.find("t.me/") != std::string::npos) {
+    if (channel_identifier.find("t.me/") != std::string::npos ||
+        channel_identifier.find("telegram.me/") != std::string::npos ||
+        skip_prefix(channel_identifier, 0, "tg://") != std::string::npos) {
         username = extract_username_from_link(channel_identifier);
-    } 
+    }
     // 处理@用户名
-    else if (channel_identifier[0] == '@') {
+    else if (!channel_identifier.empty() && channel_identifier[0] == '@') {
         username = channel_identifier.substr(1); // 去掉@
     }
     // 否则假设它是一个用户名
@@ -67,34 +236,72 @@ Int64 ChannelResolver::resolve_channel_sync(const std::string& channel_identifie
         username = channel_identifier;
     }
     
-    // 使用用户名获取频道ID
-    Int64 channel_id = get_chat_id_by_username(username);
-    
-    // 缓存并返回结果
-    {
-        std::lock_guard<std::mutex> lock(cache_mutex_);
-        channel_cache_[channel_identifier] = channel_id;
-        spdlog::debug("频道 {} (ID: {}) 已加入缓存", channel_identifier, channel_id);
+    if (username.empty() || !std::all_of(username.begin(), username.end(), is_username_char)) {
+        throw ChannelError("无效的频道用户名: " + channel_identifier);
     }
     
-    return channel_id;
-}
-
-void ChannelResolver::clear_cache() {
-    std::lock_guard<std::mutex> lock(cache_mutex_);
-    channel_cache_.clear();
-    spdlog::debug("频道缓存已清空");
+    // 用户名不区分大小写
+    for (auto& c : username) {
+        c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    }
+    return username;
 }
 
 std::string ChannelResolver::extract_username_from_link(const std::string& link) {
-    // 使用正则表达式从t.me链接提取用户名
-    std::regex pattern(R"(t\.me/([^/\s]+))");
-    std::smatch matches;
+    // 逐段匹配 [scheme://][www.](t.me|telegram.me)/[s/]<用户名>[/...|?...|#...]，或 tg://resolve?domain=<用户名>
+    size_t pos = 0;
+    while (pos < link.size() && std::isspace(static_cast<unsigned char>(link[pos]))) {
+        ++pos;
+    }
+    
+    size_t start = std::string::npos;
+    if (auto after = skip_prefix(link, pos, "tg://resolve?"); after != std::string::npos) {
+        // 在查询参数中找 domain=
+        for (size_t i = after; i < link.size(); ++i) {
+            if ((i == after || link[i - 1] == '&') && skip_prefix(link, i, "domain=") != std::string::npos) {
+                start = i + 7;
+                break;
+            }
+        }
+    } else {
+        for (const char* scheme : {"https://", "http://"}) {
+            if (auto after = skip_prefix(link, pos, scheme); after != std::string::npos) {
+                pos = after;
+                break;
+            }
+        }
+        if (auto after = skip_prefix(link, pos, "www."); after != std::string::npos) {
+            pos = after;
+        }
+        for (const char* host : {"t.me/", "telegram.me/"}) {
+            if (auto after = skip_prefix(link, pos, host); after != std::string::npos) {
+                start = after;
+                break;
+            }
+        }
+        
+        // 网页预览链接 t.me/s/<用户名>
+        if (start != std::string::npos) {
+            if (auto after = skip_prefix(link, start, "s/"); after != std::string::npos) {
+                start = after;
+            }
+        }
+    }
     
-    if (std::regex_search(link, matches, pattern) && matches.size() > 1) {
-        std::string username = matches[1].str();
-        spdlog::debug("从链接 {} 提取用户名: {}", link, username);
-        return username;
+    if (start != std::string::npos) {
+        size_t end = start;
+        while (end < link.size() && link[end] != '/' && link[end] != '?' && link[end] != '#' &&
+               link[end] != '&' && !std::isspace(static_cast<unsigned char>(link[end]))) {
+            ++end;
+        }
+        
+        std::string username = link.substr(start, end - start);
+        
+        // 邀请链接（t.me/+xxx、t.me/joinchat/xxx）和私有频道链接（t.me/c/xxx）无法通过用户名解析
+        if (!username.empty() && username[0] != '+' && username != "joinchat" && username != "c") {
+            spdlog::debug("从链接 {} 提取用户名: {}", link, username);
+            return username;
+        }
     }
     
     throw ChannelError("无法从链接提取用户名: " + link);
@@ -113,38 +320,219 @@ bool ChannelResolver::is_valid_channel_id(const std::string& id_str) {
     
     // 检查剩余部分是否为数字
     for (size_t i = 4; i < id_str.size(); ++i) {
-        if (!std::isdigit(id_str[i])) {
+        if (!std::isdigit(static_cast<unsigned char>(id_str[i]))) {
             return false;
         }
     }
     
-    return id_str.size() > 4; // 确保前缀后有数字
+    return id_str.size() > 4 && id_str.size() <= 19; // 确保前缀后有数字且不超出 Int64
+}
+
+void ChannelResolver::start_lookups() {
+    std::vector<std::pair<CacheKey, std::optional<Int64>>> runnable;
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex_);
+        while (active_lookups_ < kMaxConcurrentLookups && !pending_lookups_.empty()) {
+            runnable.push_back(std::move(pending_lookups_.front()));
+            pending_lookups_.pop_front();
+            ++active_lookups_;
+        }
+    }
+    
+    for (auto& [key, unverified_chat_id] : runnable) {
+        run_lookup(key, unverified_chat_id);
+    }
+}
+
+void ChannelResolver::run_lookup(const CacheKey& key, std::optional<Int64> unverified_chat_id) {
+    // 排队的查询可能在其他账号的续延中发起，查询须走缓存键中的账号
+    AccountScope scope(key.first);
+    
+    auto search = [this, key]() {
+        AccountScope scope(key.first);
+        try {
+            get_chat_id_by_username(key.second).on_ready([this, key](Future<Int64> ready) {
+                finish_lookup(key, std::move(ready));
+            });
+        } catch (...) {
+            finish_lookup(key, make_exceptional_future<Int64>(std::current_exception()));
+        }
+    };
+    
+    if (!unverified_chat_id) {
+        search();
+        return;
+    }
+    
+    // 磁盘上的记录：确认该账号的TDLib仍认识该聊天，否则重新查询
+    try {
+        verify_chat_id(*unverified_chat_id).on_ready([this, key, search](Future<Int64> ready) {
+            try {
+                auto chat_id = ready.get();
+                spdlog::debug("频道 {} 使用持久化缓存，ID: {}", key.second, chat_id);
+                finish_lookup(key, make_ready_future(chat_id));
+            } catch (const std::exception& e) {
+                spdlog::debug("频道 {} 的缓存记录不可用（{}），重新查询", key.second, e.what());
+                search();
+            }
+        });
+    } catch (...) {
+        search();
+    }
+}
+
+void ChannelResolver::finish_lookup(const CacheKey& key, Future<Int64> result) {
+    Int64 chat_id = 0;
+    std::exception_ptr error;
+    try {
+        chat_id = result.get();
+    } catch (...) {
+        error = std::current_exception();
+    }
+    
+    Waiters waiters;
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex_);
+        
+        auto now = Clock::now();
+        if (!error) {
+            CacheEntry entry;
+            entry.chat_id = chat_id;
+            entry.expires_at = now + positive_ttl_;
+            entry.verified = true;
+            
+            // 续用磁盘记录时不重复写日志
+            auto it = channel_cache_.find(key);
+            bool unchanged = it != channel_cache_.end() && it->second.chat_id == chat_id;
+            if (!unchanged) {
+                append_record(key, entry);
+            } else {
+                entry.expires_at = it->second.expires_at;
+            }
+            channel_cache_[key] = std::move(entry);
+            spdlog::debug("频道 {} (ID: {}) 已加入缓存", key.second, chat_id);
+        } else {
+            channel_cache_.erase(key);
+            
+            // 网络错误和限流可以重试，不缓存；用户名不存在等永久性错误在有效期内直接返回
+            try {
+                std::rethrow_exception(error);
+            } catch (const NetworkError&) {
+            } catch (const std::exception& e) {
+                if (negative_ttl_.count() > 0) {
+                    CacheEntry entry;
+                    entry.error = sanitize_field(e.what());
+                    entry.expires_at = now + negative_ttl_;
+                    append_record(key, entry);
+                    channel_cache_[key] = std::move(entry);
+                }
+            }
+        }
+        
+        auto it = lookups_.find(key);
+        if (it != lookups_.end()) {
+            waiters = std::move(it->second);
+            lookups_.erase(it);
+        }
+        --active_lookups_;
+    }
+    
+    for (auto& waiter : waiters) {
+        if (error) {
+            waiter->set_exception(error);
+        } else {
+            waiter->set_value(chat_id);
+        }
+    }
+    
+    start_lookups();
 }
 
-Int64 ChannelResolver::get_chat_id_by_username(const std::string& username) {
+Future<Int64> ChannelResolver::get_chat_id_by_username(const std::string& username) {
     spdlog::debug("通过用户名查询频道ID: {}", username);
     
     // 创建搜索公共聊天请求
     auto query = td_api::make_object<td_api::searchPublicChat>();
     query->username_ = username;
     
-    // 发送请求并等待响应
-    auto response = ClientManager::instance().send_query(std::move(query));
+    // 发送请求，响应到达后在续延中处理
+    return ClientManager::instance().send_query_future(std::move(query)).then([username](Object response) {
+        // 检查响应
+        if (response->get_id() == td_api::error::ID) {
+            auto error = td::move_object_as<td_api::error>(response);
+            std::string error_message = "获取频道ID失败: " + error->message_;
+            spdlog::error(error_message);
+            
+            // 临时性错误以 NetworkError 抛出，不进入失败缓存
+            if (is_retryable_error(error->code_, error->message_)) {
+                throw NetworkError(error_message, parse_retry_after(error->code_, error->message_));
+            }
+            throw ChannelError(error_message);
+        }
+        
+        // 处理响应
+        auto chat = td::move_object_as<td_api::chat>(response);
+        Int64 chat_id = chat->id_;
+        
+        spdlog::debug("获取到频道 {} 的ID: {}", username, chat_id);
+        return chat_id;
+    });
+}
+
+Future<Int64> ChannelResolver::verify_chat_id(Int64 chat_id) {
+    auto query = td_api::make_object<td_api::getChat>();
+    query->chat_id_ = chat_id;
+    
+    return ClientManager::instance().request<td_api::chat>(std::move(query)).then(
+        [](td_api::object_ptr<td_api::chat> chat) {
+            return static_cast<Int64>(chat->id_);
+        });
+}
+
+void ChannelResolver::append_record(const CacheKey& key, const CacheEntry& entry) {
+    if (!log_.is_open()) {
+        return;
+    }
     
-    // 检查响应
-    if (response->get_id() == td_api::error::ID) {
-        auto error = td::move_object_as<td_api::error>(response);
-        std::string error_message = "获取频道ID失败: " + error->message_;
-        spdlog::error(error_message);
-        throw ChannelError(error_message);
+    auto expires_at = std::chrono::duration_cast<std::chrono::seconds>(entry.expires_at.time_since_epoch()).count();
+    log_ << ClientManager::instance().account_name(key.first) << kFieldSeparator << key.second << kFieldSeparator
+         << entry.chat_id << kFieldSeparator << expires_at << kFieldSeparator << entry.error << '\n';
+    log_.flush();
+    ++log_records_;
+}
+
+void ChannelResolver::compact() {
+    auto temp_path = path_ + ".tmp";
+    auto now = Clock::now();
+    std::size_t written = 0;
+    
+    {
+        std::ofstream output(temp_path, std::ios::trunc);
+        if (!output.is_open()) {
+            spdlog::warn("无法重写频道解析缓存: {}", temp_path);
+            return;
+        }
+        
+        for (const auto& [key, entry] : channel_cache_) {
+            if (entry.expires_at <= now) {
+                continue;
+            }
+            auto expires_at = std::chrono::duration_cast<std::chrono::seconds>(entry.expires_at.time_since_epoch()).count();
+            output << ClientManager::instance().account_name(key.first) << kFieldSeparator << key.second
+                   << kFieldSeparator << entry.chat_id << kFieldSeparator << expires_at << kFieldSeparator
+                   << entry.error << '\n';
+            ++written;
+        }
     }
     
-    // 处理响应
-    auto chat = td::move_object_as<td_api::chat>(response);
-    Int64 chat_id = chat->id_;
+    if (std::rename(temp_path.c_str(), path_.c_str()) != 0) {
+        spdlog::warn("替换频道解析缓存失败: {}", path_);
+        std::remove(temp_path.c_str());
+        return;
+    }
     
-    spdlog::debug("获取到频道 {} 的ID: {}", username, chat_id);
-    return chat_id;
+    log_records_ = written;
+    spdlog::debug("频道解析缓存已压缩: {} 条记录", log_records_);
 }
 
-} // namespace tg_forwarder 
\ No newline at end of file
+} // namespace tg_forwarder
@@ -2,8 +2,9 @@
 #include <sstream>
 #include <thread>
 #include <chrono>
+#include <future>
+#include <algorithm>
 #include <td/telegram/td_api.h>
-#include <td/telegram/Client.h>
 #include <spdlog/spdlog.h>
 
 #include "../include/client_manager.h"
@@ -11,6 +12,123 @@
 
 namespace tg_forwarder {
 
+// ResponseDispatchTable 实现
+ResponseDispatchTable::ResponseDispatchTable(std::size_t capacity) {
+    // 容量向上取整为2的幂，便于用掩码定位槽位
+    std::size_t size = 1;
+    while (size < capacity) {
+        size <<= 1;
+    }
+    
+    slots_.resize(size);
+    mask_ = size - 1;
+}
+
+void ResponseDispatchTable::insert(std::uint64_t request_id, ResponseHandler handler) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    
+    auto& slot = slots_[request_id & mask_];
+    if (!slot.handler) {
+        slot.request_id = request_id;
+        slot.handler = std::move(handler);
+    } else {
+        // 槽位仍被更早的请求占用
+        overflow_[request_id] = std::move(handler);
+    }
+    
+    ++size_;
+}
+
+ResponseHandler ResponseDispatchTable::take(std::uint64_t request_id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    
+    ResponseHandler handler;
+    auto& slot = slots_[request_id & mask_];
+    if (slot.handler && slot.request_id == request_id) {
+        handler = std::move(slot.handler);
+        slot.handler = nullptr;
+        slot.request_id = 0;
+    } else if (!overflow_.empty()) {
+        auto it = overflow_.find(request_id);
+        if (it != overflow_.end()) {
+            handler = std::move(it->second);
+            overflow_.erase(it);
+        }
+    }
+    
+    if (handler) {
+        --size_;
+    }
+    
+    return handler;
+}
+
+bool ResponseDispatchTable::erase(std::uint64_t request_id) {
+    return static_cast<bool>(take(request_id));
+}
+
+void ResponseDispatchTable::clear() {
+    // 在锁外销毁处理器：其中未完成的 Promise 会以 BrokenPromise 执行续延，续延可能再次发出请求
+    auto handlers = take_all();
+}
+
+std::vector<ResponseHandler> ResponseDispatchTable::take_all() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    
+    std::vector<ResponseHandler> handlers;
+    handlers.reserve(size_);
+    
+    for (auto& slot : slots_) {
+        if (slot.handler) {
+            handlers.push_back(std::move(slot.handler));
+            slot.handler = nullptr;
+            slot.request_id = 0;
+        }
+    }
+    
+    for (auto& entry : overflow_) {
+        handlers.push_back(std::move(entry.second));
+    }
+    
+    overflow_.clear();
+    size_ = 0;
+    
+    return handlers;
+}
+
+std::size_t ResponseDispatchTable::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return size_;
+}
+
+namespace {
+
+// 当前线程所绑定的账号
+thread_local std::size_t current_account_index = 0;
+
+} // namespace
+
+// AccountScope 实现
+AccountScope::AccountScope(std::size_t account)
+    : previous_(current_account_index) {
+    current_account_index = account;
+}
+
+AccountScope::~AccountScope() {
+    current_account_index = previous_;
+}
+
+TdlibProfile TdlibProfile::relay() {
+    TdlibProfile profile;
+    profile.use_message_database = false;
+    profile.delete_uploaded_files = true;
+    profile.storage_max_size_mb = 1024;
+    profile.storage_ttl_minutes = 60;
+    profile.storage_immunity_minutes = 60;
+    profile.storage_optimize_interval_minutes = 10;
+    return profile;
+}
+
 // 单例访问
 ClientManager& ClientManager::instance() {
     static ClientManager instance;
@@ -18,7 +136,7 @@ ClientManager& ClientManager::instance() {
 }
 
 ClientManager::ClientManager()
-    : state_(ClientState::Idle), 
+    : backend_(std::make_unique<TdlibBackend>()),
       running_(false) {
     spdlog::debug("客户端管理器初始化");
 }
@@ -30,49 +148,131 @@ ClientManager::~ClientManager() {
     spdlog::debug("客户端管理器析构");
 }
 
+void ClientManager::add_account(const AccountConfig& account) {
+    if (initialized_) {
+        spdlog::warn("客户端已初始化，忽略新账号: {}", account.name);
+        return;
+    }
+    
+    auto entry = std::make_unique<Account>();
+    entry->index = accounts_.size();
+    entry->config = account;
+    
+    if (entry->config.name.empty()) {
+        entry->config.name = "account" + std::to_string(entry->index);
+    }
+    
+    // 主账号沿用原来的数据库目录，其余账号各用一个目录
+    if (entry->config.database_directory.empty()) {
+        entry->config.database_directory = entry->index == 0
+            ? std::string("tdlib-db")
+            : "tdlib-db-" + entry->config.name;
+    }
+    
+    for (const auto& existing : accounts_) {
+        if (existing->config.name == entry->config.name) {
+            throw Error("账号名称重复: " + entry->config.name);
+        }
+        if (existing->config.database_directory == entry->config.database_directory) {
+            throw Error("账号 " + entry->config.name + " 与 " + existing->config.name + " 使用了相同的数据库目录");
+        }
+    }
+    
+    spdlog::info("添加账号 {}，数据库目录: {}，请求预算: {}", entry->config.name,
+        entry->config.database_directory, entry->config.max_pending_queries);
+    accounts_.push_back(std::move(entry));
+}
+
+void ClientManager::set_backend(std::unique_ptr<TdBackend> backend) {
+    if (initialized_ || running_) {
+        throw Error("须在客户端初始化之前替换TDLib后端");
+    }
+    backend_ = std::move(backend);
+}
+
 void ClientManager::init() {
     spdlog::info("初始化Telegram客户端");
     
     // 初始化TDLib日志
-    td::ClientManager::execute(td_api::make_object<td_api::setLogVerbosityLevel>(2));
+    backend_->execute(td_api::make_object<td_api::setLogVerbosityLevel>(2));
+    
+    // 未配置账号列表时使用配置文件中的手机号作为唯一账号
+    if (accounts_.empty()) {
+        AccountConfig account;
+        account.name = "default";
+        account.phone_number = Config::instance().phone_number();
+        add_account(account);
+    }
     
-    // 创建客户端实例
-    client_id_ = std::make_unique<std::int32_t>(td::ClientManager::create());
+    // 每个账号一个客户端实例，响应都从同一个 receive 循环取出后按 client_id 分发
+    accounts_by_client_.clear();
+    for (auto& account : accounts_) {
+        account->client_id = backend_->create_client();
+        accounts_by_client_[account->client_id] = account.get();
     
-    spdlog::debug("客户端实例创建成功，ID: {}", *client_id_);
+        spdlog::debug("账号 {} 的客户端实例创建成功，ID: {}", account->config.name, account->client_id);
+    }
+    
+    initialized_ = true;
 }
 
 bool ClientManager::start() {
+    return start_connecting() && wait_ready();
+}
+
+bool ClientManager::start_connecting() {
     if (running_) {
         spdlog::warn("客户端已经在运行中");
         return true;
     }
     
-    if (!client_id_) {
+    if (!initialized_) {
         spdlog::error("客户端未初始化");
         return false;
     }
     
-    // 启动更新处理线程
+    // 先启动更新处理线程，再启动接收线程
+    update_dispatcher_.start(update_worker_count_);
+    
+    // 启动接收线程
+    connect_start_ = std::chrono::steady_clock::now();
     running_ = true;
     update_thread_ = std::make_unique<std::thread>(&ClientManager::process_updates, this);
+    return true;
+}
+
+bool ClientManager::wait_ready() {
+    if (!running_) {
+        spdlog::error("客户端未启动");
+        return false;
+    }
     
-    // 等待客户端准备就绪
-    auto start_time = std::chrono::steady_clock::now();
-    auto timeout = std::chrono::seconds(60); // 最多等待60秒
+    // 等待所有账号准备就绪，每个账号最多等待60秒（需要输入验证码时逐个进行）
+    auto timeout = std::chrono::seconds(60) * static_cast<int>(accounts_.size());
     
     std::unique_lock<std::mutex> lock(auth_mutex_);
-    bool ready = auth_cond_.wait_for(lock, timeout, [this] {
-        return state_ == ClientState::Ready;
+    bool finished = auth_cond_.wait_for(lock, timeout, [this] {
+        return std::all_of(accounts_.begin(), accounts_.end(), [](const auto& account) {
+            return account->state == ClientState::Ready;
+        }) || std::any_of(accounts_.begin(), accounts_.end(), [](const auto& account) {
+            return account->state == ClientState::Error || account->state == ClientState::Closed;
+        });
     });
     
+    bool ready = std::all_of(accounts_.begin(), accounts_.end(), [](const auto& account) {
+        return account->state == ClientState::Ready;
+    });
+    lock.unlock();
+    
     if (!ready) {
-        spdlog::error("客户端启动超时");
+        spdlog::error(finished ? "账号授权失败" : "客户端启动超时");
         stop();
         return false;
     }
     
-    spdlog::info("客户端启动成功");
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - connect_start_);
+    spdlog::info("客户端启动成功，共 {} 个账号，连接和授权耗时 {} ms", accounts_.size(), elapsed.count());
     return true;
 }
 
@@ -92,37 +292,91 @@ void ClientManager::stop() {
         update_thread_.reset();
     }
     
-    // 关闭客户端
-    if (client_id_) {
-        td::ClientManager::destroy(*client_id_);
-        client_id_.reset();
-    }
+    // 处理完已收到的更新后停止更新处理线程
+    update_dispatcher_.stop();
     
-    // 清理资源
-    {
-        std::lock_guard<std::mutex> lock(response_mutex_);
-        response_handlers_.clear();
+    // 关闭所有账号的客户端，丢弃尚未发出的排队请求
+    initialized_ = false;
+    for (auto& account : accounts_) {
+        backend_->destroy_client(account->client_id);
+        
+        std::lock_guard<std::mutex> lock(account->budget_mutex);
+        account->queued.clear();
+        account->in_flight = 0;
     }
+    accounts_by_client_.clear();
+    rate_limiter_.clear();
     
-    {
-        std::lock_guard<std::mutex> lock(handlers_mutex_);
-        update_handlers_.clear();
+    // 清理资源：让仍在等待的调用方收到错误，而不是永远挂起
+    for (auto& handler : response_handlers_.take_all()) {
+        handler(td_api::make_object<td_api::error>(500, "客户端已停止"));
     }
     
-    set_state(ClientState::Closed);
+    update_dispatcher_.clear_handlers();
+    
+    for (auto& account : accounts_) {
+        set_state(*account, ClientState::Closed);
+    }
     spdlog::info("客户端已停止");
 }
 
 ClientState ClientManager::state() const {
-    return state_;
+    return state(current_account());
+}
+
+ClientState ClientManager::state(std::size_t account) const {
+    if (account >= accounts_.size()) {
+        return ClientState::Idle;
+    }
+    
+    return accounts_[account]->state;
+}
+
+std::size_t ClientManager::account_count() const {
+    return accounts_.size();
+}
+
+std::optional<std::size_t> ClientManager::find_account(const std::string& name) const {
+    for (const auto& account : accounts_) {
+        if (account->config.name == name) {
+            return account->index;
+        }
+    }
+    
+    return std::nullopt;
 }
 
-void ClientManager::set_state(ClientState state) {
-    ClientState old_state = state_;
-    state_ = state;
+std::string ClientManager::account_name(std::size_t account) const {
+    if (account >= accounts_.size()) {
+        return std::string();
+    }
+    
+    return accounts_[account]->config.name;
+}
+
+std::size_t ClientManager::current_account() {
+    return current_account_index;
+}
+
+ClientManager::Account& ClientManager::current() {
+    if (!initialized_) {
+        throw std::runtime_error("客户端未初始化");
+    }
+    
+    auto index = current_account_index;
+    if (index >= accounts_.size()) {
+        throw std::runtime_error("账号不存在: " + std::to_string(index));
+    }
+    
+    return *accounts_[index];
+}
+
+void ClientManager::set_state(Account& account, ClientState state) {
+    ClientState old_state = account.state.exchange(state);
     
     if (old_state != state) {
-        spdlog::info("客户端状态变更: {} -> {}", 
+        spdlog::info("账号 {} 状态变更: {} -> {}", 
+            account.config.name,
             static_cast<int>(old_state), 
             static_cast<int>(state));
         
@@ -136,8 +390,9 @@ void ClientManager::set_state(ClientState state) {
 }
 
 void ClientManager::send_code(const std::string& code) {
-    if (state_ != ClientState::WaitingCode) {
-        spdlog::warn("客户端当前状态不是等待验证码: {}", static_cast<int>(state_));
+    auto& account = current();
+    if (account.state != ClientState::WaitingCode) {
+        spdlog::warn("账号 {} 当前状态不是等待验证码: {}", account.config.name, static_cast<int>(account.state.load()));
         return;
     }
     
@@ -150,8 +405,9 @@ void ClientManager::send_code(const std::string& code) {
 }
 
 void ClientManager::send_password(const std::string& password) {
-    if (state_ != ClientState::WaitingPassword) {
-        spdlog::warn("客户端当前状态不是等待密码: {}", static_cast<int>(state_));
+    auto& account = current();
+    if (account.state != ClientState::WaitingPassword) {
+        spdlog::warn("账号 {} 当前状态不是等待密码: {}", account.config.name, static_cast<int>(account.state.load()));
         return;
     }
     
@@ -164,190 +420,454 @@ void ClientManager::send_password(const std::string& password) {
 }
 
 Object ClientManager::send_query(Function&& query, double timeout) {
-    if (!client_id_) {
+    if (!initialized_) {
         throw std::runtime_error("客户端未初始化");
     }
     
-    // 创建Promise用于等待响应
-    std::promise<Object> promise;
-    auto future = promise.get_future();
+    // 创建Promise用于等待响应（共享所有权，超时返回后迟到的响应不会访问已销毁的对象）
+    auto promise = std::make_shared<std::promise<Object>>();
+    auto future = promise->get_future();
     
     // 创建异步请求
-    auto query_id = send_query_async(std::move(query), [&promise](Object object) {
-        promise.set_value(std::move(object));
+    auto query_id = send_query_async(std::move(query), [promise](Object object) {
+        promise->set_value(std::move(object));
     });
     
     // 等待响应或超时
     if (future.wait_for(std::chrono::duration<double>(timeout)) == std::future_status::timeout) {
-        // 超时，移除处理器
-        std::lock_guard<std::mutex> lock(response_mutex_);
-        response_handlers_.erase(query_id);
-        throw std::runtime_error("请求超时");
+        // 超时，移除处理器；若响应恰好已被取走则照常返回
+        if (response_handlers_.erase(query_id)) {
+            throw std::runtime_error("请求超时");
+        }
     }
     
     // 返回响应
     return future.get();
 }
 
-std::uint64_t ClientManager::send_query_async(Function&& query, std::function<void(Object)> handler) {
-    if (!client_id_) {
-        throw std::runtime_error("客户端未初始化");
-    }
+std::uint64_t ClientManager::send_query_async(Function&& query, ResponseHandler handler) {
+    return dispatch_query(std::move(query), nullptr, std::move(handler));
+}
+
+std::uint64_t ClientManager::send_query_async(QueryFactory factory, ResponseHandler handler) {
+    auto query = factory();
+    return dispatch_query(std::move(query), std::move(factory), std::move(handler));
+}
+
+std::uint64_t ClientManager::dispatch_query(Function query, QueryFactory factory, ResponseHandler handler) {
+    auto& account = current();
     
-    // 生成请求ID
+    // 生成请求ID（所有账号共用一个序列，响应分发表无需区分账号）
     auto query_id = ++query_id_;
     
     // 如果提供了处理器，保存它
     if (handler) {
-        std::lock_guard<std::mutex> lock(response_mutex_);
-        response_handlers_[query_id] = std::move(handler);
+        response_handlers_.insert(query_id, std::move(handler));
+    }
+    
+    // 发送类请求先取令牌，令牌不足时留在限流队列，由接收循环到期后发出
+    auto key = RateLimiter::classify(account.index, query);
+    if (key && rate_limiter_.enabled() &&
+        !rate_limiter_.admit(*key, query_id, query, std::move(factory), RateLimiter::Clock::now())) {
+        return query_id;
     }
     
     // 发送请求
-    td::ClientManager::send(*client_id_, query_id, std::move(query));
+    send_with_budget(account, query_id, std::move(query));
     
     return query_id;
 }
 
-void ClientManager::register_update_handler(const std::string& type, UpdateHandler handler) {
-    if (!handler) {
+void ClientManager::send_due_queries() {
+    for (auto& ready : rate_limiter_.take_due(RateLimiter::Clock::now())) {
+        if (ready.account < accounts_.size()) {
+            send_with_budget(*accounts_[ready.account], ready.query_id, std::move(ready.query));
+        }
+    }
+    
+    // 限流后重建失败的请求在接收线程上把原来的限流错误交给调用方
+    for (auto& failed : rate_limiter_.take_failed()) {
+        auto handler = response_handlers_.take(failed.query_id);
+        if (handler) {
+            AccountScope scope(failed.account);
+            handler(td_api::make_object<td_api::error>(failed.code, failed.message));
+        }
+    }
+}
+
+void ClientManager::handle_send_failed(Account& account, const td_api::updateMessageSendFailed& update) {
+    if (!update.error_ || !update.message_ || !rate_limiter_.enabled()) {
         return;
     }
     
-    std::lock_guard<std::mutex> lock(handlers_mutex_);
-    update_handlers_[type] = std::move(handler);
+    int retry_after = parse_retry_after(update.error_->code_, update.error_->message_);
+    if (retry_after <= 0) {
+        return;
+    }
+    
+    Int64 chat_id = update.message_->chat_id_;
+    spdlog::warn("账号 {} 向聊天 {} 发送消息被限流，{} 秒后重发", account.config.name, chat_id, retry_after);
+    
+    // 失败的消息仍在聊天中，限流结束后用 resendMessages 重发
+    auto resend = td_api::make_object<td_api::resendMessages>();
+    resend->chat_id_ = chat_id;
+    resend->message_ids_.push_back(update.message_->id_);
     
-    spdlog::debug("注册更新处理器: {}", type);
+    Function query = std::move(resend);
+    auto key = RateLimiter::classify(account.index, query);
+    auto now = RateLimiter::Clock::now();
+    rate_limiter_.enqueue(*key, ++query_id_, std::move(query), now);
+    
+    // 暂停该聊天的令牌桶（刚放入的重发请求也在其中）
+    rate_limiter_.pause_chat(account.index, chat_id, retry_after, now);
 }
 
-void ClientManager::unregister_update_handler(const std::string& type) {
-    std::lock_guard<std::mutex> lock(handlers_mutex_);
-    update_handlers_.erase(type);
+void ClientManager::send_with_budget(Account& account, std::uint64_t query_id, Function query) {
+    {
+        std::lock_guard<std::mutex> lock(account.budget_mutex);
+        
+        // 预算用尽时排队，按提交顺序在有请求返回后发出（同一聊天的发送顺序不变）
+        auto limit = account.config.max_pending_queries;
+        if (limit > 0 && account.in_flight >= static_cast<std::size_t>(limit)) {
+            account.queued.emplace_back(query_id, std::move(query));
+            return;
+        }
+        
+        ++account.in_flight;
+    }
     
-    spdlog::debug("取消注册更新处理器: {}", type);
+    backend_->send(account.client_id, query_id, std::move(query));
 }
 
-void ClientManager::clear_update_handlers() {
-    std::lock_guard<std::mutex> lock(handlers_mutex_);
-    update_handlers_.clear();
+void ClientManager::release_budget(Account& account) {
+    std::uint64_t query_id = 0;
+    Function query;
+    
+    {
+        std::lock_guard<std::mutex> lock(account.budget_mutex);
+        
+        // 有排队请求时把名额直接转给它
+        if (!account.queued.empty()) {
+            query_id = account.queued.front().first;
+            query = std::move(account.queued.front().second);
+            account.queued.pop_front();
+        } else if (account.in_flight > 0) {
+            --account.in_flight;
+        }
+    }
+    
+    if (query) {
+        backend_->send(account.client_id, query_id, std::move(query));
+    }
+}
+
+Future<Object> ClientManager::send_query_future(Function&& query) {
+    auto promise = std::make_shared<Promise<Object>>();
+    auto future = promise->get_future();
+    
+    send_query_async(std::move(query), [promise](Object object) {
+        promise->set_value(std::move(object));
+    });
+    
+    return future;
+}
+
+Future<Object> ClientManager::send_query_future(QueryFactory factory) {
+    auto promise = std::make_shared<Promise<Object>>();
+    auto future = promise->get_future();
+    
+    send_query_async(std::move(factory), [promise](Object object) {
+        promise->set_value(std::move(object));
+    });
+    
+    return future;
+}
+
+void ClientManager::set_send_rate_limit(double rate_per_second, double burst) {
+    rate_limiter_.configure(rate_per_second, burst);
+    
+    if (rate_per_second > 0) {
+        spdlog::info("发送限流: 每个目标聊天 {:.3f} 条/秒，突发 {:.0f} 条", rate_per_second, std::max(burst, 1.0));
+    } else {
+        spdlog::info("发送限流已禁用");
+    }
+}
+
+std::size_t ClientManager::rate_limited_query_count() const {
+    return rate_limiter_.queued_count();
+}
+
+bool ClientManager::send_rate_limited() const {
+    return rate_limiter_.enabled();
+}
+
+void ClientManager::set_background_executor(BackgroundExecutor executor) {
+    rate_limiter_.set_executor(std::move(executor));
+}
+
+Future<Int64> ClientManager::get_my_id_async() {
+    auto& account = current();
+    Int64 cached = account.my_id;
+    if (cached != 0) {
+        return make_ready_future(cached);
+    }
+    
+    return request<td_api::user>(td_api::make_object<td_api::getMe>())
+        .then([&account](td_api::object_ptr<td_api::user> user) {
+            account.my_id = user->id_;
+            return user->id_;
+        });
+}
+
+Int64 ClientManager::get_my_id() {
+    return get_my_id_async().get();
+}
+
+std::size_t ClientManager::pending_query_count() const {
+    return response_handlers_.size();
+}
+
+std::size_t ClientManager::in_flight_query_count(std::size_t account) const {
+    if (account >= accounts_.size()) {
+        return 0;
+    }
     
-    spdlog::debug("清除所有更新处理器");
+    std::lock_guard<std::mutex> lock(accounts_[account]->budget_mutex);
+    return accounts_[account]->in_flight;
+}
+
+std::size_t ClientManager::queued_query_count(std::size_t account) const {
+    if (account >= accounts_.size()) {
+        return 0;
+    }
+    
+    std::lock_guard<std::mutex> lock(accounts_[account]->budget_mutex);
+    return accounts_[account]->queued.size();
+}
+
+void ClientManager::set_update_worker_count(std::size_t count) {
+    update_worker_count_ = std::max<std::size_t>(count, 1);
+}
+
+void ClientManager::set_tdlib_profile(const TdlibProfile& profile) {
+    if (running_) {
+        spdlog::warn("客户端已启动，TDLib数据库配置将在下次启动时生效");
+    }
+    tdlib_profile_ = profile;
+    
+    spdlog::info("TDLib消息数据库: {}，文件缓存目录: {}",
+        profile.use_message_database ? "启用" : "禁用",
+        profile.files_directory.empty() ? "数据库目录" : profile.files_directory);
+    if (profile.storage_optimize_interval_minutes > 0) {
+        spdlog::info("每 {} 分钟清理文件缓存: 上限 {} MB / {} 个文件，超过 {} 分钟未访问",
+            profile.storage_optimize_interval_minutes, profile.storage_max_size_mb,
+            profile.storage_max_files, profile.storage_ttl_minutes);
+    }
+}
+
+std::size_t ClientManager::queued_update_count() const {
+    return update_dispatcher_.queued_count();
+}
+
+void ClientManager::register_update_handler(std::int32_t type, UpdateHandler handler) {
+    update_dispatcher_.register_handler(type, std::move(handler));
+}
+
+void ClientManager::unregister_update_handler(std::int32_t type) {
+    update_dispatcher_.unregister_handler(type);
+}
+
+void ClientManager::clear_update_handlers() {
+    update_dispatcher_.clear_handlers();
 }
 
 void ClientManager::process_updates() {
     spdlog::info("启动更新处理线程");
     
-    // 设置代理
     auto& config = Config::instance();
     if (config.proxy_enabled()) {
         spdlog::info("配置代理: {}://{}:{}", 
             config.proxy_type(), 
             config.proxy_host(), 
             config.proxy_port());
+    }
         
-        auto proxy_type = td_api::make_object<td_api::proxyTypeSocks5>();
-        if (!config.proxy_username().empty()) {
-            proxy_type->username_ = config.proxy_username();
-            proxy_type->password_ = config.proxy_password();
-        }
+    for (auto& account : accounts_) {
+        // 设置代理
+        if (config.proxy_enabled()) {
+            auto proxy_type = td_api::make_object<td_api::proxyTypeSocks5>();
+            if (!config.proxy_username().empty()) {
+                proxy_type->username_ = config.proxy_username();
+                proxy_type->password_ = config.proxy_password();
+            }
         
-        auto proxy = td_api::make_object<td_api::addProxy>();
-        proxy->server_ = config.proxy_host();
-        proxy->port_ = config.proxy_port();
-        proxy->enable_ = true;
-        proxy->type_ = std::move(proxy_type);
+            auto proxy = td_api::make_object<td_api::addProxy>();
+            proxy->server_ = config.proxy_host();
+            proxy->port_ = config.proxy_port();
+            proxy->enable_ = true;
+            proxy->type_ = std::move(proxy_type);
         
-        td::ClientManager::send(*client_id_, 1, std::move(proxy));
-    }
-    
-    // 请求设置参数
-    auto parameters = td_api::make_object<td_api::setTdlibParameters>();
-    parameters->database_directory_ = "tdlib-db";
-    parameters->use_message_database_ = true;
-    parameters->use_secret_chats_ = false;
-    parameters->api_id_ = config.api_id();
-    parameters->api_hash_ = config.api_hash();
-    parameters->system_language_code_ = "zh";
-    parameters->device_model_ = "Desktop";
-    parameters->application_version_ = "1.0";
-    parameters->enable_storage_optimizer_ = true;
+            backend_->send(account->client_id, 1, std::move(proxy));
+        }
     
-    td::ClientManager::send(*client_id_, 2, std::move(parameters));
+        // 请求设置参数（各账号使用独立的数据库目录和文件目录）
+        const auto& profile = tdlib_profile_;
+        auto parameters = td_api::make_object<td_api::setTdlibParameters>();
+        parameters->database_directory_ = account->config.database_directory;
+        if (!profile.files_directory.empty()) {
+            parameters->files_directory_ = profile.files_directory + "/" + account->config.name;
+        }
+        parameters->use_file_database_ = profile.use_file_database;
+        parameters->use_chat_info_database_ = profile.use_chat_info_database;
+        parameters->use_message_database_ = profile.use_message_database;
+        parameters->use_secret_chats_ = false;
+        parameters->api_id_ = config.api_id();
+        parameters->api_hash_ = config.api_hash();
+        parameters->system_language_code_ = "zh";
+        parameters->device_model_ = "Desktop";
+        parameters->application_version_ = "1.0";
+        parameters->enable_storage_optimizer_ = profile.enable_storage_optimizer;
+    
+        backend_->send(account->client_id, 2, std::move(parameters));
+    }
     
-    // 主循环
+    // 主循环：所有账号共用一个接收循环
     while (running_) {
-        auto response = td::ClientManager::receive(0.1);
-        if (!response) {
+        // 发出限流已到期的请求，接收等待时间不超过下一个请求的到期时间
+        send_due_queries();
+        optimize_storage_if_due();
+        
+        double timeout = 0.1;
+        auto now = RateLimiter::Clock::now();
+        auto deadline = rate_limiter_.next_deadline(now);
+        if (deadline) {
+            timeout = std::clamp(std::chrono::duration<double>(*deadline - now).count(), 0.0, timeout);
+        }
+        
+        auto response = backend_->receive(timeout);
+        if (!response.object) {
             continue;
         }
         
-        if (!client_id_ || response.client_id != *client_id_) {
+        auto it = accounts_by_client_.find(response.client_id);
+        if (it == accounts_by_client_.end()) {
             continue;
         }
         
-        process_response(std::move(response.object));
+        // 分发期间绑定该账号，处理器和续延中发出的请求仍走同一账号
+        AccountScope scope(it->second->index);
+        process_response(*it->second, response.request_id, std::move(response.object));
     }
     
     spdlog::info("更新处理线程已退出");
 }
 
-void ClientManager::process_response(Object object) {
-    if (!object) {
-        return;
-    }
-    
-    // 检查是否是响应
-    if (object->get_id() == td_api::updateAuthorizationState::ID) {
-        auto update = td::move_object_as<td_api::updateAuthorizationState>(object);
-        handle_authorization_state(std::move(update->authorization_state_));
+void ClientManager::preload_chats(Account& account) {
+    // 聊天列表已全部加载时 TDLib 返回 404，不算错误
+    auto query = td_api::make_object<td_api::loadChats>();
+    query->chat_list_ = td_api::make_object<td_api::chatListMain>();
+    query->limit_ = 100;
+    
+    auto started = std::chrono::steady_clock::now();
+    AccountScope scope(account.index);
+    send_query_async(std::move(query), [name = account.config.name, started](Object object) {
+        if (object && object->get_id() == td_api::error::ID) {
+            auto& error = static_cast<const td_api::error&>(*object);
+            if (error.code_ != 404) {
+                spdlog::warn("账号 {} 预加载聊天列表失败: {}", name, error.message_);
+                return;
+            }
+        }
+        
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started);
+        spdlog::debug("账号 {} 的聊天列表已预加载，耗时 {} ms", name, elapsed.count());
+    });
+}
+
+void ClientManager::optimize_storage_if_due() {
+    const auto& profile = tdlib_profile_;
+    if (profile.storage_optimize_interval_minutes <= 0) {
         return;
     }
     
-    std::uint64_t query_id = 0;
-    Object response;
-    std::function<void(Object)> handler;
-    
-    // 检查是否是响应回调
-    if (object->get_id() == static_cast<std::int32_t>(td::td_api::MessageContentType::Proxy)) {
-        auto result = td::move_object_as<td_api::updateOption>(object);
-    } else if (object->get_id() == td_api::error::ID) {
-        auto error = td::move_object_as<td_api::error>(object);
-        spdlog::error("TDLib错误: {} {}", error->code_, error->message_);
-    }
-    
-    // 处理未处理的消息内容类型
-    if (object->get_id() == td_api::updateNewMessage::ID) {
-        // 交给更新处理器处理
-        std::lock_guard<std::mutex> lock(handlers_mutex_);
-        auto it = update_handlers_.find("updateNewMessage");
-        if (it != update_handlers_.end()) {
-            it->second(std::move(object));
+    auto now = std::chrono::steady_clock::now();
+    for (auto& account : accounts_) {
+        if (account->state != ClientState::Ready || now < account->next_storage_optimization) {
+            continue;
         }
+        account->next_storage_optimization = now + std::chrono::minutes(profile.storage_optimize_interval_minutes);
+        
+        // 未设置的限制传 -1，使用TDLib默认值
+        auto query = td_api::make_object<td_api::optimizeStorage>();
+        query->size_ = profile.storage_max_size_mb > 0
+            ? static_cast<std::int64_t>(profile.storage_max_size_mb) * 1024 * 1024 : -1;
+        query->ttl_ = profile.storage_ttl_minutes > 0 ? profile.storage_ttl_minutes * 60 : -1;
+        query->count_ = profile.storage_max_files > 0 ? profile.storage_max_files : -1;
+        query->immunity_delay_ = profile.storage_immunity_minutes > 0 ? profile.storage_immunity_minutes * 60 : -1;
+        query->return_deleted_file_statistics_ = false;
+        query->chat_limit_ = 0;
+        
+        AccountScope scope(account->index);
+        send_query_async(std::move(query), [name = account->config.name](Object object) {
+            if (!object) {
+                return;
+            }
+            if (object->get_id() == td_api::error::ID) {
+                auto& error = static_cast<const td_api::error&>(*object);
+                spdlog::warn("账号 {} 清理文件缓存失败: {}", name, error.message_);
+            } else if (object->get_id() == td_api::storageStatistics::ID) {
+                auto& statistics = static_cast<const td_api::storageStatistics&>(*object);
+                spdlog::info("账号 {} 的文件缓存清理完成，剩余 {} 个文件，{} MB", name,
+                    statistics.count_, statistics.size_ / (1024 * 1024));
+            }
+        });
+    }
+}
+
+void ClientManager::process_response(Account& account, std::uint64_t request_id, Object object) {
+    if (!object) {
+        return;
     }
     
-    // 处理请求的响应
-    if (object->get_id() == td_api::ok::ID || object->get_id() == td_api::error::ID) {
-        if (response_handlers_.empty()) {
-            return;
-        }
-        
-        // 获取查询ID和处理器
-        {
-            std::lock_guard<std::mutex> lock(response_mutex_);
-            auto it = response_handlers_.begin();
-            query_id = it->first;
-            handler = std::move(it->second);
-            response_handlers_.erase(it);
+    // 处理请求的响应：按 request_id 直接分发给等待中的调用方
+    if (request_id != 0) {
+        // 认证流程中的固定请求不计入预算
+        if (request_id > kReservedQueryIds) {
+            release_budget(account);
+            
+            // 被限流拒绝的发送请求已重新排队，调用方等待重发的结果
+            if (rate_limiter_.on_response(request_id, object, RateLimiter::Clock::now())) {
+                return;
+            }
         }
         
-        // 调用处理器
+        auto handler = response_handlers_.take(request_id);
         if (handler) {
             handler(std::move(object));
+        } else if (object->get_id() == td_api::error::ID) {
+            auto error = td::move_object_as<td_api::error>(object);
+            spdlog::error("TDLib错误 (请求 {}): {} {}", request_id, error->code_, error->message_);
         }
+        return;
     }
+    
+    // 处理授权状态更新
+    if (object->get_id() == td_api::updateAuthorizationState::ID) {
+        auto update = td::move_object_as<td_api::updateAuthorizationState>(object);
+        handle_authorization_state(account, std::move(update->authorization_state_));
+        return;
+    }
+    
+    // 发送失败中的限流错误由限流器处理，之后照常交给更新处理器
+    if (object->get_id() == td_api::updateMessageSendFailed::ID) {
+        handle_send_failed(account, static_cast<const td_api::updateMessageSendFailed&>(*object));
+    }
+    
+    // 交给更新处理线程，接收线程不执行处理器
+    update_dispatcher_.post(account.index, std::move(object));
 }
 
-void ClientManager::handle_authorization_state(Object object) {
+void ClientManager::handle_authorization_state(Account& account, Object object) {
     if (!object) {
         return;
     }
@@ -356,22 +876,21 @@ void ClientManager::handle_authorization_state(Object object) {
     
     switch (auth_state_id) {
         case td_api::authorizationStateWaitTdlibParameters::ID:
-            set_state(ClientState::Connecting);
+            set_state(account, ClientState::Connecting);
             break;
             
         case td_api::authorizationStateWaitEncryptionKey::ID:
             spdlog::info("等待加密密钥");
-            td::ClientManager::send(*client_id_, 3, td_api::make_object<td_api::checkDatabaseEncryptionKey>());
+            backend_->send(account.client_id, 3, td_api::make_object<td_api::checkDatabaseEncryptionKey>());
             break;
             
         case td_api::authorizationStateWaitPhoneNumber::ID:
             spdlog::info("等待手机号码");
-            set_state(ClientState::WaitingPhoneNumber);
+            set_state(account, ClientState::WaitingPhoneNumber);
             
             // 自动发送手机号码
             {
-                auto& config = Config::instance();
-                auto phone_number = config.phone_number();
+                const auto& phone_number = account.config.phone_number;
                 
                 if (!phone_number.empty()) {
                     spdlog::info("使用配置的手机号码: {}", phone_number);
@@ -379,22 +898,22 @@ void ClientManager::handle_authorization_state(Object object) {
                     auto set_phone = td_api::make_object<td_api::setAuthenticationPhoneNumber>();
                     set_phone->phone_number_ = phone_number;
                     
-                    td::ClientManager::send(*client_id_, 4, std::move(set_phone));
+                    backend_->send(account.client_id, 4, std::move(set_phone));
                 } else {
-                    spdlog::error("未配置手机号码");
-                    set_state(ClientState::Error);
+                    spdlog::error("账号 {} 未配置手机号码", account.config.name);
+                    set_state(account, ClientState::Error);
                 }
             }
             break;
             
         case td_api::authorizationStateWaitCode::ID:
             spdlog::info("等待验证码");
-            set_state(ClientState::WaitingCode);
+            set_state(account, ClientState::WaitingCode);
             
             // 在实际应用中，你可能需要从控制台或UI获取验证码
             {
                 std::string code;
-                spdlog::info("请输入验证码:");
+                spdlog::info("请输入账号 {} 的验证码:", account.config.name);
                 std::cin >> code;
                 
                 // 发送验证码
@@ -404,12 +923,12 @@ void ClientManager::handle_authorization_state(Object object) {
             
         case td_api::authorizationStateWaitPassword::ID:
             spdlog::info("等待两步验证密码");
-            set_state(ClientState::WaitingPassword);
+            set_state(account, ClientState::WaitingPassword);
             
             // 在实际应用中，你可能需要从控制台或UI获取密码
             {
                 std::string password;
-                spdlog::info("请输入两步验证密码:");
+                spdlog::info("请输入账号 {} 的两步验证密码:", account.config.name);
                 std::cin >> password;
                 
                 // 发送密码
@@ -418,23 +937,24 @@ void ClientManager::handle_authorization_state(Object object) {
             break;
             
         case td_api::authorizationStateReady::ID:
-            spdlog::info("授权成功");
-            set_state(ClientState::Ready);
+            spdlog::info("账号 {} 授权成功", account.config.name);
+            set_state(account, ClientState::Ready);
+            preload_chats(account);
             break;
             
         case td_api::authorizationStateLoggingOut::ID:
             spdlog::info("正在注销");
-            set_state(ClientState::Idle);
+            set_state(account, ClientState::Idle);
             break;
             
         case td_api::authorizationStateClosing::ID:
             spdlog::info("正在关闭");
-            set_state(ClientState::Idle);
+            set_state(account, ClientState::Idle);
             break;
             
         case td_api::authorizationStateClosed::ID:
             spdlog::info("已关闭");
-            set_state(ClientState::Closed);
+            set_state(account, ClientState::Closed);
             break;
             
         default:
@@ -0,0 +1,141 @@
+#include <algorithm>
+#include "../include/dedup_window.h"
+
+namespace tg_forwarder {
+
+DedupWindow::DedupWindow(std::size_t capacity) {
+    reset(capacity);
+}
+
+void DedupWindow::reset(std::size_t capacity) {
+    capacity = std::max<std::size_t>(capacity, 1);
+    
+    // 哈希表至少为容量的两倍，保持负载因子不超过 0.5
+    std::size_t table_size = 16;
+    while (table_size < capacity * 2) {
+        table_size <<= 1;
+    }
+    
+    ring_.assign(capacity, 0);
+    table_.assign(table_size, kEmpty);
+    mask_ = table_size - 1;
+    head_ = 0;
+    size_ = 0;
+    has_zero_ = false;
+}
+
+bool DedupWindow::contains(std::uint64_t key) const {
+    if (key == kEmpty) {
+        return has_zero_;
+    }
+    
+    return find_slot(key) != table_.size();
+}
+
+bool DedupWindow::insert(std::uint64_t key) {
+    if (contains(key)) {
+        return false;
+    }
+    
+    // 满员时淘汰最旧的键
+    if (size_ == ring_.size()) {
+        erase(ring_[head_]);
+        head_ = (head_ + 1) % ring_.size();
+        --size_;
+    }
+    
+    ring_[(head_ + size_) % ring_.size()] = key;
+    ++size_;
+    
+    if (key == kEmpty) {
+        has_zero_ = true;
+        return true;
+    }
+    
+    std::size_t slot = home_slot(key);
+    while (table_[slot] != kEmpty) {
+        slot = (slot + 1) & mask_;
+    }
+    table_[slot] = key;
+    return true;
+}
+
+std::size_t DedupWindow::size() const {
+    return size_;
+}
+
+std::size_t DedupWindow::capacity() const {
+    return ring_.size();
+}
+
+void DedupWindow::clear() {
+    std::fill(table_.begin(), table_.end(), kEmpty);
+    head_ = 0;
+    size_ = 0;
+    has_zero_ = false;
+}
+
+std::uint64_t DedupWindow::hash(const std::string& value) {
+    std::uint64_t result = 14695981039346656037ULL;
+    for (unsigned char c : value) {
+        result ^= c;
+        result *= 1099511628211ULL;
+    }
+    
+    return result;
+}
+
+std::size_t DedupWindow::home_slot(std::uint64_t key) const {
+    // splitmix64 混合，使连续的消息ID均匀分布
+    key ^= key >> 30;
+    key *= 0xbf58476d1ce4e5b9ULL;
+    key ^= key >> 27;
+    key *= 0x94d049bb133111ebULL;
+    key ^= key >> 31;
+    return static_cast<std::size_t>(key) & mask_;
+}
+
+std::size_t DedupWindow::find_slot(std::uint64_t key) const {
+    std::size_t slot = home_slot(key);
+    while (table_[slot] != kEmpty) {
+        if (table_[slot] == key) {
+            return slot;
+        }
+        slot = (slot + 1) & mask_;
+    }
+    
+    return table_.size();
+}
+
+void DedupWindow::erase(std::uint64_t key) {
+    if (key == kEmpty) {
+        has_zero_ = false;
+        return;
+    }
+    
+    std::size_t hole = find_slot(key);
+    if (hole == table_.size()) {
+        return;
+    }
+    
+    // 把探测链上后续的键前移填补空洞，直到遇到空槽
+    std::size_t next = hole;
+    while (true) {
+        next = (next + 1) & mask_;
+        if (table_[next] == kEmpty) {
+            break;
+        }
+        
+        // 起始槽位不在 (hole, next] 区间内的键可以前移到空洞
+        std::size_t home = home_slot(table_[next]);
+        bool in_range = hole <= next ? (home > hole && home <= next) : (home > hole || home <= next);
+        if (!in_range) {
+            table_[hole] = table_[next];
+            hole = next;
+        }
+    }
+    
+    table_[hole] = kEmpty;
+}
+
+} // namespace tg_forwarder
@@ -0,0 +1,178 @@
+#include <sstream>
+#include <cstdio>
+#include <spdlog/spdlog.h>
+#include "../include/file_id_cache.h"
+
+namespace tg_forwarder {
+
+// 日志中每行一条记录："<account>\t<unique_id>\t<remote_id>"，remote_id 为空表示该记录已失效
+// 不带账号的旧格式记录无法确定所属账号，加载时直接丢弃
+namespace {
+constexpr char kFieldSeparator = '\t';
+}
+
+FileIdCache& FileIdCache::instance() {
+    static FileIdCache instance;
+    return instance;
+}
+
+bool FileIdCache::open(const std::string& path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    
+    if (log_.is_open()) {
+        log_.close();
+    }
+    
+    path_ = path;
+    entries_.clear();
+    log_records_ = 0;
+    
+    // 加载已有记录，后出现的记录覆盖先出现的
+    std::ifstream input(path_);
+    std::string line;
+    while (std::getline(input, line)) {
+        auto first = line.find(kFieldSeparator);
+        auto last = line.rfind(kFieldSeparator);
+        if (first == std::string::npos || first == 0 || first == last || last == first + 1) {
+            continue;
+        }
+        
+        auto key = line.substr(0, last);
+        auto remote_id = line.substr(last + 1);
+        if (remote_id.empty()) {
+            entries_.erase(key);
+        } else {
+            entries_[key] = std::move(remote_id);
+        }
+        ++log_records_;
+    }
+    input.close();
+    
+    // 覆盖和失效记录过多时重写日志
+    if (log_records_ > entries_.size() * 2 + 64) {
+        compact();
+    }
+    
+    log_.open(path_, std::ios::app);
+    if (!log_.is_open()) {
+        spdlog::error("无法打开文件ID缓存: {}", path_);
+        return false;
+    }
+    
+    spdlog::info("文件ID缓存已加载: {} ({} 条记录)", path_, entries_.size());
+    return true;
+}
+
+void FileIdCache::close() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    
+    if (log_.is_open()) {
+        log_.flush();
+        log_.close();
+    }
+}
+
+bool FileIdCache::is_open() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return log_.is_open();
+}
+
+std::optional<std::string> FileIdCache::lookup(const std::string& account, const std::string& unique_id) {
+    if (account.empty() || unique_id.empty()) {
+        return std::nullopt;
+    }
+    
+    auto key = make_key(account, unique_id);
+    std::lock_guard<std::mutex> lock(mutex_);
+    
+    auto it = entries_.find(key);
+    if (it == entries_.end()) {
+        ++misses_;
+        return std::nullopt;
+    }
+    
+    ++hits_;
+    return it->second;
+}
+
+void FileIdCache::store(const std::string& account, const std::string& unique_id,
+                        const std::string& remote_id) {
+    if (account.empty() || unique_id.empty() || remote_id.empty()) {
+        return;
+    }
+    
+    auto key = make_key(account, unique_id);
+    std::lock_guard<std::mutex> lock(mutex_);
+    
+    auto it = entries_.find(key);
+    if (it != entries_.end() && it->second == remote_id) {
+        return;
+    }
+    
+    entries_[key] = remote_id;
+    append_record(key, remote_id);
+}
+
+void FileIdCache::invalidate(const std::string& account, const std::string& unique_id) {
+    auto key = make_key(account, unique_id);
+    std::lock_guard<std::mutex> lock(mutex_);
+    
+    if (entries_.erase(key) > 0) {
+        append_record(key, "");
+        spdlog::debug("文件ID缓存记录已失效: {} ({})", unique_id, account);
+    }
+}
+
+std::uint64_t FileIdCache::hit_count() const {
+    return hits_;
+}
+
+std::uint64_t FileIdCache::miss_count() const {
+    return misses_;
+}
+
+std::size_t FileIdCache::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_.size();
+}
+
+std::string FileIdCache::make_key(const std::string& account, const std::string& unique_id) {
+    return account + kFieldSeparator + unique_id;
+}
+
+void FileIdCache::append_record(const std::string& key, const std::string& remote_id) {
+    if (!log_.is_open()) {
+        return;
+    }
+    
+    log_ << key << kFieldSeparator << remote_id << '\n';
+    log_.flush();
+    ++log_records_;
+}
+
+void FileIdCache::compact() {
+    auto temp_path = path_ + ".tmp";
+    
+    {
+        std::ofstream output(temp_path, std::ios::trunc);
+        if (!output.is_open()) {
+            spdlog::warn("无法重写文件ID缓存: {}", temp_path);
+            return;
+        }
+        
+        for (const auto& entry : entries_) {
+            output << entry.first << kFieldSeparator << entry.second << '\n';
+        }
+    }
+    
+    if (std::rename(temp_path.c_str(), path_.c_str()) != 0) {
+        spdlog::warn("替换文件ID缓存失败: {}", path_);
+        std::remove(temp_path.c_str());
+        return;
+    }
+    
+    log_records_ = entries_.size();
+    spdlog::debug("文件ID缓存已压缩: {} 条记录", log_records_);
+}
+
+} // namespace tg_forwarder
@@ -0,0 +1,248 @@
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <spdlog/spdlog.h>
+#include "../include/forward_checkpoint.h"
+
+namespace tg_forwarder {
+
+// 日志中每行一条记录，字段以制表符分隔：
+//   C <源频道ID> <目标频道ID>   频道对（压缩后的首行）
+//   L <消息ID>                  最后连续提交的消息ID
+//   M <消息ID>                  已转发的消息
+//   H <媒体组ID哈希>            已转发的媒体组（64 位哈希）
+namespace {
+constexpr std::size_t kSyncBatch = 64;
+constexpr auto kSyncInterval = std::chrono::seconds(1);
+}
+
+ForwardCheckpoint::~ForwardCheckpoint() {
+    close();
+}
+
+bool ForwardCheckpoint::open(const std::string& path, std::int64_t source_chat_id, std::int64_t target_chat_id,
+                             std::size_t window_size) {
+    close();
+    
+    path_ = path;
+    source_chat_id_ = source_chat_id;
+    target_chat_id_ = target_chat_id;
+    last_message_id_ = 0;
+    window_size_ = std::max<std::size_t>(window_size, 1);
+    messages_.reset(window_size_);
+    media_groups_.reset(window_size_);
+    log_records_ = 0;
+    unsynced_records_ = 0;
+    last_sync_ = std::chrono::steady_clock::now();
+    
+    if (path_.empty()) {
+        return true;
+    }
+    
+    // 加载已有记录
+    bool matched = true;
+    {
+        std::ifstream input(path_);
+        std::string line;
+        while (std::getline(input, line)) {
+            std::istringstream fields(line);
+            char type = 0;
+            fields >> type;
+            
+            if (type == 'C') {
+                std::int64_t source = 0;
+                std::int64_t target = 0;
+                fields >> source >> target;
+                matched = source == source_chat_id_ && target == target_chat_id_;
+            } else if (type == 'L') {
+                std::int64_t message_id = 0;
+                if (fields >> message_id) {
+                    last_message_id_ = std::max(last_message_id_, message_id);
+                }
+            } else if (type == 'M') {
+                std::int64_t message_id = 0;
+                if (fields >> message_id) {
+                    messages_.insert(static_cast<std::uint64_t>(message_id));
+                }
+            } else if (type == 'H') {
+                std::uint64_t media_group_hash = 0;
+                if (fields >> media_group_hash) {
+                    media_groups_.insert(media_group_hash);
+                }
+            } else if (type == 'G') {
+                // 早期版本直接保存媒体组ID
+                std::string media_group_id;
+                if (fields >> media_group_id) {
+                    media_groups_.insert(DedupWindow::hash(media_group_id));
+                }
+            }
+            ++log_records_;
+        }
+    }
+    
+    // 频道对变化时旧进度无效
+    if (!matched) {
+        spdlog::warn("检查点 {} 属于其他频道，已忽略旧进度", path_);
+        last_message_id_ = 0;
+        messages_.clear();
+        media_groups_.clear();
+    }
+    
+    // 新建、频道对变化或记录过多时重写日志
+    if (!matched || log_records_ == 0 || log_records_ > window_size_ * 4 + 64) {
+        compact();
+    }
+    
+    fd_ = ::open(path_.c_str(), O_WRONLY | O_APPEND | O_CREAT, 0644);
+    if (fd_ < 0) {
+        spdlog::error("无法打开检查点 {}: {}", path_, std::strerror(errno));
+        return false;
+    }
+    
+    spdlog::info("检查点已加载: {}（最后消息ID {}，去重窗口 {} 条消息 / {} 个媒体组）",
+        path_, last_message_id_, messages_.size(), media_groups_.size());
+    return true;
+}
+
+void ForwardCheckpoint::close() {
+    if (fd_ < 0) {
+        return;
+    }
+    
+    sync();
+    ::close(fd_);
+    fd_ = -1;
+}
+
+bool ForwardCheckpoint::is_persistent() const {
+    return fd_ >= 0;
+}
+
+std::int64_t ForwardCheckpoint::last_message_id() const {
+    return last_message_id_;
+}
+
+bool ForwardCheckpoint::contains_message(std::int64_t message_id) const {
+    return messages_.contains(static_cast<std::uint64_t>(message_id));
+}
+
+bool ForwardCheckpoint::contains_media_group(const std::string& media_group_id) const {
+    return media_groups_.contains(DedupWindow::hash(media_group_id));
+}
+
+void ForwardCheckpoint::record_message(std::int64_t message_id) {
+    if (messages_.insert(static_cast<std::uint64_t>(message_id))) {
+        append_line("M\t" + std::to_string(message_id));
+    }
+}
+
+void ForwardCheckpoint::record_media_group(const std::string& media_group_id) {
+    if (media_group_id.empty()) {
+        return;
+    }
+    
+    auto media_group_hash = DedupWindow::hash(media_group_id);
+    if (media_groups_.insert(media_group_hash)) {
+        append_line("H\t" + std::to_string(media_group_hash));
+    }
+}
+
+void ForwardCheckpoint::commit(std::int64_t last_message_id) {
+    if (last_message_id <= last_message_id_) {
+        return;
+    }
+    
+    last_message_id_ = last_message_id;
+    append_line("L\t" + std::to_string(last_message_id));
+    
+    if (fd_ < 0) {
+        return;
+    }
+    
+    // 按批次落盘，压缩前先同步
+    if (unsynced_records_ >= kSyncBatch || std::chrono::steady_clock::now() - last_sync_ >= kSyncInterval) {
+        sync();
+    }
+    
+    if (log_records_ > window_size_ * 4 + 64) {
+        compact();
+    }
+}
+
+void ForwardCheckpoint::sync() {
+    if (fd_ < 0 || unsynced_records_ == 0) {
+        return;
+    }
+    
+    if (::fsync(fd_) != 0) {
+        spdlog::warn("检查点落盘失败: {}", std::strerror(errno));
+    }
+    
+    unsynced_records_ = 0;
+    last_sync_ = std::chrono::steady_clock::now();
+}
+
+void ForwardCheckpoint::append_line(const std::string& line) {
+    if (fd_ < 0) {
+        return;
+    }
+    
+    // 直接写入文件描述符，进程崩溃也不会丢失；掉电保护由批量 fsync 提供
+    std::string record = line + '\n';
+    if (::write(fd_, record.data(), record.size()) != static_cast<ssize_t>(record.size())) {
+        spdlog::warn("写入检查点失败: {}", std::strerror(errno));
+        return;
+    }
+    
+    ++log_records_;
+    ++unsynced_records_;
+}
+
+void ForwardCheckpoint::compact() {
+    auto temp_path = path_ + ".tmp";
+    
+    std::ostringstream output;
+    output << "C\t" << source_chat_id_ << '\t' << target_chat_id_ << '\n';
+    output << "L\t" << last_message_id_ << '\n';
+    messages_.for_each([&output](std::uint64_t message_id) {
+        output << "M\t" << static_cast<std::int64_t>(message_id) << '\n';
+    });
+    media_groups_.for_each([&output](std::uint64_t media_group_hash) {
+        output << "H\t" << media_group_hash << '\n';
+    });
+    auto content = output.str();
+    
+    int temp_fd = ::open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (temp_fd < 0) {
+        spdlog::warn("无法重写检查点: {}", temp_path);
+        return;
+    }
+    
+    bool written = ::write(temp_fd, content.data(), content.size()) == static_cast<ssize_t>(content.size()) &&
+                   ::fsync(temp_fd) == 0;
+    ::close(temp_fd);
+    
+    if (!written || std::rename(temp_path.c_str(), path_.c_str()) != 0) {
+        spdlog::warn("替换检查点失败: {}", path_);
+        std::remove(temp_path.c_str());
+        return;
+    }
+    
+    // 旧描述符指向已被替换的文件，重新打开
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = ::open(path_.c_str(), O_WRONLY | O_APPEND | O_CREAT, 0644);
+    }
+    
+    log_records_ = 2 + messages_.size() + media_groups_.size();
+    unsynced_records_ = 0;
+    last_sync_ = std::chrono::steady_clock::now();
+    spdlog::debug("检查点已压缩: {} 条记录", log_records_);
+}
+
+} // namespace tg_forwarder
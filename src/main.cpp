@@ -2,10 +2,15 @@
 #include <fstream>
 #include <string>
 #include <memory>
+#include <atomic>
 #include <csignal>
+#include <filesystem>
 #include <thread>
+#include <algorithm>
 #include <nlohmann/json.hpp>
 #include <spdlog/spdlog.h>
+#include <spdlog/async.h>
+#include <spdlog/sinks/base_sink.h>
 #include <spdlog/sinks/rotating_file_sink.h>
 
 #include "../include/client_manager.h"
@@ -21,37 +26,117 @@ using namespace tg_forwarder;
 // 全局转发器实例，用于信号处理
 RestrictedChannelForwarder& forwarder = RestrictedChannelForwarder::instance();
 
+// 收到 SIGHUP 时置位，由主线程重新加载配置
+std::atomic<bool> reload_requested{false};
+
+// 积累一定字节数后刷新的包装 sink，限制异常退出时丢失的日志量，而不必每条日志都刷新
+class SizeFlushSink : public spdlog::sinks::base_sink<std::mutex> {
+public:
+    SizeFlushSink(spdlog::sink_ptr sink, size_t flush_bytes)
+        : sink_(std::move(sink)), flush_bytes_(flush_bytes) {}
+    
+protected:
+    void sink_it_(const spdlog::details::log_msg& msg) override {
+        sink_->log(msg);
+        pending_bytes_ += msg.payload.size();
+        if (pending_bytes_ >= flush_bytes_) {
+            sink_->flush();
+            pending_bytes_ = 0;
+        }
+    }
+    
+    void flush_() override {
+        sink_->flush();
+        pending_bytes_ = 0;
+    }
+    
+    // 格式由内部 sink 负责
+    void set_pattern_(const std::string& pattern) override {
+        sink_->set_pattern(pattern);
+    }
+    
+    void set_formatter_(std::unique_ptr<spdlog::formatter> formatter) override {
+        sink_->set_formatter(std::move(formatter));
+    }
+    
+private:
+    spdlog::sink_ptr sink_;
+    size_t flush_bytes_;
+    size_t pending_bytes_ = 0;
+};
+
+// 日志级别名称转换
+spdlog::level::level_enum parse_log_level(const std::string& level, spdlog::level::level_enum fallback) {
+    if (level == "debug") {
+        return spdlog::level::debug;
+    } else if (level == "info") {
+        return spdlog::level::info;
+    } else if (level == "warn") {
+        return spdlog::level::warn;
+    } else if (level == "error") {
+        return spdlog::level::err;
+    } else if (level == "critical") {
+        return spdlog::level::critical;
+    }
+    return fallback;
+}
+
+// 停止日志系统：异步模式下等待队列中的日志写完
+void shutdown_logger() {
+    if (auto pool = spdlog::thread_pool()) {
+        auto dropped = pool->overrun_counter();
+        if (dropped > 0) {
+            spdlog::warn("日志队列已满，共丢弃 {} 条日志", dropped);
+        }
+    }
+    spdlog::shutdown();
+}
+
 // 信号处理函数
 void signal_handler(int signal) {
     spdlog::info("接收到信号 {}，正在停止转发器...", signal);
     forwarder.stop();
+    shutdown_logger();
     exit(signal);
 }
 
+// SIGHUP 处理函数：只置位，重新加载在主线程中进行
+void reload_signal_handler(int) {
+    reload_requested = true;
+}
+
 // 初始化日志系统
 void init_logger(const LogConfig& config) {
     try {
-        auto file_sink = std::make_shared<spdlog::sinks::rotating_file_sink_mt>(
-            config.log_file, config.max_size * 1024 * 1024, config.max_files);
+        spdlog::sink_ptr file_sink;
+        if (config.flush_bytes > 0) {
+            // 包装 sink 已经加锁，内部 sink 使用单线程版本
+            file_sink = std::make_shared<SizeFlushSink>(
+                std::make_shared<spdlog::sinks::rotating_file_sink_st>(
+                    config.log_file, config.max_size * 1024 * 1024, config.max_files),
+                static_cast<size_t>(config.flush_bytes));
+        } else {
+            file_sink = std::make_shared<spdlog::sinks::rotating_file_sink_mt>(
+                config.log_file, config.max_size * 1024 * 1024, config.max_files);
+        }
         
-        auto logger = std::make_shared<spdlog::logger>("logger", file_sink);
+        // 异步模式：日志先进入有界队列，由后台线程格式化并写入文件，转发线程不再等待写文件
+        std::shared_ptr<spdlog::logger> logger;
+        if (config.async) {
+            spdlog::init_thread_pool(static_cast<size_t>(std::max(config.queue_size, 1)), 1);
+            auto policy = config.overflow_policy == "drop"
+                ? spdlog::async_overflow_policy::overrun_oldest
+                : spdlog::async_overflow_policy::block;
+            logger = std::make_shared<spdlog::async_logger>("logger", file_sink, spdlog::thread_pool(), policy);
+        } else {
+            logger = std::make_shared<spdlog::logger>("logger", file_sink);
+        }
         
         // 设置日志级别
-        spdlog::level::level_enum log_level = spdlog::level::info;
-        if (config.level == "debug") {
-            log_level = spdlog::level::debug;
-        } else if (config.level == "info") {
-            log_level = spdlog::level::info;
-        } else if (config.level == "warn") {
-            log_level = spdlog::level::warn;
-        } else if (config.level == "error") {
-            log_level = spdlog::level::err;
-        } else if (config.level == "critical") {
-            log_level = spdlog::level::critical;
-        }
+        logger->set_level(parse_log_level(config.level, spdlog::level::info));
         
-        logger->set_level(log_level);
-        logger->flush_on(spdlog::level::info);
+        // 达到该级别的日志立即刷新，其余由定时刷新和按大小刷新负责
+        logger->flush_on(parse_log_level(config.flush_level, spdlog::level::warn));
         
         // 设置默认日志格式
         logger->set_pattern("[%Y-%m-%d %H:%M:%S.%e] [%l] %v");
@@ -59,8 +144,17 @@ void init_logger(const LogConfig& config) {
         // 设置为默认记录器
         spdlog::set_default_logger(logger);
         
+        // 定时刷新（后台线程）
+        if (config.flush_interval > 0) {
+            spdlog::flush_every(std::chrono::seconds(config.flush_interval));
+        }
+        
         spdlog::info("日志系统初始化完成，日志文件: {}, 日志级别: {}", 
             config.log_file, config.level);
+        if (config.async) {
+            spdlog::info("异步日志: 队列 {} 条，队列满时{}", config.queue_size,
+                config.overflow_policy == "drop" ? "丢弃最旧的日志" : "阻塞等待");
+        }
     } catch (const spdlog::spdlog_ex& ex) {
         std::cerr << "日志初始化失败: " << ex.what() << std::endl;
         exit(1);
@@ -92,6 +186,40 @@ Config load_config(const std::string& config_file) {
         config.api.use_bot = j["api"].value("use_bot", false);
     }
     
+    // 账号列表：[{"name": "...", "phone_number": "...", "database_directory": "...", "max_pending_queries": 64}]
+    if (j.contains("accounts") && j["accounts"].is_array()) {
+        for (const auto& item : j["accounts"]) {
+            AccountConfig account;
+            account.name = item.value("name", "");
+            account.phone_number = item.value("phone_number", "");
+            account.database_directory = item.value("database_directory", "");
+            account.max_pending_queries = item.value("max_pending_queries", 64);
+            
+            if (!account.phone_number.empty()) {
+                config.accounts.push_back(std::move(account));
+            }
+        }
+    }
+    
+    // TDLib数据库和文件缓存："profile" 选择预设（"default" 或 "relay"），其余键覆盖预设中的对应项
+    if (j.contains("tdlib")) {
+        const auto& tdlib = j["tdlib"];
+        auto& profile = config.tdlib;
+        profile = tdlib.value("profile", "default") == "relay" ? TdlibProfile::relay() : TdlibProfile{};
+        profile.use_message_database = tdlib.value("use_message_database", profile.use_message_database);
+        profile.use_chat_info_database = tdlib.value("use_chat_info_database", profile.use_chat_info_database);
+        profile.use_file_database = tdlib.value("use_file_database", profile.use_file_database);
+        profile.enable_storage_optimizer = tdlib.value("enable_storage_optimizer", profile.enable_storage_optimizer);
+        profile.files_directory = tdlib.value("files_directory", profile.files_directory);
+        profile.delete_uploaded_files = tdlib.value("delete_uploaded_files", profile.delete_uploaded_files);
+        profile.storage_max_size_mb = tdlib.value("storage_max_size_mb", profile.storage_max_size_mb);
+        profile.storage_max_files = tdlib.value("storage_max_files", profile.storage_max_files);
+        profile.storage_ttl_minutes = tdlib.value("storage_ttl_minutes", profile.storage_ttl_minutes);
+        profile.storage_immunity_minutes = tdlib.value("storage_immunity_minutes", profile.storage_immunity_minutes);
+        profile.storage_optimize_interval_minutes =
+            tdlib.value("storage_optimize_interval_minutes", profile.storage_optimize_interval_minutes);
+    }
+    
     // 代理配置
     if (j.contains("proxy")) {
         config.proxy.enabled = j["proxy"].value("enabled", false);
@@ -113,9 +241,54 @@ Config load_config(const std::string& config_file) {
         config.forwarder.source_channel = j["forwarder"].value("source_channel", "");
         config.forwarder.target_channel = j["forwarder"].value("target_channel", "");
         config.forwarder.wait_time_ms = j["forwarder"].value("wait_time_ms", 1000);
+        config.forwarder.album_quiet_period_ms = j["forwarder"].value("album_quiet_period_ms", 800);
         config.forwarder.max_history_messages = j["forwarder"].value("max_history_messages", 100);
         config.forwarder.max_concurrent_downloads = j["forwarder"].value("max_concurrent_downloads", 2);
         config.forwarder.max_concurrent_uploads = j["forwarder"].value("max_concurrent_uploads", 2);
+        config.forwarder.pipeline_depth = j["forwarder"].value("pipeline_depth", 8);
+        config.forwarder.media_queue_capacity = j["forwarder"].value("media_queue_capacity", 256);
+        config.forwarder.large_file_threshold_mb = j["forwarder"].value("large_file_threshold_mb", 16);
+        config.forwarder.retry_count = j["forwarder"].value("retry_count", 3);
+        config.forwarder.retry_delay = j["forwarder"].value("retry_delay", 5);
+        config.forwarder.push_updates = j["forwarder"].value("push_updates", true);
+        config.forwarder.update_handler_threads = j["forwarder"].value("update_handler_threads", 2);
+        config.forwarder.media_input_mode = j["forwarder"].value("media_input_mode", "local");
+        config.forwarder.memory_budget_mb = j["forwarder"].value("memory_budget_mb", 512);
+        config.forwarder.memory_spill_threshold_mb = j["forwarder"].value("memory_spill_threshold_mb", 64);
+        config.forwarder.buffer_pool_mb = j["forwarder"].value("buffer_pool_mb", 128);
+        config.forwarder.file_id_cache = j["forwarder"].value("file_id_cache", "tdlib-db/file_id_cache.tsv");
+        config.forwarder.channel_cache = j["forwarder"].value("channel_cache", "tdlib-db/channel_cache.tsv");
+        config.forwarder.channel_cache_ttl_hours = j["forwarder"].value("channel_cache_ttl_hours", 168);
+        config.forwarder.channel_negative_ttl_minutes = j["forwarder"].value("channel_negative_ttl_minutes", 10);
+        config.forwarder.streaming_threshold_mb = j["forwarder"].value("streaming_threshold_mb", 20);
+        config.forwarder.checkpoint_file = j["forwarder"].value("checkpoint_file", "tdlib-db/forward_checkpoint.log");
+        config.forwarder.dedup_window = j["forwarder"].value("dedup_window", 1024);
+        config.forwarder.send_rate_per_minute = j["forwarder"].value("send_rate_per_minute", 20);
+        config.forwarder.send_burst = j["forwarder"].value("send_burst", 5);
+        config.forwarder.metrics_port = j["forwarder"].value("metrics_port", 9464);
+        config.forwarder.metrics_bind = j["forwarder"].value("metrics_bind", "127.0.0.1");
+        config.forwarder.watch_config = j["forwarder"].value("watch_config", false);
+        
+        // 转发路由表：[{"source": "...", "targets": ["...", ...], "account": "..."}]
+        if (j["forwarder"].contains("routes") && j["forwarder"]["routes"].is_array()) {
+            for (const auto& item : j["forwarder"]["routes"]) {
+                ForwardRoute route;
+                route.source = item.value("source", "");
+                route.account = item.value("account", "");
+                
+                if (item.contains("targets") && item["targets"].is_array()) {
+                    for (const auto& target : item["targets"]) {
+                        if (target.is_string()) {
+                            route.targets.push_back(target.get<std::string>());
+                        }
+                    }
+                }
+                
+                if (!route.source.empty() && !route.targets.empty()) {
+                    config.forwarder.routes.push_back(std::move(route));
+                }
+            }
+        }
         
         // 消息过滤器
         if (j["forwarder"].contains("message_filters") && j["forwarder"]["message_filters"].is_array()) {
@@ -133,11 +306,36 @@ Config load_config(const std::string& config_file) {
         config.logging.log_file = j["logging"].value("log_file", "forwarder.log");
         config.logging.max_size = j["logging"].value("max_size", 10);
         config.logging.max_files = j["logging"].value("max_files", 5);
+        config.logging.async = j["logging"].value("async", true);
+        config.logging.queue_size = j["logging"].value("queue_size", 8192);
+        config.logging.overflow_policy = j["logging"].value("overflow_policy", "block");
+        config.logging.flush_level = j["logging"].value("flush_level", "warn");
+        config.logging.flush_interval = j["logging"].value("flush_interval", 1);
+        config.logging.flush_bytes = j["logging"].value("flush_bytes", 65536);
     }
     
     return config;
 }
 
+// 转发路由：未配置路由表时使用单一的源频道和目标频道，都未指定时返回空
+std::vector<ForwardRoute> effective_routes(const ForwarderConfig& config) {
+    if (!config.routes.empty()) {
+        return config.routes;
+    }
+    
+    if (config.source_channel.empty()) {
+        spdlog::error("未指定源频道");
+        return {};
+    }
+    
+    if (config.target_channel.empty()) {
+        spdlog::error("未指定目标频道");
+        return {};
+    }
+    
+    return {ForwardRoute{config.source_channel, {config.target_channel}, ""}};
+}
+
 // 显示帮助信息
 void show_help(const char* program_name) {
     std::cout << "限制频道消息转发工具 v" << VERSION_STRING << std::endl;
@@ -218,22 +416,27 @@ int main(int argc, char* argv[]) {
         std::cout << "正在加载配置文件: " << config_file << std::endl;
         Config config = load_config(config_file);
         
-        // 命令行参数覆盖配置文件
-        if (!source_channel.empty()) {
-            config.forwarder.source_channel = source_channel;
-        }
-        
-        if (!target_channel.empty()) {
-            config.forwarder.target_channel = target_channel;
-        }
-        
-        if (one_time_mode) {
-            config.forwarder.mode = ForwarderMode::OneTime;
-        }
-        
-        if (debug_mode) {
-            config.logging.level = "debug";
-        }
+        // 命令行参数覆盖配置文件（指定后不再使用路由表），重新加载时同样适用
+        auto apply_overrides = [&](Config& loaded) {
+            if (!source_channel.empty()) {
+                loaded.forwarder.source_channel = source_channel;
+                loaded.forwarder.routes.clear();
+            }
+            
+            if (!target_channel.empty()) {
+                loaded.forwarder.target_channel = target_channel;
+                loaded.forwarder.routes.clear();
+            }
+            
+            if (one_time_mode) {
+                loaded.forwarder.mode = ForwarderMode::OneTime;
+            }
+            
+            if (debug_mode) {
+                loaded.logging.level = "debug";
+            }
+        };
+        apply_overrides(config);
         
         // 初始化日志
         init_logger(config.logging);
@@ -241,11 +444,17 @@ int main(int argc, char* argv[]) {
         // 设置信号处理
         std::signal(SIGINT, signal_handler);
         std::signal(SIGTERM, signal_handler);
+        std::signal(SIGHUP, reload_signal_handler);
         
         // 输出版本信息
         spdlog::info("限制频道消息转发工具 v{}", VERSION_STRING);
         spdlog::info("初始化中...");
         
+        // 多账号：每个账号一个TDLib客户端，共用同一个接收循环
+        for (const auto& account : config.accounts) {
+            ClientManager::instance().add_account(account);
+        }
+        
         // 初始化客户端管理器
         ClientManager::instance().init();
         
@@ -278,7 +487,7 @@ int main(int argc, char* argv[]) {
                 return 1;
             }
             
-            if (config.api.phone_number.empty()) {
+            if (config.api.phone_number.empty() && config.accounts.empty()) {
                 spdlog::error("用户模式下需要提供 phone_number");
                 return 1;
             }
@@ -289,8 +498,15 @@ int main(int argc, char* argv[]) {
             ClientManager::instance().set_phone_number(config.api.phone_number);
         }
         
-        // 启动客户端
-        if (!ClientManager::instance().start()) {
+        // 更新处理线程须在接收线程启动前确定
+        ClientManager::instance().set_update_worker_count(
+            static_cast<std::size_t>(std::max(config.forwarder.update_handler_threads, 1)));
+        
+        // TDLib数据库和文件缓存配置随 setTdlibParameters 发出，同样须在启动前确定
+        ClientManager::instance().set_tdlib_profile(config.tdlib);
+        
+        // 启动客户端：TDLib打开数据库、连接和授权期间，本线程继续初始化其他模块
+        if (!ClientManager::instance().start_connecting()) {
             spdlog::error("启动 Telegram 客户端失败");
             return 1;
         }
@@ -300,33 +516,72 @@ int main(int argc, char* argv[]) {
         
         // 初始化媒体处理器
         MediaHandler::instance().init();
+        MediaHandler::instance().set_delete_uploaded_files(config.tdlib.delete_uploaded_files);
         
-        // 初始化转发器
+        // 初始化转发器（读取频道解析缓存和文件ID缓存）
         forwarder.init(config.forwarder);
         
-        // 检查源频道和目标频道
-        if (config.forwarder.source_channel.empty()) {
-            spdlog::error("未指定源频道");
+        // 等待所有账号授权完成
+        if (!ClientManager::instance().wait_ready()) {
+            spdlog::error("启动 Telegram 客户端失败");
             return 1;
         }
         
-        if (config.forwarder.target_channel.empty()) {
-            spdlog::error("未指定目标频道");
+        // 未配置路由表时使用单一的源频道和目标频道
+        auto routes = effective_routes(config.forwarder);
+        if (routes.empty()) {
             return 1;
         }
         
         // 启动转发器
-        if (!forwarder.start(config.forwarder.source_channel, config.forwarder.target_channel)) {
+        if (!forwarder.start(routes)) {
             spdlog::error("启动转发器失败");
             return 1;
         }
         
         // 主线程等待
-        spdlog::info("转发器已启动，按 Ctrl+C 停止");
+        spdlog::info("转发器已启动，按 Ctrl+C 停止，发送 SIGHUP 重新加载配置");
+        
+        // 重新读取配置文件并应用到运行中的转发器，TDLib会话和进行中的转发不受影响；失败时保留当前配置
+        auto reload_config = [&]() {
+            try {
+                Config loaded = load_config(config_file);
+                apply_overrides(loaded);
+                
+                auto loaded_routes = effective_routes(loaded.forwarder);
+                if (loaded_routes.empty()) {
+                    spdlog::error("重新加载失败，保留当前配置");
+                    return;
+                }
+                
+                if (forwarder.reload(loaded.forwarder, loaded_routes)) {
+                    spdlog::set_level(parse_log_level(loaded.logging.level, spdlog::get_level()));
+                    MediaHandler::instance().set_delete_uploaded_files(loaded.tdlib.delete_uploaded_files);
+                    config = std::move(loaded);
+                }
+            } catch (const std::exception& e) {
+                spdlog::error("重新加载配置失败: {}，保留当前配置", e.what());
+            }
+        };
         
-        // 等待转发器停止
+        // 等待转发器停止；期间处理 SIGHUP 和配置文件修改
+        std::error_code mtime_error;
+        auto config_mtime = std::filesystem::last_write_time(config_file, mtime_error);
         while (forwarder.is_running()) {
             std::this_thread::sleep_for(std::chrono::seconds(1));
+            
+            if (config.forwarder.watch_config) {
+                auto mtime = std::filesystem::last_write_time(config_file, mtime_error);
+                if (!mtime_error && mtime != config_mtime) {
+                    config_mtime = mtime;
+                    spdlog::info("配置文件已修改");
+                    reload_requested = true;
+                }
+            }
+            
+            if (reload_requested.exchange(false)) {
+                reload_config();
+            }
         }
         
         // 正常停止
@@ -335,10 +590,12 @@ int main(int argc, char* argv[]) {
         // 关闭客户端
         ClientManager::instance().stop();
         
+        shutdown_logger();
         return 0;
     } catch (const std::exception& e) {
         std::cerr << "错误: " << e.what() << std::endl;
         spdlog::critical("程序异常终止: {}", e.what());
+        shutdown_logger();
         return 1;
     }
 } 
\ No newline at end of file
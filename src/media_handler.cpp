@@ -3,18 +3,22 @@
 #include <spdlog/spdlog.h>
 #include "../include/media_handler.h"
 #include "../include/client_manager.h"
+#include "../include/file_id_cache.h"
+#include "../include/metrics.h"
+#include "../include/media_traits.h"
 
 namespace tg_forwarder {
 
 // MediaTask 实现
-MediaTask::MediaTask(MediaTaskType type, const Message& message)
+MediaTask::MediaTask(MediaTaskType type, SharedMessage message)
     : type_(type),
       state_(MediaTaskState::Pending),
-      message_(message),
+      message_(std::move(message)),
+      file_size_(0),
       progress_(0) {
     
     // 使用消息ID和聊天ID生成唯一任务ID
-    id_ = generate_message_id(message->chat_id_, message->id_);
+    id_ = generate_message_id((*message_)->chat_id_, (*message_)->id_);
     
     // 初始化时间
     start_time_ = std::chrono::system_clock::now();
@@ -34,16 +38,51 @@ MediaTaskState MediaTask::state() const {
 }
 
 void MediaTask::set_state(MediaTaskState state) {
-    state_ = state;
+    std::function<void(MediaTaskState)> callback;
     
-    // 设置结束时间（如果是完成或失败状态）
-    if (state == MediaTaskState::Completed || state == MediaTaskState::Failed) {
-        end_time_ = std::chrono::system_clock::now();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        state_ = state;
+        
+        // 设置结束时间（如果是完成或失败状态）
+        if (state == MediaTaskState::Completed || state == MediaTaskState::Failed) {
+            end_time_ = std::chrono::system_clock::now();
+        }
+        
+        // 首次进入终止状态时取出完成回调
+        bool terminal = state == MediaTaskState::Completed ||
+                        state == MediaTaskState::Failed ||
+                        state == MediaTaskState::Cancelled;
+        if (terminal && !finished_) {
+            finished_ = true;
+            callback = std::move(finished_callback_);
+            finished_callback_ = nullptr;
+        }
+    }
+    
+    // 在锁外执行回调
+    if (callback) {
+        callback(state);
     }
 }
 
+void MediaTask::on_finished(std::function<void(MediaTaskState)> callback) {
+    MediaTaskState state;
+    
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!finished_) {
+            finished_callback_ = std::move(callback);
+            return;
+        }
+        state = state_;
+    }
+    
+    callback(state);
+}
+
 const Message& MediaTask::message() const {
-    return message_;
+    return *message_;
 }
 
 MemoryBuffer& MediaTask::buffer() {
@@ -54,11 +93,103 @@ const MemoryBuffer& MediaTask::buffer() const {
     return buffer_;
 }
 
+const std::string& MediaTask::local_path() const {
+    return local_path_;
+}
+
+void MediaTask::set_local_path(const std::string& path) {
+    local_path_ = path;
+}
+
+Int32 MediaTask::local_file_id() const {
+    return local_file_id_;
+}
+
+void MediaTask::set_local_file_id(Int32 file_id) {
+    local_file_id_ = file_id;
+}
+
+std::size_t MediaTask::account() const {
+    return account_;
+}
+
+void MediaTask::set_account(std::size_t account) {
+    account_ = account;
+}
+
+void MediaTask::add_unconfirmed_send() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++unconfirmed_sends_;
+}
+
+bool MediaTask::confirm_send() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (unconfirmed_sends_ > 0) {
+        --unconfirmed_sends_;
+    }
+    return unconfirmed_sends_ == 0 && release_requested_;
+}
+
+bool MediaTask::request_release() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (unconfirmed_sends_ == 0) {
+        return true;
+    }
+    release_requested_ = true;
+    return false;
+}
+
+const std::string& MediaTask::source_unique_id() const {
+    return source_unique_id_;
+}
+
+void MediaTask::set_source_unique_id(const std::string& unique_id) {
+    source_unique_id_ = unique_id;
+}
+
+const std::string& MediaTask::remote_file_id() const {
+    return remote_file_id_;
+}
+
+void MediaTask::set_remote_file_id(const std::string& remote_id) {
+    remote_file_id_ = remote_id;
+}
+
+const std::string& MediaTask::stream_conversion() const {
+    return stream_conversion_;
+}
+
+void MediaTask::set_stream_conversion(const std::string& conversion) {
+    stream_conversion_ = conversion;
+}
+
+int64_t MediaTask::file_size() const {
+    return file_size_;
+}
+
+void MediaTask::set_file_size(int64_t size) {
+    file_size_ = size;
+}
+
+bool MediaTask::spilled() const {
+    return spilled_;
+}
+
+void MediaTask::set_spilled(bool spilled) {
+    spilled_ = spilled;
+}
+
+void MediaTask::set_memory_reservation(std::shared_ptr<MemoryBudget::Reservation> reservation) {
+    memory_reservation_ = std::move(reservation);
+}
+
 std::string MediaTask::error() const {
+    std::lock_guard<std::mutex> lock(mutex_);
     return error_;
 }
 
 void MediaTask::set_error(const std::string& error) {
+    std::lock_guard<std::mutex> lock(mutex_);
     error_ = error;
 }
 
@@ -71,29 +202,36 @@ void MediaTask::set_progress(int progress) {
 }
 
 std::chrono::system_clock::time_point MediaTask::start_time() const {
+    std::lock_guard<std::mutex> lock(mutex_);
     return start_time_;
 }
 
 std::chrono::system_clock::time_point MediaTask::end_time() const {
+    std::lock_guard<std::mutex> lock(mutex_);
     return end_time_;
 }
 
 void MediaTask::set_start_time(std::chrono::system_clock::time_point time) {
+    std::lock_guard<std::mutex> lock(mutex_);
     start_time_ = time;
 }
 
 void MediaTask::set_end_time(std::chrono::system_clock::time_point time) {
+    std::lock_guard<std::mutex> lock(mutex_);
     end_time_ = time;
 }
 
 int64_t MediaTask::duration_ms() const {
+    std::lock_guard<std::mutex> lock(mutex_);
     auto duration = end_time_ - start_time_;
     return std::chrono::duration_cast<std::chrono::milliseconds>(duration).count();
 }
 
 // MediaGroupTask 实现
-MediaGroupTask::MediaGroupTask(const std::string& group_id)
-    : id_(group_id) {
+MediaGroupTask::MediaGroupTask(const std::string& group_id, size_t expected_count)
+    : id_(group_id),
+      expected_count_(expected_count) {
+    tasks_.reserve(expected_count);
 }
 
 std::string MediaGroupTask::id() const {
@@ -102,6 +240,14 @@ std::string MediaGroupTask::id() const {
 
 void MediaGroupTask::add_task(std::shared_ptr<MediaTask> task) {
     tasks_.push_back(task);
+    
+    // 任务终止时更新计数；持有弱引用避免任务与组互相持有
+    std::weak_ptr<MediaGroupTask> weak_self = weak_from_this();
+    task->on_finished([weak_self](MediaTaskState state) {
+        if (auto self = weak_self.lock()) {
+            self->on_task_finished(state);
+        }
+    });
 }
 
 const std::vector<std::shared_ptr<MediaTask>>& MediaGroupTask::tasks() const {
@@ -109,19 +255,57 @@ const std::vector<std::shared_ptr<MediaTask>>& MediaGroupTask::tasks() const {
 }
 
 size_t MediaGroupTask::completed_count() const {
-    return std::count_if(tasks_.begin(), tasks_.end(), [](const auto& task) {
-        return task->state() == MediaTaskState::Completed;
-    });
+    return completed_count_.load();
 }
 
 size_t MediaGroupTask::failed_count() const {
-    return std::count_if(tasks_.begin(), tasks_.end(), [](const auto& task) {
-        return task->state() == MediaTaskState::Failed;
-    });
+    return failed_count_.load();
 }
 
 bool MediaGroupTask::is_completed() const {
-    return completed_count() + failed_count() == tasks_.size();
+    return finished_count_.load() >= expected_count_;
+}
+
+void MediaGroupTask::wait() const {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this] { return completed_; });
+}
+
+void MediaGroupTask::on_completed(std::function<void()> callback) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!completed_) {
+            completion_callbacks_.push_back(std::move(callback));
+            return;
+        }
+    }
+    
+    callback();
+}
+
+void MediaGroupTask::on_task_finished(MediaTaskState state) {
+    if (state == MediaTaskState::Completed) {
+        ++completed_count_;
+    } else {
+        ++failed_count_;
+    }
+    
+    // 只有最后一个结束的任务负责通知
+    if (++finished_count_ != expected_count_) {
+        return;
+    }
+    
+    std::vector<std::function<void()>> callbacks;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        completed_ = true;
+        callbacks.swap(completion_callbacks_);
+    }
+    cv_.notify_all();
+    
+    for (auto& callback : callbacks) {
+        callback();
+    }
 }
 
 int MediaGroupTask::overall_progress() const {
@@ -137,16 +321,61 @@ int MediaGroupTask::overall_progress() const {
     return total_progress / static_cast<int>(tasks_.size());
 }
 
-std::string MediaGroupTask::caption() const {
+const td_api::formattedText* MediaGroupTask::caption() const {
     // 寻找第一个有说明文字的消息
     for (const auto& task : tasks_) {
-        std::string caption = get_caption(task->message());
-        if (!caption.empty()) {
+        auto caption = get_formatted_text(task->message());
+        if (caption && !caption->text_.empty()) {
             return caption;
         }
     }
     
-    return "";
+    return nullptr;
+}
+
+namespace {
+// 当前线程所属账号的名称（远程文件ID只对取得它的账号有效）
+std::string current_account_name() {
+    return ClientManager::instance().account_name(ClientManager::current_account());
+}
+
+// 任务预计传输的字节数（复用远程文件时几乎不传输数据）
+int64_t transfer_size(const MediaTask& task) {
+    if (!task.remote_file_id().empty()) {
+        return 0;
+    }
+    
+    if (task.file_size() > 0) {
+        return task.file_size();
+    }
+    
+    auto file = get_main_file(task.message());
+    if (!file) {
+        return 0;
+    }
+    return file->size_ != 0 ? file->size_ : file->expected_size_;
+}
+
+// 媒体处理各阶段的指标
+struct MediaMetrics {
+    Histogram& download_duration = Metrics::instance().histogram(
+        "tg_forwarder_download_duration_seconds", "下载单个媒体文件的耗时");
+    Histogram& upload_duration = Metrics::instance().histogram(
+        "tg_forwarder_upload_duration_seconds", "上传单个媒体文件（发出请求到 updateMessageSendSucceeded）的耗时");
+    Histogram& album_send_duration = Metrics::instance().histogram(
+        "tg_forwarder_album_send_duration_seconds", "发送媒体组请求到收到响应的耗时");
+    Counter& downloaded_bytes = Metrics::instance().counter(
+        "tg_forwarder_downloaded_bytes_total", "下载完成的媒体字节数");
+    Counter& uploaded_bytes = Metrics::instance().counter(
+        "tg_forwarder_uploaded_bytes_total", "上传完成的媒体字节数");
+    Counter& retries = Metrics::instance().counter(
+        "tg_forwarder_media_retries_total", "媒体下载、上传和媒体组发送的重试次数");
+};
+
+MediaMetrics& media_metrics() {
+    static MediaMetrics metrics;
+    return metrics;
+}
 }
 
 // MediaHandler 实现
@@ -157,6 +386,8 @@ MediaHandler& MediaHandler::instance() {
 
 MediaHandler::MediaHandler()
     : running_(false),
+      executor_("media"),
+      scheduler_(executor_),
       max_concurrent_downloads_(2),
       max_concurrent_uploads_(2) {
 }
@@ -180,17 +411,48 @@ void MediaHandler::start() {
     spdlog::info("启动媒体处理器");
     running_ = true;
     
-    // 启动下载和上传线程
-    for (int i = 0; i < max_concurrent_downloads_; ++i) {
-        download_threads_.emplace_back(&MediaHandler::download_worker, this);
-    }
+    // 跟踪消息发送结果，用于记录上传后的远程文件ID
+    auto& client = ClientManager::instance();
+    client.register_update_handler(td_api::updateMessageSendSucceeded::ID, [this](Object update) {
+        on_message_send_succeeded(std::move(update));
+    });
+    client.register_update_handler(td_api::updateMessageSendFailed::ID, [this](Object update) {
+        on_message_send_failed(std::move(update));
+    });
     
-    for (int i = 0; i < max_concurrent_uploads_; ++i) {
-        upload_threads_.emplace_back(&MediaHandler::upload_worker, this);
-    }
+    // 流式传输所需的文件进度和文件生成更新（文件ID按账号各自编号，流式传输只在主账号上进行）
+    streaming_.start();
+    client.register_update_handler(td_api::updateFile::ID, [this](Object update) {
+        if (ClientManager::current_account() == 0) {
+            streaming_.on_update_file(*td::move_object_as<td_api::updateFile>(update));
+        }
+    });
+    client.register_update_handler(td_api::updateFileGenerationStart::ID, [this](Object update) {
+        if (ClientManager::current_account() == 0) {
+            streaming_.on_generation_start(*td::move_object_as<td_api::updateFileGenerationStart>(update));
+        }
+    });
+    client.register_update_handler(td_api::updateFileGenerationStop::ID, [this](Object update) {
+        if (ClientManager::current_account() == 0) {
+            streaming_.on_generation_stop(*td::move_object_as<td_api::updateFileGenerationStop>(update));
+        }
+    });
+    
+    // 下载和上传共用一个工作窃取线程池
+    executor_.start(static_cast<size_t>(max_concurrent_downloads_ + max_concurrent_uploads_));
+    scheduler_.start(executor_.thread_count());
+    
+    // 被限流的发送请求重建时可能读取文件，放到线程池上进行；接收线程不能等待队列空位，只尝试提交
+    client.set_background_executor([this](std::size_t account, std::function<void()> task) {
+        return executor_.try_submit([account, task = std::move(task)]() {
+            AccountScope scope(account);
+            task();
+        });
+    });
     
-    spdlog::info("媒体处理器已启动，下载线程: {}，上传线程: {}", 
-        max_concurrent_downloads_, max_concurrent_uploads_);
+    spdlog::info("媒体处理器已启动，工作线程: {}（下载 {} + 上传 {}），队列上限: {}", 
+        executor_.thread_count(), max_concurrent_downloads_, max_concurrent_uploads_,
+        executor_.capacity());
 }
 
 void MediaHandler::stop() {
@@ -201,214 +463,147 @@ void MediaHandler::stop() {
     spdlog::info("停止媒体处理器");
     running_ = false;
     
-    // 通知所有等待中的线程
-    download_cv_.notify_all();
-    upload_cv_.notify_all();
+    ClientManager::instance().unregister_update_handler(td_api::updateMessageSendSucceeded::ID);
+    ClientManager::instance().unregister_update_handler(td_api::updateMessageSendFailed::ID);
+    ClientManager::instance().unregister_update_handler(td_api::updateFile::ID);
+    ClientManager::instance().unregister_update_handler(td_api::updateFileGenerationStart::ID);
+    ClientManager::instance().unregister_update_handler(td_api::updateFileGenerationStop::ID);
+    ClientManager::instance().set_background_executor(nullptr);
+    streaming_.stop();
     
-    // 等待所有线程结束
-    for (auto& thread : download_threads_) {
-        if (thread.joinable()) {
-            thread.join();
-        }
-    }
-    
-    for (auto& thread : upload_threads_) {
-        if (thread.joinable()) {
-            thread.join();
-        }
-    }
+    // 等待内存预算的下载请求直接失败
+    memory_budget_.cancel_all();
     
-    download_threads_.clear();
-    upload_threads_.clear();
+    // 停止调度和线程池；剩余的排队任务会因 running_ 为 false 而快速失败
+    scheduler_.stop();
+    executor_.stop();
     
     spdlog::info("媒体处理器已停止");
 }
 
-std::future<std::shared_ptr<MediaTask>> MediaHandler::download_media(const Message& message) {
-    std::promise<std::shared_ptr<MediaTask>> promise;
-    auto future = promise.get_future();
+Future<std::shared_ptr<MediaTask>> MediaHandler::download_media(SharedMessage message) {
+    auto task = std::make_shared<MediaTask>(MediaTaskType::Download, std::move(message));
+    auto account = ClientManager::current_account();
+    task->set_account(account);
     
-    auto task = std::make_shared<MediaTask>(MediaTaskType::Download, message);
+    // 先按内存预算排队，获得额度后再进入线程池
+    return reserve_memory({task}).then([this, task, account]() {
+        return submit_download(task, account);
+    });
+}
+
+Future<void> MediaHandler::reserve_memory(const std::vector<std::shared_ptr<MediaTask>>& tasks) {
+    // 只有内存模式会把文件内容读入进程，本地文件模式不占用预算
+    if (media_input_mode_ != MediaInputMode::Memory) {
+        return make_ready_future();
+    }
     
-    {
-        std::lock_guard<std::mutex> lock(download_mutex_);
-        download_queue_.emplace(task, std::move(promise));
+    // 超过溢出阈值的大文件留在磁盘上，不占用预算
+    int64_t threshold = memory_spill_threshold_;
+    int64_t total = 0;
+    for (const auto& task : tasks) {
+        auto file = get_main_file(task->message());
+        if (!file) {
+            continue;
+        }
+        
+        int64_t size = file->size_ != 0 ? file->size_ : file->expected_size_;
+        if (threshold > 0 && size >= threshold) {
+            task->set_spilled(true);
+            continue;
+        }
+        total += size;
+    }
+    
+    if (total == 0) {
+        return make_ready_future();
     }
     
-    download_cv_.notify_one();
+    return memory_budget_.acquire(total).then([tasks](MemoryBudget::Reservation reservation) {
+        auto shared = std::make_shared<MemoryBudget::Reservation>(std::move(reservation));
+        for (const auto& task : tasks) {
+            task->set_memory_reservation(shared);
+        }
+    });
+}
+
+Future<std::shared_ptr<MediaTask>> MediaHandler::submit_download(const std::shared_ptr<MediaTask>& task, std::size_t account) {
+    auto promise = std::make_shared<Promise<std::shared_ptr<MediaTask>>>();
+    auto future = promise->get_future();
+    
+    // 队列已满时在此阻塞，形成背压；任务在提交方所绑定的账号上执行
+    schedule_download(task, promise, account, 0);
     
     return future;
 }
 
-std::future<std::shared_ptr<MediaGroupTask>> MediaHandler::download_media_group(const MessageVector& messages) {
-    if (messages.empty()) {
-        std::promise<std::shared_ptr<MediaGroupTask>> empty_promise;
-        empty_promise.set_value(nullptr);
-        return empty_promise.get_future();
+Future<std::shared_ptr<MediaGroupTask>> MediaHandler::download_media_group(SharedMessageVector messages) {
+    if (!messages || messages->empty()) {
+        return make_ready_future<std::shared_ptr<MediaGroupTask>>(nullptr);
     }
     
     // 获取媒体组ID
-    auto media_group_id = get_media_group_id(messages[0]);
+    auto media_group_id = get_media_group_id(messages->front());
     if (!media_group_id) {
         spdlog::error("无法获取媒体组ID");
-        std::promise<std::shared_ptr<MediaGroupTask>> empty_promise;
-        empty_promise.set_value(nullptr);
-        return empty_promise.get_future();
+        return make_ready_future<std::shared_ptr<MediaGroupTask>>(nullptr);
     }
     
-    std::promise<std::shared_ptr<MediaGroupTask>> group_promise;
-    auto group_future = group_promise.get_future();
+    // 创建媒体组任务，先登记全部任务再开始下载，保证计数准确
+    // 每个任务以别名指针引用列表中的一条消息，共同持有整个列表
+    auto group_task = std::make_shared<MediaGroupTask>(*media_group_id, messages->size());
+    for (const auto& message : *messages) {
+        group_task->add_task(std::make_shared<MediaTask>(MediaTaskType::Download, SharedMessage(messages, &message)));
+    }
     
-    // 创建媒体组任务
-    auto group_task = std::make_shared<MediaGroupTask>(*media_group_id);
+    // 最后一个任务结束时由其所在线程完成Future，不额外创建线程
+    auto promise = std::make_shared<Promise<std::shared_ptr<MediaGroupTask>>>();
+    auto future = promise->get_future();
+    group_task->on_completed([promise, group_task]() {
+        promise->set_value(group_task);
+    });
     
-    // 为组中的每个消息创建下载任务
-    std::vector<std::future<std::shared_ptr<MediaTask>>> futures;
-    for (const auto& message : messages) {
-        futures.push_back(download_media(message));
+    // 整组一次申请内存预算，避免组内部分任务占住额度等待其余任务
+    auto account = ClientManager::current_account();
+    for (const auto& task : group_task->tasks()) {
+        task->set_account(account);
     }
-    
-    // 启动一个独立线程来等待所有下载任务完成
-    std::thread([futures = std::move(futures), group_task, group_promise = std::move(group_promise)]() mutable {
-        for (auto& future : futures) {
-            try {
-                auto task = future.get();
-                if (task) {
-                    group_task->add_task(task);
-                }
-            } catch (const std::exception& e) {
-                spdlog::error("等待下载任务时出错: {}", e.what());
+    reserve_memory(group_task->tasks()).on_ready([this, group_task, account](Future<void> reserved) {
+        try {
+            reserved.get();
+        } catch (const std::exception& e) {
+            for (const auto& task : group_task->tasks()) {
+                task->set_error(e.what());
+                task->set_state(MediaTaskState::Failed);
             }
+            return;
         }
         
-        group_promise.set_value(group_task);
-    }).detach();
+        for (const auto& task : group_task->tasks()) {
+            submit_download(task, account);
+        }
+    });
     
-    return group_future;
+    return future;
 }
 
-std::future<Message> MediaHandler::upload_media(Int64 chat_id, const std::shared_ptr<MediaTask>& task) {
-    std::promise<Message> promise;
-    auto future = promise.get_future();
-    
-    {
-        std::lock_guard<std::mutex> lock(upload_mutex_);
-        upload_queue_.emplace(chat_id, task, std::move(promise));
-    }
+Future<Message> MediaHandler::upload_media(Int64 chat_id, const std::shared_ptr<MediaTask>& task) {
+    auto promise = std::make_shared<Promise<Message>>();
+    auto future = promise->get_future();
     
-    upload_cv_.notify_one();
+    // 队列已满时在此阻塞，形成背压；任务在提交方所绑定的账号上执行
+    schedule_upload(chat_id, task, promise, ClientManager::current_account(), 0);
     
     return future;
 }
 
-std::future<MessageVector> MediaHandler::upload_media_group(Int64 chat_id, const std::shared_ptr<MediaGroupTask>& group_task) {
-    std::promise<MessageVector> promise;
-    auto future = promise.get_future();
+Future<MessageVector> MediaHandler::upload_media_group(Int64 chat_id, const std::shared_ptr<MediaGroupTask>& group_task) {
+    auto promise = std::make_shared<Promise<MessageVector>>();
+    auto future = promise->get_future();
     
-    // 启动一个线程来并行上传媒体组
-    std::thread([this, chat_id, group_task, promise = std::move(promise)]() mutable {
-        try {
-            const auto& tasks = group_task->tasks();
-            if (tasks.empty()) {
-                promise.set_value(MessageVector());
-                return;
-            }
-            
-            // 创建输入媒体数组
-            auto input_media_array = td_api::make_object<td_api::inputMessageMediaGroup>();
-            std::vector<td_api::object_ptr<td_api::InputMessageContent>> media_contents;
-            std::string caption = group_task->caption();
-            
-            for (size_t i = 0; i < tasks.size(); ++i) {
-                const auto& task = tasks[i];
-                const auto& buffer = task->buffer();
-                
-                // 根据媒体类型创建不同的输入媒体
-                auto media_type = get_media_type(task->message());
-                
-                switch (media_type) {
-                    case MediaType::Photo: {
-                        auto input_photo = td_api::make_object<td_api::inputMessagePhoto>();
-                        input_photo->photo_ = td_api::make_object<td_api::inputFileMemory>(
-                            buffer.data(), buffer.name());
-                        
-                        // 仅第一个媒体设置说明文字
-                        if (i == 0 && !caption.empty()) {
-                            input_photo->caption_ = td_api::make_object<td_api::formattedText>(
-                                caption, std::vector<td_api::object_ptr<td_api::textEntity>>());
-                        }
-                        
-                        media_contents.push_back(std::move(input_photo));
-                        break;
-                    }
-                    case MediaType::Video: {
-                        auto input_video = td_api::make_object<td_api::inputMessageVideo>();
-                        input_video->video_ = td_api::make_object<td_api::inputFileMemory>(
-                            buffer.data(), buffer.name());
-                        
-                        // 仅第一个媒体设置说明文字
-                        if (i == 0 && !caption.empty()) {
-                            input_video->caption_ = td_api::make_object<td_api::formattedText>(
-                                caption, std::vector<td_api::object_ptr<td_api::textEntity>>());
-                        }
-                        
-                        media_contents.push_back(std::move(input_video));
-                        break;
-                    }
-                    case MediaType::Document: {
-                        auto input_document = td_api::make_object<td_api::inputMessageDocument>();
-                        input_document->document_ = td_api::make_object<td_api::inputFileMemory>(
-                            buffer.data(), buffer.name());
-                        
-                        // 仅第一个媒体设置说明文字
-                        if (i == 0 && !caption.empty()) {
-                            input_document->caption_ = td_api::make_object<td_api::formattedText>(
-                                caption, std::vector<td_api::object_ptr<td_api::textEntity>>());
-                        }
-                        
-                        media_contents.push_back(std::move(input_document));
-                        break;
-                    }
-                    default:
-                        spdlog::warn("不支持的媒体类型: {}", static_cast<int>(media_type));
-                        break;
-                }
-            }
-            
-            // 设置媒体组内容
-            input_media_array->media_ = std::move(media_contents);
-            
-            // 发送媒体组
-            auto send_message = td_api::make_object<td_api::sendMessageAlbum>();
-            send_message->chat_id_ = chat_id;
-            send_message->input_message_contents_ = std::move(input_media_array->media_);
-            
-            // 发送请求
-            auto response = ClientManager::instance().send_query(std::move(send_message));
-            
-            // 处理响应
-            if (response->get_id() == td_api::error::ID) {
-                auto error = td::move_object_as<td_api::error>(response);
-                throw std::runtime_error("发送媒体组失败: " + error->message_);
-            }
-            
-            // 将响应转换为消息数组
-            auto messages = td::move_object_as<td_api::messages>(response);
-            MessageVector result;
-            
-            for (auto& message : messages->messages_) {
-                result.push_back(std::move(message));
-            }
-            
-            promise.set_value(std::move(result));
-        } catch (const std::exception& e) {
-            try {
-                promise.set_exception(std::current_exception());
-            } catch (...) {
-                // Promise已设置，忽略
-            }
-        }
-    }).detach();
+    // 在线程池中组装相册内容（内存模式下可能需要读文件），发送后由续延处理响应，
+    // 工作线程不阻塞等待服务器返回
+    schedule_album_upload(chat_id, group_task, promise, ClientManager::current_account(), 0);
     
     return future;
 }
@@ -420,6 +615,12 @@ void MediaHandler::set_max_concurrent_downloads(int max) {
     }
     
     max_concurrent_downloads_ = max;
+    
+    // 运行中立即调整线程池大小
+    if (running_) {
+        executor_.resize(static_cast<size_t>(max_concurrent_downloads_ + max_concurrent_uploads_));
+        scheduler_.set_thread_count(executor_.thread_count());
+    }
 }
 
 void MediaHandler::set_max_concurrent_uploads(int max) {
@@ -429,6 +630,104 @@ void MediaHandler::set_max_concurrent_uploads(int max) {
     }
     
     max_concurrent_uploads_ = max;
+    
+    // 运行中立即调整线程池大小
+    if (running_) {
+        executor_.resize(static_cast<size_t>(max_concurrent_downloads_ + max_concurrent_uploads_));
+        scheduler_.set_thread_count(executor_.thread_count());
+    }
+}
+
+void MediaHandler::set_queue_capacity(size_t capacity) {
+    executor_.set_capacity(capacity);
+}
+
+size_t MediaHandler::queued_task_count() const {
+    return executor_.queued_count() +
+           scheduler_.queued_count(MediaScheduler::Lane::Small) +
+           scheduler_.queued_count(MediaScheduler::Lane::Large);
+}
+
+void MediaHandler::set_large_file_threshold(int64_t bytes) {
+    scheduler_.set_large_threshold(bytes);
+}
+
+void MediaHandler::set_memory_budget(int64_t bytes) {
+    memory_budget_.set_limit(bytes);
+}
+
+void MediaHandler::set_memory_spill_threshold(int64_t bytes) {
+    memory_spill_threshold_ = std::max<int64_t>(bytes, 0);
+}
+
+int64_t MediaHandler::memory_in_flight_bytes() const {
+    return memory_budget_.in_use();
+}
+
+size_t MediaHandler::memory_waiting_count() const {
+    return memory_budget_.waiting_count();
+}
+
+void MediaHandler::set_retry_policy(int retry_count, int retry_delay_seconds) {
+    std::lock_guard<std::mutex> lock(retry_mutex_);
+    retry_policy_ = RetryPolicy(retry_count, std::chrono::seconds(std::max(retry_delay_seconds, 1)));
+    spdlog::info("媒体任务失败重试: 最多 {} 次，初始间隔 {} 秒", retry_policy_.max_retries(), std::max(retry_delay_seconds, 1));
+}
+
+size_t MediaHandler::scheduled_retry_count() const {
+    return executor_.scheduled_count();
+}
+
+void MediaHandler::set_media_input_mode(MediaInputMode mode) {
+    media_input_mode_ = mode;
+    spdlog::info("媒体上传输入方式: {}", mode == MediaInputMode::LocalFile ? "本地文件" : "内存");
+}
+
+void MediaHandler::set_streaming_threshold(int64_t bytes) {
+    streaming_threshold_ = std::max<int64_t>(bytes, 0);
+}
+
+void MediaHandler::set_delete_uploaded_files(bool enabled) {
+    delete_uploaded_files_ = enabled;
+    if (enabled) {
+        spdlog::info("转发完成后删除本地源文件");
+    }
+}
+
+void MediaHandler::release_local_files(const std::shared_ptr<MediaTask>& task) {
+    if (!delete_uploaded_files_ || !task || task->local_file_id() == 0) {
+        return;
+    }
+    
+    // 还有消息在上传中时由最后一条的发送结果触发删除
+    if (task->request_release()) {
+        delete_local_file(task);
+    }
+}
+
+void MediaHandler::delete_local_file(const std::shared_ptr<MediaTask>& task) {
+    // 上传已确认，本地副本不再需要；删除失败只影响磁盘占用，交给 optimizeStorage 兜底
+    AccountScope scope(task->account());
+    auto file_id = task->local_file_id();
+    auto query = td_api::make_object<td_api::deleteFile>();
+    query->file_id_ = file_id;
+    ClientManager::instance().send_query_async(std::move(query), [file_id](Object object) {
+        if (object && object->get_id() == td_api::error::ID) {
+            auto& error = static_cast<const td_api::error&>(*object);
+            spdlog::debug("删除本地文件 {} 失败: {}", file_id, error.message_);
+        }
+    });
+    task->set_local_file_id(0);
+}
+
+void MediaHandler::release_local_files(const std::shared_ptr<MediaGroupTask>& group_task) {
+    if (!group_task) {
+        return;
+    }
+    
+    for (const auto& task : group_task->tasks()) {
+        release_local_files(task);
+    }
 }
 
 int MediaHandler::active_download_count() const {
@@ -439,291 +738,562 @@ int MediaHandler::active_upload_count() const {
     return active_uploads_;
 }
 
-void MediaHandler::download_worker() {
-    spdlog::debug("下载线程已启动");
+std::exception_ptr MediaHandler::process_download(const std::shared_ptr<MediaTask>& task) {
+    if (!running_) {
+        return std::make_exception_ptr(MediaError("媒体处理器已停止"));
+    }
+    
+    ++active_downloads_;
     
-    while (running_) {
-        std::shared_ptr<MediaTask> task;
-        std::promise<std::shared_ptr<MediaTask>> promise;
+    std::exception_ptr error;
+    try {
+        task->set_state(MediaTaskState::Processing);
         
-        // 从队列中获取任务
-        {
-            std::unique_lock<std::mutex> lock(download_mutex_);
-            download_cv_.wait(lock, [this] {
-                return !running_ || !download_queue_.empty();
-            });
-            
-            if (!running_) {
-                break;
-            }
-            
-            if (!download_queue_.empty()) {
-                task = download_queue_.front().first;
-                promise = std::move(download_queue_.front().second);
-                download_queue_.pop();
-            }
-        }
+        // 下载文件
+        auto bytes = transfer_size(*task);
+        auto started = std::chrono::steady_clock::now();
+        download_file(task);
+        media_metrics().download_duration.record(std::chrono::steady_clock::now() - started);
+        media_metrics().downloaded_bytes.add(static_cast<std::uint64_t>(std::max<int64_t>(bytes, 0)));
         
-        // 处理任务
-        if (task && promise.get_future().valid()) {
-            try {
-                ++active_downloads_;
-                task->set_state(MediaTaskState::Processing);
-                
-                // 下载文件
-                download_file(task);
-                
-                task->set_state(MediaTaskState::Completed);
-                promise.set_value(task);
-            } catch (const std::exception& e) {
-                spdlog::error("下载文件失败: {}", e.what());
-                
-                task->set_state(MediaTaskState::Failed);
-                task->set_error(e.what());
-                
-                try {
-                    promise.set_value(task);
-                } catch (...) {
-                    // 忽略已设置的promise
-                }
-            }
-            
-            --active_downloads_;
+        task->set_state(MediaTaskState::Completed);
+    } catch (...) {
+        error = std::current_exception();
+    }
+    
+    --active_downloads_;
+    return error;
+}
+
+Future<Message> MediaHandler::process_upload(Int64 chat_id, const std::shared_ptr<MediaTask>& task) {
+    if (!running_) {
+        throw MediaError("媒体处理器已停止");
+    }
+    
+    ++active_uploads_;
+    
+    Future<Message> upload;
+    try {
+        task->set_state(MediaTaskState::Processing);
+        
+        // 上传文件
+        // 上传耗时在收到发送成功的更新时记录：请求返回的只是TDLib的临时消息，上传仍在进行
+        upload = upload_file(chat_id, task);
+    } catch (...) {
+        --active_uploads_;
+        throw;
+    }
+    
+    // 响应到达后（在接收线程上）更新统计和任务状态
+    auto bytes = transfer_size(*task);
+    auto promise = std::make_shared<Promise<Message>>();
+    auto result = promise->get_future();
+    upload.on_ready([this, task, bytes, promise](Future<Message> ready) {
+        --active_uploads_;
+        try {
+            auto message = ready.get();
+            media_metrics().uploaded_bytes.add(static_cast<std::uint64_t>(std::max<int64_t>(bytes, 0)));
+            task->set_state(MediaTaskState::Completed);
+            promise->set_value(std::move(message));
+        } catch (...) {
+            promise->set_exception(std::current_exception());
+        }
+    });
+    
+    return result;
+}
+
+void MediaHandler::schedule_download(const std::shared_ptr<MediaTask>& task,
+                                     const std::shared_ptr<Promise<std::shared_ptr<MediaTask>>>& promise,
+                                     std::size_t account, int attempt) {
+    scheduler_.submit(transfer_size(*task), task->message()->date_, [this, task, promise, account, attempt]() {
+        run_download(task, promise, account, attempt);
+    });
+}
+
+void MediaHandler::schedule_upload(Int64 chat_id, const std::shared_ptr<MediaTask>& task,
+                                   const std::shared_ptr<Promise<Message>>& promise,
+                                   std::size_t account, int attempt) {
+    scheduler_.submit(transfer_size(*task), task->message()->date_, [this, chat_id, task, promise, account, attempt]() {
+        run_upload(chat_id, task, promise, account, attempt);
+    });
+}
+
+void MediaHandler::schedule_album_upload(Int64 chat_id, const std::shared_ptr<MediaGroupTask>& group_task,
+                                         const std::shared_ptr<Promise<MessageVector>>& promise,
+                                         std::size_t account, int attempt) {
+    // 整组按总大小和第一条消息的时间排队
+    int64_t total_size = 0;
+    int32_t date = 0;
+    for (const auto& task : group_task->tasks()) {
+        total_size += transfer_size(*task);
+        if (date == 0) {
+            date = task->message()->date_;
         }
     }
     
-    spdlog::debug("下载线程已退出");
+    scheduler_.submit(total_size, date, [this, chat_id, group_task, promise, account, attempt]() {
+        run_album_upload(chat_id, group_task, promise, account, attempt);
+    });
 }
 
-void MediaHandler::upload_worker() {
-    spdlog::debug("上传线程已启动");
+void MediaHandler::run_download(const std::shared_ptr<MediaTask>& task,
+                                const std::shared_ptr<Promise<std::shared_ptr<MediaTask>>>& promise,
+                                std::size_t account, int attempt) {
+    AccountScope scope(account);
     
-    while (running_) {
-        Int64 chat_id = 0;
-        std::shared_ptr<MediaTask> task;
-        std::promise<Message> promise;
+    auto error = process_download(task);
+    if (error) {
+        // 临时性错误放入时间轮稍后重试，等待期间不占用工作线程
+        auto retry = [this, task, promise, account, attempt]() {
+            schedule_download(task, promise, account, attempt + 1);
+        };
+        if (schedule_retry("下载文件 " + task->id(), error, attempt + 1, std::move(retry))) {
+            return;
+        }
         
-        // 从队列中获取任务
-        {
-            std::unique_lock<std::mutex> lock(upload_mutex_);
-            upload_cv_.wait(lock, [this] {
-                return !running_ || !upload_queue_.empty();
-            });
-            
-            if (!running_) {
-                break;
-            }
-            
-            if (!upload_queue_.empty()) {
-                std::tie(chat_id, task, promise) = std::move(upload_queue_.front());
-                upload_queue_.pop();
+        auto what = RetryPolicy::describe(error);
+        spdlog::error("下载文件失败: {}", what);
+        
+        task->set_error(what);
+        task->set_state(MediaTaskState::Failed);
+    }
+    
+    promise->set_value(task);
+}
+
+void MediaHandler::run_upload(Int64 chat_id, const std::shared_ptr<MediaTask>& task,
+                              const std::shared_ptr<Promise<Message>>& promise,
+                              std::size_t account, int attempt) {
+    AccountScope scope(account);
+    
+    // 发出请求后工作线程即返回，结果在接收线程上处理
+    Future<Message> upload;
+    try {
+        upload = process_upload(chat_id, task);
+    } catch (...) {
+        upload = make_exceptional_future<Message>(std::current_exception());
+    }
+    
+    upload.on_ready([this, chat_id, task, promise, account, attempt](Future<Message> result) {
+        std::exception_ptr error;
+        try {
+            promise->set_value(result.get());
+            return;
+        } catch (...) {
+            error = std::current_exception();
+        }
+        
+        // 流式上传的生成文件不能从头再读一遍，只重试普通上传；重试交给时间轮，不在此等待
+        if (task->stream_conversion().empty()) {
+            auto retry = [this, chat_id, task, promise, account, attempt]() {
+                schedule_upload(chat_id, task, promise, account, attempt + 1);
+            };
+            if (schedule_retry("上传文件 " + task->id(), error, attempt + 1, std::move(retry))) {
+                return;
             }
         }
         
-        // 处理任务
-        if (task && promise.get_future().valid()) {
-            try {
-                ++active_uploads_;
-                task->set_state(MediaTaskState::Processing);
-                
-                // 上传文件
-                auto message = upload_file(chat_id, task);
+        auto what = RetryPolicy::describe(error);
+        spdlog::error("上传文件失败: {}", what);
+        
+        task->set_error(what);
+        task->set_state(MediaTaskState::Failed);
+        promise->set_exception(error);
+    });
+}
+
+void MediaHandler::run_album_upload(Int64 chat_id, const std::shared_ptr<MediaGroupTask>& group_task,
+                                    const std::shared_ptr<Promise<MessageVector>>& promise,
+                                    std::size_t account, int attempt) {
+    AccountScope scope(account);
+    
+    if (!running_) {
+        promise->set_exception(std::make_exception_ptr(MediaError("媒体处理器已停止")));
+        return;
+    }
+    
+    try {
+        const auto& tasks = group_task->tasks();
+        if (tasks.empty()) {
+            promise->set_value(MessageVector());
+            return;
+        }
+        
+        // 构造相册请求；被限流拒绝时由限流器重新构造后重发
+        auto make_request = [this, chat_id, group_task]() -> Function {
+            return make_album_request(chat_id, group_task);
+        };
+        
+        // 在接收线程上登记各条临时消息并转换结果
+        auto started = std::chrono::steady_clock::now();
+        ClientManager::instance().send_query_future(QueryFactory(make_request))
+            .then([this, tasks, started](Object response) {
+                media_metrics().album_send_duration.record(std::chrono::steady_clock::now() - started);
+                if (response->get_id() == td_api::error::ID) {
+                    auto error = td::move_object_as<td_api::error>(response);
+                    if (is_retryable_error(error->code_, error->message_)) {
+                        throw NetworkError("发送媒体组失败: " + error->message_,
+                                           parse_retry_after(error->code_, error->message_));
+                    }
+                    throw MediaError("发送媒体组失败: " + error->message_);
+                }
                 
-                task->set_state(MediaTaskState::Completed);
-                promise.set_value(std::move(message));
-            } catch (const std::exception& e) {
-                spdlog::error("上传文件失败: {}", e.what());
+                auto messages = td::move_object_as<td_api::messages>(response);
+                MessageVector result;
                 
-                task->set_state(MediaTaskState::Failed);
-                task->set_error(e.what());
+                for (size_t i = 0; i < messages->messages_.size(); ++i) {
+                    if (i < tasks.size()) {
+                        track_sent_message(messages->messages_[i]->id_, tasks[i], started);
+                    }
+                    result.push_back(std::move(messages->messages_[i]));
+                }
                 
+                return result;
+            })
+            .on_ready([this, chat_id, group_task, promise, account, attempt](Future<MessageVector> result) {
+                std::exception_ptr error;
                 try {
-                    promise.set_exception(std::current_exception());
+                    promise->set_value(result.get());
+                    return;
                 } catch (...) {
-                    // 忽略已设置的promise
+                    error = std::current_exception();
                 }
-            }
-            
-            --active_uploads_;
+                
+                // 整组重发；续延在接收线程上执行，重试交给时间轮，不在此等待
+                auto retry = [this, chat_id, group_task, promise, account, attempt]() {
+                    schedule_album_upload(chat_id, group_task, promise, account, attempt + 1);
+                };
+                if (!schedule_retry("发送媒体组 " + group_task->id(), error, attempt + 1, std::move(retry))) {
+                    promise->set_exception(error);
+                }
+            });
+    } catch (...) {
+        promise->set_exception(std::current_exception());
+    }
+}
+
+bool MediaHandler::schedule_retry(const std::string& what, const std::exception_ptr& error, int attempt,
+                                  TaskExecutor::Task retry) {
+    if (!running_) {
+        return false;
+    }
+    
+    // 永久性错误（权限、文件不存在、不支持的类型等）不重试
+    int retry_after = 0;
+    if (!RetryPolicy::is_retryable(error, retry_after)) {
+        return false;
+    }
+    
+    std::chrono::milliseconds delay;
+    {
+        std::lock_guard<std::mutex> lock(retry_mutex_);
+        if (attempt > retry_policy_.max_retries()) {
+            spdlog::warn("{} 已重试 {} 次，不再重试", what, attempt - 1);
+            return false;
         }
+        delay = retry_policy_.delay_for(attempt, retry_after);
     }
     
-    spdlog::debug("上传线程已退出");
+    spdlog::warn("{} 失败，{} ms 后第 {} 次重试: {}", what, delay.count(), attempt, RetryPolicy::describe(error));
+    media_metrics().retries.add();
+    return executor_.submit_after(delay, std::move(retry));
 }
 
 void MediaHandler::download_file(std::shared_ptr<MediaTask> task) {
     auto& message = task->message();
     
-    // 获取文件ID
-    auto file_ids = get_file_ids(message);
-    if (file_ids.empty()) {
+    // 获取主媒体文件
+    auto main_file = get_main_file(message);
+    if (!main_file) {
         throw MediaError("消息不包含媒体文件");
     }
     
-    // 通常使用第一个（最大的）文件
-    Int32 file_id = file_ids[0];
+    if (main_file->remote_) {
+        task->set_source_unique_id(main_file->remote_->unique_id_);
+    }
+    
+    auto media_type = get_media_type(message);
+    std::string file_name = "media_" + std::to_string(message->id_);
+    file_name += get_file_extension(media_type, message);
+    task->buffer().set_name(file_name);
+    
+    // 同一文件已上传过时直接复用远程文件ID，跳过下载和上传
+    auto& cache = FileIdCache::instance();
+    if (cache.is_open()) {
+        auto remote_id = cache.lookup(current_account_name(), task->source_unique_id());
+        if (remote_id) {
+            task->set_remote_file_id(*remote_id);
+            task->set_file_size(main_file->size_);
+            spdlog::info("复用已上传的文件: {} (命中 {} / 未命中 {})",
+                file_name, cache.hit_count(), cache.miss_count());
+            return;
+        }
+    }
+    
+    Int32 file_id = main_file->id_;
+    int64_t expected_size = main_file->size_ != 0 ? main_file->size_ : main_file->expected_size_;
+    
+    // 大文件边下载边上传：下载在后台进行，上传端通过 inputFileGenerated 读取已下载的部分
+    int64_t threshold = streaming_threshold_;
+    bool already_downloaded = main_file->local_ && main_file->local_->is_downloading_completed_;
+    if (threshold > 0 && expected_size >= threshold && !already_downloaded &&
+        media_input_mode_ == MediaInputMode::LocalFile && ClientManager::current_account() == 0) {
+        task->set_stream_conversion(streaming_.begin(file_id, expected_size,
+            MediaScheduler::download_priority(expected_size)));
+        task->set_local_file_id(file_id);
+        task->set_file_size(expected_size);
+        spdlog::info("文件以流式方式传输: {} ({} 字节)", file_name, expected_size);
+        return;
+    }
+    
+    // 获取文件信息后发起下载，两个请求以续延串联；
+    // 同步下载可能远超 send_query 的超时时间，因此直接等待Future
+    auto& client = ClientManager::instance();
     
-    // 获取文件信息
     auto get_file = td_api::make_object<td_api::getFile>();
     get_file->file_id_ = file_id;
     
-    auto response = ClientManager::instance().send_query(std::move(get_file));
+    // 小文件使用更高的TDLib下载优先级，与大文件同时下载时先完成
+    auto priority = MediaScheduler::download_priority(expected_size);
+    auto file_future = client.request<td_api::file>(std::move(get_file))
+        .then([&client, priority](td_api::object_ptr<td_api::file> info) {
+            auto download_file = td_api::make_object<td_api::downloadFile>();
+            download_file->file_id_ = info->id_;
+            download_file->priority_ = priority;
+            download_file->offset_ = 0;
+            download_file->limit_ = 0; // 0表示下载整个文件
+            download_file->synchronous_ = true;
+            
+            return client.request<td_api::file>(std::move(download_file));
+        });
     
-    if (response->get_id() == td_api::error::ID) {
-        auto error = td::move_object_as<td_api::error>(response);
-        throw MediaError("获取文件信息失败: " + error->message_);
+    td_api::object_ptr<td_api::file> file;
+    try {
+        file = file_future.get();
+    } catch (const NetworkError& e) {
+        throw NetworkError(std::string("下载文件失败: ") + e.what(), e.retry_after());
+    } catch (const std::exception& e) {
+        throw MediaError(std::string("下载文件失败: ") + e.what());
     }
     
-    auto file = td::move_object_as<td_api::file>(response);
-    
-    // 下载文件
-    auto download_file = td_api::make_object<td_api::downloadFile>();
-    download_file->file_id_ = file->id_;
-    download_file->priority_ = 1;
-    download_file->offset_ = 0;
-    download_file->limit_ = 0; // 0表示下载整个文件
-    download_file->synchronous_ = true;
+    // 同步下载提前返回（如连接中断）时稍后重试
+    if (!file->local_->is_downloading_completed_) {
+        throw NetworkError("文件下载未完成");
+    }
     
-    response = ClientManager::instance().send_query(std::move(download_file));
+    // 记录TDLib缓存中的文件路径，上传时直接引用，不把文件内容读入进程内存
+    task->set_local_path(file->local_->path_);
+    task->set_local_file_id(file->id_);
+    task->set_file_size(file->size_ != 0 ? file->size_ : file->local_->downloaded_size_);
     
-    if (response->get_id() == td_api::error::ID) {
-        auto error = td::move_object_as<td_api::error>(response);
-        throw MediaError("下载文件失败: " + error->message_);
+    // 仅内存模式下读入文件内容（溢出到磁盘的大文件除外）
+    if (media_input_mode_ == MediaInputMode::Memory && !task->spilled()) {
+        task->buffer().load_from_file(file->local_->path_);
     }
     
-    file = td::move_object_as<td_api::file>(response);
+    spdlog::info("文件下载完成: {} ({} 字节)", file_name, task->file_size());
+}
+
+Future<Message> MediaHandler::upload_file(Int64 chat_id, const std::shared_ptr<MediaTask>& task) {
+    return send_media_by_type(chat_id, task);
+}
+
+Function MediaHandler::make_album_request(Int64 chat_id, const std::shared_ptr<MediaGroupTask>& group_task) {
+    const auto& tasks = group_task->tasks();
+    auto caption = group_task->caption();
+    
+    // 创建输入媒体数组
+    std::vector<td_api::object_ptr<td_api::InputMessageContent>> media_contents;
     
-    // 如果文件已下载，读取文件内容
-    if (file->local_->is_downloading_completed_) {
-        std::ifstream file_stream(file->local_->path_, std::ios::binary);
-        if (!file_stream.is_open()) {
-            throw MediaError("无法打开下载的文件: " + file->local_->path_);
-        }
+    for (size_t i = 0; i < tasks.size(); ++i) {
+        const auto& task = tasks[i];
+        const auto& message = task->message();
         
-        // 读取文件内容到缓冲区
-        std::string content((std::istreambuf_iterator<char>(file_stream)), 
-                            std::istreambuf_iterator<char>());
-        
-        task->buffer().append(content);
-        
-        // 设置文件名
-        auto media_type = get_media_type(message);
-        std::string file_name = "media_" + std::to_string(message->id_);
-        file_name += get_file_extension(media_type, message);
-        
-        task->buffer().set_name(file_name);
+        // 按内容类型表构造输入媒体
+        auto traits = find_content_traits(message);
+        if (!traits || !traits->album_capable) {
+            spdlog::warn("不支持的媒体类型: {}", traits ? traits->name : "unknown");
+            continue;
+        }
         
-        spdlog::info("文件下载完成: {} ({} 字节)", file_name, content.size());
-    } else {
-        throw MediaError("文件下载未完成");
+        // 仅第一个媒体设置说明文字，保留源消息的格式实体
+        media_contents.push_back(traits->make_input(*message->content_, make_input_file(task),
+                                                    i == 0 ? clone_formatted_text(caption) : nullptr));
     }
+    
+    // 发送媒体组
+    auto send_message = td_api::make_object<td_api::sendMessageAlbum>();
+    send_message->chat_id_ = chat_id;
+    send_message->input_message_contents_ = std::move(media_contents);
+    return send_message;
 }
 
-Message MediaHandler::upload_file(Int64 chat_id, const std::shared_ptr<MediaTask>& task) {
-    return send_media_by_type(chat_id, task);
+td_api::object_ptr<td_api::InputFile> MediaHandler::make_input_file(const std::shared_ptr<MediaTask>& task) {
+    // 命中文件ID缓存：直接引用已上传的远程文件
+    if (!task->remote_file_id().empty()) {
+        return td_api::make_object<td_api::inputFileRemote>(task->remote_file_id());
+    }
+    
+    // 流式传输：上传端随下载进度读取生成文件
+    if (!task->stream_conversion().empty()) {
+        return td_api::make_object<td_api::inputFileGenerated>(
+            task->buffer().name(), task->stream_conversion(), task->file_size());
+    }
+    
+    // 默认直接引用TDLib下载好的本地文件；内存模式下溢出的大文件同样引用磁盘文件
+    bool on_disk = media_input_mode_ == MediaInputMode::LocalFile || task->spilled();
+    if (on_disk && !task->local_path().empty()) {
+        return td_api::make_object<td_api::inputFileLocal>(task->local_path());
+    }
+    
+    // 内存模式：把缓冲区移交给请求对象，避免再复制一份
+    auto& buffer = task->buffer();
+    if (buffer.size() == 0 && !task->local_path().empty()) {
+        buffer.load_from_file(task->local_path());
+    }
+    
+    return td_api::make_object<td_api::inputFileMemory>(buffer.release(), buffer.name());
 }
 
-Message MediaHandler::send_media_by_type(Int64 chat_id, const std::shared_ptr<MediaTask>& task) {
+td_api::object_ptr<td_api::InputMessageContent> MediaHandler::make_media_content(const std::shared_ptr<MediaTask>& task) {
     const auto& message = task->message();
-    const auto& buffer = task->buffer();
     
-    // 根据媒体类型发送不同类型的消息
-    auto media_type = get_media_type(message);
-    std::string caption = get_caption(message);
+    // 按内容类型表构造消息内容
+    auto traits = find_content_traits(message);
+    if (!traits || traits->media_type == MediaType::Unknown) {
+        throw MediaError("不支持的媒体类型");
+    }
     
-    td_api::object_ptr<td_api::InputMessageContent> content;
+    // 说明文字连同格式实体直接从源消息复制到请求中
+    return traits->make_input(*message->content_, make_input_file(task), clone_formatted_text(get_formatted_text(message)));
+}
+
+Future<Message> MediaHandler::send_media_by_type(Int64 chat_id, const std::shared_ptr<MediaTask>& task) {
+    // 发送消息；被限流拒绝时由限流器重新构造请求后重发（内存模式下会重新读入文件）
+    auto make_request = [this, chat_id, task]() -> Function {
+        auto send_message = td_api::make_object<td_api::sendMessage>();
+        send_message->chat_id_ = chat_id;
+        send_message->input_message_content_ = make_media_content(task);
+        return send_message;
+    };
     
-    switch (media_type) {
-        case MediaType::Photo: {
-            auto input_photo = td_api::make_object<td_api::inputMessagePhoto>();
-            input_photo->photo_ = td_api::make_object<td_api::inputFileMemory>(
-                buffer.data(), buffer.name());
-            
-            if (!caption.empty()) {
-                input_photo->caption_ = td_api::make_object<td_api::formattedText>(
-                    caption, std::vector<td_api::object_ptr<td_api::textEntity>>());
+    // 续延在接收线程上执行：登记临时消息ID，保证早于 updateMessageSendSucceeded 处理
+    auto account = ClientManager::current_account();
+    auto started = std::chrono::steady_clock::now();
+    return ClientManager::instance().send_query_future(QueryFactory(make_request))
+        .then([this, chat_id, task, account, started](Object response) -> Future<Message> {
+            if (response->get_id() != td_api::error::ID) {
+                auto message = td::move_object_as<td_api::message>(response);
+                track_sent_message(message->id_, task, started);
+                return make_ready_future<Message>(std::move(message));
             }
             
-            content = std::move(input_photo);
-            break;
-        }
-        case MediaType::Video: {
-            auto input_video = td_api::make_object<td_api::inputMessageVideo>();
-            input_video->video_ = td_api::make_object<td_api::inputFileMemory>(
-                buffer.data(), buffer.name());
+            auto error = td::move_object_as<td_api::error>(response);
             
-            if (!caption.empty()) {
-                input_video->caption_ = td_api::make_object<td_api::formattedText>(
-                    caption, std::vector<td_api::object_ptr<td_api::textEntity>>());
+            // 临时性错误（包括限流器已重发多次仍被限流）交给上层稍后重试
+            if (is_retryable_error(error->code_, error->message_)) {
+                throw NetworkError("发送媒体消息失败: " + error->message_,
+                                   parse_retry_after(error->code_, error->message_));
             }
             
-            content = std::move(input_video);
-            break;
-        }
-        case MediaType::Document: {
-            auto input_document = td_api::make_object<td_api::inputMessageDocument>();
-            input_document->document_ = td_api::make_object<td_api::inputFileMemory>(
-                buffer.data(), buffer.name());
-            
-            if (!caption.empty()) {
-                input_document->caption_ = td_api::make_object<td_api::formattedText>(
-                    caption, std::vector<td_api::object_ptr<td_api::textEntity>>());
+            if (task->remote_file_id().empty()) {
+                throw MediaError("发送媒体消息失败: " + error->message_);
             }
             
-            content = std::move(input_document);
-            break;
-        }
-        case MediaType::Audio: {
-            auto input_audio = td_api::make_object<td_api::inputMessageAudio>();
-            input_audio->audio_ = td_api::make_object<td_api::inputFileMemory>(
-                buffer.data(), buffer.name());
-            
-            if (!caption.empty()) {
-                input_audio->caption_ = td_api::make_object<td_api::formattedText>(
-                    caption, std::vector<td_api::object_ptr<td_api::textEntity>>());
-            }
+            // 缓存的远程文件ID可能已失效，改为重新下载上传一次；下载会阻塞，交回线程池执行
+            spdlog::warn("复用远程文件失败，重新下载: {}", error->message_);
+            FileIdCache::instance().invalidate(current_account_name(), task->source_unique_id());
+            task->set_remote_file_id("");
             
-            content = std::move(input_audio);
-            break;
-        }
-        case MediaType::Animation: {
-            auto input_animation = td_api::make_object<td_api::inputMessageAnimation>();
-            input_animation->animation_ = td_api::make_object<td_api::inputFileMemory>(
-                buffer.data(), buffer.name());
+            auto promise = std::make_shared<Promise<Message>>();
+            auto resend = promise->get_future();
+            auto download = [this, chat_id, task, account, promise]() {
+                AccountScope scope(account);
+                try {
+                    download_file(task);
+                    send_media_by_type(chat_id, task).on_ready([promise](Future<Message> result) {
+                        try {
+                            promise->set_value(result.get());
+                        } catch (...) {
+                            promise->set_exception(std::current_exception());
+                        }
+                    });
+                } catch (...) {
+                    promise->set_exception(std::current_exception());
+                }
+            };
             
-            if (!caption.empty()) {
-                input_animation->caption_ = td_api::make_object<td_api::formattedText>(
-                    caption, std::vector<td_api::object_ptr<td_api::textEntity>>());
+            // 延迟队列不受容量限制，接收线程不会在此阻塞
+            if (!executor_.submit_after(std::chrono::milliseconds(0), std::move(download))) {
+                throw MediaError("媒体处理器已停止");
             }
-            
-            content = std::move(input_animation);
-            break;
-        }
-        case MediaType::Sticker: {
-            auto input_sticker = td_api::make_object<td_api::inputMessageSticker>();
-            input_sticker->sticker_ = td_api::make_object<td_api::inputFileMemory>(
-                buffer.data(), buffer.name());
-            
-            content = std::move(input_sticker);
-            break;
+            return resend;
+        });
+}
+
+void MediaHandler::track_sent_message(Int64 message_id, const std::shared_ptr<MediaTask>& task,
+                                      std::chrono::steady_clock::time_point started) {
+    task->add_unconfirmed_send();
+    
+    std::lock_guard<std::mutex> lock(sent_messages_mutex_);
+    sent_messages_[{ClientManager::current_account(), message_id}] = SentMessage{task, started};
+}
+
+void MediaHandler::confirm_sent_message(const std::shared_ptr<MediaTask>& task) {
+    if (task->confirm_send()) {
+        delete_local_file(task);
+    }
+}
+
+void MediaHandler::on_message_send_succeeded(Object object) {
+    auto update = td::move_object_as<td_api::updateMessageSendSucceeded>(object);
+    
+    SentMessage sent;
+    {
+        std::lock_guard<std::mutex> lock(sent_messages_mutex_);
+        auto it = sent_messages_.find({ClientManager::current_account(), update->old_message_id_});
+        if (it == sent_messages_.end()) {
+            return;
         }
-        default:
-            throw MediaError("不支持的媒体类型");
+        sent = std::move(it->second);
+        sent_messages_.erase(it);
     }
+    media_metrics().upload_duration.record(std::chrono::steady_clock::now() - sent.started);
+    const auto& task = sent.task;
     
-    // 发送消息
-    auto send_message = td_api::make_object<td_api::sendMessage>();
-    send_message->chat_id_ = chat_id;
-    send_message->input_message_content_ = std::move(content);
+    // 发送成功后的消息携带目标端的远程文件ID（已复用远程文件或无法识别源文件时无需记录）
+    const auto& unique_id = task->source_unique_id();
+    auto file = get_main_file(update->message_);
+    if (task->remote_file_id().empty() && !unique_id.empty() && FileIdCache::instance().is_open() &&
+        file && file->remote_ && !file->remote_->id_.empty()) {
+        FileIdCache::instance().store(current_account_name(), unique_id, file->remote_->id_);
+        spdlog::debug("记录远程文件ID: {}", unique_id);
+    }
+    
+    confirm_sent_message(task);
+}
+
+void MediaHandler::on_message_send_failed(Object object) {
+    auto update = td::move_object_as<td_api::updateMessageSendFailed>(object);
     
-    auto response = ClientManager::instance().send_query(std::move(send_message));
+    std::shared_ptr<MediaTask> task;
+    {
+        std::lock_guard<std::mutex> lock(sent_messages_mutex_);
+        auto it = sent_messages_.find({ClientManager::current_account(), update->old_message_id_});
+        if (it == sent_messages_.end()) {
+            return;
+        }
+        task = std::move(it->second.task);
+        sent_messages_.erase(it);
+    }
     
-    if (response->get_id() == td_api::error::ID) {
-        auto error = td::move_object_as<td_api::error>(response);
-        throw MediaError("发送媒体消息失败: " + error->message_);
+    // 被限流的消息由 ClientManager 在限流结束后以 resendMessages 重发，仍会读取本地文件，因此不再删除
+    if (update->error_ && parse_retry_after(update->error_->code_, update->error_->message_) > 0) {
+        return;
     }
     
-    return td::move_object_as<td_api::message>(response);
+    confirm_sent_message(task);
 }
 
 } // namespace tg_forwarder 
\ No newline at end of file
@@ -0,0 +1,191 @@
+#include <cmath>
+#include <chrono>
+#include <algorithm>
+#include <spdlog/spdlog.h>
+#include "../include/media_scheduler.h"
+
+namespace tg_forwarder {
+
+namespace {
+// 估算传输时间所用的参考速度（字节/秒），只用于排序
+constexpr double kReferenceBytesPerSecond = 1024.0 * 1024.0;
+}
+
+bool MediaScheduler::JobOrder::operator()(const Job& a, const Job& b) const {
+    // priority_queue 顶部为"最大"元素，这里让排序键最小的在顶部
+    if (a.key != b.key) {
+        return a.key > b.key;
+    }
+    return a.sequence > b.sequence;
+}
+
+MediaScheduler::MediaScheduler(TaskExecutor& executor)
+    : executor_(executor) {
+}
+
+void MediaScheduler::start(size_t thread_count) {
+    std::vector<std::pair<Lane, Task>> runnable;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        running_ = true;
+        thread_count_ = std::max<size_t>(thread_count, 1);
+        runnable = take_runnable();
+    }
+    dispatch(std::move(runnable));
+}
+
+void MediaScheduler::stop() {
+    std::vector<std::pair<Lane, Task>> remaining;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!running_) {
+            return;
+        }
+        running_ = false;
+        
+        // 不再受名额限制，全部交给线程池尽快结束
+        for (auto* queue : {&small_queue_, &large_queue_}) {
+            auto lane = queue == &small_queue_ ? Lane::Small : Lane::Large;
+            while (!queue->empty()) {
+                remaining.emplace_back(lane, std::move(const_cast<Job&>(queue->top()).task));
+                queue->pop();
+                ++(lane == Lane::Small ? small_running_ : large_running_);
+            }
+        }
+    }
+    space_cv_.notify_all();
+    
+    dispatch(std::move(remaining));
+}
+
+void MediaScheduler::set_thread_count(size_t thread_count) {
+    std::vector<std::pair<Lane, Task>> runnable;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        thread_count_ = std::max<size_t>(thread_count, 1);
+        runnable = take_runnable();
+    }
+    dispatch(std::move(runnable));
+}
+
+void MediaScheduler::set_large_threshold(int64_t bytes) {
+    large_threshold_ = std::max<int64_t>(bytes, 0);
+}
+
+void MediaScheduler::submit(int64_t expected_size, int32_t message_date, Task task) {
+    std::vector<std::pair<Lane, Task>> runnable;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        
+        // 工作线程内部提交（重试、后续任务）不受容量限制，避免线程池自锁
+        if (!executor_.in_worker_thread()) {
+            space_cv_.wait(lock, [this] {
+                return !running_ || small_queue_.size() + large_queue_.size() < executor_.capacity();
+            });
+        }
+        
+        if (!running_) {
+            lock.unlock();
+            task();
+            return;
+        }
+        
+        // 消息时间越早、文件越小越先执行
+        double base = message_date > 0
+            ? static_cast<double>(message_date)
+            : static_cast<double>(std::chrono::duration_cast<std::chrono::seconds>(
+                  std::chrono::system_clock::now().time_since_epoch()).count());
+        double key = base + static_cast<double>(std::max<int64_t>(expected_size, 0)) / kReferenceBytesPerSecond;
+        
+        int64_t threshold = large_threshold_;
+        auto& queue = threshold > 0 && expected_size >= threshold ? large_queue_ : small_queue_;
+        queue.push(Job{key, next_sequence_++, std::move(task)});
+        
+        runnable = take_runnable();
+    }
+    dispatch(std::move(runnable));
+}
+
+size_t MediaScheduler::queued_count(Lane lane) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return lane == Lane::Small ? small_queue_.size() : large_queue_.size();
+}
+
+size_t MediaScheduler::running_count(Lane lane) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return lane == Lane::Small ? small_running_ : large_running_;
+}
+
+int32_t MediaScheduler::download_priority(int64_t expected_size) {
+    // 1MB 以内为最高优先级，大小每翻一倍降低2级
+    constexpr double kMegabyte = 1024.0 * 1024.0;
+    if (expected_size <= kMegabyte) {
+        return 32;
+    }
+    
+    auto doublings = std::log2(static_cast<double>(expected_size) / kMegabyte);
+    return static_cast<int32_t>(std::clamp(32.0 - 2.0 * std::ceil(doublings), 1.0, 32.0));
+}
+
+std::vector<std::pair<MediaScheduler::Lane, MediaScheduler::Task>> MediaScheduler::take_runnable() {
+    std::vector<std::pair<Lane, Task>> runnable;
+    if (!running_) {
+        return runnable;
+    }
+    
+    // 优先小文件；大文件只在不超过其名额时执行
+    while (small_running_ + large_running_ < thread_count_) {
+        if (!small_queue_.empty()) {
+            runnable.emplace_back(Lane::Small, std::move(const_cast<Job&>(small_queue_.top()).task));
+            small_queue_.pop();
+            ++small_running_;
+        } else if (!large_queue_.empty() && large_running_ < large_slots()) {
+            runnable.emplace_back(Lane::Large, std::move(const_cast<Job&>(large_queue_.top()).task));
+            large_queue_.pop();
+            ++large_running_;
+        } else {
+            break;
+        }
+    }
+    
+    if (!runnable.empty()) {
+        space_cv_.notify_all();
+    }
+    
+    return runnable;
+}
+
+void MediaScheduler::finish(Lane lane) {
+    std::vector<std::pair<Lane, Task>> runnable;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        --(lane == Lane::Small ? small_running_ : large_running_);
+        runnable = take_runnable();
+    }
+    dispatch(std::move(runnable));
+}
+
+void MediaScheduler::dispatch(std::vector<std::pair<Lane, Task>> runnable) {
+    for (auto& [lane, task] : runnable) {
+        auto job = [this, lane = lane, task = std::move(task)]() {
+            try {
+                task();
+            } catch (...) {
+                finish(lane);
+                throw;
+            }
+            finish(lane);
+        };
+        
+        // 执行中的任务数不超过线程数，提交基本不会因容量阻塞；线程池已停止时在当前线程执行
+        if (!executor_.submit(job)) {
+            job();
+        }
+    }
+}
+
+size_t MediaScheduler::large_slots() const {
+    return std::max<size_t>(thread_count_ / 2, 1);
+}
+
+} // namespace tg_forwarder
@@ -0,0 +1,458 @@
+#include <array>
+#include <utility>
+#include "../include/media_traits.h"
+
+namespace tg_forwarder {
+
+namespace {
+using InputContent = ContentTraits::InputContent;
+using InputFile = ContentTraits::InputFile;
+using Caption = ContentTraits::Caption;
+
+// 追加缩略图的文件ID
+void add_thumbnail(const td_api::object_ptr<td_api::thumbnail>& thumbnail, std::vector<Int32>& ids) {
+    if (thumbnail && thumbnail->file_) {
+        ids.push_back(thumbnail->file_->id_);
+    }
+}
+
+// 从文件名中取扩展名，没有时返回空
+std::string extension_from_file_name(const std::string& file_name) {
+    auto pos = file_name.find_last_of('.');
+    return pos == std::string::npos ? std::string() : file_name.substr(pos);
+}
+
+// 各内容类型的访问方式，未定义的函数使用 ContentAccessBase 的默认实现
+struct ContentAccessBase {
+    static constexpr bool album_capable = false;
+    
+    template <typename T>
+    static const td_api::file* main_file(const T&) { return nullptr; }
+    
+    template <typename T>
+    static void file_ids(const T&, std::vector<Int32>&) {}
+    
+    template <typename T>
+    static const td_api::formattedText* caption(const T& content) { return content.caption_.get(); }
+    
+    template <typename T>
+    static const std::string* media_album_id(const T&) { return nullptr; }
+    
+    template <typename T>
+    static std::string extension(const T&) { return std::string(); }
+    
+    template <typename T>
+    static InputContent make_input(const T&, InputFile, Caption) {
+        throw MediaError("不支持的媒体类型");
+    }
+};
+
+template <typename T>
+struct ContentAccess;
+
+template <>
+struct ContentAccess<td_api::messageText> : ContentAccessBase {
+    static constexpr const char* name = "text";
+    static constexpr MediaType media_type = MediaType::Unknown;
+    static constexpr const char* default_extension = ".txt";
+    
+    static const td_api::formattedText* caption(const td_api::messageText& content) {
+        return content.text_.get();
+    }
+};
+
+template <>
+struct ContentAccess<td_api::messagePhoto> : ContentAccessBase {
+    static constexpr const char* name = "photo";
+    static constexpr MediaType media_type = MediaType::Photo;
+    static constexpr const char* default_extension = ".jpg";
+    static constexpr bool album_capable = true;
+    
+    // sizes_ 按尺寸从小到大排列
+    static const td_api::photoSize* largest(const td_api::messagePhoto& content) {
+        if (!content.photo_ || content.photo_->sizes_.empty()) {
+            return nullptr;
+        }
+        return content.photo_->sizes_.back().get();
+    }
+    
+    static const td_api::file* main_file(const td_api::messagePhoto& content) {
+        auto size = largest(content);
+        return size ? size->photo_.get() : nullptr;
+    }
+    
+    static void file_ids(const td_api::messagePhoto& content, std::vector<Int32>& ids) {
+        for (const auto& size : content.photo_->sizes_) {
+            ids.push_back(size->photo_->id_);
+        }
+    }
+    
+    static const std::string* media_album_id(const td_api::messagePhoto& content) {
+        return &content.media_album_id_;
+    }
+    
+    static InputContent make_input(const td_api::messagePhoto& content, InputFile file, Caption caption) {
+        auto input = td_api::make_object<td_api::inputMessagePhoto>();
+        input->photo_ = std::move(file);
+        input->caption_ = std::move(caption);
+        if (auto size = largest(content)) {
+            input->width_ = size->width_;
+            input->height_ = size->height_;
+        }
+        return input;
+    }
+};
+
+template <>
+struct ContentAccess<td_api::messageVideo> : ContentAccessBase {
+    static constexpr const char* name = "video";
+    static constexpr MediaType media_type = MediaType::Video;
+    static constexpr const char* default_extension = ".mp4";
+    static constexpr bool album_capable = true;
+    
+    static const td_api::file* main_file(const td_api::messageVideo& content) {
+        return content.video_->video_.get();
+    }
+    
+    static void file_ids(const td_api::messageVideo& content, std::vector<Int32>& ids) {
+        ids.push_back(content.video_->video_->id_);
+        add_thumbnail(content.video_->thumbnail_, ids);
+    }
+    
+    static const std::string* media_album_id(const td_api::messageVideo& content) {
+        return &content.media_album_id_;
+    }
+    
+    static std::string extension(const td_api::messageVideo& content) {
+        const auto& mime_type = content.video_->mime_type_;
+        if (mime_type == "video/mp4") {
+            return ".mp4";
+        } else if (mime_type == "video/webm") {
+            return ".webm";
+        } else if (mime_type == "video/x-matroska") {
+            return ".mkv";
+        }
+        return std::string();
+    }
+    
+    static InputContent make_input(const td_api::messageVideo& content, InputFile file, Caption caption) {
+        auto input = td_api::make_object<td_api::inputMessageVideo>();
+        input->video_ = std::move(file);
+        input->caption_ = std::move(caption);
+        input->duration_ = content.video_->duration_;
+        input->width_ = content.video_->width_;
+        input->height_ = content.video_->height_;
+        input->supports_streaming_ = content.video_->supports_streaming_;
+        return input;
+    }
+};
+
+template <>
+struct ContentAccess<td_api::messageDocument> : ContentAccessBase {
+    static constexpr const char* name = "document";
+    static constexpr MediaType media_type = MediaType::Document;
+    static constexpr const char* default_extension = ".bin";
+    static constexpr bool album_capable = true;
+    
+    static const td_api::file* main_file(const td_api::messageDocument& content) {
+        return content.document_->document_.get();
+    }
+    
+    static void file_ids(const td_api::messageDocument& content, std::vector<Int32>& ids) {
+        ids.push_back(content.document_->document_->id_);
+        add_thumbnail(content.document_->thumbnail_, ids);
+    }
+    
+    static const std::string* media_album_id(const td_api::messageDocument& content) {
+        return &content.media_album_id_;
+    }
+    
+    static std::string extension(const td_api::messageDocument& content) {
+        // 优先使用文件名中的扩展名，其次根据MIME类型猜测
+        auto extension = extension_from_file_name(content.document_->file_name_);
+        if (!extension.empty()) {
+            return extension;
+        }
+        
+        const auto& mime_type = content.document_->mime_type_;
+        if (mime_type == "application/pdf") {
+            return ".pdf";
+        } else if (mime_type == "application/zip") {
+            return ".zip";
+        } else if (mime_type == "application/x-rar-compressed") {
+            return ".rar";
+        } else if (mime_type == "text/plain") {
+            return ".txt";
+        } else if (mime_type == "application/msword") {
+            return ".doc";
+        } else if (mime_type == "application/vnd.openxmlformats-officedocument.wordprocessingml.document") {
+            return ".docx";
+        }
+        return std::string();
+    }
+    
+    static InputContent make_input(const td_api::messageDocument&, InputFile file, Caption caption) {
+        auto input = td_api::make_object<td_api::inputMessageDocument>();
+        input->document_ = std::move(file);
+        input->caption_ = std::move(caption);
+        return input;
+    }
+};
+
+template <>
+struct ContentAccess<td_api::messageAudio> : ContentAccessBase {
+    static constexpr const char* name = "audio";
+    static constexpr MediaType media_type = MediaType::Audio;
+    static constexpr const char* default_extension = ".mp3";
+    static constexpr bool album_capable = true;
+    
+    static const td_api::file* main_file(const td_api::messageAudio& content) {
+        return content.audio_->audio_.get();
+    }
+    
+    static void file_ids(const td_api::messageAudio& content, std::vector<Int32>& ids) {
+        ids.push_back(content.audio_->audio_->id_);
+        add_thumbnail(content.audio_->album_cover_thumbnail_, ids);
+    }
+    
+    static const std::string* media_album_id(const td_api::messageAudio& content) {
+        return &content.media_album_id_;
+    }
+    
+    static std::string extension(const td_api::messageAudio& content) {
+        const auto& mime_type = content.audio_->mime_type_;
+        if (mime_type == "audio/mpeg") {
+            return ".mp3";
+        } else if (mime_type == "audio/ogg") {
+            return ".ogg";
+        } else if (mime_type == "audio/x-wav") {
+            return ".wav";
+        } else if (mime_type == "audio/x-flac") {
+            return ".flac";
+        }
+        return std::string();
+    }
+    
+    static InputContent make_input(const td_api::messageAudio& content, InputFile file, Caption caption) {
+        auto input = td_api::make_object<td_api::inputMessageAudio>();
+        input->audio_ = std::move(file);
+        input->caption_ = std::move(caption);
+        input->duration_ = content.audio_->duration_;
+        input->title_ = content.audio_->title_;
+        input->performer_ = content.audio_->performer_;
+        return input;
+    }
+};
+
+template <>
+struct ContentAccess<td_api::messageAnimation> : ContentAccessBase {
+    static constexpr const char* name = "animation";
+    static constexpr MediaType media_type = MediaType::Animation;
+    static constexpr const char* default_extension = ".mp4";   // 动画通常以MP4格式存储
+    
+    static const td_api::file* main_file(const td_api::messageAnimation& content) {
+        return content.animation_->animation_.get();
+    }
+    
+    static void file_ids(const td_api::messageAnimation& content, std::vector<Int32>& ids) {
+        ids.push_back(content.animation_->animation_->id_);
+        add_thumbnail(content.animation_->thumbnail_, ids);
+    }
+    
+    static InputContent make_input(const td_api::messageAnimation& content, InputFile file, Caption caption) {
+        auto input = td_api::make_object<td_api::inputMessageAnimation>();
+        input->animation_ = std::move(file);
+        input->caption_ = std::move(caption);
+        input->duration_ = content.animation_->duration_;
+        input->width_ = content.animation_->width_;
+        input->height_ = content.animation_->height_;
+        return input;
+    }
+};
+
+template <>
+struct ContentAccess<td_api::messageSticker> : ContentAccessBase {
+    static constexpr const char* name = "sticker";
+    static constexpr MediaType media_type = MediaType::Sticker;
+    static constexpr const char* default_extension = ".webp";
+    
+    static const td_api::file* main_file(const td_api::messageSticker& content) {
+        return content.sticker_->sticker_.get();
+    }
+    
+    static void file_ids(const td_api::messageSticker& content, std::vector<Int32>& ids) {
+        ids.push_back(content.sticker_->sticker_->id_);
+        add_thumbnail(content.sticker_->thumbnail_, ids);
+    }
+    
+    // 贴纸没有说明文字
+    static const td_api::formattedText* caption(const td_api::messageSticker&) { return nullptr; }
+    
+    static std::string extension(const td_api::messageSticker& content) {
+        return content.sticker_->is_animated_ ? ".tgs" : ".webp";
+    }
+    
+    static InputContent make_input(const td_api::messageSticker& content, InputFile file, Caption) {
+        auto input = td_api::make_object<td_api::inputMessageSticker>();
+        input->sticker_ = std::move(file);
+        input->width_ = content.sticker_->width_;
+        input->height_ = content.sticker_->height_;
+        input->emoji_ = content.sticker_->emoji_;
+        return input;
+    }
+};
+
+template <>
+struct ContentAccess<td_api::messageVoiceNote> : ContentAccessBase {
+    static constexpr const char* name = "voice_note";
+    static constexpr MediaType media_type = MediaType::VoiceNote;
+    static constexpr const char* default_extension = ".ogg";   // 语音消息为 OGG/Opus
+    
+    static const td_api::file* main_file(const td_api::messageVoiceNote& content) {
+        return content.voice_note_->voice_.get();
+    }
+    
+    static void file_ids(const td_api::messageVoiceNote& content, std::vector<Int32>& ids) {
+        ids.push_back(content.voice_note_->voice_->id_);
+    }
+    
+    static InputContent make_input(const td_api::messageVoiceNote& content, InputFile file, Caption caption) {
+        auto input = td_api::make_object<td_api::inputMessageVoiceNote>();
+        input->voice_note_ = std::move(file);
+        input->duration_ = content.voice_note_->duration_;
+        input->waveform_ = content.voice_note_->waveform_;
+        input->caption_ = std::move(caption);
+        return input;
+    }
+};
+
+template <>
+struct ContentAccess<td_api::messageVideoNote> : ContentAccessBase {
+    static constexpr const char* name = "video_note";
+    static constexpr MediaType media_type = MediaType::VideoNote;
+    static constexpr const char* default_extension = ".mp4";
+    
+    static const td_api::file* main_file(const td_api::messageVideoNote& content) {
+        return content.video_note_->video_.get();
+    }
+    
+    static void file_ids(const td_api::messageVideoNote& content, std::vector<Int32>& ids) {
+        ids.push_back(content.video_note_->video_->id_);
+        add_thumbnail(content.video_note_->thumbnail_, ids);
+    }
+    
+    // 视频消息没有说明文字
+    static const td_api::formattedText* caption(const td_api::messageVideoNote&) { return nullptr; }
+    
+    static InputContent make_input(const td_api::messageVideoNote& content, InputFile file, Caption) {
+        auto input = td_api::make_object<td_api::inputMessageVideoNote>();
+        input->video_note_ = std::move(file);
+        input->duration_ = content.video_note_->duration_;
+        input->length_ = content.video_note_->length_;
+        return input;
+    }
+};
+
+// 把 ContentAccess<T> 的函数包装成按基类调用的函数指针
+template <typename T>
+constexpr ContentTraits make_traits(std::size_t index) {
+    using Access = ContentAccess<T>;
+    return ContentTraits{
+        T::ID,
+        Access::name,
+        Access::media_type,
+        ContentFilterMask{1} << index,
+        Access::album_capable,
+        Access::default_extension,
+        [](const td_api::MessageContent& content) -> const td_api::file* {
+            return Access::main_file(static_cast<const T&>(content));
+        },
+        [](const td_api::MessageContent& content, std::vector<Int32>& ids) {
+            Access::file_ids(static_cast<const T&>(content), ids);
+        },
+        [](const td_api::MessageContent& content) -> const td_api::formattedText* {
+            return Access::caption(static_cast<const T&>(content));
+        },
+        [](const td_api::MessageContent& content) -> const std::string* {
+            return Access::media_album_id(static_cast<const T&>(content));
+        },
+        [](const td_api::MessageContent& content) -> std::string {
+            auto extension = Access::extension(static_cast<const T&>(content));
+            return extension.empty() ? std::string(Access::default_extension) : extension;
+        },
+        [](const td_api::MessageContent& content, InputFile file, Caption caption) -> InputContent {
+            return Access::make_input(static_cast<const T&>(content), std::move(file), std::move(caption));
+        },
+    };
+}
+
+template <typename... T, std::size_t... Index>
+constexpr std::array<ContentTraits, sizeof...(T)> make_traits_table(std::index_sequence<Index...>) {
+    return {{make_traits<T>(Index)...}};
+}
+
+template <typename... T>
+constexpr std::array<ContentTraits, sizeof...(T)> make_traits_table() {
+    return make_traits_table<T...>(std::index_sequence_for<T...>{});
+}
+
+// 内容类型表，顺序决定过滤位
+constexpr auto kContentTraits = make_traits_table<
+    td_api::messageText,
+    td_api::messagePhoto,
+    td_api::messageVideo,
+    td_api::messageDocument,
+    td_api::messageAudio,
+    td_api::messageAnimation,
+    td_api::messageSticker,
+    td_api::messageVoiceNote,
+    td_api::messageVideoNote>();
+
+static_assert(kContentTraits.size() < 31, "过滤位不能与 kOtherContentFilter 重叠");
+}
+
+const ContentTraits* find_content_traits(Int32 constructor_id) {
+    // 表只有几项，顺序比较比哈希查找更快
+    for (const auto& traits : kContentTraits) {
+        if (traits.constructor_id == constructor_id) {
+            return &traits;
+        }
+    }
+    return nullptr;
+}
+
+const ContentTraits* find_content_traits(const Message& message) {
+    if (!message || !message->content_) {
+        return nullptr;
+    }
+    return find_content_traits(message->content_->get_id());
+}
+
+const ContentTraits* find_content_traits(MediaType type) {
+    if (type == MediaType::Unknown) {
+        return nullptr;
+    }
+    
+    for (const auto& traits : kContentTraits) {
+        if (traits.media_type == type) {
+            return &traits;
+        }
+    }
+    return nullptr;
+}
+
+const ContentTraits* find_content_traits(std::string_view name) {
+    for (const auto& traits : kContentTraits) {
+        if (name == traits.name) {
+            return &traits;
+        }
+    }
+    return nullptr;
+}
+
+ContentFilterMask content_filter_bit(const Message& message) {
+    auto traits = find_content_traits(message);
+    return traits ? traits->filter_bit : kOtherContentFilter;
+}
+
+} // namespace tg_forwarder
@@ -0,0 +1,157 @@
+#include <algorithm>
+#include <spdlog/spdlog.h>
+#include "../include/memory_budget.h"
+#include "../include/utils.h"
+
+namespace tg_forwarder {
+
+// Reservation 实现
+MemoryBudget::Reservation::Reservation(MemoryBudget* budget, std::int64_t bytes)
+    : budget_(budget), bytes_(bytes) {
+}
+
+MemoryBudget::Reservation::~Reservation() {
+    release();
+}
+
+MemoryBudget::Reservation::Reservation(Reservation&& other) noexcept
+    : budget_(other.budget_), bytes_(other.bytes_) {
+    other.budget_ = nullptr;
+    other.bytes_ = 0;
+}
+
+MemoryBudget::Reservation& MemoryBudget::Reservation::operator=(Reservation&& other) noexcept {
+    if (this != &other) {
+        release();
+        budget_ = other.budget_;
+        bytes_ = other.bytes_;
+        other.budget_ = nullptr;
+        other.bytes_ = 0;
+    }
+    return *this;
+}
+
+std::int64_t MemoryBudget::Reservation::bytes() const {
+    return bytes_;
+}
+
+void MemoryBudget::Reservation::release() {
+    if (budget_) {
+        budget_->release(bytes_);
+        budget_ = nullptr;
+        bytes_ = 0;
+    }
+}
+
+// MemoryBudget 实现
+MemoryBudget::MemoryBudget(std::int64_t limit)
+    : limit_(std::max<std::int64_t>(limit, 0)) {
+}
+
+void MemoryBudget::set_limit(std::int64_t limit) {
+    std::deque<Waiter> admitted;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        limit_ = std::max<std::int64_t>(limit, 0);
+        admitted = take_admitted();
+    }
+    
+    for (auto& waiter : admitted) {
+        waiter.promise->set_value(Reservation(this, waiter.bytes));
+    }
+}
+
+std::int64_t MemoryBudget::limit() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return limit_;
+}
+
+Future<MemoryBudget::Reservation> MemoryBudget::acquire(std::int64_t bytes) {
+    bytes = std::max<std::int64_t>(bytes, 0);
+    
+    std::lock_guard<std::mutex> lock(mutex_);
+    
+    // 已有排队的申请时排在后面，避免小文件一直插队使大文件饿死
+    if (waiters_.empty() && fits(bytes)) {
+        in_use_ += bytes;
+        return make_ready_future(Reservation(this, bytes));
+    }
+    
+    auto promise = std::make_shared<Promise<Reservation>>();
+    auto future = promise->get_future();
+    waiters_.push_back(Waiter{bytes, std::move(promise)});
+    waiting_bytes_ += bytes;
+    
+    spdlog::debug("内存预算不足，等待 {} 字节（占用 {} / {}，排队 {}）",
+        bytes, in_use_.load(), limit_, waiters_.size());
+    
+    return future;
+}
+
+std::int64_t MemoryBudget::in_use() const {
+    return in_use_;
+}
+
+std::size_t MemoryBudget::waiting_count() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return waiters_.size();
+}
+
+std::int64_t MemoryBudget::waiting_bytes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return waiting_bytes_;
+}
+
+void MemoryBudget::cancel_all() {
+    std::deque<Waiter> cancelled;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        cancelled = std::move(waiters_);
+        waiters_.clear();
+        waiting_bytes_ = 0;
+    }
+    
+    for (auto& waiter : cancelled) {
+        waiter.promise->set_exception(std::make_exception_ptr(MediaError("内存预算已关闭")));
+    }
+}
+
+void MemoryBudget::release(std::int64_t bytes) {
+    std::deque<Waiter> admitted;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        in_use_ -= bytes;
+        admitted = take_admitted();
+    }
+    
+    // 在锁外完成 Future，续延可能提交新的任务
+    for (auto& waiter : admitted) {
+        waiter.promise->set_value(Reservation(this, waiter.bytes));
+    }
+}
+
+bool MemoryBudget::fits(std::int64_t bytes) const {
+    if (limit_ == 0) {
+        return true;
+    }
+    
+    // 超过整个预算的申请在空闲时单独放行
+    auto used = in_use_.load();
+    return used + bytes <= limit_ || used == 0;
+}
+
+std::deque<MemoryBudget::Waiter> MemoryBudget::take_admitted() {
+    std::deque<Waiter> admitted;
+    
+    while (!waiters_.empty() && fits(waiters_.front().bytes)) {
+        auto waiter = std::move(waiters_.front());
+        waiters_.pop_front();
+        waiting_bytes_ -= waiter.bytes;
+        in_use_ += waiter.bytes;
+        admitted.push_back(std::move(waiter));
+    }
+    
+    return admitted;
+}
+
+} // namespace tg_forwarder
@@ -0,0 +1,233 @@
+#include <cstdio>
+#include <cmath>
+#include <vector>
+#include <sstream>
+#include <algorithm>
+#include "../include/metrics.h"
+
+namespace tg_forwarder {
+
+namespace {
+// 当前线程所属的直方图分片
+std::size_t thread_shard(std::size_t shard_count) {
+    static std::atomic<std::size_t> next_shard{0};
+    thread_local std::size_t shard = next_shard.fetch_add(1, std::memory_order_relaxed);
+    return shard % shard_count;
+}
+
+// 导出的 le 边界（2的幂微秒，约 1ms ~ 19h）
+constexpr int kFirstExportExponent = 10;
+constexpr int kLastExportExponent = 36;
+
+std::string format_number(double value) {
+    char buffer[64];
+    std::snprintf(buffer, sizeof(buffer), "%.15g", value);
+    return buffer;
+}
+
+void write_header(std::ostringstream& out, const std::string& name, const std::string& help, const char* type) {
+    out << "# HELP " << name << ' ' << help << '\n';
+    out << "# TYPE " << name << ' ' << type << '\n';
+}
+}
+
+void Counter::add(std::uint64_t n) {
+    value_.fetch_add(n, std::memory_order_relaxed);
+}
+
+std::uint64_t Counter::value() const {
+    return value_.load(std::memory_order_relaxed);
+}
+
+Histogram::Histogram()
+    : shards_(new Shard[kShardCount]) {
+    for (std::size_t i = 0; i < kShardCount; ++i) {
+        for (auto& bucket : shards_[i].buckets) {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+    }
+}
+
+void Histogram::record_us(std::int64_t microseconds) {
+    auto value = static_cast<std::uint64_t>(std::max<std::int64_t>(microseconds, 0));
+    auto& shard = shards_[thread_shard(kShardCount)];
+    shard.buckets[bucket_index(value)].fetch_add(1, std::memory_order_relaxed);
+    shard.sum_us.fetch_add(value, std::memory_order_relaxed);
+}
+
+Histogram::Snapshot Histogram::snapshot() const {
+    Snapshot snapshot;
+    for (std::size_t i = 0; i < kShardCount; ++i) {
+        const auto& shard = shards_[i];
+        for (int b = 0; b < kBucketCount; ++b) {
+            snapshot.buckets[b] += shard.buckets[b].load(std::memory_order_relaxed);
+        }
+        snapshot.sum_us += shard.sum_us.load(std::memory_order_relaxed);
+    }
+    
+    // 以桶计数之和为准，避免与并发记录中的 count 不一致
+    for (auto count : snapshot.buckets) {
+        snapshot.count += count;
+    }
+    return snapshot;
+}
+
+int Histogram::bucket_index(std::uint64_t value) {
+    if (value < static_cast<std::uint64_t>(kSubBuckets)) {
+        return static_cast<int>(value);
+    }
+    
+    int exponent = 63 - __builtin_clzll(value);
+    if (exponent >= kMaxExponent) {
+        return kBucketCount - 1;
+    }
+    
+    // 第 exponent 个2的幂区间按高 kSubBucketBits+1 位均分
+    int shift = exponent - kSubBucketBits;
+    return (exponent - kSubBucketBits + 1) * kSubBuckets + static_cast<int>((value >> shift) - kSubBuckets);
+}
+
+std::uint64_t Histogram::bucket_upper_bound(int index) {
+    if (index < kSubBuckets) {
+        return static_cast<std::uint64_t>(index) + 1;
+    }
+    
+    int exponent = index / kSubBuckets + kSubBucketBits - 1;
+    auto sub = static_cast<std::uint64_t>(index % kSubBuckets);
+    return (kSubBuckets + sub + 1) << (exponent - kSubBucketBits);
+}
+
+std::uint64_t Histogram::Snapshot::quantile(double q) const {
+    if (count == 0) {
+        return 0;
+    }
+    
+    auto rank = static_cast<std::uint64_t>(std::ceil(std::clamp(q, 0.0, 1.0) * static_cast<double>(count)));
+    rank = std::max<std::uint64_t>(rank, 1);
+    
+    std::uint64_t seen = 0;
+    for (int i = 0; i < kBucketCount; ++i) {
+        seen += buckets[i];
+        if (seen >= rank) {
+            // 取桶的中点
+            auto upper = bucket_upper_bound(i);
+            auto lower = i == 0 ? 0 : bucket_upper_bound(i - 1);
+            return lower + (upper - lower) / 2;
+        }
+    }
+    return bucket_upper_bound(kBucketCount - 1);
+}
+
+std::uint64_t Histogram::Snapshot::count_below_power(int exponent) const {
+    // 子桶在2的幂处对齐，小于 2^exponent 的值恰好落在该区间之前的桶中
+    int end = exponent <= kSubBucketBits
+        ? (1 << std::max(exponent, 0))
+        : (exponent - kSubBucketBits + 1) * kSubBuckets;
+    end = std::min(end, kBucketCount);
+    
+    std::uint64_t total = 0;
+    for (int i = 0; i < end; ++i) {
+        total += buckets[i];
+    }
+    return total;
+}
+
+Metrics& Metrics::instance() {
+    static Metrics instance;
+    return instance;
+}
+
+Counter& Metrics::counter(const std::string& name, const std::string& help) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& entry = counters_[name];
+    if (!entry.metric) {
+        entry.help = help;
+        entry.metric = std::make_unique<Counter>();
+    }
+    return *entry.metric;
+}
+
+Histogram& Metrics::histogram(const std::string& name, const std::string& help) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& entry = histograms_[name];
+    if (!entry.metric) {
+        entry.help = help;
+        entry.metric = std::make_unique<Histogram>();
+    }
+    return *entry.metric;
+}
+
+void Metrics::gauge(const std::string& name, const std::string& help, std::function<double()> read) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    callbacks_[name] = Callback{help, "gauge", std::move(read)};
+}
+
+void Metrics::counter_callback(const std::string& name, const std::string& help, std::function<double()> read) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    callbacks_[name] = Callback{help, "counter", std::move(read)};
+}
+
+void Metrics::clear_callbacks() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    callbacks_.clear();
+}
+
+std::string Metrics::render_prometheus() const {
+    std::ostringstream out;
+    
+    // 回调可能访问其他模块的锁，在注册表锁之外读取
+    std::vector<std::pair<std::string, Callback>> callbacks;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        callbacks.assign(callbacks_.begin(), callbacks_.end());
+    }
+    for (const auto& [name, callback] : callbacks) {
+        write_header(out, name, callback.help, callback.type.c_str());
+        out << name << ' ' << format_number(callback.read ? callback.read() : 0.0) << '\n';
+    }
+    
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& [name, entry] : counters_) {
+        write_header(out, name, entry.help, "counter");
+        out << name << ' ' << entry.metric->value() << '\n';
+    }
+    
+    // 直方图以秒为单位导出，le 取2的幂微秒，与内部子桶边界对齐
+    for (const auto& [name, entry] : histograms_) {
+        auto snapshot = entry.metric->snapshot();
+        write_header(out, name, entry.help, "histogram");
+        for (int exponent = kFirstExportExponent; exponent <= kLastExportExponent; ++exponent) {
+            double le = static_cast<double>(std::uint64_t(1) << exponent) / 1e6;
+            out << name << "_bucket{le=\"" << format_number(le) << "\"} " << snapshot.count_below_power(exponent) << '\n';
+        }
+        out << name << "_bucket{le=\"+Inf\"} " << snapshot.count << '\n';
+        out << name << "_sum " << format_number(static_cast<double>(snapshot.sum_us) / 1e6) << '\n';
+        out << name << "_count " << snapshot.count << '\n';
+    }
+    
+    return out.str();
+}
+
+std::string Metrics::summary() const {
+    std::ostringstream out;
+    std::lock_guard<std::mutex> lock(mutex_);
+    
+    for (const auto& [name, entry] : histograms_) {
+        auto snapshot = entry.metric->snapshot();
+        if (snapshot.count == 0) {
+            continue;
+        }
+        
+        if (out.tellp() > 0) {
+            out << "; ";
+        }
+        out << name << ": n=" << snapshot.count
+            << " p50=" << format_number(snapshot.quantile(0.5) / 1e3) << "ms"
+            << " p90=" << format_number(snapshot.quantile(0.9) / 1e3) << "ms"
+            << " p99=" << format_number(snapshot.quantile(0.99) / 1e3) << "ms";
+    }
+    
+    return out.str();
+}
+
+} // namespace tg_forwarder
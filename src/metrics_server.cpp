@@ -0,0 +1,176 @@
+#include <cerrno>
+#include <cstring>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <spdlog/spdlog.h>
+#include "../include/metrics_server.h"
+#include "../include/metrics.h"
+
+namespace tg_forwarder {
+
+namespace {
+// 请求头上限和读取超时
+constexpr size_t kMaxRequestBytes = 8192;
+constexpr int kPollIntervalMs = 500;
+constexpr int kReadTimeoutSeconds = 2;
+
+// 发送全部数据（对端已关闭时放弃）
+void send_all(int fd, const std::string& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        auto n = ::send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return;
+        }
+        sent += static_cast<size_t>(n);
+    }
+}
+
+std::string make_response(const char* status, const char* content_type, const std::string& body) {
+    std::string response = "HTTP/1.1 ";
+    response += status;
+    response += "\r\nContent-Type: ";
+    response += content_type;
+    response += "\r\nContent-Length: " + std::to_string(body.size());
+    response += "\r\nConnection: close\r\n\r\n";
+    response += body;
+    return response;
+}
+}
+
+MetricsServer& MetricsServer::instance() {
+    static MetricsServer instance;
+    return instance;
+}
+
+MetricsServer::~MetricsServer() {
+    stop();
+}
+
+bool MetricsServer::start(const std::string& bind_address, std::uint16_t port) {
+    if (running_) {
+        return true;
+    }
+    
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    if (::inet_pton(AF_INET, bind_address.c_str(), &address.sin_addr) != 1) {
+        spdlog::error("无效的指标监听地址: {}", bind_address);
+        return false;
+    }
+    
+    int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        spdlog::error("创建指标监听套接字失败: {}", std::strerror(errno));
+        return false;
+    }
+    
+    int reuse = 1;
+    ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    
+    if (::bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || ::listen(fd, 16) != 0) {
+        spdlog::error("指标端点无法监听 {}:{}: {}", bind_address, port, std::strerror(errno));
+        ::close(fd);
+        return false;
+    }
+    
+    listen_fd_ = fd;
+    running_ = true;
+    thread_ = std::thread(&MetricsServer::serve, this);
+    
+    spdlog::info("指标端点已启动: http://{}:{}/metrics", bind_address, port);
+    return true;
+}
+
+void MetricsServer::stop() {
+    if (!running_) {
+        return;
+    }
+    
+    running_ = false;
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    
+    ::close(listen_fd_);
+    listen_fd_ = -1;
+    spdlog::info("指标端点已停止");
+}
+
+bool MetricsServer::is_running() const {
+    return running_;
+}
+
+void MetricsServer::serve() {
+    while (running_) {
+        // 定期醒来检查停止标志
+        pollfd poll_fd{listen_fd_, POLLIN, 0};
+        int ready = ::poll(&poll_fd, 1, kPollIntervalMs);
+        if (ready <= 0 || !(poll_fd.revents & POLLIN)) {
+            continue;
+        }
+        
+        int fd = ::accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) {
+            continue;
+        }
+        
+        handle_connection(fd);
+        ::close(fd);
+    }
+}
+
+void MetricsServer::handle_connection(int fd) {
+    timeval timeout{kReadTimeoutSeconds, 0};
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    ::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    
+    // 读到请求头结束为止，只需要请求行
+    std::string request;
+    char buffer[1024];
+    while (request.size() < kMaxRequestBytes && request.find("\r\n\r\n") == std::string::npos) {
+        auto n = ::recv(fd, buffer, sizeof(buffer), 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        request.append(buffer, static_cast<size_t>(n));
+    }
+    
+    auto line_end = request.find("\r\n");
+    if (line_end == std::string::npos) {
+        return;
+    }
+    
+    std::string line = request.substr(0, line_end);
+    auto method_end = line.find(' ');
+    auto path_end = method_end == std::string::npos ? std::string::npos : line.find(' ', method_end + 1);
+    if (path_end == std::string::npos) {
+        send_all(fd, make_response("400 Bad Request", "text/plain; charset=utf-8", "bad request\n"));
+        return;
+    }
+    
+    std::string method = line.substr(0, method_end);
+    std::string path = line.substr(method_end + 1, path_end - method_end - 1);
+    path = path.substr(0, path.find('?'));
+    
+    if (method != "GET") {
+        send_all(fd, make_response("405 Method Not Allowed", "text/plain; charset=utf-8", "method not allowed\n"));
+    } else if (path == "/metrics") {
+        send_all(fd, make_response("200 OK", "text/plain; version=0.0.4; charset=utf-8",
+                                   Metrics::instance().render_prometheus()));
+    } else {
+        send_all(fd, make_response("404 Not Found", "text/plain; charset=utf-8", "see /metrics\n"));
+    }
+}
+
+} // namespace tg_forwarder
@@ -0,0 +1,348 @@
+#include <algorithm>
+#include <tuple>
+#include <spdlog/spdlog.h>
+#include "../include/rate_limiter.h"
+#include "../include/metrics.h"
+
+namespace tg_forwarder {
+
+namespace {
+// 触发 FLOOD_WAIT 的次数（请求被拒绝或发送失败的消息被限流）
+Counter& flood_wait_counter() {
+    static auto& counter = Metrics::instance().counter(
+        "tg_forwarder_flood_waits_total", "触发服务器限流（FLOOD_WAIT）的次数");
+    return counter;
+}
+}
+
+bool RateLimiter::Key::operator<(const Key& other) const {
+    return std::tie(account, chat_id) < std::tie(other.account, other.chat_id);
+}
+
+void RateLimiter::configure(double rate_per_second, double burst) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    
+    rate_ = std::max(rate_per_second, 0.0);
+    burst_ = std::max(burst, 1.0);
+    
+    for (auto& entry : buckets_) {
+        entry.second.rate = rate_;
+        entry.second.tokens = std::min(entry.second.tokens, burst_);
+    }
+}
+
+bool RateLimiter::enabled() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return rate_ > 0;
+}
+
+void RateLimiter::set_executor(BackgroundExecutor executor) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    executor_ = std::move(executor);
+}
+
+std::optional<RateLimiter::Key> RateLimiter::classify(std::size_t account, const Function& query) {
+    if (!query) {
+        return std::nullopt;
+    }
+    
+    Int64 chat_id = 0;
+    switch (query->get_id()) {
+        case td_api::sendMessage::ID:
+            chat_id = static_cast<const td_api::sendMessage&>(*query).chat_id_;
+            break;
+        case td_api::sendMessageAlbum::ID:
+            chat_id = static_cast<const td_api::sendMessageAlbum&>(*query).chat_id_;
+            break;
+        case td_api::forwardMessages::ID:
+            chat_id = static_cast<const td_api::forwardMessages&>(*query).chat_id_;
+            break;
+        case td_api::resendMessages::ID:
+            chat_id = static_cast<const td_api::resendMessages&>(*query).chat_id_;
+            break;
+        default:
+            return std::nullopt;
+    }
+    
+    return Key{account, chat_id};
+}
+
+bool RateLimiter::admit(const Key& key, std::uint64_t query_id, Function& query, QueryFactory factory,
+                        Clock::time_point now) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    
+    auto& target = bucket(key, now);
+    refill(target, now);
+    
+    // 桶内已有排队或在途的请求时也要排在后面，保证同一桶内按提交顺序发出
+    if (target.queue.empty() && !target.in_flight && now >= target.paused_until && target.tokens >= 1.0) {
+        target.tokens -= 1.0;
+        target.in_flight = true;
+        in_flight_[query_id] = InFlight{key, std::move(factory), 0};
+        return true;
+    }
+    
+    target.queue.push_back(Pending{query_id, std::move(query), std::move(factory), 0});
+    query = nullptr;
+    return false;
+}
+
+void RateLimiter::enqueue(const Key& key, std::uint64_t query_id, Function query, Clock::time_point now) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    bucket(key, now).queue.push_back(Pending{query_id, std::move(query), nullptr, 0});
+}
+
+bool RateLimiter::on_response(std::uint64_t query_id, const Object& response, Clock::time_point now) {
+    InFlight entry;
+    std::int32_t code = 0;
+    std::string message;
+    BackgroundExecutor executor;
+    
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        
+        auto it = in_flight_.find(query_id);
+        if (it == in_flight_.end()) {
+            return false;
+        }
+        entry = std::move(it->second);
+        in_flight_.erase(it);
+        
+        // 桶内的下一个请求可以发出了（被限流时下面先把本请求放回队首）
+        auto& target = bucket(entry.key, now);
+        target.in_flight = false;
+        bool is_error = response && response->get_id() == td_api::error::ID;
+        int retry_after = 0;
+        if (is_error) {
+            const auto& error = static_cast<const td_api::error&>(*response);
+            retry_after = parse_retry_after(error.code_, error.message_);
+            code = error.code_;
+            message = error.message_;
+        }
+        
+        if (retry_after <= 0) {
+            // 发送成功，速率逐步恢复到配置值
+            if (!is_error) {
+                target.rate = std::min(rate_, target.rate + rate_ * kRecoveryStep);
+            }
+            return false;
+        }
+        
+        pause(target, retry_after, now);
+        flood_wait_counter().add();
+        spdlog::warn("聊天 {} 触发限流，暂停 {} 秒，速率降为 {:.3f}/秒",
+            entry.key.chat_id, retry_after, target.rate);
+        
+        if (!entry.factory || entry.attempts >= kMaxFloodRetries) {
+            return false;
+        }
+        
+        // 先在桶的队首占位，暂停结束后最先发出
+        target.queue.push_front(Pending{query_id, nullptr, nullptr, entry.attempts + 1, true});
+        executor = executor_;
+    }
+    
+    // 重建可能读取文件，交给后台执行器，不占用接收线程
+    auto task = [this, key = entry.key, query_id, factory = std::move(entry.factory), code, message]() {
+        rebuild(key, query_id, factory, code, message);
+    };
+    if (!executor || !executor(entry.key.account, task)) {
+        task();
+    }
+    return true;
+}
+
+void RateLimiter::rebuild(const Key& key, std::uint64_t query_id, QueryFactory factory, std::int32_t code,
+                          const std::string& message) {
+    Function query;
+    try {
+        query = factory();
+    } catch (const std::exception& e) {
+        spdlog::error("重建被限流的请求失败: {}", e.what());
+    }
+    
+    std::lock_guard<std::mutex> lock(mutex_);
+    
+    // 占位已被清除（限流器已清空）时直接放弃
+    auto bucket_it = buckets_.find(key);
+    if (bucket_it == buckets_.end()) {
+        return;
+    }
+    auto& queue = bucket_it->second.queue;
+    auto it = std::find_if(queue.begin(), queue.end(), [query_id](const Pending& pending) {
+        return pending.rebuilding && pending.query_id == query_id;
+    });
+    if (it == queue.end()) {
+        return;
+    }
+    
+    // 重建失败时把限流错误交还调用方
+    if (!query) {
+        queue.erase(it);
+        failed_.push_back(Failed{key.account, query_id, code, message});
+        return;
+    }
+    
+    it->query = std::move(query);
+    it->factory = std::move(factory);
+    it->rebuilding = false;
+}
+
+void RateLimiter::pause_chat(std::size_t account, Int64 chat_id, int retry_after, Clock::time_point now) {
+    flood_wait_counter().add();
+    
+    std::lock_guard<std::mutex> lock(mutex_);
+    
+    auto it = buckets_.find(Key{account, chat_id});
+    if (it != buckets_.end()) {
+        pause(it->second, retry_after, now);
+    }
+}
+
+std::vector<RateLimiter::Ready> RateLimiter::take_due(Clock::time_point now) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    
+    if (now - last_prune_ >= kPruneInterval) {
+        prune(now);
+        last_prune_ = now;
+    }
+    
+    // 限流被关闭后把仍在排队的请求全部放行
+    bool unlimited = rate_ <= 0;
+    
+    std::vector<Ready> ready;
+    for (auto& entry : buckets_) {
+        auto& target = entry.second;
+        if (target.queue.empty() || (!unlimited && (target.in_flight || now < target.paused_until))) {
+            continue;
+        }
+        
+        // 限流时每个桶一次只发一个，等它的响应回来再发下一个
+        refill(target, now);
+        while (!target.queue.empty() && !target.queue.front().rebuilding && (unlimited || target.tokens >= 1.0)) {
+            auto& pending = target.queue.front();
+            target.tokens -= 1.0;
+            target.in_flight = true;
+            in_flight_[pending.query_id] = InFlight{entry.first, std::move(pending.factory), pending.attempts};
+            ready.push_back(Ready{entry.first.account, pending.query_id, std::move(pending.query)});
+            target.queue.pop_front();
+            if (!unlimited) {
+                break;
+            }
+        }
+    }
+    
+    return ready;
+}
+
+std::vector<RateLimiter::Failed> RateLimiter::take_failed() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    
+    std::vector<Failed> failed;
+    failed.swap(failed_);
+    return failed;
+}
+
+std::optional<RateLimiter::Clock::time_point> RateLimiter::next_deadline(Clock::time_point now) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    
+    std::optional<Clock::time_point> earliest;
+    for (const auto& entry : buckets_) {
+        const auto& target = entry.second;
+        if (target.queue.empty() || target.queue.front().rebuilding || target.in_flight || target.rate <= 0) {
+            continue;
+        }
+        
+        // 暂停中的桶在暂停结束时到期，否则按速率推算攒够一个令牌的时间
+        auto from = std::max({target.updated, target.paused_until, now});
+        double tokens = target.tokens;
+        auto refill_from = std::max(target.updated, target.paused_until);
+        if (now > refill_from) {
+            tokens += std::chrono::duration<double>(now - refill_from).count() * target.rate;
+        }
+        
+        auto due = from;
+        if (tokens < 1.0 && target.rate > 0) {
+            due += std::chrono::duration_cast<Clock::duration>(
+                std::chrono::duration<double>((1.0 - tokens) / target.rate));
+        }
+        
+        if (!earliest || due < *earliest) {
+            earliest = due;
+        }
+    }
+    
+    return earliest;
+}
+
+std::size_t RateLimiter::queued_count() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    
+    std::size_t count = 0;
+    for (const auto& entry : buckets_) {
+        count += entry.second.queue.size();
+    }
+    
+    return count;
+}
+
+std::size_t RateLimiter::paused_count(Clock::time_point now) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    
+    return static_cast<std::size_t>(std::count_if(buckets_.begin(), buckets_.end(), [now](const auto& entry) {
+        return now < entry.second.paused_until;
+    }));
+}
+
+void RateLimiter::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    buckets_.clear();
+    in_flight_.clear();
+    failed_.clear();
+}
+
+RateLimiter::Bucket& RateLimiter::bucket(const Key& key, Clock::time_point now) {
+    auto result = buckets_.try_emplace(key);
+    auto& target = result.first->second;
+    
+    // 新建的桶是满的，可以立即突发 burst 个请求
+    if (result.second) {
+        target.tokens = burst_;
+        target.rate = rate_;
+        target.updated = now;
+        target.paused_until = now;
+    }
+    
+    return target;
+}
+
+void RateLimiter::refill(Bucket& bucket, Clock::time_point now) const {
+    auto from = std::max(bucket.updated, bucket.paused_until);
+    if (now > from) {
+        double elapsed = std::chrono::duration<double>(now - from).count();
+        bucket.tokens = std::min(burst_, bucket.tokens + elapsed * bucket.rate);
+    }
+    
+    bucket.updated = std::max(bucket.updated, now);
+}
+
+void RateLimiter::pause(Bucket& bucket, int retry_after, Clock::time_point now) {
+    bucket.paused_until = std::max(bucket.paused_until, now + std::chrono::seconds(retry_after));
+    bucket.tokens = 0;
+    bucket.rate = std::max(bucket.rate * 0.5, rate_ * kMinRateFactor);
+}
+
+void RateLimiter::prune(Clock::time_point now) {
+    // 桶按（账号, 聊天）创建，不回收会随转发过的聊天数一直增长；回收后再次使用时重新创建为满桶
+    for (auto it = buckets_.begin(); it != buckets_.end();) {
+        const auto& target = it->second;
+        if (target.queue.empty() && !target.in_flight && now >= target.paused_until &&
+            now - target.updated >= kIdleTimeout) {
+            it = buckets_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+} // namespace tg_forwarder
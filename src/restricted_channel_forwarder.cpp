@@ -1,4 +1,5 @@
 #include <regex>
+#include <algorithm>
 #include <chrono>
 #include <thread>
 #include <spdlog/spdlog.h>
@@ -6,10 +7,113 @@
 #include "../include/channel_resolver.h"
 #include "../include/client_manager.h"
 #include "../include/media_handler.h"
+#include "../include/buffer_pool.h"
+#include "../include/file_id_cache.h"
+#include "../include/forward_checkpoint.h"
+#include "../include/dedup_window.h"
+#include "../include/retry_policy.h"
+#include "../include/metrics.h"
+#include "../include/metrics_server.h"
 #include "../include/utils.h"
 
 namespace tg_forwarder {
 
+namespace {
+
+// 目标频道集合的指纹，写入检查点；目标变化后旧进度不再适用
+Int64 targets_fingerprint(std::vector<Int64> target_chat_ids) {
+    std::sort(target_chat_ids.begin(), target_chat_ids.end());
+    
+    std::string joined;
+    for (auto chat_id : target_chat_ids) {
+        joined += std::to_string(chat_id);
+        joined += ',';
+    }
+    
+    return static_cast<Int64>(DedupWindow::hash(joined));
+}
+
+// 把过滤器名称编译成位掩码，未设置时处理全部类型
+ContentFilterMask parse_message_filters(const std::vector<std::string>& filters) {
+    ContentFilterMask mask = 0;
+    for (const auto& filter : filters) {
+        if (filter == "all") {
+            mask = kAllContentFilters;
+        } else if (auto traits = find_content_traits(filter)) {
+            mask |= traits->filter_bit;
+        } else {
+            spdlog::warn("未知的消息类型过滤器: {}", filter);
+            continue;
+        }
+        
+        spdlog::info("添加消息类型过滤器: {}", filter);
+    }
+    
+    // 如果没有设置过滤器，默认处理全部类型
+    if (mask == 0) {
+        mask = kAllContentFilters;
+        spdlog::info("未设置消息类型过滤器，默认处理所有类型");
+    }
+    
+    return mask;
+}
+
+// 只有重启后才生效的配置项中发生了变化的项，以逗号分隔
+std::string restart_only_changes(const ForwarderConfig& current, const ForwarderConfig& next) {
+    std::string changed;
+    auto check = [&changed](bool differs, const char* name) {
+        if (differs) {
+            changed += changed.empty() ? name : std::string("、") + name;
+        }
+    };
+    
+    check(current.mode != next.mode, "mode");
+    check(current.mode == ForwarderMode::Continuous && current.push_updates != next.push_updates, "push_updates");
+    check(current.update_handler_threads != next.update_handler_threads, "update_handler_threads");
+    check(current.checkpoint_file != next.checkpoint_file, "checkpoint_file");
+    check(current.dedup_window != next.dedup_window, "dedup_window");
+    check(current.file_id_cache != next.file_id_cache, "file_id_cache");
+    check(current.channel_cache != next.channel_cache, "channel_cache");
+    check(current.metrics_port != next.metrics_port || current.metrics_bind != next.metrics_bind, "metrics_port/metrics_bind");
+    return changed;
+}
+
+// 发送文本消息（含限流排队）到收到响应的耗时
+Histogram& text_send_duration() {
+    static auto& histogram = Metrics::instance().histogram(
+        "tg_forwarder_text_send_duration_seconds", "发送文本消息（含限流排队）到收到响应的耗时");
+    return histogram;
+}
+
+// 启动各阶段的耗时，结束时汇总成一行日志
+class StartupPhases {
+public:
+    using Clock = std::chrono::steady_clock;
+    
+    StartupPhases() : phase_start_(Clock::now()) {}
+    
+    // 结束当前阶段并开始下一阶段
+    void finish(const char* name) {
+        auto now = Clock::now();
+        if (!summary_.empty()) {
+            summary_ += "，";
+        }
+        summary_ += name;
+        summary_ += " " + std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(now - phase_start_).count()) + " ms";
+        phase_start_ = now;
+    }
+    
+    const std::string& summary() const {
+        return summary_;
+    }
+
+private:
+    Clock::time_point phase_start_;
+    std::string summary_;
+};
+
+} // namespace
+
 // 单例实例
 RestrictedChannelForwarder& RestrictedChannelForwarder::instance() {
     static RestrictedChannelForwarder instance;
@@ -20,9 +124,6 @@ RestrictedChannelForwarder::RestrictedChannelForwarder()
     : running_(false),
       stopping_(false),
       wait_time_ms_(1000),
-      source_chat_id_(0),
-      target_chat_id_(0),
-      last_message_id_(0),
       forwarded_count_(0),
       failed_count_(0) {
 }
@@ -49,107 +150,119 @@ void RestrictedChannelForwarder::init(const ForwarderConfig& config) {
             config_.mode = ForwarderMode::Continuous;
     }
     
-    // 设置媒体处理器参数
-    MediaHandler::instance().set_max_concurrent_downloads(config.max_concurrent_downloads);
-    MediaHandler::instance().set_max_concurrent_uploads(config.max_concurrent_uploads);
+    // 并发、限流等可在运行中调整的参数
+    apply_settings(config);
+    
+    // 打开频道解析缓存
+    ChannelResolver::instance().set_ttl(
+        std::chrono::hours(std::max(config.channel_cache_ttl_hours, 0)),
+        std::chrono::minutes(std::max(config.channel_negative_ttl_minutes, 0)));
+    if (!config.channel_cache.empty()) {
+        ChannelResolver::instance().open(config.channel_cache);
+    }
+    
+    // 打开远程文件ID复用缓存
+    if (!config.file_id_cache.empty()) {
+        FileIdCache::instance().open(config.file_id_cache);
+    }
     
-    spdlog::info("最大并发下载数: {}", config.max_concurrent_downloads);
-    spdlog::info("最大并发上传数: {}", config.max_concurrent_uploads);
     spdlog::info("历史消息数量限制: {}", config.max_history_messages);
     
     // 设置等待时间
     wait_time_ms_ = config.wait_time_ms;
     spdlog::info("轮询等待时间: {} ms", wait_time_ms_);
     
+    // 一次性模式只做一次历史拉取，不订阅推送
+    if (config_.mode == ForwarderMode::OneTime) {
+        config_.push_updates = false;
+    }
+    spdlog::info("新消息获取方式: {}", config_.push_updates ? "推送 (updateNewMessage)" : "轮询 (getChatHistory)");
+    
     // 初始化统计信息
     forwarded_count_ = 0;
     failed_count_ = 0;
+    register_metrics();
     
-    // 设置消息类型过滤器
-    message_filters_.clear();
-    for (const auto& filter : config.message_filters) {
-        MessageTypeFilter filter_type = MessageTypeFilter::Unknown;
-        
-        if (filter == "text") {
-            filter_type = MessageTypeFilter::Text;
-        } else if (filter == "photo") {
-            filter_type = MessageTypeFilter::Photo;
-        } else if (filter == "video") {
-            filter_type = MessageTypeFilter::Video;
-        } else if (filter == "document") {
-            filter_type = MessageTypeFilter::Document;
-        } else if (filter == "audio") {
-            filter_type = MessageTypeFilter::Audio;
-        } else if (filter == "sticker") {
-            filter_type = MessageTypeFilter::Sticker;
-        } else if (filter == "animation") {
-            filter_type = MessageTypeFilter::Animation;
-        } else if (filter == "all") {
-            filter_type = MessageTypeFilter::All;
-        } else {
-            spdlog::warn("未知的消息类型过滤器: {}", filter);
-            continue;
-        }
-        
-        message_filters_.push_back(filter_type);
-        spdlog::info("添加消息类型过滤器: {}", filter);
-    }
+    // 设置消息类型过滤器：各类型编译成一个位掩码，每条消息只需查一次内容类型表
+    message_filter_mask_ = parse_message_filters(config.message_filters);
+}
+
+void RestrictedChannelForwarder::apply_settings(const ForwarderConfig& config) {
+    // 设置媒体处理器参数
+    MediaHandler::instance().set_max_concurrent_downloads(config.max_concurrent_downloads);
+    MediaHandler::instance().set_max_concurrent_uploads(config.max_concurrent_uploads);
+    MediaHandler::instance().set_queue_capacity(static_cast<size_t>(std::max(config.media_queue_capacity, 1)));
+    MediaHandler::instance().set_large_file_threshold(static_cast<int64_t>(config.large_file_threshold_mb) * 1024 * 1024);
+    MediaHandler::instance().set_media_input_mode(
+        config.media_input_mode == "memory" ? MediaInputMode::Memory : MediaInputMode::LocalFile);
+    MediaHandler::instance().set_memory_budget(static_cast<int64_t>(config.memory_budget_mb) * 1024 * 1024);
+    MediaHandler::instance().set_memory_spill_threshold(
+        static_cast<int64_t>(config.memory_spill_threshold_mb) * 1024 * 1024);
+    BufferPool::instance().set_retained_limit(static_cast<size_t>(std::max(config.buffer_pool_mb, 0)) * 1024 * 1024);
+    MediaHandler::instance().set_streaming_threshold(
+        static_cast<int64_t>(config.streaming_threshold_mb) * 1024 * 1024);
     
-    // 如果没有设置过滤器，默认添加"全部"过滤器
-    if (message_filters_.empty()) {
-        message_filters_.push_back(MessageTypeFilter::All);
-        spdlog::info("未设置消息类型过滤器，默认处理所有类型");
+    // 设置下载、上传失败后的重试策略
+    MediaHandler::instance().set_retry_policy(config.retry_count, config.retry_delay);
+    
+    // 设置发送限流（每个目标频道）
+    ClientManager::instance().set_send_rate_limit(config.send_rate_per_minute / 60.0, config.send_burst);
+    
+    spdlog::info("最大并发下载数: {}", config.max_concurrent_downloads);
+    spdlog::info("最大并发上传数: {}", config.max_concurrent_uploads);
+    if (config.media_input_mode == "memory") {
+        spdlog::info("内存预算: {} MB，溢出阈值: {} MB", config.memory_budget_mb, config.memory_spill_threshold_mb);
     }
+    spdlog::info("发送限流: 每个目标频道 {} 条/分钟，突发 {}", config.send_rate_per_minute, config.send_burst);
 }
 
-bool RestrictedChannelForwarder::start(const std::string& source_channel, const std::string& target_channel) {
+bool RestrictedChannelForwarder::start(const std::vector<ForwardRoute>& routes) {
     if (running_) {
         spdlog::warn("转发器已经在运行中");
         return false;
     }
     
+    if (routes.empty()) {
+        spdlog::error("未配置转发路由");
+        return false;
+    }
+    
     spdlog::info("启动转发器...");
-    spdlog::info("源频道: {}", source_channel);
-    spdlog::info("目标频道: {}", target_channel);
+    started_at_ = std::chrono::steady_clock::now();
+    first_forward_ms_ = 0;
     
-    // 解析源频道和目标频道
-    try {
-        auto source_future = ChannelResolver::instance().resolve_channel(source_channel);
-        auto target_future = ChannelResolver::instance().resolve_channel(target_channel);
-        
-        // 等待解析完成
-        source_chat_id_ = source_future.get();
-        target_chat_id_ = target_future.get();
-        
-        if (source_chat_id_ == 0) {
-            spdlog::error("无法解析源频道: {}", source_channel);
-            return false;
-        }
-        
-        if (target_chat_id_ == 0) {
-            spdlog::error("无法解析目标频道: {}", target_channel);
-            return false;
-        }
-        
-        spdlog::info("源频道ID: {}", source_chat_id_);
-        spdlog::info("目标频道ID: {}", target_chat_id_);
-    } catch (const std::exception& e) {
-        spdlog::error("解析频道时出错: {}", e.what());
+    // 媒体线程与启动检查同时就绪，检查失败时停止
+    MediaHandler::instance().start();
+    if (!prepare_routes(routes)) {
+        MediaHandler::instance().stop();
         return false;
     }
     
-    // 检查机器人在目标频道中是否有发消息权限
-    if (!check_send_message_permission(target_chat_id_)) {
-        spdlog::error("在目标频道中没有发送消息的权限: {}", target_channel);
-        return false;
+    // 启动时先做一次补漏拉取
+    {
+        std::lock_guard<std::mutex> lock(incoming_mutex_);
+        for (auto& route : routes_) {
+            route->incoming.clear();
+            route->catch_up_pending = true;
+        }
+        incoming_pending_ = true;
+        connection_ready_.assign(ClientManager::instance().account_count(), true);
     }
     
-    // 获取当前最新消息ID作为起始点
-    last_message_id_ = get_latest_message_id(source_chat_id_);
-    if (last_message_id_ == 0) {
-        spdlog::warn("无法获取源频道的最新消息ID，将从下一条消息开始转发");
-    } else {
-        spdlog::info("获取到源频道的最新消息ID: {}", last_message_id_);
+    // 订阅新消息推送和连接状态变化
+    if (config_.push_updates) {
+        auto& client = ClientManager::instance();
+        client.register_update_handler(td_api::updateNewMessage::ID, [this](Object update) {
+            on_update_new_message(std::move(update));
+        });
+        client.register_update_handler(td_api::updateConnectionState::ID, [this](Object update) {
+            on_update_connection_state(std::move(update));
+        });
+    }
+    
+    // 启动指标端点（失败不影响转发）
+    if (config_.metrics_port > 0 && config_.metrics_port <= 65535) {
+        MetricsServer::instance().start(config_.metrics_bind, static_cast<std::uint16_t>(config_.metrics_port));
     }
     
     // 启动转发线程
@@ -157,465 +270,1470 @@ bool RestrictedChannelForwarder::start(const std::string& source_channel, const
     stopping_ = false;
     forward_thread_ = std::thread(&RestrictedChannelForwarder::forward_worker, this);
     
-    spdlog::info("转发器已启动");
+    startup_ms_ = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - started_at_).count();
+    std::vector<Int64> all_targets;
+    for (const auto& route : routes_) {
+        all_targets.insert(all_targets.end(), route->target_chat_ids.begin(), route->target_chat_ids.end());
+    }
+    std::sort(all_targets.begin(), all_targets.end());
+    all_targets.erase(std::unique(all_targets.begin(), all_targets.end()), all_targets.end());
+    spdlog::info("转发器已启动，共 {} 个源频道、{} 个目标频道，启动耗时 {} ms",
+        routes_.size(), all_targets.size(), startup_ms_.load());
     return true;
 }
 
-void RestrictedChannelForwarder::stop() {
-    if (!running_) {
-        return;
+bool RestrictedChannelForwarder::prepare_routes(const std::vector<ForwardRoute>& routes) {
+    StartupPhases phases;
+    
+    RouteList prepared;
+    std::map<Int64, std::string> requested_accounts;
+    if (!build_routes(routes, prepared, requested_accounts)) {
+        return false;
     }
+    phases.finish("解析频道");
     
-    spdlog::info("停止转发器...");
-    stopping_ = true;
+    // 把源频道分到各账号，非主账号再以自己的身份解析一次负责的频道
+    if (!assign_accounts(prepared, requested_accounts, {}) || !resolve_on_accounts(prepared)) {
+        return false;
+    }
+    phases.finish("分配账号");
     
-    // 等待转发线程结束
-    if (forward_thread_.joinable()) {
-        forward_thread_.join();
+    if (!open_routes(prepared, prepared)) {
+        return false;
     }
+    phases.finish("检查权限和起始位置");
     
-    running_ = false;
-    stopping_ = false;
+    {
+        std::lock_guard<std::mutex> lock(incoming_mutex_);
+        routes_ = std::move(prepared);
+    }
+    publish_route_table();
     
-    spdlog::info("转发器已停止，总计转发 {} 条消息，失败 {} 条", 
-        forwarded_count_, failed_count_);
-}
-
-bool RestrictedChannelForwarder::is_running() const {
-    return running_;
-}
-
-int RestrictedChannelForwarder::get_forwarded_count() const {
-    return forwarded_count_;
-}
-
-int RestrictedChannelForwarder::get_failed_count() const {
-    return failed_count_;
+    spdlog::info("启动各阶段耗时: {}", phases.summary());
+    return true;
 }
 
-void RestrictedChannelForwarder::forward_worker() {
-    spdlog::debug("转发线程已启动");
-    
-    // 初始化媒体处理器
-    MediaHandler::instance().start();
-    
-    // 主转发循环
-    while (running_ && !stopping_) {
-        try {
-            // 获取新消息
-            auto messages = get_new_messages(source_chat_id_, last_message_id_, config_.max_history_messages);
+bool RestrictedChannelForwarder::build_routes(const std::vector<ForwardRoute>& routes, RouteList& built,
+                                              std::map<Int64, std::string>& requested_accounts) {
+    // 解析路由表中出现的所有频道（批量并发解析）
+    std::map<std::string, Int64> chat_ids;
+    try {
+        std::vector<std::string> channels;
+        for (const auto& route : routes) {
+            spdlog::info("转发路由: {} -> {} 个目标频道", route.source, route.targets.size());
             
-            if (!messages.empty()) {
-                spdlog::info("获取到 {} 条新消息", messages.size());
-                
-                // 处理新消息
-                for (auto& message : messages) {
-                    try {
-                        // 检查消息类型是否在过滤器中
-                        if (!should_forward_message(message)) {
-                            spdlog::debug("跳过消息 #{}: 消息类型不符合过滤条件", message->id_);
-                            continue;
-                        }
-                        
-                        // 获取媒体组ID
-                        auto media_group_id = get_media_group_id(message);
-                        
-                        // 如果是媒体组的第一条消息，尝试获取整个媒体组
-                        if (media_group_id && !media_group_processed(*media_group_id)) {
-                            spdlog::info("发现媒体组消息: {}", *media_group_id);
-                            
-                            // 获取完整的媒体组
-                            auto group_messages = get_media_group_messages(source_chat_id_, *media_group_id);
-                            
-                            if (!group_messages.empty()) {
-                                spdlog::info("获取到媒体组的 {} 条消息", group_messages.size());
-                                
-                                // 转发整个媒体组
-                                if (forward_media_group(group_messages)) {
-                                    forwarded_count_ += group_messages.size();
-                                    
-                                    // 记录已处理的媒体组
-                                    processed_media_groups_.insert(*media_group_id);
-                                    
-                                    // 更新最新消息ID
-                                    update_last_message_id(group_messages);
-                                } else {
-                                    failed_count_ += group_messages.size();
-                                }
-                            }
-                        }
-                        // 如果不是媒体组消息或者媒体组已处理，则单独转发这条消息
-                        else if (!media_group_id || (media_group_id && media_group_processed(*media_group_id))) {
-                            // 跳过已处理的媒体组消息
-                            if (media_group_id && media_group_processed(*media_group_id)) {
-                                spdlog::debug("跳过消息 #{}: 媒体组 {} 已处理", message->id_, *media_group_id);
-                                
-                                // 更新最新消息ID
-                                last_message_id_ = std::max(last_message_id_, message->id_);
-                                continue;
-                            }
-                            
-                            // 转发单条消息
-                            if (forward_message(message)) {
-                                ++forwarded_count_;
-                                
-                                // 更新最新消息ID
-                                last_message_id_ = std::max(last_message_id_, message->id_);
-                                
-                                spdlog::info("消息 #{} 转发成功", message->id_);
-                            } else {
-                                ++failed_count_;
-                                spdlog::error("消息 #{} 转发失败", message->id_);
-                            }
-                        }
-                    } catch (const std::exception& e) {
-                        ++failed_count_;
-                        spdlog::error("处理消息 #{} 时出错: {}", message->id_, e.what());
-                    }
-                }
-            } else {
-                spdlog::debug("没有新消息");
+            channels.push_back(route.source);
+            channels.insert(channels.end(), route.targets.begin(), route.targets.end());
+        }
+        std::sort(channels.begin(), channels.end());
+        channels.erase(std::unique(channels.begin(), channels.end()), channels.end());
+        
+        // 等待解析完成
+        auto results = ChannelResolver::instance().resolve_channels(channels).get();
+        for (size_t i = 0; i < channels.size(); ++i) {
+            const auto& channel = channels[i];
+            Int64 chat_id = results[i].get();
+            if (chat_id == 0) {
+                spdlog::error("无法解析频道: {}", channel);
+                return false;
             }
             
-            // 如果是一次性模式并且已经处理了消息，则停止
-            if (config_.mode == ForwarderMode::OneTime && !messages.empty()) {
-                spdlog::info("一次性模式下完成转发，停止转发器");
-                breaking;
+            spdlog::info("频道 {} 的ID: {}", channel, chat_id);
+            chat_ids[channel] = chat_id;
+        }
+    } catch (const std::exception& e) {
+        spdlog::error("解析频道时出错: {}", e.what());
+        return false;
+    }
+    
+    // 构建路由表：同一源频道合并为一条，目标去重
+    built.clear();
+    requested_accounts.clear();
+    std::map<Int64, SourceRoute*> by_chat;
+    
+    for (const auto& route : routes) {
+        Int64 source_chat_id = chat_ids[route.source];
+        auto& source_route = by_chat[source_chat_id];
+        if (!source_route) {
+            built.push_back(std::make_shared<SourceRoute>());
+            source_route = built.back().get();
+            source_route->source_channel = route.source;
+            source_route->source_chat_id = source_chat_id;
+        }
+        
+        // 同一源频道只能由一个账号负责，以第一条指定了账号的路由为准
+        if (!route.account.empty()) {
+            auto inserted = requested_accounts.emplace(source_chat_id, route.account);
+            if (!inserted.second && inserted.first->second != route.account) {
+                spdlog::warn("源频道 {} 的路由指定了不同的账号，使用 {}", route.source, inserted.first->second);
+            }
+        }
+        
+        for (const auto& target : route.targets) {
+            Int64 target_chat_id = chat_ids[target];
+            if (target_chat_id == source_chat_id) {
+                spdlog::warn("跳过与源频道相同的目标频道: {}", target);
+                continue;
             }
             
-            // 等待一段时间后再次检查
-            std::this_thread::sleep_for(std::chrono::milliseconds(wait_time_ms_));
-        } catch (const std::exception& e) {
-            spdlog::error("转发过程中出错: {}", e.what());
-            
-            // 出错后等待一段时间再重试
-            std::this_thread::sleep_for(std::chrono::milliseconds(wait_time_ms_ * 2));
+            auto& targets = source_route->target_chat_ids;
+            if (std::find(targets.begin(), targets.end(), target_chat_id) == targets.end()) {
+                targets.push_back(target_chat_id);
+                source_route->target_channels.push_back(target);
+            }
         }
     }
     
-    // 停止媒体处理器
-    MediaHandler::instance().stop();
+    for (const auto& route : built) {
+        if (route->target_chat_ids.empty()) {
+            spdlog::error("源频道 {} 没有可用的目标频道", route->source_channel);
+            return false;
+        }
+    }
     
-    spdlog::debug("转发线程已退出");
+    return true;
 }
 
-MessageVector RestrictedChannelForwarder::get_new_messages(Int64 chat_id, Int64 last_message_id, int limit) {
-    auto get_history = td_api::make_object<td_api::getChatHistory>();
-    get_history->chat_id_ = chat_id;
-    get_history->limit_ = limit;
-    get_history->offset_ = -limit;
-    get_history->only_local_ = false;
+bool RestrictedChannelForwarder::open_routes(const RouteList& routes, const RouteList& opening) {
+    // 以下请求互不依赖，全部发出后再统一等待：
+    // 目标频道的发消息权限（同一账号和目标只查一次）、没有检查点的源频道的最新消息ID、打开源频道
+    auto& client = ClientManager::instance();
+    std::vector<std::pair<std::size_t, Int64>> targets_to_check;
+    for (const auto& route : routes) {
+        for (auto target_chat_id : route->target_chat_ids) {
+            auto key = std::make_pair(route->account, target_chat_id);
+            if (std::find(targets_to_check.begin(), targets_to_check.end(), key) == targets_to_check.end()) {
+                targets_to_check.push_back(key);
+            }
+        }
+    }
     
-    auto response = ClientManager::instance().send_query(std::move(get_history));
+    std::vector<Future<bool>> checks;
+    std::vector<std::pair<SourceRoute*, Future<Int64>>> latest_ids;
+    std::vector<std::pair<SourceRoute*, Future<Object>>> opened_chats;
+    for (const auto& [account, target_chat_id] : targets_to_check) {
+        AccountScope scope(account);
+        checks.push_back(check_send_message_permission(target_chat_id));
+    }
     
-    if (response->get_id() == td_api::error::ID) {
-        auto error = td::move_object_as<td_api::error>(response);
-        throw std::runtime_error("获取聊天历史记录失败: " + error->message_);
+    for (auto& route : opening) {
+        AccountScope scope(route->account);
+        
+        // 打开检查点：有记录时从上次提交的位置继续，否则以当前最新消息为起始点
+        route->checkpoint.open(checkpoint_path(route->source_chat_id), route->source_chat_id,
+            targets_fingerprint(route->target_chat_ids), static_cast<size_t>(std::max(config_.dedup_window, 1)));
+        
+        if (route->checkpoint.last_message_id() > 0) {
+            route->last_message_id = route->checkpoint.last_message_id();
+            spdlog::info("源频道 {} 从检查点恢复，继续转发消息ID {} 之后的消息",
+                route->source_channel, route->last_message_id);
+        } else {
+            latest_ids.emplace_back(route.get(), get_latest_message_id(route->source_chat_id));
+        }
+        
+        // 频道只有在打开后TDLib才会及时拉取其更新
+        auto open_chat = td_api::make_object<td_api::openChat>();
+        open_chat->chat_id_ = route->source_chat_id;
+        opened_chats.emplace_back(route.get(), client.send_query_future(std::move(open_chat)));
+        
+        // 设置媒体组收集静默期
+        route->album_assembler.set_quiet_period(std::chrono::milliseconds(std::max(config_.album_quiet_period_ms, 0)));
     }
     
-    auto messages = td::move_object_as<td_api::messages>(response);
-    MessageVector result;
+    try {
+        for (size_t i = 0; i < checks.size(); ++i) {
+            if (!checks[i].get()) {
+                spdlog::error("账号 {} 在目标频道中没有发送消息的权限: {}",
+                    client.account_name(targets_to_check[i].first), targets_to_check[i].second);
+                return false;
+            }
+        }
+    } catch (const std::exception& e) {
+        spdlog::error("检查目标频道权限时出错: {}", e.what());
+        return false;
+    }
     
-    // 过滤出比last_message_id更新的消息，并按ID升序排序
-    for (auto& message : messages->messages_) {
-        if (message->id_ > last_message_id) {
-            result.push_back(std::move(message));
+    // 起始点必须确定：最新消息ID为0时补漏会从头拉取历史，把旧消息当作新消息转发。
+    // 临时性错误按重试策略重新获取，仍然失败时启动失败
+    RetryPolicy retry_policy(config_.retry_count, std::chrono::seconds(std::max(config_.retry_delay, 1)));
+    for (auto& [route, latest_id] : latest_ids) {
+        for (int attempt = 1;; ++attempt) {
+            try {
+                route->last_message_id = latest_id.get();
+                break;
+            } catch (const std::exception&) {
+                auto error = std::current_exception();
+                int retry_after = 0;
+                if (!RetryPolicy::is_retryable(error, retry_after) || attempt > retry_policy.max_retries()) {
+                    spdlog::error("获取源频道 {} 的最新消息ID失败: {}",
+                        route->source_channel, RetryPolicy::describe(error));
+                    return false;
+                }
+                
+                auto delay = retry_policy.delay_for(attempt, retry_after);
+                spdlog::warn("获取源频道 {} 的最新消息ID失败，{} ms 后第 {} 次重试: {}",
+                    route->source_channel, delay.count(), attempt, RetryPolicy::describe(error));
+                std::this_thread::sleep_for(delay);
+                
+                AccountScope scope(route->account);
+                latest_id = get_latest_message_id(route->source_chat_id);
+            }
+        }
+        
+        if (route->last_message_id == 0) {
+            spdlog::info("源频道 {} 暂无消息，将从下一条消息开始转发", route->source_channel);
+        } else {
+            spdlog::info("获取到源频道 {} 的最新消息ID: {}", route->source_channel, route->last_message_id);
+            route->checkpoint.commit(route->last_message_id);
         }
     }
     
-    // 按消息ID升序排序
-    std::sort(result.begin(), result.end(), [](const auto& a, const auto& b) {
-        return a->id_ < b->id_;
-    });
+    // 打开失败不影响转发，只是更新可能要等补漏拉取
+    for (auto& [route, opened] : opened_chats) {
+        auto response = opened.get();
+        if (response && response->get_id() == td_api::error::ID) {
+            auto& error = static_cast<const td_api::error&>(*response);
+            spdlog::warn("打开源频道 {} 失败: {}", route->source_channel, error.message_);
+        }
+    }
     
-    return result;
+    return true;
 }
 
-Int64 RestrictedChannelForwarder::get_latest_message_id(Int64 chat_id) {
-    auto get_history = td_api::make_object<td_api::getChatHistory>();
-    get_history->chat_id_ = chat_id;
-    get_history->limit_ = 1;
-    get_history->offset_ = 0;
-    get_history->only_local_ = false;
-    
-    auto response = ClientManager::instance().send_query(std::move(get_history));
+bool RestrictedChannelForwarder::assign_accounts(const RouteList& routes,
+                                                 const std::map<Int64, std::string>& requested_accounts,
+                                                 const RouteList& assigned) {
+    auto& client = ClientManager::instance();
+    std::vector<size_t> routes_per_account(std::max<size_t>(client.account_count(), 1), 0);
+    for (const auto& route : assigned) {
+        ++routes_per_account[std::min(route->account, routes_per_account.size() - 1)];
+    }
     
-    if (response->get_id() == td_api::error::ID) {
-        auto error = td::move_object_as<td_api::error>(response);
-        spdlog::error("获取最新消息ID失败: {}", error->message_);
-        return 0;
+    // 先处理指定了账号的源频道
+    std::vector<SourceRoute*> unassigned;
+    for (auto& route : routes) {
+        auto it = requested_accounts.find(route->source_chat_id);
+        if (it == requested_accounts.end()) {
+            unassigned.push_back(route.get());
+            continue;
+        }
+        
+        auto account = client.find_account(it->second);
+        if (!account) {
+            spdlog::error("源频道 {} 指定的账号不存在: {}", route->source_channel, it->second);
+            return false;
+        }
+        
+        route->account = *account;
+        ++routes_per_account[*account];
     }
     
-    auto messages = td::move_object_as<td_api::messages>(response);
+    // 其余源频道依次分给当前负责源频道最少的账号
+    for (auto route : unassigned) {
+        auto least = std::min_element(routes_per_account.begin(), routes_per_account.end());
+        route->account = static_cast<size_t>(least - routes_per_account.begin());
+        ++*least;
+    }
     
-    if (messages->messages_.empty()) {
-        return 0;
+    for (const auto& route : routes) {
+        spdlog::info("源频道 {} 由账号 {} 负责", route->source_channel, client.account_name(route->account));
     }
     
-    return messages->messages_[0]->id_;
+    return true;
 }
 
-MessageVector RestrictedChannelForwarder::get_media_group_messages(Int64 chat_id, const std::string& media_group_id) {
-    // 获取足够多的历史记录，确保能包含整个媒体组
-    auto get_history = td_api::make_object<td_api::getChatHistory>();
-    get_history->chat_id_ = chat_id;
-    get_history->limit_ = 50; // 假设媒体组不会超过50条消息
-    get_history->offset_ = 0;
-    get_history->only_local_ = false;
-    
-    auto response = ClientManager::instance().send_query(std::move(get_history));
-    
-    if (response->get_id() == td_api::error::ID) {
-        auto error = td::move_object_as<td_api::error>(response);
-        throw std::runtime_error("获取媒体组消息失败: " + error->message_);
-    }
-    
-    auto messages = td::move_object_as<td_api::messages>(response);
-    MessageVector result;
+bool RestrictedChannelForwarder::resolve_on_accounts(const RouteList& routes) {
+    struct Lookup {
+        std::string channel;
+        Int64 expected_chat_id;
+        std::size_t account;
+        Future<Int64> future;
+    };
     
-    // 过滤出属于同一媒体组的消息
-    for (auto& message : messages->messages_) {
-        auto msg_media_group_id = get_media_group_id(message);
-        if (msg_media_group_id && *msg_media_group_id == media_group_id) {
-            result.push_back(std::move(message));
+    std::vector<Lookup> lookups;
+    try {
+        for (const auto& route : routes) {
+            if (route->account == 0) {
+                continue;
+            }
+            
+            AccountScope scope(route->account);
+            lookups.push_back(Lookup{route->source_channel, route->source_chat_id, route->account,
+                ChannelResolver::instance().resolve_channel(route->source_channel)});
+            for (size_t i = 0; i < route->target_channels.size(); ++i) {
+                lookups.push_back(Lookup{route->target_channels[i], route->target_chat_ids[i], route->account,
+                    ChannelResolver::instance().resolve_channel(route->target_channels[i])});
+            }
+        }
+        
+        for (auto& lookup : lookups) {
+            Int64 chat_id = lookup.future.get();
+            if (chat_id != lookup.expected_chat_id) {
+                spdlog::error("账号 {} 解析频道 {} 的结果不一致: {} / {}",
+                    ClientManager::instance().account_name(lookup.account), lookup.channel,
+                    chat_id, lookup.expected_chat_id);
+                return false;
+            }
         }
+    } catch (const std::exception& e) {
+        spdlog::error("解析频道时出错: {}", e.what());
+        return false;
     }
     
-    // 按消息ID升序排序，确保媒体组内顺序正确
-    std::sort(result.begin(), result.end(), [](const auto& a, const auto& b) {
-        return a->id_ < b->id_;
-    });
-    
-    return result;
+    return true;
 }
 
-bool RestrictedChannelForwarder::should_forward_message(const Message& message) {
-    // 如果过滤器包含全部类型，直接返回true
-    for (const auto& filter : message_filters_) {
-        if (filter == MessageTypeFilter::All) {
-            return true;
+bool RestrictedChannelForwarder::start(const std::string& source_channel, const std::string& target_channel) {
+    return start(std::vector<ForwardRoute>{ForwardRoute{source_channel, {target_channel}, ""}});
+}
+
+void RestrictedChannelForwarder::stop() {
+    if (!running_) {
+        return;
+    }
+    
+    spdlog::info("停止转发器...");
+    
+    if (config_.push_updates) {
+        ClientManager::instance().unregister_update_handler(td_api::updateNewMessage::ID);
+        ClientManager::instance().unregister_update_handler(td_api::updateConnectionState::ID);
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(incoming_mutex_);
+        stopping_ = true;
+    }
+    incoming_cv_.notify_all();
+    
+    // 等待转发线程结束
+    if (forward_thread_.joinable()) {
+        forward_thread_.join();
+    }
+    
+    running_ = false;
+    stopping_ = false;
+    
+    // 转发线程已退出（路由表不再变化），检查点落盘并关闭启动时打开的源频道
+    for (auto& route : routes_) {
+        route->checkpoint.close();
+        close_source_chat(*route);
+    }
+    
+    spdlog::info("转发器已停止，总计转发 {} 条消息，失败 {} 条", 
+        forwarded_count_, failed_count_);
+    
+    MetricsServer::instance().stop();
+    auto latency_summary = Metrics::instance().summary();
+    if (!latency_summary.empty()) {
+        spdlog::info("延迟统计: {}", latency_summary);
+    }
+    
+    auto& file_id_cache = FileIdCache::instance();
+    if (file_id_cache.is_open()) {
+        spdlog::info("文件ID缓存命中 {} 次，未命中 {} 次，共 {} 条记录",
+            file_id_cache.hit_count(), file_id_cache.miss_count(), file_id_cache.size());
+        file_id_cache.close();
+    }
+    ChannelResolver::instance().close();
+}
+
+bool RestrictedChannelForwarder::reload(const ForwarderConfig& config, const std::vector<ForwardRoute>& routes) {
+    if (!running_) {
+        spdlog::warn("转发器未运行，忽略重新加载");
+        return false;
+    }
+    
+    if (routes.empty()) {
+        spdlog::error("重新加载失败：未配置转发路由，保留当前配置");
+        return false;
+    }
+    
+    // 上一次的路由变化由转发线程生效、被移除的源频道排空之前不接受新的重载
+    {
+        std::lock_guard<std::mutex> lock(incoming_mutex_);
+        if (pending_reload_ || retiring_route_count_ > 0) {
+            spdlog::warn("上一次重新加载尚未完成，请稍后再试");
+            return false;
         }
     }
     
-    // 获取消息类型
-    auto content_type = message->content_->get_id();
+    spdlog::info("重新加载转发器配置...");
+    auto restart_only = restart_only_changes(config_, config);
+    if (!restart_only.empty()) {
+        spdlog::warn("以下配置项需要重启后才能生效: {}", restart_only);
+    }
     
-    // 检查消息类型是否在过滤器中
-    for (const auto& filter : message_filters_) {
-        switch (filter) {
-            case MessageTypeFilter::Text:
-                if (content_type == td_api::messageText::ID) {
-                    return true;
-                }
-                break;
-            case MessageTypeFilter::Photo:
-                if (content_type == td_api::messagePhoto::ID) {
-                    return true;
-                }
-                break;
-            case MessageTypeFilter::Video:
-                if (content_type == td_api::messageVideo::ID) {
-                    return true;
-                }
-                break;
-            case MessageTypeFilter::Document:
-                if (content_type == td_api::messageDocument::ID) {
-                    return true;
-                }
-                break;
-            case MessageTypeFilter::Audio:
-                if (content_type == td_api::messageAudio::ID) {
-                    return true;
-                }
-                break;
-            case MessageTypeFilter::Sticker:
-                if (content_type == td_api::messageSticker::ID) {
-                    return true;
-                }
-                break;
-            case MessageTypeFilter::Animation:
-                if (content_type == td_api::messageAnimation::ID) {
-                    return true;
-                }
-                break;
-            default:
-                break;
+    // 解析新的路由表；已在转发的源频道沿用原来的账号、流水线和检查点，只更新目标
+    RouteList prepared;
+    std::map<Int64, std::string> requested_accounts;
+    if (!build_routes(routes, prepared, requested_accounts)) {
+        spdlog::error("重新加载失败，保留当前配置");
+        return false;
+    }
+    
+    auto& client = ClientManager::instance();
+    auto table = route_table();
+    RouteList added;
+    RouteList kept;
+    for (auto& route : prepared) {
+        auto it = table->find(route->source_chat_id);
+        if (it == table->end()) {
+            added.push_back(route);
+            continue;
+        }
+        
+        route->account = it->second->account;
+        kept.push_back(it->second);
+        
+        auto requested = requested_accounts.find(route->source_chat_id);
+        if (requested != requested_accounts.end() && client.find_account(requested->second) != route->account) {
+            spdlog::warn("源频道 {} 的账号变更需要重启后才能生效", route->source_channel);
+        }
+    }
+    
+    // 新增的源频道分给负责源频道最少的账号；所有目标都重新检查权限，只打开新增的源频道
+    if (!assign_accounts(added, requested_accounts, kept) || !resolve_on_accounts(prepared) ||
+        !open_routes(prepared, added)) {
+        for (auto& route : added) {
+            route->checkpoint.close();
+            close_source_chat(*route);
+        }
+        spdlog::error("重新加载失败，保留当前配置");
+        return false;
+    }
+    
+    // 转发线程拥有的设置和路由表打包交给转发线程，在两轮处理之间一次性替换
+    auto pending = std::make_unique<PendingReload>();
+    pending->wait_time_ms = config.wait_time_ms;
+    pending->pipeline_depth = config.pipeline_depth;
+    pending->max_history_messages = config.max_history_messages;
+    pending->album_quiet_period_ms = config.album_quiet_period_ms;
+    pending->filter_mask = parse_message_filters(config.message_filters);
+    for (auto& route : prepared) {
+        auto it = table->find(route->source_chat_id);
+        pending->routes.push_back(RouteUpdate{it == table->end() ? route : it->second,
+                                              route->target_channels, route->target_chat_ids});
+    }
+    
+    // 并发、限流等参数立即生效（各模块自身线程安全，进行中的任务不受影响）
+    apply_settings(config);
+    
+    size_t removed = table->size() - kept.size();
+    {
+        std::lock_guard<std::mutex> lock(incoming_mutex_);
+        pending_reload_ = std::move(pending);
+        incoming_pending_ = true;
+    }
+    incoming_cv_.notify_one();
+    
+    spdlog::info("转发器配置已重新加载：共 {} 个源频道，新增 {} 个，移除 {} 个",
+        prepared.size(), added.size(), removed);
+    return true;
+}
+
+void RestrictedChannelForwarder::apply_pending_reload() {
+    std::vector<SourceRoute*> retargeted;
+    {
+        std::lock_guard<std::mutex> lock(incoming_mutex_);
+        if (!pending_reload_) {
+            return;
+        }
+        
+        auto reload = std::move(pending_reload_);
+        wait_time_ms_ = reload->wait_time_ms;
+        config_.wait_time_ms = reload->wait_time_ms;
+        config_.pipeline_depth = reload->pipeline_depth;
+        config_.max_history_messages = reload->max_history_messages;
+        config_.album_quiet_period_ms = reload->album_quiet_period_ms;
+        message_filter_mask_ = reload->filter_mask;
+        
+        auto now = std::chrono::steady_clock::now();
+        RouteList next;
+        for (auto& update : reload->routes) {
+            auto& route = update.route;
+            if (std::find(routes_.begin(), routes_.end(), route) == routes_.end()) {
+                // 新增的源频道从起始位置补拉一次
+                route->last_enqueued_id = route->last_message_id;
+                route->catch_up_cursor = route->last_message_id;
+                route->next_poll_time = now;
+                route->catch_up_pending = true;
+                incoming_pending_ = true;
+                spdlog::info("开始转发新增的源频道 {}", route->source_channel);
+            } else if (route->target_chat_ids != update.target_chat_ids) {
+                retargeted.push_back(route.get());
+            }
+            
+            route->target_channels = std::move(update.target_channels);
+            route->target_chat_ids = std::move(update.target_chat_ids);
+            route->album_assembler.set_quiet_period(std::chrono::milliseconds(std::max(config_.album_quiet_period_ms, 0)));
+            next.push_back(route);
+        }
+        
+        // 不在新路由表中的源频道不再接收新消息，流水线中已有的项照常转发完
+        for (auto& route : routes_) {
+            if (std::find(next.begin(), next.end(), route) != next.end()) {
+                continue;
+            }
+            
+            if (!route->retiring) {
+                route->retiring = true;
+                ++retiring_route_count_;
+                spdlog::info("源频道 {} 已从路由表移除，转发完流水线中的 {} 项后停止", 
+                    route->source_channel, route->pipeline.size());
+            }
+            next.push_back(route);
         }
+        
+        routes_ = std::move(next);
+        publish_route_table();
     }
     
-    return false;
+    // 目标变化后按新的目标集合重建检查点，从当前进度继续
+    for (auto route : retargeted) {
+        spdlog::info("源频道 {} 的目标频道已更新为 {} 个", route->source_channel, route->target_chat_ids.size());
+        route->checkpoint.close();
+        route->checkpoint.open(checkpoint_path(route->source_chat_id), route->source_chat_id,
+            targets_fingerprint(route->target_chat_ids), static_cast<size_t>(std::max(config_.dedup_window, 1)));
+        if (route->last_message_id > 0) {
+            route->checkpoint.commit(route->last_message_id);
+        }
+    }
 }
 
-bool RestrictedChannelForwarder::media_group_processed(const std::string& media_group_id) {
-    return processed_media_groups_.find(media_group_id) != processed_media_groups_.end();
+void RestrictedChannelForwarder::remove_retired_routes() {
+    RouteList retired;
+    {
+        std::lock_guard<std::mutex> lock(incoming_mutex_);
+        if (retiring_route_count_ == 0) {
+            return;
+        }
+        
+        for (auto it = routes_.begin(); it != routes_.end();) {
+            if ((*it)->retiring && (*it)->pipeline.empty()) {
+                retired.push_back(std::move(*it));
+                it = routes_.erase(it);
+                --retiring_route_count_;
+            } else {
+                ++it;
+            }
+        }
+    }
+    
+    // 接收线程可能仍持有旧的路由表快照，对象随最后一个快照释放
+    for (auto& route : retired) {
+        route->checkpoint.close();
+        close_source_chat(*route);
+        spdlog::info("源频道 {} 已停止转发", route->source_channel);
+    }
 }
 
-void RestrictedChannelForwarder::update_last_message_id(const MessageVector& messages) {
-    for (const auto& message : messages) {
-        last_message_id_ = std::max(last_message_id_, message->id_);
+void RestrictedChannelForwarder::publish_route_table() {
+    auto table = std::make_shared<RouteTable>();
+    for (const auto& route : routes_) {
+        if (!route->retiring) {
+            (*table)[route->source_chat_id] = route;
+        }
     }
+    std::atomic_store(&route_table_, std::shared_ptr<const RouteTable>(std::move(table)));
 }
 
-bool RestrictedChannelForwarder::check_send_message_permission(Int64 chat_id) {
-    auto get_chat = td_api::make_object<td_api::getChat>();
-    get_chat->chat_id_ = chat_id;
-    
-    auto response = ClientManager::instance().send_query(std::move(get_chat));
+std::shared_ptr<const RestrictedChannelForwarder::RouteTable> RestrictedChannelForwarder::route_table() const {
+    return std::atomic_load(&route_table_);
+}
+
+std::string RestrictedChannelForwarder::checkpoint_path(Int64 source_chat_id) const {
+    return config_.checkpoint_file.empty()
+        ? std::string()
+        : config_.checkpoint_file + "." + std::to_string(source_chat_id);
+}
+
+void RestrictedChannelForwarder::close_source_chat(const SourceRoute& route) {
+    AccountScope scope(route.account);
+    auto close_chat = td_api::make_object<td_api::closeChat>();
+    close_chat->chat_id_ = route.source_chat_id;
+    ClientManager::instance().send_query_async(std::move(close_chat));
+}
+
+bool RestrictedChannelForwarder::is_running() const {
+    return running_;
+}
+
+int RestrictedChannelForwarder::get_forwarded_count() const {
+    return forwarded_count_;
+}
+
+int RestrictedChannelForwarder::get_failed_count() const {
+    return failed_count_;
+}
+
+void RestrictedChannelForwarder::forward_worker() {
+    spdlog::debug("转发线程已启动");
     
-    if (response->get_id() == td_api::error::ID) {
-        auto error = td::move_object_as<td_api::error>(response);
-        spdlog::error("获取聊天信息失败: {}", error->message_);
-        return false;
+    auto now = std::chrono::steady_clock::now();
+    for (auto& route : routes_) {
+        route->last_enqueued_id = route->last_message_id;
+        route->catch_up_cursor = route->last_message_id;
+        route->next_poll_time = now;
     }
+    draining_ = false;
     
-    auto chat = td::move_object_as<td_api::chat>(response);
+    // 主转发循环：获取 → 过滤 → 下载 → 上传 → 按源顺序提交
+    while (running_ && !stopping_) {
+        try {
+            // 重新加载的设置和路由表在两轮处理之间生效
+            apply_pending_reload();
+            
+            // 获取新消息：等待推送、下载完成或下次轮询，需要补漏时再拉取历史
+            auto message_count = collect_new_messages();
+            
+            if (message_count > 0) {
+                spdlog::info("获取到 {} 条新消息", message_count);
+                
+                // 一次性模式：拿到第一批消息后不再拉取，流水线排空即停止
+                if (config_.mode == ForwarderMode::OneTime) {
+                    draining_ = true;
+                }
+            }
+            
+            for (auto& route : routes_) {
+                // 过滤并放入流水线
+                auto messages = std::move(route->batch);
+                route->batch.clear();
+                enqueue_messages(*route, std::move(messages));
+                
+                // 媒体组凑齐后才能开始下载；一次性模式下或源频道已移除时不再等待后续消息
+                assign_ready_albums(*route, draining_ || route->retiring);
+            }
+            
+            // 在共享的并发上限内启动下载，然后按顺序提交各源频道队首已就绪的项
+            start_downloads();
+            for (auto& route : routes_) {
+                start_sends(*route);
+                commit_ready_slots(*route);
+            }
+            start_downloads();
+            remove_retired_routes();
+            
+            if (draining_ && pipelines_empty()) {
+                spdlog::info("一次性模式下完成转发，停止转发器");
+                break;
+            }
+        } catch (const std::exception& e) {
+            spdlog::error("转发过程中出错: {}", e.what());
+            
+            // 出错后等待一段时间再重试
+            std::this_thread::sleep_for(std::chrono::milliseconds(wait_time_ms_ * 2));
+        }
+    }
     
-    // 获取机器人在聊天中的权限
-    auto get_chat_member = td_api::make_object<td_api::getChatMember>();
-    get_chat_member->chat_id_ = chat_id;
-    get_chat_member->member_id_ = td_api::make_object<td_api::messageSenderUser>(
-        ClientManager::instance().get_my_id());
+    for (auto& route : routes_) {
+        if (!route->pipeline.empty()) {
+            spdlog::warn("源频道 {} 停止时仍有 {} 项未完成转发", route->source_channel, route->pipeline.size());
+            route->pipeline.clear();
+        }
+        route->album_assembler.clear();
+    }
     
-    response = ClientManager::instance().send_query(std::move(get_chat_member));
+    // 停止媒体处理器
+    MediaHandler::instance().stop();
     
-    if (response->get_id() == td_api::error::ID) {
-        auto error = td::move_object_as<td_api::error>(response);
-        spdlog::error("获取聊天成员信息失败: {}", error->message_);
-        return false;
+    spdlog::debug("转发线程已退出");
+}
+
+void RestrictedChannelForwarder::enqueue_messages(SourceRoute& route, MessageVector messages) {
+    for (auto& message : messages) {
+        auto media_group_id = get_media_group_id(message);
+        
+        // 已进入流水线的消息只可能是尚未凑齐的媒体组的补充
+        if (message->id_ <= route.last_enqueued_id) {
+            auto slot = media_group_id ? find_album_slot(route, *media_group_id) : nullptr;
+            if (slot && !slot->album_ready && should_forward_message(message)) {
+                route.album_assembler.add(message);
+            }
+            continue;
+        }
+        route.last_enqueued_id = message->id_;
+        
+        // 源消息发布到被转发器取到的延迟（推送模式下主要是网络延迟，轮询模式下包含轮询间隔）
+        static auto& fetch_delay = Metrics::instance().histogram(
+            "tg_forwarder_fetch_delay_seconds", "源消息发布到被转发器取到的延迟");
+        fetch_delay.record(std::chrono::system_clock::now() - std::chrono::system_clock::from_time_t(message->date_));
+        
+        PipelineSlot slot;
+        slot.first_message_id = message->id_;
+        slot.last_message_id = message->id_;
+        
+        // 被过滤或已转发过的消息仍占一个槽位，提交时只推进 last_message_id
+        if (!should_forward_message(message)) {
+            spdlog::debug("跳过消息 #{}: 消息类型不符合过滤条件", message->id_);
+            slot.skip = true;
+        } else if (route.checkpoint.contains_message(message->id_)) {
+            spdlog::debug("跳过消息 #{}: 已转发过", message->id_);
+            slot.skip = true;
+        } else if (media_group_id) {
+            auto album_slot = find_album_slot(route, *media_group_id);
+            
+            if (media_group_processed(route, *media_group_id) || (album_slot && album_slot->album_ready)) {
+                spdlog::debug("跳过消息 #{}: 媒体组 {} 已处理", message->id_, *media_group_id);
+                slot.skip = true;
+            } else if (album_slot) {
+                // 同组后续消息并入已有槽位
+                route.album_assembler.add(message);
+                continue;
+            } else {
+                // 媒体组在首条消息的位置占位，凑齐后再下载
+                spdlog::info("发现媒体组消息: {}", *media_group_id);
+                slot.media_group_id = *media_group_id;
+                route.album_assembler.add(message);
+                route.pipeline.push_back(std::move(slot));
+                continue;
+            }
+        }
+        
+        // 非媒体消息无需下载，可直接提交
+        slot.started = slot.skip || !is_media_message(message);
+        slot.message = std::make_shared<const Message>(std::move(message));
+        route.pipeline.push_back(std::move(slot));
     }
+}
+
+void RestrictedChannelForwarder::assign_ready_albums(SourceRoute& route, bool flush_all) {
+    auto albums = flush_all ? route.album_assembler.take_all() : route.album_assembler.take_ready();
     
-    auto chat_member = td::move_object_as<td_api::chatMember>(response);
+    for (auto& album : albums) {
+        auto media_group_id = get_media_group_id(album.front());
+        auto slot = find_album_slot(route, *media_group_id);
+        if (!slot) {
+            continue;
+        }
+        
+        spdlog::info("媒体组 {} 已收集 {} 条消息", *media_group_id, album.size());
+        
+        slot->last_message_id = std::max(slot->first_message_id, album.back()->id_);
+        slot->album = std::make_shared<const MessageVector>(std::move(album));
+        slot->album_ready = true;
+    }
+}
+
+void RestrictedChannelForwarder::start_downloads() {
+    size_t limit = static_cast<size_t>(std::max(config_.pipeline_depth, 1));
     
-    // 检查是否有发送消息的权限
-    if (chat_member->status_->get_id() == td_api::chatMemberStatusAdministrator::ID) {
-        auto admin_status = static_cast<const td_api::chatMemberStatusAdministrator*>(chat_member->status_.get());
-        return admin_status->can_post_messages_;
-    } else if (chat_member->status_->get_id() == td_api::chatMemberStatusMember::ID) {
-        // 对于普通成员，如果是普通群组，通常可以发送消息
-        return chat->type_->get_id() != td_api::chatTypeSupergroup::ID ||
-               !static_cast<const td_api::chatTypeSupergroup*>(chat->type_.get())->is_channel_;
+    // 只计仍在下载的槽位：已下载完、等待按序提交的槽位不占并发，
+    // 否则队首媒体组凑齐时后续槽位已占满上限，队首永远无法开始下载
+    size_t in_flight = 0;
+    {
+        std::lock_guard<std::mutex> lock(incoming_mutex_);
+        for (const auto& route : routes_) {
+            in_flight += std::count_if(route->pipeline.begin(), route->pipeline.end(), [](const PipelineSlot& slot) {
+                return slot.started && slot.download && !slot.download->done;
+            });
+        }
     }
     
-    return false;
+    // 各源频道轮流启动，避免积压多的频道占满下载并发
+    bool started_any = true;
+    while (in_flight < limit && started_any) {
+        started_any = false;
+        
+        for (auto& route : routes_) {
+            if (in_flight >= limit) {
+                break;
+            }
+            
+            auto it = std::find_if(route->pipeline.begin(), route->pipeline.end(), [](const PipelineSlot& slot) {
+                return !slot.started && (slot.media_group_id.empty() || slot.album_ready);
+            });
+            if (it == route->pipeline.end()) {
+                continue;
+            }
+            
+            auto& slot = *it;
+            auto result = std::make_shared<DownloadResult>();
+            slot.download = result;
+            slot.started = true;
+            started_any = true;
+            ++in_flight;
+            
+            // 下载完成时记录结果并唤醒转发线程；下载结果由该源频道的所有目标共用
+            AccountScope scope(route->account);
+            if (!slot.media_group_id.empty()) {
+                MediaHandler::instance().download_media_group(slot.album).on_ready(
+                    [this, result](Future<std::shared_ptr<MediaGroupTask>> ready) {
+                        std::shared_ptr<MediaGroupTask> group_task;
+                        try {
+                            group_task = ready.get();
+                        } catch (const std::exception& e) {
+                            spdlog::error("下载媒体组时出错: {}", e.what());
+                        }
+                        finish_download(result, nullptr, std::move(group_task));
+                    });
+            } else {
+                MediaHandler::instance().download_media(slot.message).on_ready(
+                    [this, result](Future<std::shared_ptr<MediaTask>> ready) {
+                        std::shared_ptr<MediaTask> task;
+                        try {
+                            task = ready.get();
+                        } catch (const std::exception& e) {
+                            spdlog::error("下载媒体文件时出错: {}", e.what());
+                        }
+                        finish_download(result, std::move(task), nullptr);
+                    });
+            }
+        }
+    }
 }
 
-bool RestrictedChannelForwarder::forward_message(const Message& message) {
-    spdlog::info("转发消息 #{}", message->id_);
+void RestrictedChannelForwarder::finish_download(const std::shared_ptr<DownloadResult>& result,
+                                                 std::shared_ptr<MediaTask> task,
+                                                 std::shared_ptr<MediaGroupTask> group_task) {
+    {
+        std::lock_guard<std::mutex> lock(incoming_mutex_);
+        result->task = std::move(task);
+        result->group_task = std::move(group_task);
+        result->done = true;
+        pipeline_progress_ = true;
+    }
+    incoming_cv_.notify_one();
+}
+
+void RestrictedChannelForwarder::start_sends(SourceRoute& route) {
+    // 上传和发送都通过负责该源频道的账号
+    AccountScope scope(route.account);
     
-    // 获取消息类型
-    auto content_type = message->content_->get_id();
+    // 前面还有媒体没发完的目标：媒体请求要在上传后才发出，后面的槽位须等它完成，
+    // 否则后发的消息可能先到。文本请求发出时即进入该目标的发送顺序：发往同一聊天的各种请求
+    // 在限流器中共用一个桶、按提交顺序发出（限流重发也排在桶的队首），不阻塞后续槽位。
+    // TDLib 没有一次发送多条文本消息的请求（sendMessageAlbum 只接受媒体，受保护频道的消息
+    // 也不能用 forwardMessages 转发），连续的文本槽位因此不合并，而是在同一轮中依次发出
+    std::vector<Int64> blocked;
+    auto is_blocked = [&blocked](Int64 target_chat_id) {
+        return std::find(blocked.begin(), blocked.end(), target_chat_id) != blocked.end();
+    };
     
-    // 根据消息类型执行不同的转发逻辑
-    if (content_type == td_api::messageText::ID) {
-        // 文本消息
-        return forward_text_message(message);
-    } else if (is_media_message(content_type)) {
-        // 媒体消息
-        return forward_media_message(message);
-    } else {
-        spdlog::warn("不支持的消息类型: {}", content_type);
-        return false;
+    for (auto& slot : route.pipeline) {
+        if (!slot.started) {
+            return;
+        }
+        if (slot.skip) {
+            continue;
+        }
+        
+        // 下载未完成的槽位挡住所有目标
+        if (slot.download) {
+            std::lock_guard<std::mutex> lock(incoming_mutex_);
+            if (!slot.download->done) {
+                return;
+            }
+        }
+        
+        if (!slot.sending) {
+            slot.sending = true;
+            
+            // 未启用限流时请求不会被重建，源消息的正文只需留到最后一个目标
+            slot.take_text = !ClientManager::instance().send_rate_limited();
+            for (auto target_chat_id : route.target_chat_ids) {
+                auto send = std::make_shared<SendResult>();
+                send->target_chat_id = target_chat_id;
+                slot.sends.push_back(std::move(send));
+            }
+        }
+        
+        // 同一个下载任务依次上传到各目标：上传会改写任务的状态和缓冲区，不能并发
+        bool uploading = false;
+        for (const auto& send : slot.sends) {
+            if (!send->started && !is_blocked(send->target_chat_id) && !(slot.download && uploading)) {
+                start_send(slot, send);
+            }
+            
+            bool done = false;
+            {
+                std::lock_guard<std::mutex> lock(incoming_mutex_);
+                done = send->done;
+            }
+            if (!done && send->started) {
+                uploading = true;
+            }
+            if (!done && (!send->started || !send->text) && !is_blocked(send->target_chat_id)) {
+                blocked.push_back(send->target_chat_id);
+            }
+        }
     }
 }
 
-bool RestrictedChannelForwarder::forward_text_message(const Message& message) {
-    auto content = static_cast<const td_api::messageText*>(message->content_.get());
-    auto text = content->text_->text_;
+void RestrictedChannelForwarder::start_send(const PipelineSlot& slot, const std::shared_ptr<SendResult>& send) {
+    send->started = true;
+    auto target_chat_id = send->target_chat_id;
     
-    // 创建发送消息请求
-    auto send_message = td_api::make_object<td_api::sendMessage>();
-    send_message->chat_id_ = target_chat_id_;
+    // 媒体组：整组一次上传发送
+    if (!slot.media_group_id.empty()) {
+        auto group_task = slot.download->group_task;
+        if (!group_task) {
+            spdlog::error("下载媒体组失败");
+            finish_send(send, false);
+            return;
+        }
+        if (group_task->failed_count() > 0) {
+            spdlog::error("媒体组中有 {} 个任务下载失败", group_task->failed_count());
+            finish_send(send, false);
+            return;
+        }
+        
+        spdlog::info("转发媒体组 {} 到 {}，共 {} 条消息", slot.media_group_id, target_chat_id, slot.album->size());
+        MediaHandler::instance().upload_media_group(target_chat_id, group_task).on_ready(
+            [this, send](Future<MessageVector> ready) {
+                bool success = false;
+                try {
+                    auto new_messages = ready.get();
+                    success = !new_messages.empty();
+                    if (success) {
+                        spdlog::info("媒体组转发成功，共 {} 条消息", new_messages.size());
+                    } else {
+                        spdlog::error("上传媒体组失败");
+                    }
+                } catch (const std::exception& e) {
+                    spdlog::error("转发媒体组时出错: {}", e.what());
+                }
+                finish_send(send, success);
+            });
+        return;
+    }
     
-    // 创建消息内容
-    auto message_content = td_api::make_object<td_api::inputMessageText>();
-    message_content->text_ = td_api::make_object<td_api::formattedText>(
-        text, std::vector<td_api::object_ptr<td_api::textEntity>>());
+    const auto& message = *slot.message;
+    spdlog::info("转发消息 #{}", message->id_);
     
-    send_message->input_message_content_ = std::move(message_content);
+    // 文本消息
+    auto content_type = message->content_->get_id();
+    if (content_type == td_api::messageText::ID) {
+        send->text = true;
+        auto started = std::chrono::steady_clock::now();
+        
+        // 最后发出的目标取走正文，其余目标各复制一份
+        bool last = std::all_of(slot.sends.begin(), slot.sends.end(),
+            [](const std::shared_ptr<SendResult>& other) { return other->started; });
+        send_text_message(target_chat_id, slot.message, !slot.take_text, slot.take_text && last).on_ready([this, send, started](Future<Object> ready) {
+            bool success = false;
+            try {
+                auto response = ready.get();
+                text_send_duration().record(std::chrono::steady_clock::now() - started);
+                success = text_message_sent(std::move(response));
+            } catch (const std::exception& e) {
+                spdlog::error("转发文本消息时出错: {}", e.what());
+            }
+            finish_send(send, success);
+        });
+        return;
+    }
     
-    // 发送消息
-    auto response = ClientManager::instance().send_query(std::move(send_message));
+    if (!is_media_message(message)) {
+        spdlog::warn("不支持的消息类型: {}", content_type);
+        finish_send(send, false);
+        return;
+    }
     
-    if (response->get_id() == td_api::error::ID) {
-        auto error = td::move_object_as<td_api::error>(response);
-        spdlog::error("转发文本消息失败: {}", error->message_);
-        return false;
+    // 媒体消息：使用已下载完成的任务上传
+    auto media_task = slot.download ? slot.download->task : nullptr;
+    if (!media_task || media_task->state() != MediaTaskState::Completed) {
+        spdlog::error("下载媒体文件失败");
+        finish_send(send, false);
+        return;
     }
     
-    return true;
+    Int64 message_id = message->id_;
+    MediaHandler::instance().upload_media(target_chat_id, media_task).on_ready(
+        [this, send, message_id](Future<Message> ready) {
+            bool success = false;
+            try {
+                auto new_message = ready.get();
+                spdlog::info("媒体消息转发成功: 原ID #{}, 新ID #{}", message_id, new_message->id_);
+                success = true;
+            } catch (const std::exception& e) {
+                spdlog::error("转发媒体消息时出错: {}", e.what());
+            }
+            finish_send(send, success);
+        });
 }
 
-bool RestrictedChannelForwarder::forward_media_message(const Message& message) {
-    try {
-        // 下载媒体文件
-        auto media_task_future = MediaHandler::instance().download_media(message);
-        auto media_task = media_task_future.get();
+void RestrictedChannelForwarder::finish_send(const std::shared_ptr<SendResult>& send, bool success) {
+    {
+        std::lock_guard<std::mutex> lock(incoming_mutex_);
+        send->success = success;
+        send->done = true;
+        pipeline_progress_ = true;
+    }
+    incoming_cv_.notify_one();
+}
+
+void RestrictedChannelForwarder::commit_ready_slots(SourceRoute& route) {
+    // 只提交队首连续发送完成的项：last_message_id 不会越过未完成的消息
+    while (!route.pipeline.empty()) {
+        auto& slot = route.pipeline.front();
+        if (!slot.started) {
+            return;
+        }
         
-        if (!media_task || media_task->state() != MediaTaskState::Completed) {
-            spdlog::error("下载媒体文件失败");
-            return false;
+        if (!slot.skip) {
+            if (!slot.sending) {
+                return;
+            }
+            
+            std::lock_guard<std::mutex> lock(incoming_mutex_);
+            bool done = std::all_of(slot.sends.begin(), slot.sends.end(), [](const auto& send) {
+                return send->done;
+            });
+            if (!done) {
+                return;
+            }
         }
         
-        // 上传媒体文件
-        auto upload_future = MediaHandler::instance().upload_media(target_chat_id_, media_task);
-        auto new_message = upload_future.get();
+        commit_slot(route, slot);
         
-        spdlog::info("媒体消息转发成功: 原ID #{}, 新ID #{}", message->id_, new_message->id_);
-        return true;
-    } catch (const std::exception& e) {
-        spdlog::error("转发媒体消息时出错: {}", e.what());
-        return false;
+        // 更新最新消息ID并写入检查点
+        route.last_message_id = std::max(route.last_message_id, slot.last_message_id);
+        route.checkpoint.commit(route.last_message_id);
+        route.pipeline.pop_front();
     }
 }
 
-bool RestrictedChannelForwarder::forward_media_group(const MessageVector& messages) {
-    try {
-        spdlog::info("转发媒体组，共 {} 条消息", messages.size());
+void RestrictedChannelForwarder::commit_slot(SourceRoute& route, PipelineSlot& slot) {
+    if (slot.skip) {
+        return;
+    }
+    
+    // 各目标的发送结果（commit_ready_slots 已在锁内确认全部完成）
+    bool album = !slot.media_group_id.empty();
+    size_t count = album ? slot.album->size() : 1;
+    const auto& first = album ? slot.album->front() : *slot.message;
+    for (const auto& send : slot.sends) {
+        if (send->success) {
+            forwarded_count_ += count;
+            record_delivery(first);
+            if (!album) {
+                spdlog::info("消息 #{} 已转发到 {}", first->id_, send->target_chat_id);
+            }
+        } else {
+            failed_count_ += count;
+            if (album) {
+                spdlog::error("媒体组 {} 转发到 {} 失败", slot.media_group_id, send->target_chat_id);
+            } else {
+                spdlog::error("消息 #{} 转发到 {} 失败", first->id_, send->target_chat_id);
+            }
+        }
+    }
+    
+    // 记录已处理的消息和媒体组，迟到的同组消息不再单独转发
+    if (album) {
+        route.checkpoint.record_media_group(slot.media_group_id);
+        for (const auto& message : *slot.album) {
+            route.checkpoint.record_message(message->id_);
+        }
+    } else {
+        route.checkpoint.record_message(first->id_);
+    }
+    
+    // 所有目标都已发出，各条消息收到发送结果后下载的本地文件不再需要
+    if (slot.download) {
+        MediaHandler::instance().release_local_files(slot.download->task);
+        MediaHandler::instance().release_local_files(slot.download->group_task);
+    }
+}
+
+bool RestrictedChannelForwarder::pipelines_empty() const {
+    return std::all_of(routes_.begin(), routes_.end(), [](const auto& route) {
+        return route->pipeline.empty();
+    });
+}
+
+RestrictedChannelForwarder::PipelineSlot* RestrictedChannelForwarder::find_album_slot(SourceRoute& route, const std::string& media_group_id) {
+    for (auto& slot : route.pipeline) {
+        if (slot.media_group_id == media_group_id) {
+            return &slot;
+        }
+    }
+    
+    return nullptr;
+}
+
+size_t RestrictedChannelForwarder::collect_new_messages() {
+    std::vector<SourceRoute*> catch_up_routes;
+    
+    {
+        std::unique_lock<std::mutex> lock(incoming_mutex_);
         
-        // 下载媒体组
-        auto group_task_future = MediaHandler::instance().download_media_group(messages);
-        auto group_task = group_task_future.get();
+        // 等到有新消息、下载完成、需要补漏或停止。推送模式（或一次性模式排空时）超时仅作为
+        // 保底唤醒，轮询模式下最迟等到下次轮询；有相册在缓冲时最多等到它的静默期结束
+        auto timeout = std::chrono::steady_clock::now() + std::chrono::milliseconds(wait_time_ms_);
+        for (const auto& route : routes_) {
+            if (!config_.push_updates && !draining_ && route->next_poll_time < timeout) {
+                timeout = route->next_poll_time;
+            }
+            
+            auto album_deadline = route->album_assembler.next_deadline();
+            if (album_deadline && *album_deadline < timeout) {
+                timeout = *album_deadline;
+            }
+        }
         
-        if (!group_task) {
-            spdlog::error("下载媒体组失败");
-            return false;
+        incoming_cv_.wait_until(lock, timeout, [this] {
+            return stopping_ || incoming_pending_ || pipeline_progress_;
+        });
+        incoming_pending_ = false;
+        pipeline_progress_ = false;
+        
+        auto now = std::chrono::steady_clock::now();
+        for (auto& route : routes_) {
+            // 已移除的源频道不再获取新消息
+            if (route->retiring) {
+                route->catch_up_pending = false;
+                route->incoming.clear();
+                continue;
+            }
+            
+            bool poll_due = !config_.push_updates && now >= route->next_poll_time;
+            bool catching_up = !draining_ && (route->catch_up_pending || poll_due);
+            if (catching_up) {
+                catch_up_routes.push_back(route.get());
+            }
+            route->catch_up_pending = false;
+            
+            // 补漏翻页期间推送的消息先留着，取空积压后再和历史消息一起排序
+            if (catching_up && config_.push_updates) {
+                continue;
+            }
+            
+            for (auto& message : route->incoming) {
+                route->batch.push_back(std::move(message));
+            }
+            route->incoming.clear();
         }
+    }
+    
+    // 轮询模式或重连后补漏：从上次补漏取到的位置继续拉取历史记录。推送模式下推送的消息也会推进
+    // last_enqueued_id，不能以它为起点，否则推送与补漏交错时会跳过两者之间尚未取到的历史
+    for (auto route : catch_up_routes) {
+        AccountScope scope(route->account);
         
-        // 等待所有媒体下载完成
-        while (!group_task->is_completed()) {
-            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        // 每个源频道单独处理失败，不影响本轮其他源频道
+        MessageVector history;
+        try {
+            history = get_new_messages(route->source_chat_id,
+                std::max(route->last_message_id, route->catch_up_cursor), config_.max_history_messages);
+        } catch (const std::exception& e) {
+            spdlog::error("源频道 {} 拉取历史消息失败: {}", route->source_channel, e.what());
+            
+            // 拉取成功前保留补漏标记，下次唤醒（最迟 wait_time_ms 后）重试
+            std::lock_guard<std::mutex> lock(incoming_mutex_);
+            route->catch_up_pending = config_.push_updates;
+            if (!config_.push_updates) {
+                route->next_poll_time = std::chrono::steady_clock::now() + std::chrono::milliseconds(wait_time_ms_);
+            }
+            continue;
         }
         
-        // 检查是否所有任务都成功完成
-        if (group_task->failed_count() > 0) {
-            spdlog::error("媒体组中有 {} 个任务下载失败", group_task->failed_count());
-            return false;
+        for (const auto& message : history) {
+            if (message) {
+                route->catch_up_cursor = std::max(route->catch_up_cursor, message->id_);
+            }
         }
         
-        // 上传媒体组
-        auto upload_future = MediaHandler::instance().upload_media_group(target_chat_id_, group_task);
-        auto new_messages = upload_future.get();
+        if (config_.push_updates) {
+            std::lock_guard<std::mutex> lock(incoming_mutex_);
+            if (!history.empty()) {
+                spdlog::info("源频道 {} 补漏拉取到 {} 条消息", route->source_channel, history.size());
+                
+                // 可能还有更多积压，继续翻页直到取空
+                route->catch_up_pending = true;
+                incoming_pending_ = true;
+            } else {
+                // 积压已取空，放出补漏期间留下的推送消息
+                for (auto& message : route->incoming) {
+                    route->batch.push_back(std::move(message));
+                }
+                route->incoming.clear();
+            }
+        }
         
-        if (new_messages.empty()) {
-            spdlog::error("上传媒体组失败");
-            return false;
+        for (auto& message : history) {
+            route->batch.push_back(std::move(message));
         }
         
-        spdlog::info("媒体组转发成功，共 {} 条消息", new_messages.size());
-        return true;
-    } catch (const std::exception& e) {
-        spdlog::error("转发媒体组时出错: {}", e.what());
-        return false;
+        if (!config_.push_updates) {
+            route->next_poll_time = std::chrono::steady_clock::now() + std::chrono::milliseconds(wait_time_ms_);
+        }
     }
+    
+    size_t total = 0;
+    for (auto& route : routes_) {
+        auto& messages = route->batch;
+        Int64 last_message_id = route->last_message_id;
+        
+        // 去掉已处理的消息，按ID升序排序并去重（推送与补漏可能重叠）
+        messages.erase(std::remove_if(messages.begin(), messages.end(), [last_message_id](const Message& message) {
+            return !message || message->id_ <= last_message_id;
+        }), messages.end());
+        
+        std::sort(messages.begin(), messages.end(), [](const auto& a, const auto& b) {
+            return a->id_ < b->id_;
+        });
+        
+        messages.erase(std::unique(messages.begin(), messages.end(), [](const auto& a, const auto& b) {
+            return a->id_ == b->id_;
+        }), messages.end());
+        
+        total += messages.size();
+    }
+    
+    return total;
+}
+
+void RestrictedChannelForwarder::on_update_new_message(Object object) {
+    auto update = td::move_object_as<td_api::updateNewMessage>(object);
+    if (!update->message_) {
+        return;
+    }
+    
+    // 其他账号也可能加入了该频道，只接收负责该源频道的账号收到的推送；
+    // 读取当前路由表快照，重载时转发线程整体替换快照，不阻塞这里
+    auto table = route_table();
+    auto it = table->find(update->message_->chat_id_);
+    if (it == table->end() || it->second->account != ClientManager::current_account()) {
+        return;
+    }
+    
+    spdlog::debug("收到源频道 {} 新消息推送 #{}", it->second->source_channel, update->message_->id_);
+    
+    {
+        std::lock_guard<std::mutex> lock(incoming_mutex_);
+        it->second->incoming.push_back(std::move(update->message_));
+        incoming_pending_ = true;
+    }
+    incoming_cv_.notify_one();
+}
+
+void RestrictedChannelForwarder::on_update_connection_state(Object object) {
+    auto update = td::move_object_as<td_api::updateConnectionState>(object);
+    bool ready = update->state_ && update->state_->get_id() == td_api::connectionStateReady::ID;
+    auto account = ClientManager::current_account();
+    
+    // 断线期间推送可能丢失，该账号重新连上后为它负责的源频道补拉一次历史
+    bool reconnected = false;
+    {
+        std::lock_guard<std::mutex> lock(incoming_mutex_);
+        if (account >= connection_ready_.size()) {
+            return;
+        }
+        
+        reconnected = ready && !connection_ready_[account];
+        connection_ready_[account] = ready;
+        
+        if (reconnected) {
+            for (auto& route : routes_) {
+                if (route->account == account) {
+                    route->catch_up_pending = true;
+                }
+            }
+            incoming_pending_ = true;
+        }
+    }
+    
+    if (reconnected) {
+        spdlog::info("账号 {} 连接已恢复，安排补漏拉取", ClientManager::instance().account_name(account));
+        incoming_cv_.notify_one();
+    }
+}
+
+MessageVector RestrictedChannelForwarder::get_new_messages(Int64 chat_id, Int64 last_message_id, int limit) {
+    // 从 last_message_id 向新的方向翻页（负偏移），落后较多时多次补漏可逐页追上
+    limit = std::clamp(limit, 2, 100);
+    auto get_history = td_api::make_object<td_api::getChatHistory>();
+    get_history->chat_id_ = chat_id;
+    get_history->from_message_id_ = last_message_id;
+    get_history->limit_ = limit;
+    get_history->offset_ = last_message_id > 0 ? -(limit - 1) : 0;
+    get_history->only_local_ = false;
+    
+    auto response = ClientManager::instance().send_query(std::move(get_history));
+    
+    if (response->get_id() == td_api::error::ID) {
+        auto error = td::move_object_as<td_api::error>(response);
+        throw std::runtime_error("获取聊天历史记录失败: " + error->message_);
+    }
+    
+    auto messages = td::move_object_as<td_api::messages>(response);
+    MessageVector result;
+    
+    // 过滤出比last_message_id更新的消息，并按ID升序排序
+    for (auto& message : messages->messages_) {
+        if (message->id_ > last_message_id) {
+            result.push_back(std::move(message));
+        }
+    }
+    
+    // 按消息ID升序排序
+    std::sort(result.begin(), result.end(), [](const auto& a, const auto& b) {
+        return a->id_ < b->id_;
+    });
+    
+    return result;
+}
+
+Future<Int64> RestrictedChannelForwarder::get_latest_message_id(Int64 chat_id) {
+    auto get_history = td_api::make_object<td_api::getChatHistory>();
+    get_history->chat_id_ = chat_id;
+    get_history->limit_ = 1;
+    get_history->offset_ = 0;
+    get_history->only_local_ = false;
+    
+    return ClientManager::instance().request<td_api::messages>(std::move(get_history))
+        .then([](td_api::object_ptr<td_api::messages> messages) -> Int64 {
+            return messages->messages_.empty() ? 0 : messages->messages_[0]->id_;
+        });
+}
+
+bool RestrictedChannelForwarder::should_forward_message(const Message& message) {
+    return (message_filter_mask_ & content_filter_bit(message)) != 0;
+}
+
+bool RestrictedChannelForwarder::media_group_processed(const SourceRoute& route, const std::string& media_group_id) {
+    return route.checkpoint.contains_media_group(media_group_id);
+}
+
+Future<bool> RestrictedChannelForwarder::check_send_message_permission(Int64 chat_id) {
+    auto& client = ClientManager::instance();
+    
+    auto get_chat = td_api::make_object<td_api::getChat>();
+    get_chat->chat_id_ = chat_id;
+    
+    // getChat -> getMe -> getChatMember 以续延串联，中间不阻塞任何线程
+    return client.request<td_api::chat>(std::move(get_chat))
+        .then([&client](td_api::object_ptr<td_api::chat> chat) {
+            std::shared_ptr<td_api::chat> shared_chat = std::move(chat);
+            
+            return client.get_my_id_async().then([&client, shared_chat](Int64 my_id) {
+                // 获取当前账号在聊天中的权限
+                auto get_chat_member = td_api::make_object<td_api::getChatMember>();
+                get_chat_member->chat_id_ = shared_chat->id_;
+                get_chat_member->member_id_ = td_api::make_object<td_api::messageSenderUser>(my_id);
+                
+                return client.request<td_api::chatMember>(std::move(get_chat_member))
+                    .then([shared_chat](td_api::object_ptr<td_api::chatMember> chat_member) {
+                        // 检查是否有发送消息的权限
+                        auto status_id = chat_member->status_->get_id();
+                        if (status_id == td_api::chatMemberStatusCreator::ID) {
+                            return true;
+                        } else if (status_id == td_api::chatMemberStatusAdministrator::ID) {
+                            auto admin_status = static_cast<const td_api::chatMemberStatusAdministrator*>(chat_member->status_.get());
+                            return admin_status->can_post_messages_;
+                        } else if (status_id == td_api::chatMemberStatusMember::ID) {
+                            // 对于普通成员，如果是普通群组，通常可以发送消息
+                            const auto& type = shared_chat->type_;
+                            return type->get_id() != td_api::chatTypeSupergroup::ID ||
+                                   !static_cast<const td_api::chatTypeSupergroup*>(type.get())->is_channel_;
+                        }
+                        
+                        return false;
+                    });
+            });
+        });
+}
+
+void RestrictedChannelForwarder::record_delivery(const Message& message) {
+    static auto& end_to_end = Metrics::instance().histogram(
+        "tg_forwarder_end_to_end_seconds", "源消息发布到在目标频道发送成功的延迟");
+    end_to_end.record(std::chrono::system_clock::now() - std::chrono::system_clock::from_time_t(message->date_));
+    
+    // 首次投递距转发器启动的时间，衡量重启后多久恢复转发
+    if (first_forward_ms_ == 0) {
+        first_forward_ms_ = std::max<std::int64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - started_at_).count(), 1);
+        spdlog::info("首条消息已转发，距转发器启动 {} ms", first_forward_ms_.load());
+    }
+}
+
+void RestrictedChannelForwarder::register_metrics() {
+    auto& metrics = Metrics::instance();
+    
+    // 转发统计
+    metrics.counter_callback("tg_forwarder_forwarded_messages_total", "转发成功的消息数（每个目标各计一次）",
+        [this]() { return static_cast<double>(forwarded_count_.load()); });
+    metrics.counter_callback("tg_forwarder_failed_messages_total", "转发失败的消息数（每个目标各计一次）",
+        [this]() { return static_cast<double>(failed_count_.load()); });
+    
+    // 启动耗时
+    metrics.gauge("tg_forwarder_startup_seconds", "转发器启动（解析、权限检查、确定起始位置）耗时",
+        [this]() { return static_cast<double>(startup_ms_.load()) / 1e3; });
+    metrics.gauge("tg_forwarder_time_to_first_forward_seconds", "转发器启动到首条消息转发成功的时间，尚未转发时为0",
+        [this]() { return static_cast<double>(first_forward_ms_.load()) / 1e3; });
+    
+    // 媒体处理
+    metrics.gauge("tg_forwarder_media_queued_tasks", "等待媒体线程的任务数",
+        []() { return static_cast<double>(MediaHandler::instance().queued_task_count()); });
+    metrics.gauge("tg_forwarder_media_active_downloads", "进行中的下载数",
+        []() { return static_cast<double>(MediaHandler::instance().active_download_count()); });
+    metrics.gauge("tg_forwarder_media_active_uploads", "进行中的上传数",
+        []() { return static_cast<double>(MediaHandler::instance().active_upload_count()); });
+    metrics.gauge("tg_forwarder_media_scheduled_retries", "在时间轮中等待重试的任务数",
+        []() { return static_cast<double>(MediaHandler::instance().scheduled_retry_count()); });
+    metrics.gauge("tg_forwarder_memory_in_flight_bytes", "内存模式下已读入内存的媒体字节数",
+        []() { return static_cast<double>(MediaHandler::instance().memory_in_flight_bytes()); });
+    metrics.gauge("tg_forwarder_memory_waiting_tasks", "等待内存预算的下载数",
+        []() { return static_cast<double>(MediaHandler::instance().memory_waiting_count()); });
+    
+    // TDLib 请求与更新
+    metrics.gauge("tg_forwarder_pending_queries", "已发出、等待响应的请求数",
+        []() { return static_cast<double>(ClientManager::instance().pending_query_count()); });
+    metrics.gauge("tg_forwarder_rate_limited_queries", "在发送限流队列中等待的请求数",
+        []() { return static_cast<double>(ClientManager::instance().rate_limited_query_count()); });
+    metrics.gauge("tg_forwarder_queued_updates", "等待更新处理线程的更新数",
+        []() { return static_cast<double>(ClientManager::instance().queued_update_count()); });
+    
+    // 缓冲区池与文件ID缓存
+    metrics.gauge("tg_forwarder_buffer_pool_retained_bytes", "缓冲区池保留的空闲内存字节数",
+        []() { return static_cast<double>(BufferPool::instance().retained_bytes()); });
+    metrics.counter_callback("tg_forwarder_buffer_pool_hits_total", "缓冲区池命中次数",
+        []() { return static_cast<double>(BufferPool::instance().hit_count()); });
+    metrics.counter_callback("tg_forwarder_buffer_pool_misses_total", "缓冲区池未命中次数",
+        []() { return static_cast<double>(BufferPool::instance().miss_count()); });
+    metrics.counter_callback("tg_forwarder_file_id_cache_hits_total", "远程文件ID复用命中次数",
+        []() { return static_cast<double>(FileIdCache::instance().hit_count()); });
+    metrics.counter_callback("tg_forwarder_file_id_cache_misses_total", "远程文件ID复用未命中次数",
+        []() { return static_cast<double>(FileIdCache::instance().miss_count()); });
 }
 
-bool RestrictedChannelForwarder::is_media_message(int32_t content_type) {
-    return content_type == td_api::messagePhoto::ID ||
-           content_type == td_api::messageVideo::ID ||
-           content_type == td_api::messageDocument::ID ||
-           content_type == td_api::messageAudio::ID ||
-           content_type == td_api::messageAnimation::ID ||
-           content_type == td_api::messageSticker::ID;
+Future<Object> RestrictedChannelForwarder::send_text_message(Int64 target_chat_id, const SharedMessage& message,
+                                                             bool rebuildable, bool take) {
+    // 正文连同格式实体直接放入请求：取走时不再复制，否则从共用的源消息复制一份
+    auto make_request = [target_chat_id, message, take]() -> Function {
+        auto send_message = td_api::make_object<td_api::sendMessage>();
+        send_message->chat_id_ = target_chat_id;
+        
+        auto message_content = td_api::make_object<td_api::inputMessageText>();
+        message_content->text_ = take ? take_formatted_text(*message) : clone_formatted_text(get_formatted_text(*message));
+        
+        send_message->input_message_content_ = std::move(message_content);
+        return send_message;
+    };
+    
+    // 被限流拒绝时由限流器重新构造后重发（重建会再读一次源消息，正文被取走后不能这样做）
+    if (rebuildable) {
+        return ClientManager::instance().send_query_future(QueryFactory(make_request));
+    }
+    return ClientManager::instance().send_query_future(make_request());
+}
+
+bool RestrictedChannelForwarder::text_message_sent(Object response) {
+    if (response->get_id() == td_api::error::ID) {
+        auto error = td::move_object_as<td_api::error>(response);
+        int retry_after = parse_retry_after(error->code_, error->message_);
+        if (retry_after > 0) {
+            spdlog::error("转发文本消息失败: {}（限流 {} 秒）", error->message_, retry_after);
+        } else {
+            spdlog::error("转发文本消息失败: {}", error->message_);
+        }
+        return false;
+    }
+    
+    return true;
 }
 
 } // namespace tg_forwarder 
\ No newline at end of file
@@ -0,0 +1,63 @@
+#include <random>
+#include <algorithm>
+#include "../include/retry_policy.h"
+#include "../include/utils.h"
+
+namespace tg_forwarder {
+
+RetryPolicy::RetryPolicy(int max_retries, std::chrono::milliseconds base_delay, std::chrono::milliseconds max_delay)
+    : max_retries_(std::max(max_retries, 0)),
+      base_delay_(std::max(base_delay, std::chrono::milliseconds(1))),
+      max_delay_(std::max(max_delay, base_delay_)) {
+}
+
+int RetryPolicy::max_retries() const {
+    return max_retries_;
+}
+
+std::chrono::milliseconds RetryPolicy::delay_for(int attempt, int retry_after) const {
+    // 指数退避，位移次数受限以免溢出
+    int shift = std::clamp(attempt - 1, 0, 20);
+    auto delay = std::min<std::int64_t>(base_delay_.count() << shift, max_delay_.count());
+    
+    // 等待时间在一半到全部之间随机取值
+    thread_local std::mt19937_64 generator{std::random_device{}()};
+    std::uniform_int_distribution<std::int64_t> jitter(delay / 2, delay);
+    auto result = std::chrono::milliseconds(jitter(generator));
+    
+    // 服务器要求的等待时间优先
+    auto required = std::chrono::milliseconds(static_cast<std::int64_t>(retry_after) * 1000);
+    return std::max(result, required);
+}
+
+bool RetryPolicy::is_retryable(const std::exception_ptr& error, int& retry_after) {
+    retry_after = 0;
+    if (!error) {
+        return false;
+    }
+    
+    try {
+        std::rethrow_exception(error);
+    } catch (const NetworkError& e) {
+        retry_after = e.retry_after();
+        return true;
+    } catch (...) {
+        return false;
+    }
+}
+
+std::string RetryPolicy::describe(const std::exception_ptr& error) {
+    if (!error) {
+        return "";
+    }
+    
+    try {
+        std::rethrow_exception(error);
+    } catch (const std::exception& e) {
+        return e.what();
+    } catch (...) {
+        return "未知错误";
+    }
+}
+
+} // namespace tg_forwarder
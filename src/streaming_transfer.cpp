@@ -0,0 +1,311 @@
+#include <algorithm>
+#include <vector>
+#include <spdlog/spdlog.h>
+#include "../include/streaming_transfer.h"
+#include "../include/buffer_pool.h"
+#include "../include/client_manager.h"
+
+namespace tg_forwarder {
+
+namespace {
+// conversion 前缀，用于从 updateFileGenerationStart 找回对应的源文件
+const std::string kConversionPrefix = "#tg_forwarder_stream#";
+
+// 单次搬运的块大小
+constexpr size_t kChunkSize = 512 * 1024;
+}
+
+StreamingTransfer::~StreamingTransfer() {
+    stop();
+}
+
+void StreamingTransfer::start() {
+    if (running_) {
+        return;
+    }
+    
+    running_ = true;
+    worker_ = std::thread(&StreamingTransfer::pump_worker, this);
+}
+
+void StreamingTransfer::stop() {
+    if (!running_) {
+        return;
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        running_ = false;
+    }
+    cv_.notify_all();
+    
+    if (worker_.joinable()) {
+        worker_.join();
+    }
+    
+    // 未完成的生成以错误结束，避免上传端无限等待
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& entry : streams_) {
+        if (entry.second->generation_id != 0) {
+            finish(*entry.second, "转发器已停止");
+        }
+    }
+    streams_.clear();
+    dirty_.clear();
+}
+
+std::string StreamingTransfer::begin(Int32 source_file_id, int64_t expected_size, int priority) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto& stream = streams_[source_file_id];
+        if (!stream) {
+            stream = std::make_shared<Stream>();
+            stream->source_file_id = source_file_id;
+        }
+        stream->expected_size = expected_size;
+    }
+    
+    // 异步下载，进度通过 updateFile 推送
+    auto download_file = td_api::make_object<td_api::downloadFile>();
+    download_file->file_id_ = source_file_id;
+    download_file->priority_ = priority;
+    download_file->offset_ = 0;
+    download_file->limit_ = 0;
+    download_file->synchronous_ = false;
+    
+    ClientManager::instance().send_query_async(std::move(download_file), [this, source_file_id](Object object) {
+        if (object->get_id() == td_api::error::ID) {
+            auto error = td::move_object_as<td_api::error>(object);
+            spdlog::error("流式下载启动失败 (文件 {}): {}", source_file_id, error->message_);
+            
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = streams_.find(source_file_id);
+            if (it != streams_.end()) {
+                it->second->download_failed = true;
+                dirty_[source_file_id] = true;
+            }
+            cv_.notify_one();
+        } else if (object->get_id() == td_api::file::ID) {
+            on_update_file(td_api::updateFile(td::move_object_as<td_api::file>(object)));
+        }
+    });
+    
+    spdlog::debug("开始流式传输: 文件 {} ({} 字节)", source_file_id, expected_size);
+    return kConversionPrefix + std::to_string(source_file_id);
+}
+
+bool StreamingTransfer::is_stream_conversion(const std::string& conversion) {
+    return conversion.compare(0, kConversionPrefix.size(), kConversionPrefix) == 0;
+}
+
+void StreamingTransfer::on_update_file(const td_api::updateFile& update) {
+    const auto& file = update.file_;
+    if (!file || !file->local_) {
+        return;
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = streams_.find(file->id_);
+        if (it == streams_.end()) {
+            return;
+        }
+        
+        auto& stream = *it->second;
+        if (!file->local_->path_.empty()) {
+            stream.source_path = file->local_->path_;
+        }
+        // 更新在处理线程上执行，可能晚于 downloadFile 的响应到达，进度只前进不后退
+        stream.downloaded_prefix = std::max(stream.downloaded_prefix, file->local_->downloaded_prefix_size_);
+        stream.download_completed = stream.download_completed || file->local_->is_downloading_completed_;
+        if (stream.expected_size == 0) {
+            stream.expected_size = file->size_ != 0 ? file->size_ : file->expected_size_;
+        }
+        
+        // 下载既未完成也不再进行，说明下载被取消或失败
+        if (!stream.download_completed && !file->local_->is_downloading_active_ &&
+            stream.downloaded_prefix < stream.expected_size && stream.downloaded_prefix > 0) {
+            stream.download_failed = true;
+        }
+        
+        dirty_[file->id_] = true;
+    }
+    cv_.notify_one();
+}
+
+void StreamingTransfer::on_generation_start(const td_api::updateFileGenerationStart& update) {
+    if (!is_stream_conversion(update.conversion_)) {
+        return;
+    }
+    
+    Int32 source_file_id = 0;
+    try {
+        source_file_id = std::stoi(update.conversion_.substr(kConversionPrefix.size()));
+    } catch (const std::exception&) {
+        spdlog::warn("无法识别的流式传输: {}", update.conversion_);
+        return;
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = streams_.find(source_file_id);
+        if (it == streams_.end()) {
+            spdlog::warn("流式传输 {} 不存在，忽略生成请求", source_file_id);
+            return;
+        }
+        
+        auto& stream = *it->second;
+        stream.generation_id = update.generation_id_;
+        stream.destination_path = update.destination_path_;
+        stream.written = 0;
+        stream.destination.reset();
+        dirty_[source_file_id] = true;
+    }
+    cv_.notify_one();
+    
+    spdlog::debug("流式传输 {} 开始生成: {}", source_file_id, update.destination_path_);
+}
+
+void StreamingTransfer::on_generation_stop(const td_api::updateFileGenerationStop& update) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    
+    for (auto it = streams_.begin(); it != streams_.end(); ++it) {
+        if (it->second->generation_id == update.generation_id_) {
+            spdlog::debug("流式传输 {} 已结束", it->first);
+            dirty_.erase(it->first);
+            streams_.erase(it);
+            return;
+        }
+    }
+}
+
+size_t StreamingTransfer::active_count() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return streams_.size();
+}
+
+void StreamingTransfer::pump_worker() {
+    spdlog::debug("流式传输线程已启动");
+    
+    while (true) {
+        std::vector<std::shared_ptr<Stream>> ready;
+        
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [this] { return !running_ || !dirty_.empty(); });
+            
+            if (!running_) {
+                break;
+            }
+            
+            for (const auto& entry : dirty_) {
+                auto it = streams_.find(entry.first);
+                if (it != streams_.end() && it->second->generation_id != 0) {
+                    ready.push_back(it->second);
+                }
+            }
+            dirty_.clear();
+        }
+        
+        // 文件读写在锁外进行，接收线程不会被磁盘IO阻塞
+        for (auto& stream : ready) {
+            if (pump(*stream)) {
+                std::lock_guard<std::mutex> lock(mutex_);
+                streams_.erase(stream->source_file_id);
+            }
+        }
+    }
+    
+    spdlog::debug("流式传输线程已退出");
+}
+
+bool StreamingTransfer::pump(Stream& stream) {
+    int64_t available = 0;
+    bool completed = false;
+    bool failed = false;
+    std::string source_path;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        available = stream.downloaded_prefix;
+        completed = stream.download_completed;
+        failed = stream.download_failed;
+        source_path = stream.source_path;
+    }
+    
+    if (failed) {
+        finish(stream, "源文件下载失败");
+        return true;
+    }
+    
+    if (source_path.empty() || available <= stream.written) {
+        if (completed && available == stream.written && stream.written > 0) {
+            finish(stream, "");
+            return true;
+        }
+        return false;
+    }
+    
+    if (!stream.source) {
+        stream.source = std::make_unique<std::ifstream>(source_path, std::ios::binary);
+    }
+    if (!stream.destination) {
+        stream.destination = std::make_unique<std::ofstream>(stream.destination_path, std::ios::binary | std::ios::trunc);
+    }
+    
+    if (!stream.source->is_open() || !stream.destination->is_open()) {
+        finish(stream, "无法打开流式传输文件");
+        return true;
+    }
+    
+    // 追加 [written, available) 区间的数据；搬运缓冲区从池中借出，用完归还
+    auto chunk = BufferPool::instance().acquire(kChunkSize);
+    chunk.resize(kChunkSize);
+    stream.source->clear();
+    stream.source->seekg(stream.written);
+    
+    while (stream.written < available) {
+        auto count = static_cast<std::streamsize>(std::min<int64_t>(kChunkSize, available - stream.written));
+        stream.source->read(&chunk[0], count);
+        auto read = stream.source->gcount();
+        if (read <= 0) {
+            break;
+        }
+        
+        stream.destination->write(chunk.data(), read);
+        stream.written += read;
+    }
+    stream.destination->flush();
+    BufferPool::instance().recycle(std::move(chunk));
+    
+    // 通知上传端可用的前缀长度
+    auto progress = td_api::make_object<td_api::setFileGenerationProgress>();
+    progress->generation_id_ = stream.generation_id;
+    progress->expected_size_ = stream.expected_size;
+    progress->local_prefix_size_ = stream.written;
+    ClientManager::instance().send_query_async(std::move(progress));
+    
+    if (completed && stream.written >= available) {
+        finish(stream, "");
+        return true;
+    }
+    
+    return false;
+}
+
+void StreamingTransfer::finish(Stream& stream, const std::string& error) {
+    stream.source.reset();
+    stream.destination.reset();
+    
+    auto finish_generation = td_api::make_object<td_api::finishFileGeneration>();
+    finish_generation->generation_id_ = stream.generation_id;
+    if (!error.empty()) {
+        finish_generation->error_ = td_api::make_object<td_api::error>(400, error);
+        spdlog::error("流式传输 {} 失败: {}", stream.source_file_id, error);
+    } else {
+        spdlog::info("流式传输 {} 完成 ({} 字节)", stream.source_file_id, stream.written);
+    }
+    
+    ClientManager::instance().send_query_async(std::move(finish_generation));
+}
+
+} // namespace tg_forwarder
@@ -0,0 +1,359 @@
+#include <spdlog/spdlog.h>
+#include "../include/task_executor.h"
+
+namespace tg_forwarder {
+
+namespace {
+// 当前线程所属的执行器（用于识别内部提交）
+thread_local const TaskExecutor* current_executor = nullptr;
+}
+
+TaskExecutor::TaskExecutor(std::string name, size_t capacity)
+    : name_(std::move(name)),
+      capacity_(capacity > 0 ? capacity : 1) {
+}
+
+TaskExecutor::~TaskExecutor() {
+    stop();
+}
+
+void TaskExecutor::start(size_t thread_count) {
+    if (running_) {
+        resize(thread_count);
+        return;
+    }
+    
+    running_ = true;
+    resize(thread_count);
+    
+    // 到期的延迟任务直接进入工作线程队列
+    timers_.start([this](Task task) {
+        ++queued_;
+        enqueue(std::move(task));
+    });
+    
+    spdlog::debug("执行器 {} 已启动，线程数: {}", name_, thread_count);
+}
+
+void TaskExecutor::stop() {
+    if (!running_.exchange(false)) {
+        return;
+    }
+    
+    // 唤醒所有等待中的线程
+    {
+        std::lock_guard<std::mutex> lock(idle_mutex_);
+    }
+    idle_cv_.notify_all();
+    {
+        std::lock_guard<std::mutex> lock(space_mutex_);
+    }
+    space_cv_.notify_all();
+    
+    // 尚未到期的延迟任务提前执行，由任务自己发现执行器已停止并结束
+    for (auto& task : timers_.stop()) {
+        ++queued_;
+        enqueue(std::move(task));
+    }
+    
+    std::vector<std::unique_ptr<Worker>> workers;
+    {
+        std::unique_lock<std::shared_mutex> lock(workers_mutex_);
+        workers = std::move(workers_);
+        workers_.clear();
+        for (auto& worker : retired_) {
+            workers.push_back(std::move(worker));
+        }
+        retired_.clear();
+    }
+    
+    for (auto& worker : workers) {
+        if (worker->thread.joinable()) {
+            worker->thread.join();
+        }
+    }
+    
+    // 线程退出后仍未执行的任务（理论上只有并发提交的漏网任务）在当前线程执行完
+    for (auto& worker : workers) {
+        while (!worker->queue.empty()) {
+            auto task = std::move(worker->queue.front());
+            worker->queue.pop_front();
+            --queued_;
+            task();
+        }
+    }
+    
+    spdlog::debug("执行器 {} 已停止", name_);
+}
+
+void TaskExecutor::resize(size_t thread_count) {
+    if (thread_count == 0) {
+        thread_count = 1;
+    }
+    
+    {
+        std::unique_lock<std::shared_mutex> lock(workers_mutex_);
+        
+        if (!running_) {
+            return;
+        }
+        
+        // 增加线程
+        while (workers_.size() < thread_count) {
+            auto worker = std::make_unique<Worker>();
+            auto* raw = worker.get();
+            worker->thread = std::thread(&TaskExecutor::worker_loop, this, raw);
+            workers_.push_back(std::move(worker));
+        }
+        
+        // 减少线程：标记退役，线程执行完手上的任务后退出
+        while (workers_.size() > thread_count) {
+            auto worker = std::move(workers_.back());
+            workers_.pop_back();
+            worker->retiring = true;
+            
+            // 退役线程已不在窃取范围内，队列中剩余的任务移交给仍在运行的线程
+            std::deque<Task> remaining;
+            {
+                std::lock_guard<std::mutex> queue_lock(worker->mutex);
+                remaining.swap(worker->queue);
+            }
+            for (auto& task : remaining) {
+                auto& target = *workers_[next_worker_++ % workers_.size()];
+                std::lock_guard<std::mutex> target_lock(target.mutex);
+                target.queue.push_back(std::move(task));
+            }
+            
+            retired_.push_back(std::move(worker));
+        }
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(idle_mutex_);
+    }
+    idle_cv_.notify_all();
+    
+    join_retired();
+    
+    spdlog::debug("执行器 {} 线程数调整为 {}", name_, thread_count);
+}
+
+bool TaskExecutor::submit(Task task) {
+    if (!running_) {
+        return false;
+    }
+    
+    // 工作线程内部提交不受容量限制，避免所有线程互相等待
+    if (current_executor != this) {
+        std::unique_lock<std::mutex> lock(space_mutex_);
+        space_cv_.wait(lock, [this] {
+            return !running_ || queued_ < capacity_;
+        });
+        
+        if (!running_) {
+            return false;
+        }
+        
+        ++queued_;
+    } else {
+        ++queued_;
+    }
+    
+    enqueue(std::move(task));
+    return true;
+}
+
+bool TaskExecutor::try_submit(Task task) {
+    if (!running_) {
+        return false;
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(space_mutex_);
+        if (queued_ >= capacity_ && current_executor != this) {
+            return false;
+        }
+        ++queued_;
+    }
+    
+    enqueue(std::move(task));
+    return true;
+}
+
+bool TaskExecutor::submit_after(std::chrono::milliseconds delay, Task task) {
+    if (!running_) {
+        return false;
+    }
+    
+    return timers_.schedule(delay, std::move(task));
+}
+
+size_t TaskExecutor::scheduled_count() const {
+    return timers_.pending_count();
+}
+
+void TaskExecutor::set_capacity(size_t capacity) {
+    capacity_ = capacity > 0 ? capacity : 1;
+    space_cv_.notify_all();
+}
+
+size_t TaskExecutor::capacity() const {
+    return capacity_;
+}
+
+size_t TaskExecutor::queued_count() const {
+    return queued_;
+}
+
+size_t TaskExecutor::thread_count() const {
+    std::shared_lock<std::shared_mutex> lock(workers_mutex_);
+    return workers_.size();
+}
+
+bool TaskExecutor::is_running() const {
+    return running_;
+}
+
+bool TaskExecutor::in_worker_thread() const {
+    return current_executor == this;
+}
+
+void TaskExecutor::enqueue(Task task) {
+    {
+        std::shared_lock<std::shared_mutex> lock(workers_mutex_);
+        
+        if (workers_.empty()) {
+            // 执行器正在停止，直接在当前线程执行
+            lock.unlock();
+            --queued_;
+            task();
+            return;
+        }
+        
+        // 轮转分配到各工作线程的队列
+        auto index = next_worker_++ % workers_.size();
+        auto& worker = *workers_[index];
+        std::lock_guard<std::mutex> queue_lock(worker.mutex);
+        worker.queue.push_back(std::move(task));
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(idle_mutex_);
+    }
+    idle_cv_.notify_one();
+}
+
+bool TaskExecutor::take_task(Worker* self, Task& task) {
+    // 先取自己的队列（FIFO）
+    {
+        std::lock_guard<std::mutex> lock(self->mutex);
+        if (!self->queue.empty()) {
+            task = std::move(self->queue.front());
+            self->queue.pop_front();
+            return true;
+        }
+    }
+    
+    if (self->retiring) {
+        return false;
+    }
+    
+    // 再从其他线程队列尾部窃取
+    std::shared_lock<std::shared_mutex> lock(workers_mutex_);
+    auto count = workers_.size();
+    if (count == 0) {
+        return false;
+    }
+    
+    auto start = next_worker_.load() % count;
+    for (size_t i = 0; i < count; ++i) {
+        auto& victim = *workers_[(start + i) % count];
+        if (&victim == self) {
+            continue;
+        }
+        
+        std::lock_guard<std::mutex> victim_lock(victim.mutex);
+        if (!victim.queue.empty()) {
+            task = std::move(victim.queue.back());
+            victim.queue.pop_back();
+            return true;
+        }
+    }
+    
+    return false;
+}
+
+void TaskExecutor::worker_loop(Worker* self) {
+    current_executor = this;
+    
+    while (true) {
+        Task task;
+        if (take_task(self, task)) {
+            --queued_;
+            space_cv_.notify_one();
+            
+            try {
+                task();
+            } catch (const std::exception& e) {
+                spdlog::error("执行器 {} 任务异常: {}", name_, e.what());
+            } catch (...) {
+                spdlog::error("执行器 {} 任务异常: 未知错误", name_);
+            }
+            continue;
+        }
+        
+        // 退役线程或停止时，自己的队列已空即可退出
+        if (self->retiring || !running_) {
+            std::lock_guard<std::mutex> lock(self->mutex);
+            if (self->queue.empty()) {
+                break;
+            }
+            continue;
+        }
+        
+        // 只等能取到的任务：queued_ 还包括正在入队的任务，以它为条件会在取不到时空转
+        std::unique_lock<std::mutex> lock(idle_mutex_);
+        idle_cv_.wait_for(lock, std::chrono::milliseconds(100), [this, self] {
+            return !running_ || self->retiring || has_reachable_task();
+        });
+    }
+    
+    current_executor = nullptr;
+    self->exited = true;
+}
+
+bool TaskExecutor::has_reachable_task() const {
+    std::shared_lock<std::shared_mutex> lock(workers_mutex_);
+    for (const auto& worker : workers_) {
+        std::lock_guard<std::mutex> queue_lock(worker->mutex);
+        if (!worker->queue.empty()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void TaskExecutor::join_retired() {
+    std::vector<std::unique_ptr<Worker>> finished;
+    {
+        std::unique_lock<std::shared_mutex> lock(workers_mutex_);
+        
+        for (auto it = retired_.begin(); it != retired_.end();) {
+            // 只回收已经退出的线程，仍在执行任务的线程留到下次或 stop() 时回收
+            if ((*it)->exited) {
+                finished.push_back(std::move(*it));
+                it = retired_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+    
+    for (auto& worker : finished) {
+        if (worker->thread.joinable()) {
+            worker->thread.join();
+        }
+    }
+}
+
+} // namespace tg_forwarder
@@ -0,0 +1,27 @@
+#include <td/telegram/Client.h>
+#include "../include/td_backend.h"
+
+namespace tg_forwarder {
+
+std::int32_t TdlibBackend::create_client() {
+    return td::ClientManager::create();
+}
+
+void TdlibBackend::destroy_client(std::int32_t client_id) {
+    td::ClientManager::destroy(client_id);
+}
+
+void TdlibBackend::send(std::int32_t client_id, std::uint64_t request_id, Function query) {
+    td::ClientManager::send(client_id, request_id, std::move(query));
+}
+
+TdResponse TdlibBackend::receive(double timeout) {
+    auto response = td::ClientManager::receive(timeout);
+    return TdResponse{response.client_id, response.request_id, std::move(response.object)};
+}
+
+Object TdlibBackend::execute(Function query) {
+    return td::ClientManager::execute(std::move(query));
+}
+
+} // namespace tg_forwarder
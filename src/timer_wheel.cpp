@@ -0,0 +1,159 @@
+#include <algorithm>
+#include <spdlog/spdlog.h>
+#include "../include/timer_wheel.h"
+
+namespace tg_forwarder {
+
+TimerWheel::TimerWheel(std::chrono::milliseconds tick, size_t slot_count)
+    : tick_(tick.count() > 0 ? tick : std::chrono::milliseconds(1)),
+      slots_(slot_count > 0 ? slot_count : 1) {
+}
+
+TimerWheel::~TimerWheel() {
+    stop();
+}
+
+void TimerWheel::start(std::function<void(Task)> dispatch) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (running_) {
+        return;
+    }
+    
+    dispatch_ = std::move(dispatch);
+    running_ = true;
+    thread_ = std::thread(&TimerWheel::run, this);
+}
+
+std::vector<TimerWheel::Task> TimerWheel::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!running_) {
+            return {};
+        }
+        running_ = false;
+    }
+    cv_.notify_all();
+    
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    
+    // 取出所有未到期的任务，按剩余时间从近到远排列
+    std::vector<Task> remaining;
+    std::lock_guard<std::mutex> lock(mutex_);
+    
+    size_t max_rounds = 0;
+    for (const auto& slot : slots_) {
+        for (const auto& timer : slot) {
+            max_rounds = std::max(max_rounds, timer.rounds);
+        }
+    }
+    
+    for (size_t round = 0; round <= max_rounds && pending_ > 0; ++round) {
+        for (size_t i = 1; i <= slots_.size(); ++i) {
+            auto& slot = slots_[(cursor_ + i) % slots_.size()];
+            for (auto& timer : slot) {
+                if (timer.task && timer.rounds == round) {
+                    remaining.push_back(std::move(timer.task));
+                    --pending_;
+                }
+            }
+        }
+    }
+    
+    for (auto& slot : slots_) {
+        slot.clear();
+    }
+    pending_ = 0;
+    
+    return remaining;
+}
+
+bool TimerWheel::schedule(std::chrono::milliseconds delay, Task task) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!running_) {
+            return false;
+        }
+        
+        // 空闲时从现在开始计格，避免空转期间的格数被算进新任务的等待时间
+        if (pending_ == 0) {
+            next_tick_ = Clock::now() + tick_;
+        }
+        
+        // 向上取整到格数，至少等待一格
+        auto ticks = static_cast<size_t>((delay.count() + tick_.count() - 1) / tick_.count());
+        ticks = std::max<size_t>(ticks, 1);
+        
+        auto& slot = slots_[(cursor_ + ticks) % slots_.size()];
+        slot.push_back(Timer{(ticks - 1) / slots_.size(), std::move(task)});
+        ++pending_;
+    }
+    cv_.notify_one();
+    return true;
+}
+
+size_t TimerWheel::pending_count() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return pending_;
+}
+
+bool TimerWheel::is_running() const {
+    return running_;
+}
+
+void TimerWheel::advance(std::vector<Task>& due) {
+    cursor_ = (cursor_ + 1) % slots_.size();
+    auto& slot = slots_[cursor_];
+    
+    for (auto it = slot.begin(); it != slot.end();) {
+        if (it->rounds == 0) {
+            due.push_back(std::move(it->task));
+            it = slot.erase(it);
+            --pending_;
+        } else {
+            --it->rounds;
+            ++it;
+        }
+    }
+}
+
+void TimerWheel::run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    
+    while (running_) {
+        if (pending_ == 0) {
+            cv_.wait(lock, [this] { return !running_ || pending_ > 0; });
+            continue;
+        }
+        
+        if (cv_.wait_until(lock, next_tick_, [this] { return !running_ || pending_ == 0; })) {
+            continue;
+        }
+        
+        // 线程被延迟唤醒时补齐错过的格数
+        std::vector<Task> due;
+        auto now = Clock::now();
+        while (next_tick_ <= now && pending_ > 0) {
+            advance(due);
+            next_tick_ += tick_;
+        }
+        
+        if (due.empty()) {
+            continue;
+        }
+        
+        // 在锁外分发，dispatch 可能阻塞或再次调用 schedule
+        lock.unlock();
+        for (auto& task : due) {
+            try {
+                dispatch_(std::move(task));
+            } catch (const std::exception& e) {
+                spdlog::error("分发定时任务失败: {}", e.what());
+            }
+        }
+        lock.lock();
+    }
+}
+
+} // namespace tg_forwarder
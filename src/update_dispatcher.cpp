@@ -0,0 +1,253 @@
+#include <spdlog/spdlog.h>
+#include "../include/update_dispatcher.h"
+#include "../include/client_manager.h"
+
+namespace tg_forwarder {
+
+namespace {
+// 消息类更新所属的聊天ID
+template <typename T>
+Int64 message_chat_id(const td_api::Object& update) {
+    const auto& message = static_cast<const T&>(update).message_;
+    return message ? message->chat_id_ : 0;
+}
+}
+
+UpdateDispatcher::Shard::Shard()
+    : head(new Node()), tail(head.load()) {
+}
+
+UpdateDispatcher::Shard::~Shard() {
+    while (tail) {
+        Node* next = tail->next.load();
+        delete tail;
+        tail = next;
+    }
+}
+
+void UpdateDispatcher::Shard::push(Node* node) {
+    node->next.store(nullptr, std::memory_order_relaxed);
+    Node* previous = head.exchange(node, std::memory_order_acq_rel);
+    previous->next.store(node, std::memory_order_release);
+}
+
+bool UpdateDispatcher::Shard::pop(std::size_t& account, Object& update) {
+    // tail 为已取出的哨兵节点，数据在它的后继中，后继取出后成为新的哨兵
+    Node* next = tail->next.load(std::memory_order_acquire);
+    if (!next) {
+        return false;
+    }
+    
+    account = next->account;
+    update = std::move(next->update);
+    
+    delete tail;
+    tail = next;
+    return true;
+}
+
+UpdateDispatcher::~UpdateDispatcher() {
+    stop();
+}
+
+void UpdateDispatcher::start(size_t worker_count) {
+    if (!shards_.empty()) {
+        return;
+    }
+    
+    stopping_ = false;
+    worker_count = std::max<size_t>(worker_count, 1);
+    for (size_t i = 0; i < worker_count; ++i) {
+        shards_.push_back(std::make_unique<Shard>());
+    }
+    for (auto& shard : shards_) {
+        shard->thread = std::thread(&UpdateDispatcher::worker_loop, this, std::ref(*shard));
+    }
+    
+    spdlog::debug("更新分发器已启动，处理线程: {}", worker_count);
+}
+
+void UpdateDispatcher::stop() {
+    if (shards_.empty()) {
+        return;
+    }
+    
+    stopping_ = true;
+    for (auto& shard : shards_) {
+        {
+            std::lock_guard<std::mutex> lock(shard->wake_mutex);
+        }
+        shard->wake_cv.notify_one();
+    }
+    
+    for (auto& shard : shards_) {
+        if (shard->thread.joinable()) {
+            shard->thread.join();
+        }
+    }
+    shards_.clear();
+    
+    spdlog::debug("更新分发器已停止");
+}
+
+size_t UpdateDispatcher::worker_count() const {
+    return shards_.size();
+}
+
+void UpdateDispatcher::register_handler(std::int32_t type, UpdateHandler handler) {
+    if (!handler) {
+        return;
+    }
+    
+    std::lock_guard<std::mutex> lock(handlers_write_mutex_);
+    auto table = std::make_shared<HandlerTable>(*std::atomic_load(&handlers_));
+    (*table)[type] = std::make_shared<const UpdateHandler>(std::move(handler));
+    std::atomic_store(&handlers_, std::shared_ptr<const HandlerTable>(std::move(table)));
+    
+    spdlog::debug("注册更新处理器: {}", type);
+}
+
+void UpdateDispatcher::unregister_handler(std::int32_t type) {
+    // 换上不含该处理器的新表，不等待各分片：处理器内（包括其他分片的处理器内）取消注册也不会互相等待。
+    // 已经取到旧表的分发仍会执行完，它们持有处理器的引用，处理器对象在最后一次调用结束后释放
+    {
+        std::lock_guard<std::mutex> lock(handlers_write_mutex_);
+        auto table = std::make_shared<HandlerTable>(*std::atomic_load(&handlers_));
+        table->erase(type);
+        std::atomic_store(&handlers_, std::shared_ptr<const HandlerTable>(std::move(table)));
+    }
+    
+    spdlog::debug("取消注册更新处理器: {}", type);
+}
+
+void UpdateDispatcher::clear_handlers() {
+    {
+        std::lock_guard<std::mutex> lock(handlers_write_mutex_);
+        std::atomic_store(&handlers_, std::make_shared<const HandlerTable>());
+    }
+    
+    spdlog::debug("清除所有更新处理器");
+}
+
+void UpdateDispatcher::post(std::size_t account, Object update) {
+    if (!update || !find_handler(update->get_id())) {
+        return;
+    }
+    
+    if (shards_.empty()) {
+        invoke(account, std::move(update));
+        return;
+    }
+    
+    auto& shard = *shards_[shard_key(account, *update) % shards_.size()];
+    
+    // 先计数再入队，处理线程取出节点后的递减不会跑到递增之前而使计数回绕
+    shard.pending.fetch_add(1);
+    
+    // 已开始停止时处理线程可能已退出，撤销计数并在当前线程直接处理
+    if (stopping_.load()) {
+        shard.pending.fetch_sub(1);
+        invoke(account, std::move(update));
+        return;
+    }
+    
+    auto* node = new Node();
+    node->account = account;
+    node->update = std::move(update);
+    shard.push(node);
+    
+    // 处理线程先置 sleeping 再检查 pending，这里先增加 pending 再检查 sleeping，不会漏掉唤醒
+    if (shard.sleeping.load()) {
+        {
+            std::lock_guard<std::mutex> lock(shard.wake_mutex);
+        }
+        shard.wake_cv.notify_one();
+    }
+}
+
+size_t UpdateDispatcher::queued_count() const {
+    size_t total = 0;
+    for (const auto& shard : shards_) {
+        total += shard->pending.load();
+    }
+    return total;
+}
+
+void UpdateDispatcher::worker_loop(Shard& shard) {
+    while (true) {
+        std::size_t account = 0;
+        Object update;
+        if (shard.pop(account, update)) {
+            invoke(account, std::move(update));
+            shard.pending.fetch_sub(1);
+            continue;
+        }
+        
+        // 先读停止标志再读 pending：生产者在停止前计数的更新此处一定可见
+        bool stopping = stopping_.load();
+        
+        // 生产者已计数但尚未链接完成，稍后再取
+        if (shard.pending.load() > 0) {
+            std::this_thread::yield();
+            continue;
+        }
+        
+        // 停止时已排队的更新全部处理完才退出
+        if (stopping) {
+            break;
+        }
+        
+        std::unique_lock<std::mutex> lock(shard.wake_mutex);
+        shard.sleeping = true;
+        shard.wake_cv.wait(lock, [this, &shard] {
+            return shard.pending.load() > 0 || stopping_;
+        });
+        shard.sleeping = false;
+    }
+}
+
+void UpdateDispatcher::invoke(std::size_t account, Object update) {
+    auto handler = find_handler(update->get_id());
+    if (!handler) {
+        return;
+    }
+    
+    // 处理器中发出的请求仍走收到该更新的账号
+    AccountScope scope(account);
+    try {
+        (*handler)(std::move(update));
+    } catch (const std::exception& e) {
+        spdlog::error("更新处理器异常: {}", e.what());
+    }
+}
+
+std::shared_ptr<const UpdateHandler> UpdateDispatcher::find_handler(std::int32_t type) const {
+    auto table = std::atomic_load(&handlers_);
+    auto it = table->find(type);
+    return it != table->end() ? it->second : nullptr;
+}
+
+std::uint64_t UpdateDispatcher::shard_key(std::size_t account, const td_api::Object& update) {
+    Int64 chat_id = 0;
+    switch (update.get_id()) {
+        case td_api::updateNewMessage::ID:
+            chat_id = message_chat_id<td_api::updateNewMessage>(update);
+            break;
+        case td_api::updateMessageSendSucceeded::ID:
+            chat_id = message_chat_id<td_api::updateMessageSendSucceeded>(update);
+            break;
+        case td_api::updateMessageSendFailed::ID:
+            chat_id = message_chat_id<td_api::updateMessageSendFailed>(update);
+            break;
+        default:
+            // 文件进度、文件生成和连接状态更新彼此有先后关系，同一账号的都归入同一分片
+            break;
+    }
+    
+    // 混合账号和聊天ID，使相邻的聊天ID分散到不同分片
+    std::uint64_t key = static_cast<std::uint64_t>(chat_id) * 0x9E3779B97F4A7C15ULL + account;
+    key ^= key >> 31;
+    return key;
+}
+
+} // namespace tg_forwarder
@@ -8,190 +8,175 @@
 #include <vector>
 #include <regex>
 #include <algorithm>
+#include <cctype>
+#include <type_traits>
 #include <fstream>
 #include "../include/utils.h"
+#include "../include/buffer_pool.h"
+#include "../include/media_traits.h"
 
 namespace tg_forwarder {
 
 bool is_media_message(const Message& message) {
-    if (!message) {
-        return false;
-    }
-    
-    const auto content = message->content_.get();
-    return content->get_id() == td_api::messagePhoto::ID ||
-           content->get_id() == td_api::messageVideo::ID ||
-           content->get_id() == td_api::messageDocument::ID ||
-           content->get_id() == td_api::messageAudio::ID ||
-           content->get_id() == td_api::messageAnimation::ID ||
-           content->get_id() == td_api::messageSticker::ID ||
-           content->get_id() == td_api::messageVoiceNote::ID ||
-           content->get_id() == td_api::messageVideoNote::ID;
+    auto traits = find_content_traits(message);
+    return traits && traits->media_type != MediaType::Unknown;
 }
 
 std::vector<Int32> get_file_ids(const Message& message) {
     std::vector<Int32> file_ids;
     
-    if (!message) {
-        return file_ids;
-    }
-    
-    const auto content = message->content_.get();
-    
-    switch (content->get_id()) {
-        case td_api::messagePhoto::ID: {
-            auto photo = static_cast<const td_api::messagePhoto*>(content);
-            for (const auto& size : photo->photo_->sizes_) {
-                file_ids.push_back(size->photo_->id_);
-            }
-            break;
-        }
-        case td_api::messageVideo::ID: {
-            auto video = static_cast<const td_api::messageVideo*>(content);
-            file_ids.push_back(video->video_->video_->id_);
-            if (video->video_->thumbnail_) {
-                file_ids.push_back(video->video_->thumbnail_->file_->id_);
-            }
-            break;
-        }
-        case td_api::messageDocument::ID: {
-            auto document = static_cast<const td_api::messageDocument*>(content);
-            file_ids.push_back(document->document_->document_->id_);
-            if (document->document_->thumbnail_) {
-                file_ids.push_back(document->document_->thumbnail_->file_->id_);
-            }
-            break;
-        }
-        case td_api::messageAudio::ID: {
-            auto audio = static_cast<const td_api::messageAudio*>(content);
-            file_ids.push_back(audio->audio_->audio_->id_);
-            if (audio->audio_->album_cover_thumbnail_) {
-                file_ids.push_back(audio->audio_->album_cover_thumbnail_->file_->id_);
-            }
-            break;
-        }
-        case td_api::messageAnimation::ID: {
-            auto animation = static_cast<const td_api::messageAnimation*>(content);
-            file_ids.push_back(animation->animation_->animation_->id_);
-            if (animation->animation_->thumbnail_) {
-                file_ids.push_back(animation->animation_->thumbnail_->file_->id_);
-            }
-            break;
-        }
-        case td_api::messageSticker::ID: {
-            auto sticker = static_cast<const td_api::messageSticker*>(content);
-            file_ids.push_back(sticker->sticker_->sticker_->id_);
-            if (sticker->sticker_->thumbnail_) {
-                file_ids.push_back(sticker->sticker_->thumbnail_->file_->id_);
-            }
-            break;
-        }
-        case td_api::messageVoiceNote::ID: {
-            auto voice = static_cast<const td_api::messageVoiceNote*>(content);
-            file_ids.push_back(voice->voice_note_->voice_->id_);
-            break;
-        }
-        case td_api::messageVideoNote::ID: {
-            auto video_note = static_cast<const td_api::messageVideoNote*>(content);
-            file_ids.push_back(video_note->video_note_->video_->id_);
-            if (video_note->video_note_->thumbnail_) {
-                file_ids.push_back(video_note->video_note_->thumbnail_->file_->id_);
-            }
-            break;
-        }
+    if (auto traits = find_content_traits(message)) {
+        traits->file_ids(*message->content_, file_ids);
     }
     
     return file_ids;
 }
 
+const td_api::file* get_main_file(const Message& message) {
+    auto traits = find_content_traits(message);
+    return traits ? traits->main_file(*message->content_) : nullptr;
+}
+
 std::optional<std::string> get_media_group_id(const Message& message) {
-    if (!message) {
+    auto traits = find_content_traits(message);
+    if (!traits) {
         return std::nullopt;
     }
     
-    // 检查消息类型
-    int32_t content_type = message->content_->get_id();
+    auto media_album_id = traits->media_album_id(*message->content_);
+    if (!media_album_id || media_album_id->empty()) {
+        return std::nullopt;
+    }
     
-    // 检查具有媒体组的消息类型
-    if (content_type == td_api::messagePhoto::ID) {
-        auto photo = static_cast<const td_api::messagePhoto*>(message->content_.get());
-        if (!photo->media_album_id_.empty()) {
-            return photo->media_album_id_;
-        }
-    } else if (content_type == td_api::messageVideo::ID) {
-        auto video = static_cast<const td_api::messageVideo*>(message->content_.get());
-        if (!video->media_album_id_.empty()) {
-            return video->media_album_id_;
+    return *media_album_id;
+}
+
+const td_api::formattedText* get_formatted_text(const Message& message) {
+    auto traits = find_content_traits(message);
+    return traits ? traits->caption(*message->content_) : nullptr;
+}
+
+namespace {
+
+// 复制实体类型；TDLib 对象不可复制，按具体类型逐个字段重建
+td_api::object_ptr<td_api::TextEntityType> clone_entity_type(const td_api::TextEntityType& type) {
+    td_api::object_ptr<td_api::TextEntityType> result;
+    
+    // downcast_call 只接受非常量引用，这里只读取字段
+    td_api::downcast_call(const_cast<td_api::TextEntityType&>(type), [&result](auto& source) {
+        using T = std::decay_t<decltype(source)>;
+        if constexpr (std::is_same_v<T, td_api::textEntityTypePreCode>) {
+            result = td_api::make_object<T>(source.language_);
+        } else if constexpr (std::is_same_v<T, td_api::textEntityTypeTextUrl>) {
+            result = td_api::make_object<T>(source.url_);
+        } else if constexpr (std::is_same_v<T, td_api::textEntityTypeMentionName>) {
+            result = td_api::make_object<T>(source.user_id_);
+        } else if constexpr (std::is_same_v<T, td_api::textEntityTypeCustomEmoji>) {
+            result = td_api::make_object<T>(source.custom_emoji_id_);
+        } else if constexpr (std::is_same_v<T, td_api::textEntityTypeMediaTimestamp>) {
+            result = td_api::make_object<T>(source.media_timestamp_);
+        } else {
+            // 其余类型（粗体、斜体、代码、引用等）没有字段
+            result = td_api::make_object<T>();
         }
-    } else if (content_type == td_api::messageDocument::ID) {
-        auto document = static_cast<const td_api::messageDocument*>(message->content_.get());
-        if (!document->media_album_id_.empty()) {
-            return document->media_album_id_;
+    });
+    
+    return result;
+}
+
+} // namespace
+
+td_api::object_ptr<td_api::formattedText> clone_formatted_text(const td_api::formattedText* text) {
+    if (!text || text->text_.empty()) {
+        return nullptr;
+    }
+    
+    std::vector<td_api::object_ptr<td_api::textEntity>> entities;
+    entities.reserve(text->entities_.size());
+    for (const auto& entity : text->entities_) {
+        if (!entity || !entity->type_) {
+            continue;
         }
-    } else if (content_type == td_api::messageAudio::ID) {
-        auto audio = static_cast<const td_api::messageAudio*>(message->content_.get());
-        if (!audio->media_album_id_.empty()) {
-            return audio->media_album_id_;
+        
+        auto type = clone_entity_type(*entity->type_);
+        if (type) {
+            entities.push_back(td_api::make_object<td_api::textEntity>(entity->offset_, entity->length_, std::move(type)));
         }
     }
     
-    return std::nullopt;
+    return td_api::make_object<td_api::formattedText>(text->text_, std::move(entities));
 }
 
-std::string get_caption(const Message& message) {
-    if (!message) {
-        return "";
+td_api::object_ptr<td_api::formattedText> take_formatted_text(const Message& message) {
+    if (!message || !message->content_ || message->content_->get_id() != td_api::messageText::ID) {
+        return nullptr;
     }
     
-    const auto content = message->content_.get();
-    
-    switch (content->get_id()) {
-        case td_api::messageText::ID: {
-            auto text = static_cast<const td_api::messageText*>(content);
-            return text->text_->text_;
-        }
-        case td_api::messagePhoto::ID: {
-            auto photo = static_cast<const td_api::messagePhoto*>(content);
-            return photo->caption_->text_;
-        }
-        case td_api::messageVideo::ID: {
-            auto video = static_cast<const td_api::messageVideo*>(content);
-            return video->caption_->text_;
-        }
-        case td_api::messageDocument::ID: {
-            auto document = static_cast<const td_api::messageDocument*>(content);
-            return document->caption_->text_;
-        }
-        case td_api::messageAudio::ID: {
-            auto audio = static_cast<const td_api::messageAudio*>(content);
-            return audio->caption_->text_;
+    auto text = std::move(static_cast<td_api::messageText&>(*message->content_).text_);
+    if (!text || text->text_.empty()) {
+        return nullptr;
+    }
+    return text;
+}
+
+std::string get_caption(const Message& message) {
+    auto caption = get_formatted_text(message);
+    return caption ? caption->text_ : "";
+}
+
+std::string get_text(const Message& message) {
+    // 文本消息的正文和媒体消息的说明文字都由 get_caption 取出
+    return get_caption(message);
+}
+
+int parse_retry_after(int code, const std::string& message) {
+    // 读取标记之后的十进制秒数
+    auto read_seconds = [&message](const std::string& marker) {
+        auto pos = message.find(marker);
+        if (pos == std::string::npos) {
+            return -1;
         }
-        case td_api::messageAnimation::ID: {
-            auto animation = static_cast<const td_api::messageAnimation*>(content);
-            return animation->caption_->text_;
+        
+        int seconds = 0;
+        bool found = false;
+        for (pos += marker.size(); pos < message.size() && std::isdigit(static_cast<unsigned char>(message[pos])); ++pos) {
+            seconds = std::min(seconds * 10 + (message[pos] - '0'), 24 * 3600);
+            found = true;
         }
-        case td_api::messageVoiceNote::ID: {
-            auto voice = static_cast<const td_api::messageVoiceNote*>(content);
-            return voice->caption_->text_;
+        
+        return found ? seconds : -1;
+    };
+    
+    for (const char* marker : {"FLOOD_WAIT_", "SLOWMODE_WAIT_", "retry after "}) {
+        int seconds = read_seconds(marker);
+        if (seconds >= 0) {
+            return std::max(seconds, 1);
         }
-        default:
-            return "";
     }
+    
+    // 429 但没有给出等待时间时至少等待1秒
+    return code == 429 ? 1 : 0;
 }
 
-std::string get_text(const Message& message) {
-    if (!message) {
-        return "";
+bool is_retryable_error(int code, const std::string& message) {
+    // 限流
+    if (parse_retry_after(code, message) > 0) {
+        return true;
     }
     
-    const auto content = message->content_.get();
+    // 服务器内部错误
+    if (code >= 500) {
+        return true;
+    }
     
-    if (content->get_id() == td_api::messageText::ID) {
-        auto text = static_cast<const td_api::messageText*>(content);
-        return text->text_->text_;
+    // 连接中断、超时等临时性错误
+    for (const char* marker : {"Timeout", "TIMEOUT", "NETWORK", "Connection", "Request aborted"}) {
+        if (message.find(marker) != std::string::npos) {
+            return true;
+        }
     }
     
-    return get_caption(message);
+    return false;
 }
 
 void delay(int seconds) {
@@ -202,20 +187,87 @@ std::string generate_message_id(Int64 chat_id, Int64 message_id) {
     return std::to_string(chat_id) + "_" + std::to_string(message_id);
 }
 
-void MemoryBuffer::append(const std::string& data) {
-    binary_data_ += data;
+MemoryBuffer::~MemoryBuffer() {
+    BufferPool::instance().recycle(std::move(data_));
+}
+
+MemoryBuffer::MemoryBuffer(MemoryBuffer&& other) noexcept
+    : data_(std::move(other.data_)), name_(std::move(other.name_)) {
+    other.data_.clear();
+}
+
+MemoryBuffer& MemoryBuffer::operator=(MemoryBuffer&& other) noexcept {
+    if (this != &other) {
+        BufferPool::instance().recycle(std::move(data_));
+        data_ = std::move(other.data_);
+        name_ = std::move(other.name_);
+        other.data_.clear();
+    }
+    return *this;
+}
+
+void MemoryBuffer::append(std::string_view data) {
+    reserve(data_.size() + data.size());
+    data_.append(data.data(), data.size());
+}
+
+void MemoryBuffer::append(std::string&& data) {
+    if (data_.empty()) {
+        BufferPool::instance().recycle(std::move(data_));
+        data_ = std::move(data);
+        return;
+    }
+    
+    append(std::string_view(data));
+}
+
+void MemoryBuffer::reserve(size_t capacity) {
+    if (capacity <= data_.capacity()) {
+        return;
+    }
+    
+    // 换用池中足够大的缓冲区，旧缓冲区归还
+    auto block = BufferPool::instance().acquire(std::max(capacity, data_.capacity() * 2));
+    block.append(data_);
+    BufferPool::instance().recycle(std::move(data_));
+    data_ = std::move(block);
+}
+
+void MemoryBuffer::load_from_file(const std::string& path) {
+    std::ifstream file_stream(path, std::ios::binary | std::ios::ate);
+    if (!file_stream.is_open()) {
+        throw MediaError("无法打开文件: " + path);
+    }
+    
+    auto file_size = static_cast<size_t>(file_stream.tellg());
+    file_stream.seekg(0, std::ios::beg);
+    
+    data_.clear();
+    reserve(file_size);
+    data_.resize(file_size);
+    if (file_size > 0 && !file_stream.read(&data_[0], static_cast<std::streamsize>(file_size))) {
+        data_.clear();
+        throw MediaError("读取文件失败: " + path);
+    }
 }
 
 const std::string& MemoryBuffer::data() const {
-    return binary_data_;
+    return data_;
+}
+
+std::string MemoryBuffer::release() {
+    std::string data = std::move(data_);
+    data_ = std::string();
+    return data;
 }
 
 void MemoryBuffer::clear() {
-    binary_data_.clear();
+    BufferPool::instance().recycle(std::move(data_));
+    data_ = std::string();
 }
 
 size_t MemoryBuffer::size() const {
-    return binary_data_.size();
+    return data_.size();
 }
 
 void MemoryBuffer::set_name(const std::string& name) {
@@ -227,144 +279,27 @@ const std::string& MemoryBuffer::name() const {
 }
 
 MediaType get_media_type(const Message& message) {
-    if (!message) {
-        return MediaType::Unknown;
-    }
-    
-    const auto content = message->content_.get();
-    
-    switch (content->get_id()) {
-        case td_api::messagePhoto::ID:
-            return MediaType::Photo;
-        case td_api::messageVideo::ID:
-            return MediaType::Video;
-        case td_api::messageDocument::ID:
-            return MediaType::Document;
-        case td_api::messageAudio::ID:
-            return MediaType::Audio;
-        case td_api::messageAnimation::ID:
-            return MediaType::Animation;
-        case td_api::messageSticker::ID:
-            return MediaType::Sticker;
-        case td_api::messageVoiceNote::ID:
-            return MediaType::VoiceNote;
-        case td_api::messageVideoNote::ID:
-            return MediaType::VideoNote;
-        default:
-            return MediaType::Unknown;
-    }
+    auto traits = find_content_traits(message);
+    return traits ? traits->media_type : MediaType::Unknown;
 }
 
 std::string media_type_to_string(MediaType type) {
-    switch (type) {
-        case MediaType::Photo:
-            return "photo";
-        case MediaType::Video:
-            return "video";
-        case MediaType::Document:
-            return "document";
-        case MediaType::Audio:
-            return "audio";
-        case MediaType::Animation:
-            return "animation";
-        case MediaType::Sticker:
-            return "sticker";
-        case MediaType::VoiceNote:
-            return "voice_note";
-        case MediaType::VideoNote:
-            return "video_note";
-        default:
-            return "unknown";
-    }
+    auto traits = find_content_traits(type);
+    return traits ? traits->name : "unknown";
 }
 
 std::string get_file_extension(MediaType type, const Message& message) {
-    switch (type) {
-        case MediaType::Photo:
-            return ".jpg";
-        case MediaType::Video: {
-            if (message && message->content_->get_id() == td_api::messageVideo::ID) {
-                auto video = static_cast<const td_api::messageVideo*>(message->content_.get());
-                auto mime_type = video->video_.mime_type_;
-                
-                if (mime_type == "video/mp4") {
-                    return ".mp4";
-                } else if (mime_type == "video/webm") {
-                    return ".webm";
-                } else if (mime_type == "video/x-matroska") {
-                    return ".mkv";
-                }
-            }
-            
-            return ".mp4"; // 默认扩展名
-        }
-        case MediaType::Document: {
-            if (message && message->content_->get_id() == td_api::messageDocument::ID) {
-                auto document = static_cast<const td_api::messageDocument*>(message->content_.get());
-                auto file_name = document->document_.file_name_;
-                
-                // 尝试从文件名中提取扩展名
-                size_t pos = file_name.find_last_of('.');
-                if (pos != std::string::npos) {
-                    return file_name.substr(pos);
-                }
-                
-                // 根据MIME类型猜测扩展名
-                auto mime_type = document->document_.mime_type_;
-                
-                if (mime_type == "application/pdf") {
-                    return ".pdf";
-                } else if (mime_type == "application/zip") {
-                    return ".zip";
-                } else if (mime_type == "application/x-rar-compressed") {
-                    return ".rar";
-                } else if (mime_type == "text/plain") {
-                    return ".txt";
-                } else if (mime_type == "application/msword") {
-                    return ".doc";
-                } else if (mime_type == "application/vnd.openxmlformats-officedocument.wordprocessingml.document") {
-                    return ".docx";
-                }
-            }
-            
-            return ".bin"; // 默认扩展名
-        }
-        case MediaType::Audio: {
-            if (message && message->content_->get_id() == td_api::messageAudio::ID) {
-                auto audio = static_cast<const td_api::messageAudio*>(message->content_.get());
-                auto mime_type = audio->audio_.mime_type_;
-                
-                if (mime_type == "audio/mpeg") {
-                    return ".mp3";
-                } else if (mime_type == "audio/ogg") {
-                    return ".ogg";
-                } else if (mime_type == "audio/x-wav") {
-                    return ".wav";
-                } else if (mime_type == "audio/x-flac") {
-                    return ".flac";
-                }
-            }
-            
-            return ".mp3"; // 默认扩展名
-        }
-        case MediaType::Animation:
-            return ".mp4"; // 动画通常以MP4格式存储
-        case MediaType::Sticker: {
-            if (message && message->content_->get_id() == td_api::messageSticker::ID) {
-                auto sticker = static_cast<const td_api::messageSticker*>(message->content_.get());
-                
-                if (sticker->sticker_.is_animated_) {
-                    return ".tgs"; // 动画贴纸
-                } else {
-                    return ".webp"; // 静态贴纸
-                }
-            }
-            
-            return ".webp"; // 默认扩展名
-        }
-        default:
-            return ".bin"; // 默认二进制扩展名
+    auto traits = find_content_traits(type);
+    if (!traits) {
+        return ".bin"; // 默认二进制扩展名
     }
+    
+    // 消息与媒体类型一致时根据文件名、MIME类型等细化
+    if (message && message->content_ && message->content_->get_id() == traits->constructor_id) {
+        return traits->extension(*message->content_);
+    }
+    
+    return traits->default_extension;
 }
 
 } // namespace tg_forwarder 
\ No newline at end of file